@@ -165,6 +165,14 @@ extern "C" {
 	/** Get the peak memory usage in bytes, including mmap allocations. */
 	uintptr_t MEM_get_peak_memory(void) WARN_UNUSED;
 
+	/** Record allocation counts, bytes and peak usage per block name to a
+	 * binary trace, and the lifetime of one in sample_rate blocks.
+	 * @retval 0 when the file can't be written. */
+	int MEM_profile_begin(const char *filepath, int sample_rate);
+
+	/** Write the remaining statistics and close the trace. */
+	void MEM_profile_end(void);
+
 #ifndef NDEBUG
 const char *MEM_name_ptr(void *vmemh);
 #endif
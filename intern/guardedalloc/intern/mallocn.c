@@ -54,8 +54,10 @@
 /* mmap exception */
 #if defined(WIN32)
 #include "mmap_win.h"
+#include <windows.h>	/* GetTickCount */
 #else
 #include <sys/mman.h>
+#include <sys/time.h>
 #endif
 
 #include "MEM_guardedalloc.h"
@@ -99,7 +101,8 @@ typedef struct MemHead {
 	const char * name;
 	const char * nextname;
 	int tag2;
-	int mmap;	/* if true, memory was mmapped */
+	short mmap;	/* if true, memory was mmapped */
+	short shard;	/* index in shards, the list the block is in */
 #ifdef DEBUG_MEMCOUNTER
 	int _count;
 #endif
@@ -109,6 +112,40 @@ typedef struct MemTail {
 	int tag3, pad;
 } MemTail;
 
+/* In release builds with gcc, every thread allocates from its own shard: a
+ * block list with statistics and a cache of freed small blocks, protected by
+ * a spinlock that only sees contention when blocks are freed by another
+ * thread than the one that allocated them. Statistics of all shards are
+ * merged when asked for. Otherwise there is one shard, protected by the
+ * thread lock callback. */
+#if defined(NDEBUG) && defined(__GNUC__) && !defined(DEBUG_MEMCOUNTER)
+#define MEM_THREAD_CACHE
+#endif
+
+#ifdef MEM_THREAD_CACHE
+#define MEM_TOT_SHARD			64
+#else
+#define MEM_TOT_SHARD			1
+#endif
+
+/* freed blocks up to MEM_CACHE_MAX_LEN are kept per size class of 16 bytes */
+#define MEM_CACHE_MAX_LEN		1024
+#define MEM_CACHE_CLASS(len)	(((len) + 15) >> 4)
+#define MEM_TOT_CACHE_CLASS		(MEM_CACHE_CLASS(MEM_CACHE_MAX_LEN) + 1)
+#define MEM_CACHE_MAX_BLOCKS	64
+
+typedef struct MemShard {
+	volatile int lock;
+	volatile localListBase membase;
+	int totblock;
+	uintptr_t mem_in_use, mmap_in_use, peak_mem;
+#ifdef MEM_THREAD_CACHE
+	MemHead *freeblocks[MEM_TOT_CACHE_CLASS];
+	int totfree[MEM_TOT_CACHE_CLASS];
+#endif
+	char pad[64];	/* keep the locks of shards on different cache lines */
+} MemShard;
+
 
 /* --------------------------------------------------------------------- */
 /* local functions                                                       */
@@ -116,9 +153,10 @@ typedef struct MemTail {
 
 static void addtail(volatile localListBase *listbase, void *vlink);
 static void remlink(volatile localListBase *listbase, void *vlink);
-static void rem_memblock(MemHead *memh);
+static void rem_memblock(MemShard *shard, MemHead *memh);
 static void MemorY_ErroR(const char *block, const char *error);
-static const char *check_memlist(MemHead *memh);
+static const char *check_memlist(MemShard *shard, MemHead *memh);
+static const char *check_memlist_all(MemHead *memh);
 
 /* --------------------------------------------------------------------- */
 /* locally used defines                                                  */
@@ -142,11 +180,14 @@ static const char *check_memlist(MemHead *memh);
 /* --------------------------------------------------------------------- */
 	
 
-static volatile int totblock= 0;
-static volatile uintptr_t mem_in_use= 0, mmap_in_use= 0, peak_mem = 0;
+static MemShard shards[MEM_TOT_SHARD];
+static uintptr_t peak_mem = 0;	/* sampled when statistics are merged, lock shard 0 */
+
+#ifdef MEM_THREAD_CACHE
+static __thread int mem_thread_shard = -1;
+static volatile unsigned int mem_next_shard = 0;
+#endif
 
-static volatile struct localListBase _membase;
-static volatile struct localListBase *membase = &_membase;
 static void (*error_callback)(const char *) = NULL;
 static void (*thread_lock_callback)(void) = NULL;
 static void (*thread_unlock_callback)(void) = NULL;
@@ -183,6 +224,7 @@ static void print_error(const char *str, ...)
 	if (error_callback) error_callback(buf);
 }
 
+#ifndef MEM_THREAD_CACHE
 static void mem_lock_thread(void)
 {
 	if (thread_lock_callback)
@@ -194,16 +236,546 @@ static void mem_unlock_thread(void)
 	if (thread_unlock_callback)
 		thread_unlock_callback();
 }
+#endif
+
+#ifdef MEM_THREAD_CACHE
+static void mem_spin_lock(volatile int *lock)
+{
+	while(__sync_lock_test_and_set(lock, 1)) {
+		while(*lock)
+			;
+	}
+}
+#endif
+
+static void mem_lock_shard(MemShard *shard)
+{
+#ifdef MEM_THREAD_CACHE
+	mem_spin_lock(&shard->lock);
+#else
+	(void)shard;
+	mem_lock_thread();
+#endif
+}
+
+static void mem_unlock_shard(MemShard *shard)
+{
+#ifdef MEM_THREAD_CACHE
+	__sync_lock_release(&shard->lock);
+#else
+	(void)shard;
+	mem_unlock_thread();
+#endif
+}
+
+/* always in the same order, single shard operations only take one lock */
+static void mem_lock_all(void)
+{
+	int a;
+
+	for(a=0; a<MEM_TOT_SHARD; a++)
+		mem_lock_shard(&shards[a]);
+}
+
+static void mem_unlock_all(void)
+{
+	int a;
+
+	for(a=MEM_TOT_SHARD-1; a>=0; a--)
+		mem_unlock_shard(&shards[a]);
+}
+
+/* shard of the calling thread, threads are spread round robin */
+static MemShard *mem_shard_get(void)
+{
+#ifdef MEM_THREAD_CACHE
+	if(mem_thread_shard == -1)
+		mem_thread_shard= __sync_fetch_and_add(&mem_next_shard, 1) % MEM_TOT_SHARD;
+
+	return &shards[mem_thread_shard];
+#else
+	return &shards[0];
+#endif
+}
+
+/* merged statistics of all shards */
+static void mem_get_stats(int *r_totblock, uintptr_t *r_mem_in_use, uintptr_t *r_mmap_in_use, uintptr_t *r_peak_mem)
+{
+	uintptr_t _mem_in_use= 0, _mmap_in_use= 0, _peak_mem= 0;
+	int a, _totblock= 0;
+
+	for(a=0; a<MEM_TOT_SHARD; a++) {
+		MemShard *shard= &shards[a];
+
+		mem_lock_shard(shard);
+		_totblock += shard->totblock;
+		_mem_in_use += shard->mem_in_use;
+		_mmap_in_use += shard->mmap_in_use;
+		if(shard->peak_mem > _peak_mem)
+			_peak_mem= shard->peak_mem;
+		mem_unlock_shard(shard);
+	}
+
+	mem_lock_shard(&shards[0]);
+	if(_mem_in_use > peak_mem) peak_mem= _mem_in_use;
+	if(_peak_mem > peak_mem) peak_mem= _peak_mem;
+	_peak_mem= peak_mem;
+	mem_unlock_shard(&shards[0]);
+
+	if(r_totblock) *r_totblock= _totblock;
+	if(r_mem_in_use) *r_mem_in_use= _mem_in_use;
+	if(r_mmap_in_use) *r_mmap_in_use= _mmap_in_use;
+	if(r_peak_mem) *r_peak_mem= _peak_mem;
+}
+
+/* size including head and tail, small blocks are rounded up to their size class */
+static size_t mem_block_size(size_t len)
+{
+#ifdef MEM_THREAD_CACHE
+	if(len <= MEM_CACHE_MAX_LEN)
+		len= MEM_CACHE_CLASS(len) << 4;
+#endif
+	return len + sizeof(MemHead) + sizeof(MemTail);
+}
+
+/* freed block of the size class of len, shard must be locked */
+static MemHead *mem_cache_pop(MemShard *shard, size_t len)
+{
+#ifdef MEM_THREAD_CACHE
+	if(len <= MEM_CACHE_MAX_LEN) {
+		int cls= MEM_CACHE_CLASS(len);
+		MemHead *memh= shard->freeblocks[cls];
+
+		if(memh) {
+			shard->freeblocks[cls]= memh->next;
+			shard->totfree[cls]--;
+		}
+
+		return memh;
+	}
+#else
+	(void)shard;
+	(void)len;
+#endif
+	return NULL;
+}
+
+/* keep a freed block for reuse, returns 0 when it has to be freed,
+ * shard must be locked */
+static int mem_cache_push(MemShard *shard, MemHead *memh)
+{
+#ifdef MEM_THREAD_CACHE
+	if(!memh->mmap && memh->len <= MEM_CACHE_MAX_LEN) {
+		int cls= MEM_CACHE_CLASS(memh->len);
+
+		if(shard->totfree[cls] < MEM_CACHE_MAX_BLOCKS) {
+			memh->next= shard->freeblocks[cls];
+			shard->freeblocks[cls]= memh;
+			shard->totfree[cls]++;
+			return 1;
+		}
+	}
+#else
+	(void)shard;
+	(void)memh;
+#endif
+	return 0;
+}
+
+static void mem_free_block(MemHead *memh)
+{
+	if(memh->mmap) {
+		if (munmap(memh, memh->len + sizeof(MemHead) + sizeof(MemTail)))
+			printf("Couldn't unmap memory %s\n", memh->name);
+	}
+	else {
+		free(memh);
+	}
+}
+
+/* --------------------------------------------------------------------- */
+/* allocation profiler                                                   */
+/* --------------------------------------------------------------------- */
+
+/* While profiling, allocations and frees are counted per tag, the name of
+ * the block, and every MEM_PROF_INTERVAL the tags that changed are written
+ * to the trace. One in sample_rate blocks is remembered to measure its
+ * lifetime. Records are in native byte order:
+ *
+ * header   "MEMPROF1", int32 1, int32 sample_rate, int32 MEM_PROF_TOT_BUCKET
+ * 'T'      int32 id, int32 len, char name[len]
+ * 'S'      uint64 time in us, int32 tot,
+ *          tot times int32 id, uint64 totalloc, totfree, bytes, live, peak
+ * 'L'      int32 id, uint64 lifetime[MEM_PROF_TOT_BUCKET],
+ *          bucket b counts blocks that lived less than 2^b us
+ *
+ * source/tools/memprof.py converts traces to flame graph input. */
+
+#define MEM_PROF_TOT_TAG		4096	/* power of two */
+#define MEM_PROF_TOT_SAMPLE		65536	/* power of two */
+#define MEM_PROF_TOT_BUCKET		32
+#define MEM_PROF_INTERVAL		100000
+#define MEM_PROF_HASH(ptr)		((((uintptr_t)(ptr)) >> 4) ^ (((uintptr_t)(ptr)) >> 16))
+
+typedef struct MemProfTag {
+	const char *name;
+	int id, dirty;
+	uint64_t totalloc, totfree, bytes, live, peak;
+	uint64_t lifetime[MEM_PROF_TOT_BUCKET];
+} MemProfTag;
+
+typedef struct MemProfSample {
+	MemHead *memh;	/* NULL for an empty slot */
+	MemProfTag *tag;
+	uint64_t time;
+} MemProfSample;
+
+static volatile int mem_prof_active = 0;
+static FILE *mem_prof_file = NULL;
+static MemProfTag *mem_prof_tags = NULL;
+static MemProfTag mem_prof_other;	/* id 0, blocks without name or when the table is full */
+static MemProfSample *mem_prof_samples = NULL;
+static int mem_prof_tottag = 0, mem_prof_totsample = 0;
+static int mem_prof_sample_rate = 1, mem_prof_sample_count = 0;
+static uint64_t mem_prof_start = 0, mem_prof_last = 0;
+#ifdef MEM_THREAD_CACHE
+static volatile int mem_prof_lock = 0;
+#endif
+
+/* profiler functions are called with a shard locked, in the single shard
+ * case that lock covers the profiler too */
+static void mem_lock_prof(void)
+{
+#ifdef MEM_THREAD_CACHE
+	mem_spin_lock(&mem_prof_lock);
+#endif
+}
+
+static void mem_unlock_prof(void)
+{
+#ifdef MEM_THREAD_CACHE
+	__sync_lock_release(&mem_prof_lock);
+#endif
+}
+
+static uint64_t mem_prof_time(void)
+{
+#ifdef WIN32
+	return (uint64_t)GetTickCount() * 1000;
+#else
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return (uint64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+#endif
+}
+
+static void mem_prof_write_int(int i)
+{
+	int32_t v= i;
+	fwrite(&v, sizeof(v), 1, mem_prof_file);
+}
+
+static void mem_prof_write_uint64(uint64_t v)
+{
+	fwrite(&v, sizeof(v), 1, mem_prof_file);
+}
+
+static void mem_prof_write_tag_name(MemProfTag *tag)
+{
+	int len= strlen(tag->name);
+
+	fputc('T', mem_prof_file);
+	mem_prof_write_int(tag->id);
+	mem_prof_write_int(len);
+	fwrite(tag->name, 1, len, mem_prof_file);
+}
+
+static MemProfTag *mem_prof_tag(const char *name)
+{
+	MemProfTag *tag;
+	uintptr_t a;
+
+	if(name == NULL)
+		return &mem_prof_other;
+
+	/* linear probing, kept at most half full */
+	for(a= MEM_PROF_HASH(name) & (MEM_PROF_TOT_TAG-1); ; a= (a+1) & (MEM_PROF_TOT_TAG-1)) {
+		tag= &mem_prof_tags[a];
+
+		if(tag->name == name)
+			return tag;
+		if(tag->name == NULL)
+			break;
+	}
+
+	if(mem_prof_tottag >= MEM_PROF_TOT_TAG/2)
+		return &mem_prof_other;
+
+	tag->name= name;
+	tag->id= ++mem_prof_tottag;
+	mem_prof_write_tag_name(tag);
+
+	return tag;
+}
+
+static void mem_prof_write_snapshot(uint64_t time, int all)
+{
+	MemProfTag *tag;
+	int a, tot= 0;
+
+	for(a=0; a<=MEM_PROF_TOT_TAG; a++) {
+		tag= (a == MEM_PROF_TOT_TAG)? &mem_prof_other: &mem_prof_tags[a];
+		if(tag->name && (tag->dirty || all))
+			tot++;
+	}
+
+	if(tot == 0)
+		return;
+
+	fputc('S', mem_prof_file);
+	mem_prof_write_uint64(time - mem_prof_start);
+	mem_prof_write_int(tot);
+
+	for(a=0; a<=MEM_PROF_TOT_TAG; a++) {
+		tag= (a == MEM_PROF_TOT_TAG)? &mem_prof_other: &mem_prof_tags[a];
+
+		if(tag->name && (tag->dirty || all)) {
+			mem_prof_write_int(tag->id);
+			mem_prof_write_uint64(tag->totalloc);
+			mem_prof_write_uint64(tag->totfree);
+			mem_prof_write_uint64(tag->bytes);
+			mem_prof_write_uint64(tag->live);
+			mem_prof_write_uint64(tag->peak);
+			tag->dirty= 0;
+		}
+	}
+
+	mem_prof_last= time;
+}
+
+static void mem_prof_sample_add(MemHead *memh, MemProfTag *tag, uint64_t time)
+{
+	uintptr_t a;
+
+	if(mem_prof_totsample >= MEM_PROF_TOT_SAMPLE/2)
+		return;
+
+	a= MEM_PROF_HASH(memh) & (MEM_PROF_TOT_SAMPLE-1);
+	while(mem_prof_samples[a].memh)
+		a= (a+1) & (MEM_PROF_TOT_SAMPLE-1);
+
+	mem_prof_samples[a].memh= memh;
+	mem_prof_samples[a].tag= tag;
+	mem_prof_samples[a].time= time;
+	mem_prof_totsample++;
+}
+
+/* adds the lifetime of a sampled block to its tag */
+static void mem_prof_sample_remove(MemHead *memh, uint64_t time)
+{
+	MemProfSample *sample;
+	uint64_t lifetime;
+	uintptr_t a, b, home;
+	int bucket;
+
+	for(a= MEM_PROF_HASH(memh) & (MEM_PROF_TOT_SAMPLE-1); mem_prof_samples[a].memh != memh; a= (a+1) & (MEM_PROF_TOT_SAMPLE-1))
+		if(mem_prof_samples[a].memh == NULL)
+			return;
+
+	sample= &mem_prof_samples[a];
+	lifetime= time - sample->time;
+	for(bucket=0; bucket < MEM_PROF_TOT_BUCKET-1 && ((uint64_t)1 << bucket) <= lifetime; bucket++)
+		;
+	sample->tag->lifetime[bucket]++;
+
+	/* fill the hole with entries further down their probe sequence */
+	sample->memh= NULL;
+	mem_prof_totsample--;
+
+	for(b= (a+1) & (MEM_PROF_TOT_SAMPLE-1); mem_prof_samples[b].memh; b= (b+1) & (MEM_PROF_TOT_SAMPLE-1)) {
+		home= MEM_PROF_HASH(mem_prof_samples[b].memh) & (MEM_PROF_TOT_SAMPLE-1);
+
+		if((a < b)? (home <= a || home > b): (home <= a && home > b)) {
+			mem_prof_samples[a]= mem_prof_samples[b];
+			mem_prof_samples[b].memh= NULL;
+			a= b;
+		}
+	}
+}
+
+/* shard must be locked */
+static void mem_prof_alloc(MemHead *memh)
+{
+	MemProfTag *tag;
+	uint64_t time;
+
+	mem_lock_prof();
+
+	if(mem_prof_active) {
+		time= mem_prof_time();
+		tag= mem_prof_tag(memh->name);
+
+		tag->totalloc++;
+		tag->bytes += memh->len;
+		tag->live += memh->len;
+		if(tag->live > tag->peak)
+			tag->peak= tag->live;
+		tag->dirty= 1;
+
+		if(++mem_prof_sample_count >= mem_prof_sample_rate) {
+			mem_prof_sample_count= 0;
+			mem_prof_sample_add(memh, tag, time);
+		}
+
+		if(time - mem_prof_last >= MEM_PROF_INTERVAL)
+			mem_prof_write_snapshot(time, 0);
+	}
+
+	mem_unlock_prof();
+}
+
+/* shard must be locked */
+static void mem_prof_free(MemHead *memh)
+{
+	MemProfTag *tag;
+	uint64_t time;
+
+	mem_lock_prof();
+
+	if(mem_prof_active) {
+		time= mem_prof_time();
+		tag= mem_prof_tag(memh->name);
+
+		tag->totfree++;
+		tag->live -= (tag->live < memh->len)? tag->live: memh->len;
+		tag->dirty= 1;
+
+		if(mem_prof_totsample)
+			mem_prof_sample_remove(memh, time);
+
+		if(time - mem_prof_last >= MEM_PROF_INTERVAL)
+			mem_prof_write_snapshot(time, 0);
+	}
+
+	mem_unlock_prof();
+}
+
+int MEM_profile_begin(const char *filepath, int sample_rate)
+{
+	MemHead *membl;
+	FILE *fp;
+	int a;
+
+	MEM_profile_end();
+
+	fp= fopen(filepath, "wb");
+	if(fp == NULL) {
+		print_error("Memory profile: can't open %s for writing\n", filepath);
+		return 0;
+	}
+
+	mem_lock_all();
+	mem_lock_prof();
+
+	mem_prof_file= fp;
+	mem_prof_tags= calloc(MEM_PROF_TOT_TAG, sizeof(MemProfTag));
+	mem_prof_samples= calloc(MEM_PROF_TOT_SAMPLE, sizeof(MemProfSample));
+	mem_prof_tottag= 0;
+	mem_prof_totsample= 0;
+	mem_prof_sample_rate= (sample_rate > 0)? sample_rate: 1;
+	mem_prof_sample_count= 0;
+	mem_prof_start= mem_prof_last= mem_prof_time();
+
+	memset(&mem_prof_other, 0, sizeof(mem_prof_other));
+	mem_prof_other.name= "(other)";
+
+	fwrite("MEMPROF1", 1, 8, mem_prof_file);
+	mem_prof_write_int(1);
+	mem_prof_write_int(mem_prof_sample_rate);
+	mem_prof_write_int(MEM_PROF_TOT_BUCKET);
+	mem_prof_write_tag_name(&mem_prof_other);
+
+	/* blocks that exist already count as live, so frees balance */
+	for(a=0; a<MEM_TOT_SHARD; a++) {
+		membl = shards[a].membase.first;
+		if (membl) membl = MEMNEXT(membl);
+
+		while(membl) {
+			MemProfTag *tag= mem_prof_tag(membl->name);
+
+			tag->live += membl->len;
+			tag->peak= tag->live;
+			tag->dirty= 1;
+
+			if(membl->next)
+				membl= MEMNEXT(membl->next);
+			else break;
+		}
+	}
+
+	mem_prof_write_snapshot(mem_prof_start, 0);
+	mem_prof_active= 1;
+
+	mem_unlock_prof();
+	mem_unlock_all();
+
+	return 1;
+}
+
+void MEM_profile_end(void)
+{
+	MemProfTag *tag;
+	int a, b;
+
+	if(!mem_prof_active)
+		return;
+
+	mem_lock_all();
+	mem_lock_prof();
+
+	mem_prof_write_snapshot(mem_prof_time(), 1);
+
+	for(a=0; a<=MEM_PROF_TOT_TAG; a++) {
+		tag= (a == MEM_PROF_TOT_TAG)? &mem_prof_other: &mem_prof_tags[a];
+
+		if(tag->name) {
+			fputc('L', mem_prof_file);
+			mem_prof_write_int(tag->id);
+			for(b=0; b<MEM_PROF_TOT_BUCKET; b++)
+				mem_prof_write_uint64(tag->lifetime[b]);
+		}
+	}
+
+	fclose(mem_prof_file);
+	free(mem_prof_tags);
+	free(mem_prof_samples);
+	mem_prof_file= NULL;
+	mem_prof_tags= NULL;
+	mem_prof_samples= NULL;
+	mem_prof_active= 0;
+
+	mem_unlock_prof();
+	mem_unlock_all();
+}
 
 int MEM_check_memory_integrity(void)
 {
 	const char* err_val = NULL;
 	MemHead* listend;
-	/* check_memlist starts from the front, and runs until it finds
-	 * the requested chunk. For this test, that's the last one. */
-	listend = membase->last;
-	
-	err_val = check_memlist(listend);
+	int a;
+
+	mem_lock_all();
+
+	for(a=0; a<MEM_TOT_SHARD && err_val == NULL; a++) {
+		/* check_memlist starts from the front, and runs until it finds
+		 * the requested chunk. For this test, that's the last one. */
+		listend = shards[a].membase.last;
+
+		err_val = check_memlist(&shards[a], listend);
+	}
+
+	mem_unlock_all();
 
 	if (err_val == NULL) return 0;
 	return 1;
@@ -280,7 +852,8 @@ void *MEM_reallocN(void *vmemh, size_t len)
 	return newp;
 }
 
-static void make_memhead_header(MemHead *memh, size_t len, const char *str)
+/* shard must be locked */
+static void make_memhead_header(MemShard *shard, MemHead *memh, size_t len, const char *str)
 {
 	MemTail *memt;
 	
@@ -289,33 +862,65 @@ static void make_memhead_header(MemHead *memh, size_t len, const char *str)
 	memh->nextname = NULL;
 	memh->len = len;
 	memh->mmap = 0;
+	memh->shard = (short)(shard - shards);
 	memh->tag2 = MEMTAG2;
 	
 	memt = (MemTail *)(((char *) memh) + sizeof(MemHead) + len);
 	memt->tag3 = MEMTAG3;
 	
-	addtail(membase,&memh->next);
+	addtail(&shard->membase,&memh->next);
 	if (memh->next) memh->nextname = MEMNEXT(memh->next)->name;
 	
-	totblock++;
-	mem_in_use += len;
+	shard->totblock++;
+	shard->mem_in_use += len;
 
-	peak_mem = mem_in_use > peak_mem ? mem_in_use : peak_mem;
+	shard->peak_mem = shard->mem_in_use > shard->peak_mem ? shard->mem_in_use : shard->peak_mem;
 }
 
-void *MEM_mallocN(size_t len, const char *str)
+/* reuses a cached block of this thread when possible */
+static MemHead *mem_alloc_block(size_t len, const char *str, int clear)
 {
+	MemShard *shard= mem_shard_get();
 	MemHead *memh;
 
-	mem_lock_thread();
+	mem_lock_shard(shard);
+	memh= mem_cache_pop(shard, len);
+	if(memh) {
+		make_memhead_header(shard, memh, len, str);
+		if(mem_prof_active) mem_prof_alloc(memh);
+	}
+	mem_unlock_shard(shard);
+
+	if(memh) {
+		if(clear && len)
+			memset(memh+1, 0, len);
+		return memh;
+	}
+
+	if(clear)
+		memh= (MemHead *)calloc(mem_block_size(len), 1);
+	else
+		memh= (MemHead *)malloc(mem_block_size(len));
+
+	if(memh) {
+		mem_lock_shard(shard);
+		make_memhead_header(shard, memh, len, str);
+		if(mem_prof_active) mem_prof_alloc(memh);
+		mem_unlock_shard(shard);
+	}
+
+	return memh;
+}
+
+void *MEM_mallocN(size_t len, const char *str)
+{
+	MemHead *memh;
 
 	len = (len + 3 ) & ~3; 	/* allocate in units of 4 */
 	
-	memh= (MemHead *)malloc(len+sizeof(MemHead)+sizeof(MemTail));
+	memh= mem_alloc_block(len, str, 0);
 
 	if(memh) {
-		make_memhead_header(memh, len, str);
-		mem_unlock_thread();
 		if(malloc_debug_memset && len)
 			memset(memh+1, 255, len);
 
@@ -326,8 +931,7 @@ void *MEM_mallocN(size_t len, const char *str)
 #endif
 		return (++memh);
 	}
-	mem_unlock_thread();
-	print_error("Malloc returns null: len=" SIZET_FORMAT " in %s, total %u\n", SIZET_ARG(len), str, mem_in_use);
+	print_error("Malloc returns null: len=" SIZET_FORMAT " in %s, total %u\n", SIZET_ARG(len), str, (unsigned int)MEM_get_memory_in_use());
 	return NULL;
 }
 
@@ -335,15 +939,11 @@ void *MEM_callocN(size_t len, const char *str)
 {
 	MemHead *memh;
 
-	mem_lock_thread();
-
 	len = (len + 3 ) & ~3; 	/* allocate in units of 4 */
 
-	memh= (MemHead *)calloc(len+sizeof(MemHead)+sizeof(MemTail),1);
+	memh= mem_alloc_block(len, str, 1);
 
 	if(memh) {
-		make_memhead_header(memh, len, str);
-		mem_unlock_thread();
 #ifdef DEBUG_MEMCOUNTER
 		if(_mallocn_count==DEBUG_MEMCOUNTER_ERROR_VAL)
 			memcount_raise("MEM_callocN");
@@ -351,18 +951,16 @@ void *MEM_callocN(size_t len, const char *str)
 #endif
 		return (++memh);
 	}
-	mem_unlock_thread();
-	print_error("Calloc returns null: len=" SIZET_FORMAT " in %s, total %u\n", SIZET_ARG(len), str, mem_in_use);
+	print_error("Calloc returns null: len=" SIZET_FORMAT " in %s, total %u\n", SIZET_ARG(len), str, (unsigned int)MEM_get_memory_in_use());
 	return NULL;
 }
 
 /* note; mmap returns zero'd memory */
 void *MEM_mapallocN(size_t len, const char *str)
 {
+	MemShard *shard= mem_shard_get();
 	MemHead *memh;
 
-	mem_lock_thread();
-	
 	len = (len + 3 ) & ~3; 	/* allocate in units of 4 */
 	
 #ifdef __sgi
@@ -382,11 +980,12 @@ void *MEM_mapallocN(size_t len, const char *str)
 #endif
 
 	if(memh!=(MemHead *)-1) {
-		make_memhead_header(memh, len, str);
+		mem_lock_shard(shard);
+		make_memhead_header(shard, memh, len, str);
 		memh->mmap= 1;
-		mmap_in_use += len;
-		peak_mem = mmap_in_use > peak_mem ? mmap_in_use : peak_mem;
-		mem_unlock_thread();
+		shard->mmap_in_use += len;
+		if(mem_prof_active) mem_prof_alloc(memh);
+		mem_unlock_shard(shard);
 #ifdef DEBUG_MEMCOUNTER
 		if(_mallocn_count==DEBUG_MEMCOUNTER_ERROR_VAL)
 			memcount_raise("MEM_mapallocN");
@@ -395,8 +994,7 @@ void *MEM_mapallocN(size_t len, const char *str)
 		return (++memh);
 	}
 	else {
-		mem_unlock_thread();
-		print_error("Mapalloc returns null, fallback to regular malloc: len=" SIZET_FORMAT " in %s, total %u\n", SIZET_ARG(len), str, mmap_in_use);
+		print_error("Mapalloc returns null, fallback to regular malloc: len=" SIZET_FORMAT " in %s, total %u\n", SIZET_ARG(len), str, (unsigned int)MEM_get_mapped_memory_in_use());
 		return MEM_callocN(len, str);
 	}
 }
@@ -433,30 +1031,38 @@ void MEM_printmemlist_stats()
 {
 	MemHead *membl;
 	MemPrintBlock *pb, *printblock;
-	int totpb, a, b;
+	uintptr_t _mem_in_use= 0;
+	int totpb, a, b, _totblock= 0;
 
-	mem_lock_thread();
+	mem_lock_all();
+
+	for(a=0; a<MEM_TOT_SHARD; a++) {
+		_totblock += shards[a].totblock;
+		_mem_in_use += shards[a].mem_in_use;
+	}
 
 	/* put memory blocks into array */
-	printblock= malloc(sizeof(MemPrintBlock)*totblock);
+	printblock= malloc(sizeof(MemPrintBlock)*_totblock);
 
 	pb= printblock;
 	totpb= 0;
 
-	membl = membase->first;
-	if (membl) membl = MEMNEXT(membl);
+	for(a=0; a<MEM_TOT_SHARD; a++) {
+		membl = shards[a].membase.first;
+		if (membl) membl = MEMNEXT(membl);
 
-	while(membl) {
-		pb->name= membl->name;
-		pb->len= membl->len;
-		pb->items= 1;
+		while(membl) {
+			pb->name= membl->name;
+			pb->len= membl->len;
+			pb->items= 1;
 
-		totpb++;
-		pb++;
+			totpb++;
+			pb++;
 
-		if(membl->next)
-			membl= MEMNEXT(membl->next);
-		else break;
+			if(membl->next)
+				membl= MEMNEXT(membl->next);
+			else break;
+		}
 	}
 
 	/* sort by name and add together blocks with the same name */
@@ -478,14 +1084,14 @@ void MEM_printmemlist_stats()
 
 	/* sort by length and print */
 	qsort(printblock, totpb, sizeof(MemPrintBlock), compare_len);
-	printf("\ntotal memory len: %.3f MB\n", (double)mem_in_use/(double)(1024*1024));
+	printf("\ntotal memory len: %.3f MB\n", (double)_mem_in_use/(double)(1024*1024));
 	printf(" ITEMS TOTAL-MiB AVERAGE-KiB TYPE\n");
 	for(a=0, pb=printblock; a<totpb; a++, pb++)
 		printf("%6d (%8.3f  %8.3f) %s\n", pb->items, (double)pb->len/(double)(1024*1024), (double)pb->len/1024.0/(double)pb->items, pb->name);
 
 	free(printblock);
 	
-	mem_unlock_thread();
+	mem_unlock_all();
 
 #if 0 /* GLIBC only */
 	malloc_stats();
@@ -496,29 +1102,32 @@ void MEM_printmemlist_stats()
 static void MEM_printmemlist_internal( int pydict )
 {
 	MemHead *membl;
+	int a;
 
-	mem_lock_thread();
+	mem_lock_all();
 
-	membl = membase->first;
-	if (membl) membl = MEMNEXT(membl);
-	
 	if (pydict) {
 		print_error("# membase_debug.py\n");
 		print_error("membase = [\\\n");
 	}
-	while(membl) {
-		if (pydict) {
-			fprintf(stderr, "{'len':" SIZET_FORMAT ", 'name':'''%s''', 'pointer':'%p'},\\\n", SIZET_ARG(membl->len), membl->name, (void *)(membl+1));
-		} else {
+	for(a=0; a<MEM_TOT_SHARD; a++) {
+		membl = shards[a].membase.first;
+		if (membl) membl = MEMNEXT(membl);
+
+		while(membl) {
+			if (pydict) {
+				fprintf(stderr, "{'len':" SIZET_FORMAT ", 'name':'''%s''', 'pointer':'%p'},\\\n", SIZET_ARG(membl->len), membl->name, (void *)(membl+1));
+			} else {
 #ifdef DEBUG_MEMCOUNTER
-			print_error("%s len: " SIZET_FORMAT " %p, count: %d\n", membl->name, SIZET_ARG(membl->len), membl+1, membl->_count);
+				print_error("%s len: " SIZET_FORMAT " %p, count: %d\n", membl->name, SIZET_ARG(membl->len), membl+1, membl->_count);
 #else
-			print_error("%s len: " SIZET_FORMAT " %p\n", membl->name, SIZET_ARG(membl->len), membl+1);
+				print_error("%s len: " SIZET_FORMAT " %p\n", membl->name, SIZET_ARG(membl->len), membl+1);
 #endif
+			}
+			if(membl->next)
+				membl= MEMNEXT(membl->next);
+			else break;
 		}
-		if(membl->next)
-			membl= MEMNEXT(membl->next);
-		else break;
 	}
 	if (pydict) {
 		fprintf(stderr, "]\n\n");
@@ -540,47 +1149,53 @@ static void MEM_printmemlist_internal( int pydict )
 		);
 	}
 	
-	mem_unlock_thread();
+	mem_unlock_all();
 }
 
 void MEM_callbackmemlist(void (*func)(void*)) {
 	MemHead *membl;
+	int a;
 
-	mem_lock_thread();
+	mem_lock_all();
 
-	membl = membase->first;
-	if (membl) membl = MEMNEXT(membl);
+	for(a=0; a<MEM_TOT_SHARD; a++) {
+		membl = shards[a].membase.first;
+		if (membl) membl = MEMNEXT(membl);
 
-	while(membl) {
-		func(membl+1);
-		if(membl->next)
-			membl= MEMNEXT(membl->next);
-		else break;
+		while(membl) {
+			func(membl+1);
+			if(membl->next)
+				membl= MEMNEXT(membl->next);
+			else break;
+		}
 	}
 
-	mem_unlock_thread();
+	mem_unlock_all();
 }
 
 short MEM_testN(void *vmemh) {
 	MemHead *membl;
+	int a;
 
-	mem_lock_thread();
+	mem_lock_all();
 
-	membl = membase->first;
-	if (membl) membl = MEMNEXT(membl);
+	for(a=0; a<MEM_TOT_SHARD; a++) {
+		membl = shards[a].membase.first;
+		if (membl) membl = MEMNEXT(membl);
 
-	while(membl) {
-		if (vmemh == membl+1) {
-			mem_unlock_thread();
-			return 1;
-		}
+		while(membl) {
+			if (vmemh == membl+1) {
+				mem_unlock_all();
+				return 1;
+			}
 
-		if(membl->next)
-			membl= MEMNEXT(membl->next);
-		else break;
+			if(membl->next)
+				membl= MEMNEXT(membl->next);
+			else break;
+		}
 	}
 
-	mem_unlock_thread();
+	mem_unlock_all();
 
 	print_error("Memoryblock %p: pointer not in memlist\n", vmemh);
 	return 0;
@@ -625,41 +1240,51 @@ short MEM_freeN(void *vmemh)		/* anders compileertie niet meer */
 		return(-1);
 	}
 
-	mem_lock_thread();
-	if ((memh->tag1 == MEMTAG1) && (memh->tag2 == MEMTAG2) && ((memh->len & 0x3) == 0)) {
+	if ((memh->tag1 == MEMTAG1) && (memh->tag2 == MEMTAG2) && ((memh->len & 0x3) == 0) &&
+	    (memh->shard >= 0) && (memh->shard < MEM_TOT_SHARD)) {
 		memt = (MemTail *)(((char *) memh) + sizeof(MemHead) + memh->len);
 		if (memt->tag3 == MEMTAG3){
-			
+			/* blocks are freed in the shard of the thread that allocated them */
+			MemShard *shard= &shards[memh->shard];
+			int cached;
+
+			if(malloc_debug_memset && memh->len && !memh->mmap)
+				memset(memh+1, 255, memh->len);
+
+			mem_lock_shard(shard);
+
 			memh->tag1 = MEMFREE;
 			memh->tag2 = MEMFREE;
 			memt->tag3 = MEMFREE;
 			/* after tags !!! */
-			rem_memblock(memh);
+			rem_memblock(shard, memh);
+			if(mem_prof_active) mem_prof_free(memh);
+			cached= mem_cache_push(shard, memh);
+
+			mem_unlock_shard(shard);
 
-			mem_unlock_thread();
+			if(!cached)
+				mem_free_block(memh);
 			
 			return(0);
 		}
 		error = 2;
 		MemorY_ErroR(memh->name,"end corrupt");
-		name = check_memlist(memh);
+		name = check_memlist_all(memh);
 		if (name != NULL){
 			if (name != memh->name) MemorY_ErroR(name,"is also corrupt");
 		}
 	} else{
 		error = -1;
-		name = check_memlist(memh);
+		name = check_memlist_all(memh);
 		if (name == NULL)
 			MemorY_ErroR("free","pointer not in memlist");
 		else
 			MemorY_ErroR(name,"error in header");
 	}
 
-	totblock--;
 	/* here a DUMP should happen */
 
-	mem_unlock_thread();
-
 	return(error);
 }
 
@@ -696,9 +1321,10 @@ static void remlink(volatile localListBase *listbase, void *vlink)
 	if (listbase->first == link) listbase->first = link->next;
 }
 
-static void rem_memblock(MemHead *memh)
+/* only unlinks, freeing the block is up to the caller, shard must be locked */
+static void rem_memblock(MemShard *shard, MemHead *memh)
 {
-	remlink(membase,&memh->next);
+	remlink(&shard->membase,&memh->next);
 	if (memh->prev) {
 		if (memh->next)
 			MEMNEXT(memh->prev)->nextname = MEMNEXT(memh->next)->name;
@@ -706,19 +1332,11 @@ static void rem_memblock(MemHead *memh)
 			MEMNEXT(memh->prev)->nextname = NULL;
 	}
 
-	totblock--;
-	mem_in_use -= memh->len;
+	shard->totblock--;
+	shard->mem_in_use -= memh->len;
 
-	if(memh->mmap) {
-		mmap_in_use -= memh->len;
-		if (munmap(memh, memh->len + sizeof(MemHead) + sizeof(MemTail)))
-			printf("Couldn't unmap memory %s\n", memh->name);
-	}
-	else {
-		if(malloc_debug_memset && memh->len)
-			memset(memh+1, 255, memh->len);
-		free(memh);
-	}
+	if(memh->mmap)
+		shard->mmap_in_use -= memh->len;
 }
 
 static void MemorY_ErroR(const char *block, const char *error)
@@ -726,8 +1344,23 @@ static void MemorY_ErroR(const char *block, const char *error)
 	print_error("Memoryblock %s: %s\n",block, error);
 }
 
-static const char *check_memlist(MemHead *memh)
+/* the shard of a corrupt block is unknown, so look in all of them */
+static const char *check_memlist_all(MemHead *memh)
 {
+	const char *name = NULL;
+	int a;
+
+	mem_lock_all();
+	for(a=0; a<MEM_TOT_SHARD && name == NULL; a++)
+		name = check_memlist(&shards[a], memh);
+	mem_unlock_all();
+
+	return name;
+}
+
+static const char *check_memlist(MemShard *shard, MemHead *memh)
+{
+	volatile localListBase *membase= &shard->membase;
 	MemHead *forw,*back,*forwok,*backok;
 	const char *name;
 
@@ -815,27 +1448,27 @@ uintptr_t MEM_get_peak_memory(void)
 {
 	uintptr_t _peak_mem;
 
-	mem_lock_thread();
-	_peak_mem = peak_mem;
-	mem_unlock_thread();
+	mem_get_stats(NULL, NULL, NULL, &_peak_mem);
 
 	return _peak_mem;
 }
 
 void MEM_reset_peak_memory(void)
 {
-	mem_lock_thread();
+	int a;
+
+	mem_lock_all();
+	for(a=0; a<MEM_TOT_SHARD; a++)
+		shards[a].peak_mem = 0;
 	peak_mem = 0;
-	mem_unlock_thread();
+	mem_unlock_all();
 }
 
 uintptr_t MEM_get_memory_in_use(void)
 {
 	uintptr_t _mem_in_use;
 
-	mem_lock_thread();
-	_mem_in_use= mem_in_use;
-	mem_unlock_thread();
+	mem_get_stats(NULL, &_mem_in_use, NULL, NULL);
 
 	return _mem_in_use;
 }
@@ -844,9 +1477,7 @@ uintptr_t MEM_get_mapped_memory_in_use(void)
 {
 	uintptr_t _mmap_in_use;
 
-	mem_lock_thread();
-	_mmap_in_use= mmap_in_use;
-	mem_unlock_thread();
+	mem_get_stats(NULL, NULL, &_mmap_in_use, NULL);
 
 	return _mmap_in_use;
 }
@@ -855,9 +1486,7 @@ int MEM_get_memory_blocks_in_use(void)
 {
 	int _totblock;
 
-	mem_lock_thread();
-	_totblock= totblock;
-	mem_unlock_thread();
+	mem_get_stats(&_totblock, NULL, NULL, NULL);
 
 	return _totblock;
 }
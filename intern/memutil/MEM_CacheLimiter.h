@@ -32,7 +32,8 @@
 /**
  * @section MEM_CacheLimiter
  * This class defines a generic memory cache management system
- * to limit memory usage to a fixed global maximum.
+ * to limit memory usage to a fixed global maximum. It is thread safe,
+ * elements are kept in least recently used order per shard.
  * 
  * Please use the C-API in MEM_CacheLimiterC-Api.h for code written in C.
  *
@@ -59,8 +60,15 @@
  */
 
 #include <list>
+#include <pthread.h>
 #include "MEM_Allocator.h"
 
+/* handles are spread over shards with their own lock, so threads using
+ * different elements don't wait for each other */
+#define MEM_CACHE_LIMITER_SHARDS	8
+/* an eviction picks among this many of the least recently used elements */
+#define MEM_CACHE_LIMITER_WINDOW	8
+
 template<class T>
 class MEM_CacheLimiter;
 
@@ -74,15 +82,20 @@ extern "C" {
 template<class T>
 class MEM_CacheLimiterHandle {
 public:
+	typedef typename std::list<MEM_CacheLimiterHandle<T> *,
+	  MEM_Allocator<MEM_CacheLimiterHandle<T> *> >::iterator iterator;
+
 	explicit MEM_CacheLimiterHandle(T * data_, 
-					 MEM_CacheLimiter<T> * parent_) 
-		: data(data_), refcount(0), parent(parent_) { }
+					 MEM_CacheLimiter<T> * parent_,
+					 int shard_) 
+		: data(data_), refcount(0), priority(0), shard(shard_),
+		  parent(parent_) { }
 
 	void ref() { 
-		refcount++; 
+		parent->ref(this); 
 	}
 	void unref() { 
-		refcount--; 
+		parent->unref(this); 
 	}
 	T * get() { 
 		return data; 
@@ -97,13 +110,7 @@ public:
 		return !data || !refcount; 
 	}
 	bool destroy_if_possible() {
-		if (can_destroy()) {
-			delete data;
-			data = 0;
-			unmanage();
-			return true;
-		}
-		return false;
+		return parent->destroy_if_possible(this);
 	}
 	void unmanage() {
 		parent->unmanage(this);
@@ -111,62 +118,242 @@ public:
 	void touch() {
 		parent->touch(this);
 	}
+	/* lower priority elements are evicted first, for data that is
+	 * cheap to recreate */
+	void set_priority(int priority_) {
+		parent->set_priority(this, priority_);
+	}
+	int get_priority() const {
+		return priority;
+	}
 private:
 	friend class MEM_CacheLimiter<T>;
 
 	T * data;
 	int refcount;
-	typename std::list<MEM_CacheLimiterHandle<T> *, 
-	  MEM_Allocator<MEM_CacheLimiterHandle<T> *> >::iterator me;
+	int priority;
+	int shard;
+	iterator me;
 	MEM_CacheLimiter<T> * parent;
 };
 
+struct MEM_CacheLimiterCounters {
+	int totelem;
+	int inserts, touches, evictions;
+	size_t evicted_size;
+};
+
 template<class T>
 class MEM_CacheLimiter {
 public:
-	typedef typename std::list<MEM_CacheLimiterHandle<T> *,
-	  MEM_Allocator<MEM_CacheLimiterHandle<T> *> >::iterator iterator;
+	typedef MEM_CacheLimiterHandle<T> handle_t;
+	typedef typename handle_t::iterator iterator;
+	typedef size_t (*data_size_func)(T * data);
+
+	/* data_size is optional, when equally important elements are
+	 * evicted, larger ones go first */
+	MEM_CacheLimiter(data_size_func data_size_ = 0)
+		: data_size(data_size_), next_shard(0) {
+		pthread_mutex_init(&enforce_lock, NULL);
+		for (int i = 0; i < MEM_CACHE_LIMITER_SHARDS; i++) {
+			pthread_mutex_init(&shards[i].lock, NULL);
+			shards[i].inserts = 0;
+			shards[i].touches = 0;
+			shards[i].evictions = 0;
+			shards[i].evicted_size = 0;
+		}
+	}
 	~MEM_CacheLimiter() {
-		for (iterator it = queue.begin(); it != queue.end(); it++) {
-			delete *it;
+		for (int i = 0; i < MEM_CACHE_LIMITER_SHARDS; i++) {
+			list_t & queue = shards[i].queue;
+			for (iterator it = queue.begin(); it != queue.end(); it++) {
+				delete *it;
+			}
+			pthread_mutex_destroy(&shards[i].lock);
 		}
+		pthread_mutex_destroy(&enforce_lock);
 	}
-	MEM_CacheLimiterHandle<T> * insert(T * elem) {
-		queue.push_back(new MEM_CacheLimiterHandle<T>(elem, this));
-		iterator it = queue.end();
-		--it;
-		queue.back()->me = it;
-		return queue.back();
+	handle_t * insert(T * elem) {
+		uintptr_t key = (uintptr_t) elem;
+		int index = ((key >> 4) ^ (key >> 12)) % MEM_CACHE_LIMITER_SHARDS;
+		Shard & s = shards[index];
+		handle_t * handle = new handle_t(elem, this, index);
+
+		pthread_mutex_lock(&s.lock);
+		s.queue.push_back(handle);
+		handle->me = --s.queue.end();
+		s.inserts++;
+		pthread_mutex_unlock(&s.lock);
+
+		return handle;
 	}
-	void unmanage(MEM_CacheLimiterHandle<T> * handle) {
-		queue.erase(handle->me);
+	void unmanage(handle_t * handle) {
+		Shard & s = shards[handle->shard];
+
+		pthread_mutex_lock(&s.lock);
+		s.queue.erase(handle->me);
+		pthread_mutex_unlock(&s.lock);
+
 		delete handle;
 	}
+	bool destroy_if_possible(handle_t * handle) {
+		Shard & s = shards[handle->shard];
+
+		pthread_mutex_lock(&s.lock);
+		bool destroyed = destroy(s, handle);
+		pthread_mutex_unlock(&s.lock);
+
+		return destroyed;
+	}
 	void enforce_limits() {
 		intptr_t max = MEM_CacheLimiter_get_maximum();
-		intptr_t mem_in_use= MEM_get_memory_in_use();
-		intptr_t mmap_in_use= MEM_get_mapped_memory_in_use();
 
 		if (max == 0) {
 			return;
 		}
-		for (iterator it = queue.begin(); 
-		     it != queue.end() && mem_in_use + mmap_in_use > max;) {
-			iterator jt = it;
-			++it;
-			(*jt)->destroy_if_possible();
+		/* a thread that is already evicting does the work for us */
+		if (pthread_mutex_trylock(&enforce_lock) != 0) {
+			return;
+		}
+
+		/* take turns between shards, until memory is below the
+		 * maximum or no shard has anything left to evict */
+		int index = next_shard;
+		for (int tried = 0; tried < MEM_CACHE_LIMITER_SHARDS &&
+			     memory_in_use() > max;) {
+			if (evict(shards[index]))
+				tried = 0;
+			else
+				tried++;
+			index = (index + 1) % MEM_CACHE_LIMITER_SHARDS;
 		}
+		next_shard = index;
+
+		pthread_mutex_unlock(&enforce_lock);
+	}
+	void touch(handle_t * handle) {
+		Shard & s = shards[handle->shard];
+
+		/* splice keeps the iterator valid */
+		pthread_mutex_lock(&s.lock);
+		s.queue.splice(s.queue.end(), s.queue, handle->me);
+		s.touches++;
+		pthread_mutex_unlock(&s.lock);
+	}
+	void ref(handle_t * handle) {
+		Shard & s = shards[handle->shard];
+
+		pthread_mutex_lock(&s.lock);
+		handle->refcount++;
+		pthread_mutex_unlock(&s.lock);
+	}
+	void unref(handle_t * handle) {
+		Shard & s = shards[handle->shard];
+
+		pthread_mutex_lock(&s.lock);
+		handle->refcount--;
+		pthread_mutex_unlock(&s.lock);
 	}
-	void touch(MEM_CacheLimiterHandle<T> * handle) {
-		queue.push_back(handle);
-		queue.erase(handle->me);
-		iterator it = queue.end();
-		--it;
-		handle->me = it;
+	void set_priority(handle_t * handle, int priority) {
+		Shard & s = shards[handle->shard];
+
+		pthread_mutex_lock(&s.lock);
+		handle->priority = priority;
+		pthread_mutex_unlock(&s.lock);
+	}
+	void get_counters(MEM_CacheLimiterCounters * counters) {
+		counters->totelem = 0;
+		counters->inserts = 0;
+		counters->touches = 0;
+		counters->evictions = 0;
+		counters->evicted_size = 0;
+
+		for (int i = 0; i < MEM_CACHE_LIMITER_SHARDS; i++) {
+			Shard & s = shards[i];
+
+			pthread_mutex_lock(&s.lock);
+			counters->totelem += s.queue.size();
+			counters->inserts += s.inserts;
+			counters->touches += s.touches;
+			counters->evictions += s.evictions;
+			counters->evicted_size += s.evicted_size;
+			pthread_mutex_unlock(&s.lock);
+		}
 	}
 private:
-	std::list<MEM_CacheLimiterHandle<T>*,
-	  MEM_Allocator<MEM_CacheLimiterHandle<T> *> > queue;
+	typedef std::list<handle_t *, MEM_Allocator<handle_t *> > list_t;
+
+	struct Shard {
+		pthread_mutex_t lock;
+		list_t queue;
+		int inserts, touches, evictions;
+		size_t evicted_size;
+	};
+
+	static intptr_t memory_in_use() {
+		return MEM_get_memory_in_use() +
+			MEM_get_mapped_memory_in_use();
+	}
+
+	/* shard must be locked */
+	bool destroy(Shard & s, handle_t * handle) {
+		if (!handle->can_destroy()) {
+			return false;
+		}
+		delete handle->data;
+		handle->data = 0;
+		s.queue.erase(handle->me);
+		delete handle;
+		return true;
+	}
+
+	/* of the least recently used elements that can be destroyed, evict
+	 * the lowest priority one, the largest of those */
+	bool evict(Shard & s) {
+		iterator victim;
+		size_t victim_size = 0;
+		bool found = false;
+		int window = 0;
+
+		pthread_mutex_lock(&s.lock);
+
+		for (iterator it = s.queue.begin();
+		     it != s.queue.end() && window < MEM_CACHE_LIMITER_WINDOW;
+		     it++) {
+			handle_t * handle = *it;
+
+			if (!handle->can_destroy()) {
+				continue;
+			}
+
+			size_t size = (data_size && handle->data)?
+				data_size(handle->data): 0;
+
+			if (!found || handle->priority < (*victim)->priority ||
+			    (handle->priority == (*victim)->priority &&
+			     size > victim_size)) {
+				victim = it;
+				victim_size = size;
+				found = true;
+			}
+			window++;
+		}
+
+		if (found) {
+			destroy(s, *victim);
+			s.evictions++;
+			s.evicted_size += victim_size;
+		}
+
+		pthread_mutex_unlock(&s.lock);
+
+		return found;
+	}
+
+	data_size_func data_size;
+	Shard shards[MEM_CACHE_LIMITER_SHARDS];
+	pthread_mutex_t enforce_lock;
+	int next_shard;
 };
 
 #endif // MEM_CACHELIMITER_H
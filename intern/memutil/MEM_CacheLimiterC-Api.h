@@ -29,6 +29,8 @@
 #ifndef MEM_CACHELIMITERC_API_H
 #define MEM_CACHELIMITERC_API_H
 
+#include <stddef.h> /* size_t */
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -42,6 +44,15 @@ typedef struct MEM_CacheLimiterHandle_s MEM_CacheLimiterHandleC;
 /* function used to remove data from memory */
 typedef void(*MEM_CacheLimiter_Destruct_Func)(void*);
 
+/* function used to get the size of data in memory */
+typedef size_t(*MEM_CacheLimiter_DataSize_Func)(void*);
+
+typedef struct MEM_CacheLimiterStats {
+	int totelem;
+	int inserts, touches, evictions;
+	size_t evicted_size;
+} MEM_CacheLimiterStats;
+
 #ifndef MEM_CACHELIMITER_H
 extern void MEM_CacheLimiter_set_maximum(int m);
 extern int MEM_CacheLimiter_get_maximum(void);
@@ -51,11 +62,13 @@ extern int MEM_CacheLimiter_get_maximum(void);
  * managed objects are destructed with the data_destructor
  *
  * @param data_destructor
+ * @param data_size optional, to evict larger objects first
  * @return A new MEM_CacheLimter object
  */
 
 extern MEM_CacheLimiterC * new_MEM_CacheLimiter(
-	MEM_CacheLimiter_Destruct_Func data_destructor);
+	MEM_CacheLimiter_Destruct_Func data_destructor,
+	MEM_CacheLimiter_DataSize_Func data_size);
 
 /** 
  * Delete MEM_CacheLimiter
@@ -129,6 +142,25 @@ extern void MEM_CacheLimiter_unref(MEM_CacheLimiterHandleC * handle);
 	
 extern int MEM_CacheLimiter_get_refcount(MEM_CacheLimiterHandleC * handle);
 
+/** 
+ * Set priority of object, objects with lower priority are deleted first.
+ * Use it to keep objects that are expensive to recreate. Default is 0.
+ * 
+ * @param handle of object, priority
+ */
+	
+extern void MEM_CacheLimiter_set_priority(MEM_CacheLimiterHandleC * handle,
+					  int priority);
+
+/** 
+ * Get object count and counters of inserts, touches and evictions
+ * 
+ * @param This "This" pointer, stats to fill in
+ */
+	
+extern void MEM_CacheLimiter_get_stats(MEM_CacheLimiterC * This,
+				       MEM_CacheLimiterStats * stats);
+
 /** 
  * Get pointer to managed object
  * 
@@ -54,9 +54,8 @@ typedef std::list<MEM_CacheLimiterHandleCClass*,
 
 class MEM_CacheLimiterCClass {
 public:
-	MEM_CacheLimiterCClass(MEM_CacheLimiter_Destruct_Func data_destructor_)
-		: data_destructor(data_destructor_) { 
-	}
+	MEM_CacheLimiterCClass(MEM_CacheLimiter_Destruct_Func data_destructor_,
+			       MEM_CacheLimiter_DataSize_Func data_size_);
         ~MEM_CacheLimiterCClass();
 	
 	handle_t * insert(void * data);
@@ -64,14 +63,21 @@ public:
 	void destruct(void * data,
 		      list_t::iterator it);
 
+	size_t get_data_size(void * data) {
+		return data_size(data);
+	}
+
 	cache_t * get_cache() {
 		return &cache;
 	}
 private:
 	MEM_CacheLimiter_Destruct_Func data_destructor;
+	MEM_CacheLimiter_DataSize_Func data_size;
 
 	MEM_CacheLimiter<MEM_CacheLimiterHandleCClass> cache;
 	
+	/* handles are inserted and destructed from any thread */
+	pthread_mutex_t cclass_lock;
 	list_t cclass_list;
 };
 
@@ -90,26 +96,51 @@ public:
 	void * get_data() const {
 		return data;
 	}
+	size_t get_data_size() const {
+		return parent->get_data_size(data);
+	}
 private:
 	void * data;
 	MEM_CacheLimiterCClass * parent;
 	list_t::iterator it;
 };
 
+static size_t handle_data_size(MEM_CacheLimiterHandleCClass * handle)
+{
+	return handle->get_data_size();
+}
+
+MEM_CacheLimiterCClass::MEM_CacheLimiterCClass(
+	MEM_CacheLimiter_Destruct_Func data_destructor_,
+	MEM_CacheLimiter_DataSize_Func data_size_)
+	: data_destructor(data_destructor_), data_size(data_size_),
+	  cache(data_size_? handle_data_size: 0)
+{
+	pthread_mutex_init(&cclass_lock, NULL);
+}
+
 handle_t * MEM_CacheLimiterCClass::insert(void * data) 
 {
-	cclass_list.push_back(new MEM_CacheLimiterHandleCClass(data, this));
+	MEM_CacheLimiterHandleCClass * handle =
+		new MEM_CacheLimiterHandleCClass(data, this);
+
+	pthread_mutex_lock(&cclass_lock);
+	cclass_list.push_back(handle);
 	list_t::iterator it = cclass_list.end();
 	--it;
-	cclass_list.back()->set_iter(it);
+	handle->set_iter(it);
+	pthread_mutex_unlock(&cclass_lock);
 	
-	return cache.insert(cclass_list.back());
+	return cache.insert(handle);
 }
 
 void MEM_CacheLimiterCClass::destruct(void * data, list_t::iterator it) 
 {
 	data_destructor(data);
+
+	pthread_mutex_lock(&cclass_lock);
 	cclass_list.erase(it);
+	pthread_mutex_unlock(&cclass_lock);
 }
 
 MEM_CacheLimiterHandleCClass::~MEM_CacheLimiterHandleCClass()
@@ -127,6 +158,7 @@ MEM_CacheLimiterCClass::~MEM_CacheLimiterCClass()
 		(*it)->set_data(0);
 		delete *it;
 	}
+	pthread_mutex_destroy(&cclass_lock);
 }
 
 // ----------------------------------------------------------------------
@@ -142,10 +174,11 @@ static inline handle_t* cast(MEM_CacheLimiterHandleC * l)
 }
 
 MEM_CacheLimiterC * new_MEM_CacheLimiter(
-	MEM_CacheLimiter_Destruct_Func data_destructor)
+	MEM_CacheLimiter_Destruct_Func data_destructor,
+	MEM_CacheLimiter_DataSize_Func data_size)
 {
 	return (MEM_CacheLimiterC*) new MEM_CacheLimiterCClass(
-		data_destructor);
+		data_destructor, data_size);
 }
 
 void delete_MEM_CacheLimiter(MEM_CacheLimiterC * This)
@@ -189,6 +222,26 @@ int MEM_CacheLimiter_get_refcount(MEM_CacheLimiterHandleC * handle)
 	return cast(handle)->get_refcount();
 }
 
+void MEM_CacheLimiter_set_priority(MEM_CacheLimiterHandleC * handle,
+				   int priority)
+{
+	cast(handle)->set_priority(priority);
+}
+
+void MEM_CacheLimiter_get_stats(MEM_CacheLimiterC * This,
+				MEM_CacheLimiterStats * stats)
+{
+	MEM_CacheLimiterCounters counters;
+
+	cast(This)->get_cache()->get_counters(&counters);
+
+	stats->totelem = counters.totelem;
+	stats->inserts = counters.inserts;
+	stats->touches = counters.touches;
+	stats->evictions = counters.evictions;
+	stats->evicted_size = counters.evicted_size;
+}
+
 	
 void * MEM_CacheLimiter_get(MEM_CacheLimiterHandleC * handle)
 {
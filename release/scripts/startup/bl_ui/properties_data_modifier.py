@@ -603,6 +603,7 @@ class DATA_PT_modifiers(ModifierButtonsPanel, Panel):
         col.label(text="Options:")
         col.prop(md, "use_subsurf_uv")
         col.prop(md, "show_only_control_edges")
+        col.prop(md, "use_stencils")
 
     def SURFACE(self, layout, ob, md):
         layout.label(text="Settings can be found inside the Physics context")
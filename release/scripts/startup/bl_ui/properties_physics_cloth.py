@@ -79,6 +79,7 @@ class PHYSICS_PT_cloth(PhysicButtonsPanel, Panel):
 
             col.label(text="Quality:")
             col.prop(cloth, "quality", text="Steps", slider=True)
+            col.prop(cloth, "use_preconditioner")
 
             col.label(text="Material:")
             col.prop(cloth, "mass")
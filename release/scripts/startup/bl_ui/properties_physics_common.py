@@ -138,10 +138,11 @@ def point_cache_ui(self, context, cache, enabled, cachetype):
             col = split.column()
             col.active = cache.use_disk_cache
             col.prop(cache, "use_library_path", "Use Lib Path")
+            col.prop(cache, "use_disk_cache_packed")
 
             row = layout.row()
             row.enabled = enabled and bpy.data.is_saved
-            row.active = cache.use_disk_cache
+            row.active = cache.use_disk_cache and not cache.use_disk_cache_packed
             row.label(text="Compression:")
             row.prop(cache, "compression", expand=True)
 
@@ -460,6 +460,17 @@ class USERPREF_PT_system(Panel):
         col.label(text="Sequencer:")
         col.prop(system, "prefetch_frames")
         col.prop(system, "memory_cache_limit")
+        sub = col.column(align=True)
+        sub.prop(system, "sequencer_cache_raw")
+        sub.prop(system, "sequencer_cache_preprocessed")
+        sub.prop(system, "sequencer_cache_composite")
+
+        col.separator()
+        col.separator()
+        col.separator()
+
+        col.label(text="Modifiers:")
+        col.prop(system, "modifier_cache_limit")
 
         # 3. Column
         column = split.column()
@@ -552,6 +552,11 @@ void DM_vertex_attributes_from_gpu(DerivedMesh *dm,
 
 void DM_add_tangent_layer(DerivedMesh *dm);
 
+/* results of modifiers kept for the next evaluation of the stack, limited by
+ * the modifier cache limit user preference */
+void DM_modifier_cache_remove(struct ModifierData *md);
+void DM_modifier_cache_free(void);
+
 /* Set object's bounding box based on DerivedMesh min/max data */
 void DM_set_object_boundbox(struct Object *ob, DerivedMesh *dm);
 
@@ -123,6 +123,7 @@ typedef struct Mat4 {
 } Mat4;
 
 Mat4 *b_bone_spline_setup(struct bPoseChannel *pchan, int rest);
+void b_bone_spline_setup_array(struct bPoseChannel *pchan, int rest, Mat4 *result_array);
 
 /* like EBONE_VISIBLE */
 #define PBONE_VISIBLE(arm, bone) (((bone)->layer & (arm)->layer) && !((bone)->flag & BONE_HIDDEN_P))
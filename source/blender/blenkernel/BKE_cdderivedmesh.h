@@ -43,6 +43,7 @@ struct DerivedMesh;
 struct EditMesh;
 struct Mesh;
 struct Object;
+struct VertCornerMap;
 
 /* creates a new CDDerivedMesh */
 struct DerivedMesh *CDDM_new(int numVerts, int numEdges, int numFaces);
@@ -86,6 +87,12 @@ void CDDM_apply_vert_normals(struct DerivedMesh *cddm, short (*vertNormals)[3]);
  */
 void CDDM_calc_normals(struct DerivedMesh *dm);
 
+/* recalculates the normals around the given vertices, when only those moved
+ * since normals were valid. cmap is the vertex to face map of the faces, it
+ * is built for the call when NULL
+ */
+void CDDM_calc_normals_partial(struct DerivedMesh *dm, struct VertCornerMap *cmap, const int *dirty, int totdirty);
+
 /* calculates edges for a CDDerivedMesh (from face data)
  * this completely replaces the current edge data in the DerivedMesh
  */
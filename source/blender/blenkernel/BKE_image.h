@@ -162,6 +162,9 @@ void BKE_image_memorypack(struct Image *ima);
 /* prints memory statistics for images */
 void BKE_image_print_memlist(void);
 
+/* load tiled images with the imbuf tile cache instead of fully */
+void BKE_image_use_tile_cache(int use);
+
 /* empty image block, of similar type and filename */
 struct Image *copy_image(struct Image *ima);
 
@@ -53,6 +53,7 @@ struct VecNor;
 struct CustomData;
 struct DerivedMesh;
 struct Scene;
+struct VertCornerMap;
 
 #ifdef __cplusplus
 extern "C" {
@@ -101,6 +102,14 @@ void mesh_strip_loose_edges(struct Mesh *me);
 	 */
 void mesh_calc_normals(struct MVert *mverts, int numVerts, struct MFace *mfaces, int numFaces, float (*faceNors_r)[3]);
 
+	/* Same as mesh_calc_normals, but only for the faces using one of the
+	 * dirty vertices and the vertices of those faces. faceNors may be NULL,
+	 * otherwise it must hold valid normals of the other faces and gets
+	 * the dirty ones updated. The result matches a full recalculation.
+	 */
+void mesh_calc_normals_partial(struct MVert *mverts, int numVerts, struct MFace *mfaces, int numFaces,
+	float (*faceNors)[3], struct VertCornerMap *cmap, const int *dirty, int totdirty);
+
 	/* Return a newly MEM_malloc'd array of all the mesh vertex locations
 	 * (_numVerts_r_ may be NULL) */
 float (*mesh_getVertexCos(struct Mesh *me, int *numVerts_r))[3];
@@ -127,6 +136,21 @@ UvMapVert *get_uv_map_vert(UvVertMap *vmap, unsigned int v);
 void free_uv_vert_map(UvVertMap *vmap);
 
 /* Connectivity data */
+
+/* corners using a vertex, packed as face*4 + corner in face order:
+ * corner[first[v]] .. corner[first[v+1]-1] */
+typedef struct VertCornerMap {
+	int *first;
+	int *corner;
+	int totvert, totface;
+	unsigned int topology;	/* hash of the face vertices, for the map kept on a mesh */
+} VertCornerMap;
+
+VertCornerMap *make_vert_corner_map(const struct MFace *mface, int totface, int totvert);
+void free_vert_corner_map(VertCornerMap *cmap);
+/* the map of the mesh faces, kept on the mesh and rebuilt when the topology changed */
+VertCornerMap *mesh_get_vert_corner_map(struct Mesh *me);
+
 typedef struct IndexNode {
 	struct IndexNode *next, *prev;
 	int index;
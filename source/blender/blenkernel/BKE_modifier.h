@@ -358,7 +358,16 @@ struct LinkNode *modifiers_calcDataMasks(struct Scene *scene,
 										 struct ModifierData *md,
 										 CustomDataMask dataMask,
 										 int required_mode);
-struct ModifierData  *modifiers_getVirtualModifierList(struct Object *ob);
+
+/* storage for the modifiers that parenting and shape keys add to the stack */
+typedef struct VirtualModifierData {
+	ArmatureModifierData amd;
+	CurveModifierData cmd;
+	LatticeModifierData lmd;
+	ShapeKeyModifierData smd;
+} VirtualModifierData;
+
+struct ModifierData  *modifiers_getVirtualModifierList(struct Object *ob, VirtualModifierData *virtualModifierData);
 
 /* ensure modifier correctness when changing ob->data */
 void test_object_modifiers(struct Object *ob);
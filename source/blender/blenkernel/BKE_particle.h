@@ -56,6 +56,7 @@ struct MVert;
 struct IpoCurve;
 struct LinkNode;
 struct KDTree;
+struct EdgeHash;
 struct RNG;
 struct SurfaceModifierData;
 struct BVHTreeRay;
@@ -128,18 +129,30 @@ typedef struct ParticleThreadContext {
 	/* path caching */
 	int editupdate, between, steps;
 	int totchild, totparent, parent_pass;
+	int child_next;				/* first child not taken by a thread yet */
+	void *child_lock;			/* ThreadMutex guarding child_next, NULL with one thread */
+	char *parent_moved;			/* parents that moved since the child cache was made, only these children are updated */
 
 	float cfra;
 
 	float *vg_length, *vg_clump, *vg_kink;
 	float *vg_rough1, *vg_rough2, *vg_roughe;
 	float *vg_effector;
+
+	/* dynamics */
+	float *gravity;
+	struct EdgeHash *springhash;
+	struct ParticleSystem *sph_psys[10];
 } ParticleThreadContext;
 
 typedef struct ParticleThread {
 	ParticleThreadContext *ctx;
 	struct RNG *rng, *rng_path;
 	int num, tot;
+
+	/* fluid springs created by this thread, added to the system afterwards */
+	struct ParticleSpring *fluid_springs;
+	int tot_fluidsprings, alloc_fluidsprings;
 } ParticleThread;
 
 typedef struct ParticleBillboardData
@@ -53,6 +53,7 @@
 
 /* Add the blendfile name after blendcache_ */
 #define PTCACHE_EXT ".bphys"
+#define PTCACHE_PACK_EXT ".bpack"
 #define PTCACHE_PATH "blendcache_"
 
 /* File open options, for BKE_ptcache_file_open */
@@ -320,8 +321,15 @@ void BKE_ptcache_disk_to_mem(struct PTCacheID *pid);
 /* Convert memory cache to disk cache. */
 void BKE_ptcache_mem_to_disk(struct PTCacheID *pid);
 
+/* Waits for frames of the cache that are written in the background, all
+ * caches if NULL, which also ends the writing threads. */
+void BKE_ptcache_write_flush(struct PointCache *cache);
+/* Ends the writing threads when no frames were written for a while. */
+void BKE_ptcache_write_end_idle(void);
+
 /* Convert disk cache to memory cache and vice versa. Clears the cache that was converted. */
 void BKE_ptcache_toggle_disk_cache(struct PTCacheID *pid);
+void BKE_ptcache_toggle_disk_packed(struct PTCacheID *pid);
 
 /* Rename all disk cache files with a new name. Doesn't touch the actual content of the files. */
 void BKE_ptcache_disk_cache_rename(struct PTCacheID *pid, char *from, char *to);
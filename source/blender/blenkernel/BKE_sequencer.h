@@ -169,6 +169,8 @@ struct ImBuf *give_ibuf_seq_threaded(SeqRenderData context, float cfra, int chan
 struct ImBuf *give_ibuf_seq_direct(SeqRenderData context, float cfra, struct Sequence *seq);
 struct ImBuf *give_ibuf_seqbase(SeqRenderData context, float cfra, int chan_shown, struct ListBase *seqbasep);
 void give_ibuf_prefetch_request(SeqRenderData context, float cfra, int chan_shown);
+void seq_prefetch_cancel(void);
+void seq_prefetch_free(void);
 
 /* apply functions recursively */
 int seqbase_recursive_apply(struct ListBase *seqbase, int (*apply_func)(struct Sequence *seq, void *), void *arg);
@@ -227,9 +229,32 @@ struct ImBuf * seq_stripelem_cache_get(
    you can pass the same ImBuf multiple times to the cache without problems.
 */
    
+/* cost is the time in seconds it took to render nval */
 void seq_stripelem_cache_put(
 	SeqRenderData context, struct Sequence * seq, 
-	float cfra, seq_stripelem_ibuf_t type, struct ImBuf * nval);
+	float cfra, seq_stripelem_ibuf_t type, struct ImBuf * nval, float cost);
+
+/* frames close to the playhead are kept longest */
+void seq_stripelem_cache_playhead(float cfra);
+
+/* each stage has its own memory budget */
+enum {
+	SEQ_CACHE_STAGE_RAW,
+	SEQ_CACHE_STAGE_PREPROCESSED,
+	SEQ_CACHE_STAGE_COMPOSITE,
+	SEQ_CACHE_TOT_STAGE
+};
+
+typedef struct SeqCacheStats {
+	size_t size[SEQ_CACHE_TOT_STAGE];
+	size_t budget[SEQ_CACHE_TOT_STAGE];	/* 0 is unlimited */
+	int totentry[SEQ_CACHE_TOT_STAGE];
+	int hits[SEQ_CACHE_TOT_STAGE];
+	int misses[SEQ_CACHE_TOT_STAGE];
+	int evictions[SEQ_CACHE_TOT_STAGE];
+} SeqCacheStats;
+
+void seq_stripelem_cache_stats(SeqCacheStats * stats);
 
 /* **********************************************************************
    seqeffects.c 
@@ -242,6 +267,10 @@ void seq_stripelem_cache_put(
 struct SeqEffectHandle get_sequence_blend(struct Sequence *seq);
 void sequence_effect_speed_rebuild_map(struct Scene *scene, struct Sequence *seq, int force);
 
+/* run func over slices of rows [0, recty) in parallel, slices start at even rows */
+typedef void (*SeqSliceFunc)(void *userdata, int start_line, int total_lines);
+void seq_execute_slices(int recty, SeqSliceFunc func, void *userdata);
+
 /* extern */
 struct SeqEffectHandle get_sequence_effect(struct Sequence *seq);
 int get_sequence_effect_num_inputs(int seq_type);
@@ -12,6 +12,14 @@
 #include "MEM_guardedalloc.h"
 #include "BLO_sys_types.h" // for intptr_t support
 
+#include "DNA_listBase.h"
+
+#include "BLI_threads.h"
+
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
 #ifdef _MSC_VER
 #define CCG_INLINE __inline
 #else
@@ -298,6 +306,8 @@ struct _CCGFace {
 #define FACE_getEdges(f)		((CCGEdge**) &(FACE_getVerts(f)[(f)->numVerts]))
 #define FACE_getCenterData(f)	((byte*) &(FACE_getEdges(f)[(f)->numVerts]))
 
+typedef struct _CCGStencils CCGStencils;
+
 typedef enum {
 	eSyncState_None = 0,
 	eSyncState_Vert,
@@ -342,6 +352,10 @@ struct _CCGSubSurf {
 	int lenTempArrays;
 	CCGVert **tempVerts;
 	CCGEdge **tempEdges;
+
+		// precomputed weights of the highest level, see ccgSubSurf_buildStencils
+	CCGStencils *stencils;
+	int stencilsFailed;
 };
 
 #define CCGSUBSURF_alloc(ss, nb)			((ss)->allocatorIFC.alloc((ss)->allocator, nb))
@@ -687,6 +701,9 @@ CCGSubSurf *ccgSubSurf_new(CCGMeshIFC *ifc, int subdivLevels, CCGAllocatorIFC *a
 		ss->tempVerts = NULL;
 		ss->tempEdges = NULL;	
 
+		ss->stencils = NULL;
+		ss->stencilsFailed = 0;
+
 		return ss;
 	}
 }
@@ -704,6 +721,8 @@ void ccgSubSurf_free(CCGSubSurf *ss) {
 		MEM_freeN(ss->tempEdges);
 	}
 
+	ccgSubSurf_freeStencils(ss);
+
 	CCGSUBSURF_free(ss, ss->r);
 	CCGSUBSURF_free(ss, ss->q);
 	if (ss->defaultEdgeUserData) CCGSUBSURF_free(ss, ss->defaultEdgeUserData);
@@ -748,6 +767,9 @@ CCGError ccgSubSurf_setSubdivisionLevels(CCGSubSurf *ss, int subdivisionLevels)
 	if (subdivisionLevels<=0) {
 		return eCCGError_InvalidValue;
 	} else if (subdivisionLevels!=ss->subdivLevels) {
+		ccgSubSurf_freeStencils(ss);
+		ss->stencilsFailed = 0;
+
 		ss->numGrids = 0;
 		ss->subdivLevels = subdivisionLevels;
 		_ehash_free(ss->vMap, (EHEntryFreeFP) _vert_free, ss);
@@ -813,6 +835,8 @@ CCGError ccgSubSurf_initFullSync(CCGSubSurf *ss) {
 		return eCCGError_InvalidSyncState;
 	}
 
+	ccgSubSurf_freeStencils(ss);
+
 	ss->currentAge++;
 
 	ss->oldVMap = ss->vMap; 
@@ -839,6 +863,8 @@ CCGError ccgSubSurf_initPartialSync(CCGSubSurf *ss) {
 		return eCCGError_InvalidSyncState;
 	}
 
+	ccgSubSurf_freeStencils(ss);
+
 	ss->currentAge++;
 
 	ss->syncState = eSyncState_Partial;
@@ -1153,25 +1179,100 @@ CCGError ccgSubSurf_processSync(CCGSubSurf *ss) {
 	return eCCGError_None;
 }
 
+/* Subdivision and normals are computed in passes over the effected faces,
+ * edges and vertices. A pass only reads results of earlier passes and writes
+ * data owned by the element it's working on, so the elements of a pass are
+ * split in ranges that run in parallel, and passes run one after another. */
+
+typedef struct CCGPassData {
+	CCGSubSurf *ss;
+	CCGVert **effectedV;
+	CCGEdge **effectedE;
+	CCGFace **effectedF;
+	int numEffectedV, numEffectedE, numEffectedF;
+	int curLvl;
+} CCGPassData;
+
+/* q and r are scratch vertex data of the thread */
+typedef void (*CCGPassFunc)(CCGPassData *data, int start, int end, void *q, void *r);
+
+typedef struct CCGPassRange {
+	CCGPassData *data;
+	CCGPassFunc func;
+	int start, end;
+} CCGPassRange;
+
+static void *ccgSubSurf__passThread(void *range_v)
+{
+	CCGPassRange *range = range_v;
+	int vertDataSize = range->data->ss->meshIFC.vertDataSize;
+	void *q = MEM_mallocN(vertDataSize, "CCGSubsurf q");
+	void *r = MEM_mallocN(vertDataSize, "CCGSubsurf r");
+
+	range->func(range->data, range->start, range->end, q, r);
+
+	MEM_freeN(q);
+	MEM_freeN(r);
+
+	return NULL;
+}
+
+/* work is the amount of vertex data of the level, small levels aren't worth
+ * starting threads for. the threads come from the shared budget, so inside
+ * scene update or render threads only the cores that are free are used */
+static void ccgSubSurf__runPass(CCGPassData *data, CCGPassFunc func, int tot, int work)
+{
+	CCGPassRange ranges[BLENDER_MAX_THREADS];
+	ListBase threads;
+	int i, budget, totthread, len;
+
+	if (work < CCG_OMP_LIMIT || tot < 2) {
+		func(data, 0, tot, data->ss->q, data->ss->r);
+		return;
+	}
+
+	budget = BLI_thread_budget_acquire((tot < BLENDER_MAX_THREADS)? tot: BLENDER_MAX_THREADS);
+
+	len = (tot + budget - 1)/budget;
+	totthread = (tot + len - 1)/len;
+
+	if (totthread <= 1) {
+		BLI_thread_budget_release(budget);
+		func(data, 0, tot, data->ss->q, data->ss->r);
+		return;
+	}
+
+	BLI_init_threads(&threads, ccgSubSurf__passThread, totthread);
+
+	for (i=0; i<totthread; i++) {
+		ranges[i].data = data;
+		ranges[i].func = func;
+		ranges[i].start = i*len;
+		ranges[i].end = (i == totthread-1)? tot: (i+1)*len;
+
+		BLI_insert_thread(&threads, &ranges[i]);
+	}
+
+	BLI_end_threads(&threads);
+	BLI_thread_budget_release(budget);
+}
+
 #define VERT_getNo(e, lvl)					_vert_getNo(e, lvl, vertDataSize, normalDataOffset)
 #define EDGE_getNo(e, lvl, x)				_edge_getNo(e, lvl, x, vertDataSize, normalDataOffset)
 #define FACE_getIFNo(f, lvl, S, x, y)		_face_getIFNo(f, lvl, S, x, y, subdivLevels, vertDataSize, normalDataOffset)
 #define FACE_calcIFNo(f, lvl, S, x, y, no)	_face_calcIFNo(f, lvl, S, x, y, no, subdivLevels, vertDataSize)
 #define FACE_getIENo(f, lvl, S, x)			_face_getIENo(f, lvl, S, x, subdivLevels, vertDataSize, normalDataOffset)
-static void ccgSubSurf__calcVertNormals(CCGSubSurf *ss,
-	CCGVert **effectedV, CCGEdge **effectedE, CCGFace **effectedF,
-	int numEffectedV, int numEffectedE, int numEffectedF) {
-	int i,ptrIdx;
+static void ccgSubSurf__normalsFacePass(CCGPassData *data, int start, int end, void *UNUSED(q), void *UNUSED(r)) {
+	CCGSubSurf *ss = data->ss;
 	int subdivLevels = ss->subdivLevels;
+	int vertDataSize = ss->meshIFC.vertDataSize;
+	int normalDataOffset = ss->normalDataOffset;
 	int lvl = ss->subdivLevels;
-	int edgeSize = 1 + (1<<lvl);
 	int gridSize = 1 + (1<<(lvl-1));
-	int normalDataOffset = ss->normalDataOffset;
-	int vertDataSize = ss->meshIFC.vertDataSize;
+	int ptrIdx;
 
-	#pragma omp parallel for private(ptrIdx) if(numEffectedF*edgeSize*edgeSize*4 >= CCG_OMP_LIMIT)
-	for (ptrIdx=0; ptrIdx<numEffectedF; ptrIdx++) {
-		CCGFace *f = (CCGFace*) effectedF[ptrIdx];
+	for (ptrIdx=start; ptrIdx<end; ptrIdx++) {
+		CCGFace *f = (CCGFace*) data->effectedF[ptrIdx];
 		int S, x, y;
 		float no[3];
 
@@ -1240,9 +1341,20 @@ static void ccgSubSurf__calcVertNormals(CCGSubSurf *ss,
 			}
 		}
 	}
+}
+/* the face grid corners at a vertex are only written by that vertex */
+static void ccgSubSurf__normalsVertPass(CCGPassData *data, int start, int end, void *UNUSED(q), void *UNUSED(r)) {
+	CCGSubSurf *ss = data->ss;
+	int subdivLevels = ss->subdivLevels;
+	int vertDataSize = ss->meshIFC.vertDataSize;
+	int normalDataOffset = ss->normalDataOffset;
+	int lvl = ss->subdivLevels;
+	int gridSize = 1 + (1<<(lvl-1));
+	int i, ptrIdx;
+
 		// XXX can I reduce the number of normalisations here?
-	for (ptrIdx=0; ptrIdx<numEffectedV; ptrIdx++) {
-		CCGVert *v = (CCGVert*) effectedV[ptrIdx];
+	for (ptrIdx=start; ptrIdx<end; ptrIdx++) {
+		CCGVert *v = (CCGVert*) data->effectedV[ptrIdx];
 		float length, *no = _vert_getNo(v, lvl, vertDataSize, normalDataOffset);
 
 		NormZero(no);
@@ -1268,8 +1380,19 @@ static void ccgSubSurf__calcVertNormals(CCGSubSurf *ss,
 			NormCopy(FACE_getIFNo(f, lvl, _face_getVertIndex(f,v), gridSize-1, gridSize-1), no);
 		}
 	}
-	for (ptrIdx=0; ptrIdx<numEffectedE; ptrIdx++) {
-		CCGEdge *e = (CCGEdge*) effectedE[ptrIdx];
+}
+/* as are the face grid sides at an edge, without the corners */
+static void ccgSubSurf__normalsEdgePass(CCGPassData *data, int start, int end, void *UNUSED(q), void *UNUSED(r)) {
+	CCGSubSurf *ss = data->ss;
+	int subdivLevels = ss->subdivLevels;
+	int vertDataSize = ss->meshIFC.vertDataSize;
+	int normalDataOffset = ss->normalDataOffset;
+	int lvl = ss->subdivLevels;
+	int edgeSize = 1 + (1<<lvl);
+	int i, ptrIdx;
+
+	for (ptrIdx=start; ptrIdx<end; ptrIdx++) {
+		CCGEdge *e = (CCGEdge*) data->effectedE[ptrIdx];
 
 		if (e->numFaces) {
 			CCGFace *fLast = e->faces[e->numFaces-1];
@@ -1294,10 +1417,18 @@ static void ccgSubSurf__calcVertNormals(CCGSubSurf *ss,
 			}
 		}
 	}
+}
+static void ccgSubSurf__normalsFaceFinishPass(CCGPassData *data, int start, int end, void *UNUSED(q), void *UNUSED(r)) {
+	CCGSubSurf *ss = data->ss;
+	int subdivLevels = ss->subdivLevels;
+	int vertDataSize = ss->meshIFC.vertDataSize;
+	int normalDataOffset = ss->normalDataOffset;
+	int lvl = ss->subdivLevels;
+	int gridSize = 1 + (1<<(lvl-1));
+	int ptrIdx;
 
-	#pragma omp parallel for private(ptrIdx) if(numEffectedF*edgeSize*edgeSize*4 >= CCG_OMP_LIMIT)
-	for (ptrIdx=0; ptrIdx<numEffectedF; ptrIdx++) {
-		CCGFace *f = (CCGFace*) effectedF[ptrIdx];
+	for (ptrIdx=start; ptrIdx<end; ptrIdx++) {
+		CCGFace *f = (CCGFace*) data->effectedF[ptrIdx];
 		int S, x, y;
 
 		for (S=0; S<f->numVerts; S++) {
@@ -1330,9 +1461,18 @@ static void ccgSubSurf__calcVertNormals(CCGSubSurf *ss,
 					FACE_getIFNo(f, lvl, S, x, 0));
 		}
 	}
+}
+static void ccgSubSurf__normalsEdgeFinishPass(CCGPassData *data, int start, int end, void *UNUSED(q), void *UNUSED(r)) {
+	CCGSubSurf *ss = data->ss;
+	int subdivLevels = ss->subdivLevels;
+	int vertDataSize = ss->meshIFC.vertDataSize;
+	int normalDataOffset = ss->normalDataOffset;
+	int lvl = ss->subdivLevels;
+	int edgeSize = 1 + (1<<lvl);
+	int ptrIdx;
 
-	for (ptrIdx=0; ptrIdx<numEffectedE; ptrIdx++) {
-		CCGEdge *e = (CCGEdge*) effectedE[ptrIdx];
+	for (ptrIdx=start; ptrIdx<end; ptrIdx++) {
+		CCGEdge *e = (CCGEdge*) data->effectedE[ptrIdx];
 
 		if (e->numFaces) {
 			CCGFace *f = e->faces[0];
@@ -1355,26 +1495,46 @@ static void ccgSubSurf__calcVertNormals(CCGSubSurf *ss,
 		}
 	}
 }
+static void ccgSubSurf__calcVertNormals(CCGSubSurf *ss,
+	CCGVert **effectedV, CCGEdge **effectedE, CCGFace **effectedF,
+	int numEffectedV, int numEffectedE, int numEffectedF) {
+	CCGPassData data;
+	int lvl = ss->subdivLevels;
+	int edgeSize = 1 + (1<<lvl);
+	int work = numEffectedF*edgeSize*edgeSize*4;
+
+	data.ss = ss;
+	data.effectedV = effectedV;
+	data.effectedE = effectedE;
+	data.effectedF = effectedF;
+	data.numEffectedV = numEffectedV;
+	data.numEffectedE = numEffectedE;
+	data.numEffectedF = numEffectedF;
+	data.curLvl = lvl;
+
+	ccgSubSurf__runPass(&data, ccgSubSurf__normalsFacePass, numEffectedF, work);
+	ccgSubSurf__runPass(&data, ccgSubSurf__normalsVertPass, numEffectedV, work);
+	ccgSubSurf__runPass(&data, ccgSubSurf__normalsEdgePass, numEffectedE, work);
+	ccgSubSurf__runPass(&data, ccgSubSurf__normalsFaceFinishPass, numEffectedF, work);
+	ccgSubSurf__runPass(&data, ccgSubSurf__normalsEdgeFinishPass, numEffectedE, work);
+}
 #undef FACE_getIFNo
 
 #define VERT_getCo(v, lvl)				_vert_getCo(v, lvl, vertDataSize)
 #define EDGE_getCo(e, lvl, x)			_edge_getCo(e, lvl, x, vertDataSize)
 #define FACE_getIECo(f, lvl, S, x)		_face_getIECo(f, lvl, S, x, subdivLevels, vertDataSize)
 #define FACE_getIFCo(f, lvl, S, x, y)	_face_getIFCo(f, lvl, S, x, y, subdivLevels, vertDataSize)
-static void ccgSubSurf__calcSubdivLevel(CCGSubSurf *ss,
-	CCGVert **effectedV, CCGEdge **effectedE, CCGFace **effectedF,
-	int numEffectedV, int numEffectedE, int numEffectedF, int curLvl) {
+static void ccgSubSurf__subdivFaceMidPass(CCGPassData *data, int start, int end, void *UNUSED(q), void *UNUSED(r)) {
+	CCGSubSurf *ss = data->ss;
 	int subdivLevels = ss->subdivLevels;
-	int edgeSize = 1 + (1<<curLvl);
+	int vertDataSize = ss->meshIFC.vertDataSize;
+	int curLvl = data->curLvl;
 	int gridSize = 1 + (1<<(curLvl-1));
 	int nextLvl = curLvl+1;
-	int ptrIdx, cornerIdx, i;
-	int vertDataSize = ss->meshIFC.vertDataSize;
-	void *q = ss->q, *r = ss->r;
+	int ptrIdx;
 
-	#pragma omp parallel for private(ptrIdx) if(numEffectedF*edgeSize*edgeSize*4 >= CCG_OMP_LIMIT)
-	for (ptrIdx=0; ptrIdx<numEffectedF; ptrIdx++) {
-		CCGFace *f = (CCGFace*) effectedF[ptrIdx];
+	for (ptrIdx=start; ptrIdx<end; ptrIdx++) {
+		CCGFace *f = (CCGFace*) data->effectedF[ptrIdx];
 		int S, x, y;
 
 			/* interior face midpoints
@@ -1448,13 +1608,22 @@ static void ccgSubSurf__calcSubdivLevel(CCGSubSurf *ss,
 			}
 		}
 	}
+}
+static void ccgSubSurf__subdivEdgeMidPass(CCGPassData *data, int start, int end, void *q, void *r) {
+	CCGSubSurf *ss = data->ss;
+	int subdivLevels = ss->subdivLevels;
+	int vertDataSize = ss->meshIFC.vertDataSize;
+	int curLvl = data->curLvl;
+	int edgeSize = 1 + (1<<curLvl);
+	int nextLvl = curLvl+1;
+	int ptrIdx;
 
 		/* exterior edge midpoints
 		 *  o old exterior edge points
 		 *  o new interior face midpoints
 		 */
-	for (ptrIdx=0; ptrIdx<numEffectedE; ptrIdx++) {
-		CCGEdge *e = (CCGEdge*) effectedE[ptrIdx];
+	for (ptrIdx=start; ptrIdx<end; ptrIdx++) {
+		CCGEdge *e = (CCGEdge*) data->effectedE[ptrIdx];
 		float sharpness = EDGE_getSharpness(e, curLvl);
 		int x, j;
 
@@ -1499,14 +1668,22 @@ static void ccgSubSurf__calcSubdivLevel(CCGSubSurf *ss,
 			}
 		}
 	}
+}
+static void ccgSubSurf__subdivVertPass(CCGPassData *data, int start, int end, void *q, void *r) {
+	CCGSubSurf *ss = data->ss;
+	int subdivLevels = ss->subdivLevels;
+	int vertDataSize = ss->meshIFC.vertDataSize;
+	int curLvl = data->curLvl;
+	int nextLvl = curLvl+1;
+	int ptrIdx;
 
 		/* exterior vertex shift
 		 *  o old vertex points (shifting)
 		 *  o old exterior edge points
 		 *  o new interior face midpoints
 		 */
-	for (ptrIdx=0; ptrIdx<numEffectedV; ptrIdx++) {
-		CCGVert *v = (CCGVert*) effectedV[ptrIdx];
+	for (ptrIdx=start; ptrIdx<end; ptrIdx++) {
+		CCGVert *v = (CCGVert*) data->effectedV[ptrIdx];
 		void *co = VERT_getCo(v, curLvl);
 		void *nCo = VERT_getCo(v, nextLvl);
 		int sharpCount = 0, allSharp = 1;
@@ -1625,14 +1802,23 @@ static void ccgSubSurf__calcSubdivLevel(CCGSubSurf *ss,
 			VertDataAdd(nCo, r);
 		}
 	}
+}
+static void ccgSubSurf__subdivEdgeShiftPass(CCGPassData *data, int start, int end, void *q, void *r) {
+	CCGSubSurf *ss = data->ss;
+	int subdivLevels = ss->subdivLevels;
+	int vertDataSize = ss->meshIFC.vertDataSize;
+	int curLvl = data->curLvl;
+	int edgeSize = 1 + (1<<curLvl);
+	int nextLvl = curLvl+1;
+	int ptrIdx;
 
 		/* exterior edge interior shift
 		 *  o old exterior edge midpoints (shifting)
 		 *  o old exterior edge midpoints
 		 *  o new interior face midpoints
 		 */
-	for (ptrIdx=0; ptrIdx<numEffectedE; ptrIdx++) {
-		CCGEdge *e = (CCGEdge*) effectedE[ptrIdx];
+	for (ptrIdx=start; ptrIdx<end; ptrIdx++) {
+		CCGEdge *e = (CCGEdge*) data->effectedE[ptrIdx];
 		float sharpness = EDGE_getSharpness(e, curLvl);
 		int sharpCount = 0;
 		float avgSharpness = 0.0;
@@ -1705,92 +1891,63 @@ static void ccgSubSurf__calcSubdivLevel(CCGSubSurf *ss,
 			}
 		}
 	}
+}
+static void ccgSubSurf__subdivFaceShiftPass(CCGPassData *data, int start, int end, void *q, void *r) {
+	CCGSubSurf *ss = data->ss;
+	int subdivLevels = ss->subdivLevels;
+	int vertDataSize = ss->meshIFC.vertDataSize;
+	int curLvl = data->curLvl;
+	int gridSize = 1 + (1<<(curLvl-1));
+	int nextLvl = curLvl+1;
+	int ptrIdx;
 
-	#pragma omp parallel private(ptrIdx) if(numEffectedF*edgeSize*edgeSize*4 >= CCG_OMP_LIMIT)
-	{
-		void *q, *r;
+	for (ptrIdx=start; ptrIdx<end; ptrIdx++) {
+		CCGFace *f = (CCGFace*) data->effectedF[ptrIdx];
+		int S, x, y;
 
-		#pragma omp critical
-		{
-			q = MEM_mallocN(ss->meshIFC.vertDataSize, "CCGSubsurf q");
-			r = MEM_mallocN(ss->meshIFC.vertDataSize, "CCGSubsurf r");
+			/* interior center point shift
+			 *  o old face center point (shifting)
+			 *  o old interior edge points
+			 *  o new interior face midpoints
+			 */
+		VertDataZero(q);
+		for (S=0; S<f->numVerts; S++) {
+			VertDataAdd(q, FACE_getIFCo(f, nextLvl, S, 1, 1));
 		}
+		VertDataMulN(q, 1.0f/f->numVerts);
+		VertDataZero(r);
+		for (S=0; S<f->numVerts; S++) {
+			VertDataAdd(r, FACE_getIECo(f, curLvl, S, 1));
+		}
+		VertDataMulN(r, 1.0f/f->numVerts);
 
-		#pragma omp for schedule(static)
-		for (ptrIdx=0; ptrIdx<numEffectedF; ptrIdx++) {
-			CCGFace *f = (CCGFace*) effectedF[ptrIdx];
-			int S, x, y;
+		VertDataMulN(FACE_getCenterData(f), f->numVerts-2.0f);
+		VertDataAdd(FACE_getCenterData(f), q);
+		VertDataAdd(FACE_getCenterData(f), r);
+		VertDataMulN(FACE_getCenterData(f), 1.0f/f->numVerts);
 
-				/* interior center point shift
-				 *  o old face center point (shifting)
-				 *  o old interior edge points
+		for (S=0; S<f->numVerts; S++) {
+				/* interior face shift
+				 *  o old interior face point (shifting)
+				 *  o new interior edge midpoints
 				 *  o new interior face midpoints
 				 */
-			VertDataZero(q);
-			for (S=0; S<f->numVerts; S++) {
-				VertDataAdd(q, FACE_getIFCo(f, nextLvl, S, 1, 1));
-			}
-			VertDataMulN(q, 1.0f/f->numVerts);
-			VertDataZero(r);
-			for (S=0; S<f->numVerts; S++) {
-				VertDataAdd(r, FACE_getIECo(f, curLvl, S, 1));
-			}
-			VertDataMulN(r, 1.0f/f->numVerts);
-
-			VertDataMulN(FACE_getCenterData(f), f->numVerts-2.0f);
-			VertDataAdd(FACE_getCenterData(f), q);
-			VertDataAdd(FACE_getCenterData(f), r);
-			VertDataMulN(FACE_getCenterData(f), 1.0f/f->numVerts);
-
-			for (S=0; S<f->numVerts; S++) {
-					/* interior face shift
-					 *  o old interior face point (shifting)
-					 *  o new interior edge midpoints
-					 *  o new interior face midpoints
-					 */
-				for (x=1; x<gridSize-1; x++) {
-					for (y=1; y<gridSize-1; y++) {
-						int fx = x*2;
-						int fy = y*2;
-						void *co = FACE_getIFCo(f, curLvl, S, x, y);
-						void *nCo = FACE_getIFCo(f, nextLvl, S, fx, fy);
-						
-						VertDataAvg4(q, FACE_getIFCo(f, nextLvl, S, fx-1, fy-1),
-							FACE_getIFCo(f, nextLvl, S, fx+1, fy-1),
-							FACE_getIFCo(f, nextLvl, S, fx+1, fy+1),
-							FACE_getIFCo(f, nextLvl, S, fx-1, fy+1));
-
-						VertDataAvg4(r, FACE_getIFCo(f, nextLvl, S, fx-1, fy+0),
-							FACE_getIFCo(f, nextLvl, S, fx+1, fy+0),
-							FACE_getIFCo(f, nextLvl, S, fx+0, fy-1),
-							FACE_getIFCo(f, nextLvl, S, fx+0, fy+1));
-
-						VertDataCopy(nCo, co);
-						VertDataSub(nCo, q);
-						VertDataMulN(nCo, 0.25f);
-						VertDataAdd(nCo, r);
-					}
-				}
-
-					/* interior edge interior shift
-					 *  o old interior edge point (shifting)
-					 *  o new interior edge midpoints
-					 *  o new interior face midpoints
-					 */
-				for (x=1; x<gridSize-1; x++) {
+			for (x=1; x<gridSize-1; x++) {
+				for (y=1; y<gridSize-1; y++) {
 					int fx = x*2;
-					void *co = FACE_getIECo(f, curLvl, S, x);
-					void *nCo = FACE_getIECo(f, nextLvl, S, fx);
+					int fy = y*2;
+					void *co = FACE_getIFCo(f, curLvl, S, x, y);
+					void *nCo = FACE_getIFCo(f, nextLvl, S, fx, fy);
 					
-					VertDataAvg4(q, FACE_getIFCo(f, nextLvl, (S+1)%f->numVerts, 1, fx-1),
-						FACE_getIFCo(f, nextLvl, (S+1)%f->numVerts, 1, fx+1),
-						FACE_getIFCo(f, nextLvl, S, fx+1, +1),
-						FACE_getIFCo(f, nextLvl, S, fx-1, +1));
+					VertDataAvg4(q, FACE_getIFCo(f, nextLvl, S, fx-1, fy-1),
+						FACE_getIFCo(f, nextLvl, S, fx+1, fy-1),
+						FACE_getIFCo(f, nextLvl, S, fx+1, fy+1),
+						FACE_getIFCo(f, nextLvl, S, fx-1, fy+1));
 
-					VertDataAvg4(r, FACE_getIECo(f, nextLvl, S, fx-1),
-						FACE_getIECo(f, nextLvl, S, fx+1),
-						FACE_getIFCo(f, nextLvl, (S+1)%f->numVerts, 1, fx),
-						FACE_getIFCo(f, nextLvl, S, fx, 1));
+					VertDataAvg4(r, FACE_getIFCo(f, nextLvl, S, fx-1, fy+0),
+						FACE_getIFCo(f, nextLvl, S, fx+1, fy+0),
+						FACE_getIFCo(f, nextLvl, S, fx+0, fy-1),
+						FACE_getIFCo(f, nextLvl, S, fx+0, fy+1));
 
 					VertDataCopy(nCo, co);
 					VertDataSub(nCo, q);
@@ -1798,111 +1955,140 @@ static void ccgSubSurf__calcSubdivLevel(CCGSubSurf *ss,
 					VertDataAdd(nCo, r);
 				}
 			}
-		}
 
-		#pragma omp critical
-		{
-			MEM_freeN(q);
-			MEM_freeN(r);
+				/* interior edge interior shift
+				 *  o old interior edge point (shifting)
+				 *  o new interior edge midpoints
+				 *  o new interior face midpoints
+				 */
+			for (x=1; x<gridSize-1; x++) {
+				int fx = x*2;
+				void *co = FACE_getIECo(f, curLvl, S, x);
+				void *nCo = FACE_getIECo(f, nextLvl, S, fx);
+				
+				VertDataAvg4(q, FACE_getIFCo(f, nextLvl, (S+1)%f->numVerts, 1, fx-1),
+					FACE_getIFCo(f, nextLvl, (S+1)%f->numVerts, 1, fx+1),
+					FACE_getIFCo(f, nextLvl, S, fx+1, +1),
+					FACE_getIFCo(f, nextLvl, S, fx-1, +1));
+
+				VertDataAvg4(r, FACE_getIECo(f, nextLvl, S, fx-1),
+					FACE_getIECo(f, nextLvl, S, fx+1),
+					FACE_getIFCo(f, nextLvl, (S+1)%f->numVerts, 1, fx),
+					FACE_getIFCo(f, nextLvl, S, fx, 1));
+
+				VertDataCopy(nCo, co);
+				VertDataSub(nCo, q);
+				VertDataMulN(nCo, 0.25f);
+				VertDataAdd(nCo, r);
+			}
 		}
 	}
+}
+	/* copy down, curLvl is the level that was computed */
+static void ccgSubSurf__copyEdgeEndsPass(CCGPassData *data, int start, int end, void *UNUSED(q), void *UNUSED(r)) {
+	CCGSubSurf *ss = data->ss;
+	int vertDataSize = ss->meshIFC.vertDataSize;
+	int lvl = data->curLvl;
+	int edgeSize = 1 + (1<<lvl);
+	int i;
 
-		/* copy down */
-	edgeSize = 1 + (1<<(nextLvl));
-	gridSize = 1 + (1<<((nextLvl)-1));
-	cornerIdx = gridSize-1;
-
-	#pragma omp parallel for private(i) if(numEffectedF*edgeSize*edgeSize*4 >= CCG_OMP_LIMIT)
-	for (i=0; i<numEffectedE; i++) {
-		CCGEdge *e = effectedE[i];
-		VertDataCopy(EDGE_getCo(e, nextLvl, 0), VERT_getCo(e->v0, nextLvl));
-		VertDataCopy(EDGE_getCo(e, nextLvl, edgeSize-1), VERT_getCo(e->v1, nextLvl));
+	for (i=start; i<end; i++) {
+		CCGEdge *e = data->effectedE[i];
+		VertDataCopy(EDGE_getCo(e, lvl, 0), VERT_getCo(e->v0, lvl));
+		VertDataCopy(EDGE_getCo(e, lvl, edgeSize-1), VERT_getCo(e->v1, lvl));
 	}
+}
+static void ccgSubSurf__copyFaceBordersPass(CCGPassData *data, int start, int end, void *UNUSED(q), void *UNUSED(r)) {
+	CCGSubSurf *ss = data->ss;
+	int subdivLevels = ss->subdivLevels;
+	int vertDataSize = ss->meshIFC.vertDataSize;
+	int lvl = data->curLvl;
+	int gridSize = 1 + (1<<(lvl-1));
+	int cornerIdx = gridSize-1;
+	int i;
 
-	#pragma omp parallel for private(i) if(numEffectedF*edgeSize*edgeSize*4 >= CCG_OMP_LIMIT)
-	for (i=0; i<numEffectedF; i++) {
-		CCGFace *f = effectedF[i];
+	for (i=start; i<end; i++) {
+		CCGFace *f = data->effectedF[i];
 		int S, x;
 
 		for (S=0; S<f->numVerts; S++) {
 			CCGEdge *e = FACE_getEdges(f)[S];
 			CCGEdge *prevE = FACE_getEdges(f)[(S+f->numVerts-1)%f->numVerts];
 
-			VertDataCopy(FACE_getIFCo(f, nextLvl, S, 0, 0), FACE_getCenterData(f));
-			VertDataCopy(FACE_getIECo(f, nextLvl, S, 0), FACE_getCenterData(f));
-			VertDataCopy(FACE_getIFCo(f, nextLvl, S, cornerIdx, cornerIdx), VERT_getCo(FACE_getVerts(f)[S], nextLvl));
-			VertDataCopy(FACE_getIECo(f, nextLvl, S, cornerIdx), EDGE_getCo(FACE_getEdges(f)[S], nextLvl, cornerIdx));
+			VertDataCopy(FACE_getIFCo(f, lvl, S, 0, 0), FACE_getCenterData(f));
+			VertDataCopy(FACE_getIECo(f, lvl, S, 0), FACE_getCenterData(f));
+			VertDataCopy(FACE_getIFCo(f, lvl, S, cornerIdx, cornerIdx), VERT_getCo(FACE_getVerts(f)[S], lvl));
+			VertDataCopy(FACE_getIECo(f, lvl, S, cornerIdx), EDGE_getCo(FACE_getEdges(f)[S], lvl, cornerIdx));
 			for (x=1; x<gridSize-1; x++) {
-				void *co = FACE_getIECo(f, nextLvl, S, x);
-				VertDataCopy(FACE_getIFCo(f, nextLvl, S, x, 0), co);
-				VertDataCopy(FACE_getIFCo(f, nextLvl, (S+1)%f->numVerts, 0, x), co);
+				void *co = FACE_getIECo(f, lvl, S, x);
+				VertDataCopy(FACE_getIFCo(f, lvl, S, x, 0), co);
+				VertDataCopy(FACE_getIFCo(f, lvl, (S+1)%f->numVerts, 0, x), co);
 			}
 			for (x=0; x<gridSize-1; x++) {
 				int eI = gridSize-1-x;
-				VertDataCopy(FACE_getIFCo(f, nextLvl, S, cornerIdx, x), _edge_getCoVert(e, FACE_getVerts(f)[S], nextLvl, eI,vertDataSize));
-				VertDataCopy(FACE_getIFCo(f, nextLvl, S, x, cornerIdx), _edge_getCoVert(prevE, FACE_getVerts(f)[S], nextLvl, eI,vertDataSize));
+				VertDataCopy(FACE_getIFCo(f, lvl, S, cornerIdx, x), _edge_getCoVert(e, FACE_getVerts(f)[S], lvl, eI,vertDataSize));
+				VertDataCopy(FACE_getIFCo(f, lvl, S, x, cornerIdx), _edge_getCoVert(prevE, FACE_getVerts(f)[S], lvl, eI,vertDataSize));
 			}
 		}
 	}
 }
+static void ccgSubSurf__calcSubdivLevel(CCGSubSurf *ss,
+	CCGVert **effectedV, CCGEdge **effectedE, CCGFace **effectedF,
+	int numEffectedV, int numEffectedE, int numEffectedF, int curLvl) {
+	CCGPassData data;
+	int edgeSize = 1 + (1<<curLvl);
+	int work = numEffectedF*edgeSize*edgeSize*4;
+
+	data.ss = ss;
+	data.effectedV = effectedV;
+	data.effectedE = effectedE;
+	data.effectedF = effectedF;
+	data.numEffectedV = numEffectedV;
+	data.numEffectedE = numEffectedE;
+	data.numEffectedF = numEffectedF;
+	data.curLvl = curLvl;
+
+	ccgSubSurf__runPass(&data, ccgSubSurf__subdivFaceMidPass, numEffectedF, work);
+	ccgSubSurf__runPass(&data, ccgSubSurf__subdivEdgeMidPass, numEffectedE, work);
+	ccgSubSurf__runPass(&data, ccgSubSurf__subdivVertPass, numEffectedV, work);
+	ccgSubSurf__runPass(&data, ccgSubSurf__subdivEdgeShiftPass, numEffectedE, work);
+	ccgSubSurf__runPass(&data, ccgSubSurf__subdivFaceShiftPass, numEffectedF, work);
 
+		/* copy down */
+	data.curLvl = curLvl+1;
+	edgeSize = 1 + (1<<(curLvl+1));
+	work = numEffectedF*edgeSize*edgeSize*4;
 
-static void ccgSubSurf__sync(CCGSubSurf *ss) {
-	CCGVert **effectedV;
-	CCGEdge **effectedE;
-	CCGFace **effectedF;
-	int numEffectedV, numEffectedE, numEffectedF;
-	int subdivLevels = ss->subdivLevels;
-	int vertDataSize = ss->meshIFC.vertDataSize;
-	int i, j, ptrIdx, S;
-	int curLvl, nextLvl;
-	void *q = ss->q, *r = ss->r;
-
-	effectedV = MEM_mallocN(sizeof(*effectedV)*ss->vMap->numEntries, "CCGSubsurf effectedV");
-	effectedE = MEM_mallocN(sizeof(*effectedE)*ss->eMap->numEntries, "CCGSubsurf effectedE");
-	effectedF = MEM_mallocN(sizeof(*effectedF)*ss->fMap->numEntries, "CCGSubsurf effectedF");
-	numEffectedV = numEffectedE = numEffectedF = 0;
-	for (i=0; i<ss->vMap->curSize; i++) {
-		CCGVert *v = (CCGVert*) ss->vMap->buckets[i];
-		for (; v; v = v->next) {
-			if (v->flags&Vert_eEffected) {
-				effectedV[numEffectedV++] = v;
-
-				for (j=0; j<v->numEdges; j++) {
-					CCGEdge *e = v->edges[j];
-					if (!(e->flags&Edge_eEffected)) {
-						effectedE[numEffectedE++] = e;
-						e->flags |= Edge_eEffected;
-					}
-				}
-
-				for (j=0; j<v->numFaces; j++) {
-					CCGFace *f = v->faces[j];
-					if (!(f->flags&Face_eEffected)) {
-						effectedF[numEffectedF++] = f;
-						f->flags |= Face_eEffected;
-					}
-				}
-			}
-		}
-	}
+	ccgSubSurf__runPass(&data, ccgSubSurf__copyEdgeEndsPass, numEffectedE, work);
+	ccgSubSurf__runPass(&data, ccgSubSurf__copyFaceBordersPass, numEffectedF, work);
+}
 
-	curLvl = 0;
-	nextLvl = curLvl+1;
+	/* the first level is computed from the base mesh */
+static void ccgSubSurf__baseFacePass(CCGPassData *data, int start, int end, void *UNUSED(q), void *UNUSED(r)) {
+	CCGSubSurf *ss = data->ss;
+	int vertDataSize = ss->meshIFC.vertDataSize;
+	int ptrIdx, i;
 
-	for (ptrIdx=0; ptrIdx<numEffectedF; ptrIdx++) {
-		CCGFace *f = effectedF[ptrIdx];
+	for (ptrIdx=start; ptrIdx<end; ptrIdx++) {
+		CCGFace *f = data->effectedF[ptrIdx];
 		void *co = FACE_getCenterData(f);
 		VertDataZero(co);
 		for (i=0; i<f->numVerts; i++) {
-			VertDataAdd(co, VERT_getCo(FACE_getVerts(f)[i], curLvl));
+			VertDataAdd(co, VERT_getCo(FACE_getVerts(f)[i], 0));
 		}
 		VertDataMulN(co, 1.0f/f->numVerts);
 
 		f->flags = 0;
 	}
-	for (ptrIdx=0; ptrIdx<numEffectedE; ptrIdx++) {
-		CCGEdge *e = effectedE[ptrIdx];
+}
+static void ccgSubSurf__baseEdgePass(CCGPassData *data, int start, int end, void *q, void *r) {
+	CCGSubSurf *ss = data->ss;
+	int vertDataSize = ss->meshIFC.vertDataSize;
+	int curLvl = 0, nextLvl = 1;
+	int ptrIdx, i;
+
+	for (ptrIdx=start; ptrIdx<end; ptrIdx++) {
+		CCGEdge *e = data->effectedE[ptrIdx];
 		void *co = EDGE_getCo(e, nextLvl, 1);
 		float sharpness = EDGE_getSharpness(e, curLvl);
 
@@ -1933,8 +2119,15 @@ static void ccgSubSurf__sync(CCGSubSurf *ss) {
 
 		// edge flags cleared later
 	}
-	for (ptrIdx=0; ptrIdx<numEffectedV; ptrIdx++) {
-		CCGVert *v = effectedV[ptrIdx];
+}
+static void ccgSubSurf__baseVertPass(CCGPassData *data, int start, int end, void *q, void *r) {
+	CCGSubSurf *ss = data->ss;
+	int vertDataSize = ss->meshIFC.vertDataSize;
+	int curLvl = 0, nextLvl = 1;
+	int ptrIdx, i;
+
+	for (ptrIdx=start; ptrIdx<end; ptrIdx++) {
+		CCGVert *v = data->effectedV[ptrIdx];
 		void *co = VERT_getCo(v, curLvl);
 		void *nCo = VERT_getCo(v, nextLvl);
 		int sharpCount = 0, allSharp = 1;
@@ -2056,6 +2249,60 @@ static void ccgSubSurf__sync(CCGSubSurf *ss) {
 
 		// vert flags cleared later
 	}
+}
+static void ccgSubSurf__sync(CCGSubSurf *ss) {
+	CCGVert **effectedV;
+	CCGEdge **effectedE;
+	CCGFace **effectedF;
+	CCGPassData data;
+	int numEffectedV, numEffectedE, numEffectedF;
+	int subdivLevels = ss->subdivLevels;
+	int i, j, ptrIdx, curLvl, work;
+
+	effectedV = MEM_mallocN(sizeof(*effectedV)*ss->vMap->numEntries, "CCGSubsurf effectedV");
+	effectedE = MEM_mallocN(sizeof(*effectedE)*ss->eMap->numEntries, "CCGSubsurf effectedE");
+	effectedF = MEM_mallocN(sizeof(*effectedF)*ss->fMap->numEntries, "CCGSubsurf effectedF");
+	numEffectedV = numEffectedE = numEffectedF = 0;
+	for (i=0; i<ss->vMap->curSize; i++) {
+		CCGVert *v = (CCGVert*) ss->vMap->buckets[i];
+		for (; v; v = v->next) {
+			if (v->flags&Vert_eEffected) {
+				effectedV[numEffectedV++] = v;
+
+				for (j=0; j<v->numEdges; j++) {
+					CCGEdge *e = v->edges[j];
+					if (!(e->flags&Edge_eEffected)) {
+						effectedE[numEffectedE++] = e;
+						e->flags |= Edge_eEffected;
+					}
+				}
+
+				for (j=0; j<v->numFaces; j++) {
+					CCGFace *f = v->faces[j];
+					if (!(f->flags&Face_eEffected)) {
+						effectedF[numEffectedF++] = f;
+						f->flags |= Face_eEffected;
+					}
+				}
+			}
+		}
+	}
+
+	data.ss = ss;
+	data.effectedV = effectedV;
+	data.effectedE = effectedE;
+	data.effectedF = effectedF;
+	data.numEffectedV = numEffectedV;
+	data.numEffectedE = numEffectedE;
+	data.numEffectedF = numEffectedF;
+	data.curLvl = 1;
+
+	/* level 1 has edgeSize 3 */
+	work = numEffectedF*3*3*4;
+
+	ccgSubSurf__runPass(&data, ccgSubSurf__baseFacePass, numEffectedF, work);
+	ccgSubSurf__runPass(&data, ccgSubSurf__baseEdgePass, numEffectedE, work);
+	ccgSubSurf__runPass(&data, ccgSubSurf__baseVertPass, numEffectedV, work);
 
 	if (ss->useAgeCounts) {
 		for (i=0; i<numEffectedV; i++) {
@@ -2077,26 +2324,9 @@ static void ccgSubSurf__sync(CCGSubSurf *ss) {
 		}
 	}
 
-	for (i=0; i<numEffectedE; i++) {
-		CCGEdge *e = effectedE[i];
-		VertDataCopy(EDGE_getCo(e, nextLvl, 0), VERT_getCo(e->v0, nextLvl));
-		VertDataCopy(EDGE_getCo(e, nextLvl, 2), VERT_getCo(e->v1, nextLvl));
-	}
-	for (i=0; i<numEffectedF; i++) {
-		CCGFace *f = effectedF[i];
-		for (S=0; S<f->numVerts; S++) {
-			CCGEdge *e = FACE_getEdges(f)[S];
-			CCGEdge *prevE = FACE_getEdges(f)[(S+f->numVerts-1)%f->numVerts];
-
-			VertDataCopy(FACE_getIFCo(f, nextLvl, S, 0, 0), FACE_getCenterData(f));
-			VertDataCopy(FACE_getIECo(f, nextLvl, S, 0), FACE_getCenterData(f));
-			VertDataCopy(FACE_getIFCo(f, nextLvl, S, 1, 1), VERT_getCo(FACE_getVerts(f)[S], nextLvl));
-			VertDataCopy(FACE_getIECo(f, nextLvl, S, 1), EDGE_getCo(FACE_getEdges(f)[S], nextLvl, 1));
-
-			VertDataCopy(FACE_getIFCo(f, nextLvl, S, 1, 0), _edge_getCoVert(e, FACE_getVerts(f)[S], nextLvl, 1, vertDataSize));
-			VertDataCopy(FACE_getIFCo(f, nextLvl, S, 0, 1), _edge_getCoVert(prevE, FACE_getVerts(f)[S], nextLvl, 1, vertDataSize));
-		}
-	}
+	/* same as the copy down of other levels */
+	ccgSubSurf__runPass(&data, ccgSubSurf__copyEdgeEndsPass, numEffectedE, work);
+	ccgSubSurf__runPass(&data, ccgSubSurf__copyFaceBordersPass, numEffectedF, work);
 
 	for (curLvl=1; curLvl<subdivLevels; curLvl++) {
 		ccgSubSurf__calcSubdivLevel(ss,
@@ -2473,6 +2703,642 @@ CCGError ccgSubSurf_updateLevels(CCGSubSurf *ss, int lvl, CCGFace **effectedF, i
 	return eCCGError_None;
 }
 
+/*** Stencils ***/
+
+/* For a fixed topology and creases subdivision is linear in the positions
+ * of the base verts, every vertex of the highest level is a weighted sum of
+ * a few base verts, its stencil. Animated meshes that keep their topology
+ * are evaluated as these sums instead of subdividing level by level.
+ *
+ * The weights are found by subdividing probe positions. Base verts that
+ * can't influence the same element get the same color, a probe sets the
+ * coordinates of three colors to one and everything else to zero, so every
+ * coordinate of a result is the weight of the base vert with that color in
+ * the support of the element. Only the highest level is evaluated, lower
+ * levels of verts and edges keep the data of the last sync. */
+
+typedef struct _CCGStencilVert CCGStencilVert;
+struct _CCGStencilVert {
+	CCGStencilVert	*next;	/* EHData.next */
+	CCGVert			*v;		/* EHData.key */
+
+	int index;
+};
+
+struct _CCGStencils {
+	CCGVert **verts;
+	CCGEdge **edges;
+	CCGFace **faces;
+	int numVerts, numEdges, numFaces;
+
+		// stencils of all verts, then edges, then faces
+	int numStencils;
+	int *faceOffsets;
+
+		// entries of stencil n are offsets[n] to offsets[n+1]
+	int *offsets;
+	int *index;
+	float *weight;
+
+		// base positions, padded for SSE
+	float (*co)[4];
+};
+
+typedef struct CCGStencilBuild {
+	EHash *vertHash;
+	CCGStencilVert *stencilVerts;
+
+		// verts sharing an edge or face with a vert, including itself
+	int *neighbourOffsets, *neighbourIndex;
+	int *color, numColors;
+
+	int *entryStencil, *entryIndex;
+	float *entryWeight;
+	int numEntries, lenEntries;
+} CCGStencilBuild;
+
+#define STENCIL_getEdgeNum(ss)		((1<<(ss)->subdivLevels) - 1)
+
+static float *ccgSubSurf__stencilFaceCo(CCGSubSurf *ss, CCGFace *f, int n) {
+	int subdivLevels = ss->subdivLevels;
+	int vertDataSize = ss->meshIFC.vertDataSize;
+	int len = (1<<(subdivLevels-1)) - 1;
+	int S, x, y;
+
+		/* center, then per grid the interior edge and grid interior,
+		 * borders are copied from other elements */
+	if (n==0)
+		return (float*) FACE_getCenterData(f);
+
+	n--;
+	S = n/(len + len*len);
+	n -= S*(len + len*len);
+
+	if (n<len)
+		return FACE_getIECo(f, subdivLevels, S, n+1);
+
+	n -= len;
+	x = n%len + 1;
+	y = n/len + 1;
+
+	return FACE_getIFCo(f, subdivLevels, S, x, y);
+}
+
+	/* face of face stencil n */
+static int ccgSubSurf__stencilFaceIndex(CCGStencils *st, int n) {
+	int first = 0, last = st->numFaces-1;
+
+	while (first<last) {
+		int mid = (first + last + 1)/2;
+
+		if (st->faceOffsets[mid]<=n)
+			first = mid;
+		else
+			last = mid-1;
+	}
+
+	return first;
+}
+
+static float *ccgSubSurf__stencilCo(CCGSubSurf *ss, int n) {
+	CCGStencils *st = ss->stencils;
+	int subdivLevels = ss->subdivLevels;
+	int vertDataSize = ss->meshIFC.vertDataSize;
+	int edgeNum = STENCIL_getEdgeNum(ss);
+	int first;
+
+	if (n<st->numVerts)
+		return VERT_getCo(st->verts[n], subdivLevels);
+
+	n -= st->numVerts;
+	if (n<st->numEdges*edgeNum)
+		return EDGE_getCo(st->edges[n/edgeNum], subdivLevels, n%edgeNum + 1);
+
+	n += st->numVerts;
+	first = ccgSubSurf__stencilFaceIndex(st, n);
+
+	return ccgSubSurf__stencilFaceCo(ss, st->faces[first], n - st->faceOffsets[first]);
+}
+
+static CCG_INLINE void ccgSubSurf__evalStencil(CCGStencils *st, int n, float *co) {
+	int i, end = st->offsets[n+1];
+#ifdef __SSE__
+	__m128 sum = _mm_setzero_ps();
+	float result[4];
+
+	for (i=st->offsets[n]; i<end; i++)
+		sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set_ps1(st->weight[i]), _mm_loadu_ps(st->co[st->index[i]])));
+
+	_mm_storeu_ps(result, sum);
+	co[0] = result[0];
+	co[1] = result[1];
+	co[2] = result[2];
+#else
+	float x = 0.0f, y = 0.0f, z = 0.0f;
+
+	for (i=st->offsets[n]; i<end; i++) {
+		float w = st->weight[i];
+		float *vco = st->co[st->index[i]];
+
+		x += w*vco[0];
+		y += w*vco[1];
+		z += w*vco[2];
+	}
+
+	co[0] = x;
+	co[1] = y;
+	co[2] = z;
+#endif
+}
+
+	/* stencils of verts, edges and faces write different data, so one pass
+	 * over all stencils splits them in ranges of the same work */
+static void ccgSubSurf__stencilPass(CCGPassData *data, int start, int end, void *UNUSED(q), void *UNUSED(r)) {
+	CCGSubSurf *ss = data->ss;
+	CCGStencils *st = ss->stencils;
+	int subdivLevels = ss->subdivLevels;
+	int vertDataSize = ss->meshIFC.vertDataSize;
+	int edgeNum = STENCIL_getEdgeNum(ss);
+	int numVertEdge = st->numVerts + st->numEdges*edgeNum;
+	int n, i;
+
+	for (n=start; n<end && n<st->numVerts; n++)
+		ccgSubSurf__evalStencil(st, n, VERT_getCo(st->verts[n], subdivLevels));
+
+	for (; n<end && n<numVertEdge; n++) {
+		i = n - st->numVerts;
+		ccgSubSurf__evalStencil(st, n, EDGE_getCo(st->edges[i/edgeNum], subdivLevels, i%edgeNum + 1));
+	}
+
+	if (n<end) {
+		i = ccgSubSurf__stencilFaceIndex(st, n);
+
+		for (; n<end; n++) {
+			while (st->faceOffsets[i+1]<=n)
+				i++;
+
+			ccgSubSurf__evalStencil(st, n, ccgSubSurf__stencilFaceCo(ss, st->faces[i], n - st->faceOffsets[i]));
+		}
+	}
+}
+
+static void ccgSubSurf__stencilVertFree(EHEntry *UNUSED(entry), void *UNUSED(userData)) {
+	/* entries are freed as one array */
+}
+
+static int ccgSubSurf__stencilVertIndex(CCGStencilBuild *build, CCGVert *v) {
+	return ((CCGStencilVert*) _ehash_lookup(build->vertHash, v))->index;
+}
+
+static void ccgSubSurf__stencilAddNeighbour(CCGStencilBuild *build, int *stamp, int mark, int ni, int *tot) {
+	if (stamp[ni]!=mark) {
+		stamp[ni] = mark;
+		if (build->neighbourIndex)
+			build->neighbourIndex[*tot] = ni;
+		(*tot)++;
+	}
+}
+
+static void ccgSubSurf__stencilNeighbours(CCGSubSurf *ss, CCGStencilBuild *build) {
+	CCGStencils *st = ss->stencils;
+	int *stamp = MEM_callocN(sizeof(*stamp)*st->numVerts, "CCGSubsurf stencil stamp");
+	int pass, i, j, k, tot = 0;
+
+	build->neighbourOffsets = MEM_mallocN(sizeof(int)*(st->numVerts+1), "CCGSubsurf stencil neighbourOffsets");
+	build->neighbourIndex = NULL;
+
+		/* count, then fill in */
+	for (pass=0; pass<2; pass++) {
+		tot = 0;
+
+		for (i=0; i<st->numVerts; i++) {
+			CCGVert *v = st->verts[i];
+			int mark = pass*st->numVerts + i+1;
+
+			build->neighbourOffsets[i] = tot;
+
+			ccgSubSurf__stencilAddNeighbour(build, stamp, mark, i, &tot);
+			for (j=0; j<v->numEdges; j++) {
+				CCGVert *oV = _edge_getOtherVert(v->edges[j], v);
+				ccgSubSurf__stencilAddNeighbour(build, stamp, mark, ccgSubSurf__stencilVertIndex(build, oV), &tot);
+			}
+			for (j=0; j<v->numFaces; j++) {
+				CCGFace *f = v->faces[j];
+				for (k=0; k<f->numVerts; k++)
+					ccgSubSurf__stencilAddNeighbour(build, stamp, mark, ccgSubSurf__stencilVertIndex(build, FACE_getVerts(f)[k]), &tot);
+			}
+		}
+
+		build->neighbourOffsets[st->numVerts] = tot;
+
+		if (pass==0)
+			build->neighbourIndex = MEM_mallocN(sizeof(int)*tot, "CCGSubsurf stencil neighbourIndex");
+	}
+
+	MEM_freeN(stamp);
+}
+
+	/* the support of a face is the neighbours of its verts, so verts within
+	 * three steps of each other can be in the same support and need a
+	 * different color */
+static void ccgSubSurf__stencilColors(CCGSubSurf *ss, CCGStencilBuild *build) {
+	CCGStencils *st = ss->stencils;
+	int *stamp = MEM_callocN(sizeof(*stamp)*st->numVerts, "CCGSubsurf stencil stamp");
+	int *colorStamp = MEM_callocN(sizeof(*colorStamp)*(st->numVerts+1), "CCGSubsurf stencil colorStamp");
+	int *queue = MEM_mallocN(sizeof(*queue)*st->numVerts, "CCGSubsurf stencil queue");
+	int i, j, c, step, len, first, last;
+
+	build->color = MEM_mallocN(sizeof(int)*st->numVerts, "CCGSubsurf stencil color");
+	build->numColors = 0;
+
+	for (i=0; i<st->numVerts; i++)
+		build->color[i] = -1;
+
+	for (i=0; i<st->numVerts; i++) {
+		queue[0] = i;
+		stamp[i] = i+1;
+		len = 1;
+		first = 0;
+
+		for (step=0; step<3; step++) {
+			last = len;
+
+			for (; first<last; first++) {
+				int vi = queue[first];
+
+				for (j=build->neighbourOffsets[vi]; j<build->neighbourOffsets[vi+1]; j++) {
+					int ni = build->neighbourIndex[j];
+
+					if (stamp[ni]!=i+1) {
+						stamp[ni] = i+1;
+						queue[len++] = ni;
+					}
+				}
+			}
+		}
+
+		for (j=1; j<len; j++)
+			if (build->color[queue[j]]!=-1)
+				colorStamp[build->color[queue[j]]] = i+1;
+
+		for (c=0; colorStamp[c]==i+1; c++);
+
+		build->color[i] = c;
+		if (c>=build->numColors)
+			build->numColors = c+1;
+	}
+
+	MEM_freeN(queue);
+	MEM_freeN(colorStamp);
+	MEM_freeN(stamp);
+}
+
+	/* base verts of colors color to color+2 that are neighbours of vi */
+static void ccgSubSurf__stencilSupport(CCGStencilBuild *build, int vi, int color, int *found) {
+	int i;
+
+	for (i=build->neighbourOffsets[vi]; i<build->neighbourOffsets[vi+1]; i++) {
+		int ni = build->neighbourIndex[i];
+		int c = build->color[ni] - color;
+
+		if (c>=0 && c<3)
+			found[c] = ni;
+	}
+}
+
+	/* adds the weights of a probe result, fails when the result depends
+	 * on a vert outside of the support */
+static int ccgSubSurf__stencilProbeRead(CCGStencilBuild *build, int n, float *co, int *found) {
+	int k;
+
+	for (k=0; k<3; k++) {
+		if (co[k]==0.0f)
+			continue;
+		if (found[k]==-1)
+			return 0;
+
+		if (build->numEntries==build->lenEntries) {
+			build->lenEntries *= 2;
+			build->entryStencil = MEM_reallocN(build->entryStencil, sizeof(int)*build->lenEntries);
+			build->entryIndex = MEM_reallocN(build->entryIndex, sizeof(int)*build->lenEntries);
+			build->entryWeight = MEM_reallocN(build->entryWeight, sizeof(float)*build->lenEntries);
+		}
+
+		build->entryStencil[build->numEntries] = n;
+		build->entryIndex[build->numEntries] = found[k];
+		build->entryWeight[build->numEntries] = co[k];
+		build->numEntries++;
+	}
+
+	return 1;
+}
+
+static int ccgSubSurf__stencilProbe(CCGSubSurf *ss, CCGStencilBuild *build, int color) {
+	CCGStencils *st = ss->stencils;
+	int subdivLevels = ss->subdivLevels;
+	int vertDataSize = ss->meshIFC.vertDataSize;
+	int edgeNum = STENCIL_getEdgeNum(ss);
+	int i, j, k, n = 0;
+
+	for (i=0; i<st->numVerts; i++) {
+		CCGVert *v = st->verts[i];
+		float *co = VERT_getCo(v, 0);
+
+		for (k=0; k<3; k++)
+			co[k] = (build->color[i]==color+k)? 1.0f: 0.0f;
+
+		v->flags = Vert_eEffected;
+	}
+
+	ccgSubSurf__sync(ss);
+
+	for (i=0; i<st->numVerts; i++) {
+		int found[3] = {-1, -1, -1};
+
+		ccgSubSurf__stencilSupport(build, i, color, found);
+
+		if (!ccgSubSurf__stencilProbeRead(build, n++, VERT_getCo(st->verts[i], subdivLevels), found))
+			return 0;
+	}
+
+	for (i=0; i<st->numEdges; i++) {
+		CCGEdge *e = st->edges[i];
+		int found[3] = {-1, -1, -1};
+
+		ccgSubSurf__stencilSupport(build, ccgSubSurf__stencilVertIndex(build, e->v0), color, found);
+		ccgSubSurf__stencilSupport(build, ccgSubSurf__stencilVertIndex(build, e->v1), color, found);
+
+		for (j=0; j<edgeNum; j++)
+			if (!ccgSubSurf__stencilProbeRead(build, n++, EDGE_getCo(e, subdivLevels, j+1), found))
+				return 0;
+	}
+
+	for (i=0; i<st->numFaces; i++) {
+		CCGFace *f = st->faces[i];
+		int found[3] = {-1, -1, -1};
+
+		for (j=0; j<f->numVerts; j++)
+			ccgSubSurf__stencilSupport(build, ccgSubSurf__stencilVertIndex(build, FACE_getVerts(f)[j]), color, found);
+
+		for (j=0; j<st->faceOffsets[i+1] - st->faceOffsets[i]; j++)
+			if (!ccgSubSurf__stencilProbeRead(build, n++, ccgSubSurf__stencilFaceCo(ss, f, j), found))
+				return 0;
+	}
+
+	return 1;
+}
+
+static void ccgSubSurf__stencilBuildFree(CCGStencilBuild *build) {
+	if (build->vertHash) _ehash_free(build->vertHash, ccgSubSurf__stencilVertFree, NULL);
+	if (build->stencilVerts) MEM_freeN(build->stencilVerts);
+	if (build->neighbourOffsets) MEM_freeN(build->neighbourOffsets);
+	if (build->neighbourIndex) MEM_freeN(build->neighbourIndex);
+	if (build->color) MEM_freeN(build->color);
+	if (build->entryStencil) MEM_freeN(build->entryStencil);
+	if (build->entryIndex) MEM_freeN(build->entryIndex);
+	if (build->entryWeight) MEM_freeN(build->entryWeight);
+}
+
+/* Builds the stencils of the current topology, from the synced data. This
+ * costs about one sync per three colors, a few tens for regular meshes, and
+ * memory for ~10 weights per vertex of the highest level. Fails for meshes
+ * that subdivide to verts outside of the expected support, then a full sync
+ * has to be done every time until the subdivision levels change. */
+CCGError ccgSubSurf_buildStencils(CCGSubSurf *ss) {
+	CCGStencils *st;
+	CCGStencilBuild build;
+	float (*ref)[3];
+	float maxCo = 0.0f;
+	int subdivLevels = ss->subdivLevels;
+	int vertDataSize = ss->meshIFC.vertDataSize;
+	int calcVertNormals = ss->calcVertNormals;
+	int faceNum = (1<<(subdivLevels-1)) - 1;
+	int i, j, k, n, color, success = 1;
+	int *cursor;
+
+	if (ss->syncState!=eSyncState_None) {
+		return eCCGError_InvalidSyncState;
+	} else if (ss->stencilsFailed) {
+		return eCCGError_InvalidValue;
+	} else if (ss->stencils) {
+		return eCCGError_None;
+	}
+
+	st = ss->stencils = MEM_callocN(sizeof(*st), "CCGSubsurf stencils");
+	memset(&build, 0, sizeof(build));
+
+	st->numVerts = ss->vMap->numEntries;
+	st->numEdges = ss->eMap->numEntries;
+	st->numFaces = ss->fMap->numEntries;
+	st->verts = MEM_mallocN(sizeof(*st->verts)*st->numVerts, "CCGSubsurf stencil verts");
+	st->edges = MEM_mallocN(sizeof(*st->edges)*st->numEdges, "CCGSubsurf stencil edges");
+	st->faces = MEM_mallocN(sizeof(*st->faces)*st->numFaces, "CCGSubsurf stencil faces");
+	st->faceOffsets = MEM_mallocN(sizeof(int)*(st->numFaces+1), "CCGSubsurf stencil faceOffsets");
+	st->co = MEM_mallocN(sizeof(*st->co)*st->numVerts, "CCGSubsurf stencil co");
+
+	build.vertHash = _ehash_new(st->numVerts, _getStandardAllocatorIFC(), NULL);
+	build.stencilVerts = MEM_mallocN(sizeof(*build.stencilVerts)*st->numVerts, "CCGSubsurf stencil vertHash");
+
+	for (i=0, n=0; i<ss->vMap->curSize; i++) {
+		CCGVert *v = (CCGVert*) ss->vMap->buckets[i];
+
+		for (; v; v = v->next, n++) {
+			st->verts[n] = v;
+			build.stencilVerts[n].v = v;
+			build.stencilVerts[n].index = n;
+			_ehash_insert(build.vertHash, (EHEntry*) &build.stencilVerts[n]);
+		}
+	}
+	for (i=0, n=0; i<ss->eMap->curSize; i++) {
+		CCGEdge *e = (CCGEdge*) ss->eMap->buckets[i];
+
+		for (; e; e = e->next)
+			st->edges[n++] = e;
+	}
+
+	n = st->numVerts + st->numEdges*STENCIL_getEdgeNum(ss);
+	for (i=0, j=0; i<ss->fMap->curSize; i++) {
+		CCGFace *f = (CCGFace*) ss->fMap->buckets[i];
+
+		for (; f; f = f->next, j++) {
+			st->faces[j] = f;
+			st->faceOffsets[j] = n;
+			n += 1 + f->numVerts*(faceNum + faceNum*faceNum);
+		}
+	}
+	st->faceOffsets[st->numFaces] = n;
+	st->numStencils = n;
+
+	ccgSubSurf__stencilNeighbours(ss, &build);
+	ccgSubSurf__stencilColors(ss, &build);
+
+		/* keep the synced result and positions to restore and verify */
+	ref = MEM_mallocN(sizeof(*ref)*st->numStencils, "CCGSubsurf stencil ref");
+	for (n=0; n<st->numStencils; n++) {
+		float *co = ccgSubSurf__stencilCo(ss, n);
+		ref[n][0] = co[0];
+		ref[n][1] = co[1];
+		ref[n][2] = co[2];
+	}
+	for (i=0; i<st->numVerts; i++) {
+		float *co = VERT_getCo(st->verts[i], 0);
+
+		for (k=0; k<3; k++) {
+			st->co[i][k] = co[k];
+			if (fabsf(co[k])>maxCo)
+				maxCo = fabsf(co[k]);
+		}
+		st->co[i][3] = 0.0f;
+	}
+
+	build.lenEntries = st->numStencils*4 + 16;
+	build.entryStencil = MEM_mallocN(sizeof(int)*build.lenEntries, "CCGSubsurf stencil entryStencil");
+	build.entryIndex = MEM_mallocN(sizeof(int)*build.lenEntries, "CCGSubsurf stencil entryIndex");
+	build.entryWeight = MEM_mallocN(sizeof(float)*build.lenEntries, "CCGSubsurf stencil entryWeight");
+
+	ss->calcVertNormals = 0;
+	for (color=0; color<build.numColors && success; color+=3)
+		success = ccgSubSurf__stencilProbe(ss, &build, color);
+	ss->calcVertNormals = calcVertNormals;
+
+	for (i=0; i<st->numVerts; i++) {
+		float *co = VERT_getCo(st->verts[i], 0);
+		co[0] = st->co[i][0];
+		co[1] = st->co[i][1];
+		co[2] = st->co[i][2];
+	}
+
+	if (success) {
+			/* entries sorted by stencil */
+		st->offsets = MEM_callocN(sizeof(int)*(st->numStencils+1), "CCGSubsurf stencil offsets");
+		st->index = MEM_mallocN(sizeof(int)*build.numEntries, "CCGSubsurf stencil index");
+		st->weight = MEM_mallocN(sizeof(float)*build.numEntries, "CCGSubsurf stencil weight");
+
+		for (i=0; i<build.numEntries; i++)
+			st->offsets[build.entryStencil[i]+1]++;
+		for (n=0; n<st->numStencils; n++)
+			st->offsets[n+1] += st->offsets[n];
+
+		cursor = MEM_mallocN(sizeof(int)*st->numStencils, "CCGSubsurf stencil cursor");
+		memcpy(cursor, st->offsets, sizeof(int)*st->numStencils);
+
+		for (i=0; i<build.numEntries; i++) {
+			j = cursor[build.entryStencil[i]]++;
+			st->index[j] = build.entryIndex[i];
+			st->weight[j] = build.entryWeight[i];
+		}
+
+		MEM_freeN(cursor);
+
+			/* same result as the sync up to float precision */
+		for (n=0; n<st->numStencils && success; n++) {
+			float co[3];
+
+			ccgSubSurf__evalStencil(st, n, co);
+
+			for (k=0; k<3; k++)
+				if (fabsf(co[k] - ref[n][k]) > 1e-4f*maxCo)
+					success = 0;
+		}
+	}
+
+	ccgSubSurf__stencilBuildFree(&build);
+	MEM_freeN(ref);
+
+		/* sync again, to leave the data as it was */
+	for (i=0; i<st->numVerts; i++)
+		st->verts[i]->flags = Vert_eEffected;
+	ccgSubSurf__sync(ss);
+
+	if (!success) {
+		ccgSubSurf_freeStencils(ss);
+		ss->stencilsFailed = 1;
+
+		return eCCGError_InvalidValue;
+	}
+
+	return eCCGError_None;
+}
+
+/* Subdivides the base vertex data, set as level 0 of ccgSubSurf_getVertLevelData,
+ * topology and creases have to be the same as when building. */
+CCGError ccgSubSurf_evalStencils(CCGSubSurf *ss) {
+	CCGStencils *st = ss->stencils;
+	CCGPassData data;
+	int subdivLevels = ss->subdivLevels;
+	int vertDataSize = ss->meshIFC.vertDataSize;
+	int i, work;
+
+	if (ss->syncState!=eSyncState_None) {
+		return eCCGError_InvalidSyncState;
+	} else if (!st) {
+		return eCCGError_InvalidValue;
+	}
+
+	for (i=0; i<st->numVerts; i++) {
+		float *co = VERT_getCo(st->verts[i], 0);
+		st->co[i][0] = co[0];
+		st->co[i][1] = co[1];
+		st->co[i][2] = co[2];
+	}
+
+	data.ss = ss;
+	data.effectedV = st->verts;
+	data.effectedE = st->edges;
+	data.effectedF = st->faces;
+	data.numEffectedV = st->numVerts;
+	data.numEffectedE = st->numEdges;
+	data.numEffectedF = st->numFaces;
+	data.curLvl = subdivLevels;
+
+	work = st->offsets[st->numStencils];
+
+	ccgSubSurf__runPass(&data, ccgSubSurf__stencilPass, st->numStencils, work);
+
+	ccgSubSurf__runPass(&data, ccgSubSurf__copyEdgeEndsPass, st->numEdges, work);
+	ccgSubSurf__runPass(&data, ccgSubSurf__copyFaceBordersPass, st->numFaces, work);
+
+	if (ss->calcVertNormals) {
+		for (i=0; i<st->numVerts; i++)
+			st->verts[i]->flags |= Vert_eEffected;
+		for (i=0; i<st->numEdges; i++)
+			st->edges[i]->flags |= Edge_eEffected;
+
+		ccgSubSurf__calcVertNormals(ss,
+			st->verts, st->edges, st->faces,
+			st->numVerts, st->numEdges, st->numFaces);
+
+		for (i=0; i<st->numVerts; i++)
+			st->verts[i]->flags = 0;
+		for (i=0; i<st->numEdges; i++)
+			st->edges[i]->flags = 0;
+	}
+
+	return eCCGError_None;
+}
+
+int ccgSubSurf_hasStencils(CCGSubSurf *ss) {
+	return ss->stencils != NULL;
+}
+
+void ccgSubSurf_freeStencils(CCGSubSurf *ss) {
+	CCGStencils *st = ss->stencils;
+
+	if (st) {
+		MEM_freeN(st->verts);
+		MEM_freeN(st->edges);
+		MEM_freeN(st->faces);
+		MEM_freeN(st->faceOffsets);
+		MEM_freeN(st->co);
+		if (st->offsets) MEM_freeN(st->offsets);
+		if (st->index) MEM_freeN(st->index);
+		if (st->weight) MEM_freeN(st->weight);
+		MEM_freeN(st);
+
+		ss->stencils = NULL;
+	}
+}
+
 #undef VERT_getCo
 #undef EDGE_getCo
 #undef FACE_getIECo
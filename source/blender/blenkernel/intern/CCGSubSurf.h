@@ -72,6 +72,11 @@ CCGError	ccgSubSurf_updateNormals(CCGSubSurf *ss, CCGFace **faces, int numFaces)
 CCGError	ccgSubSurf_updateLevels(CCGSubSurf *ss, int lvl, CCGFace **faces, int numFaces);
 CCGError	ccgSubSurf_stitchFaces(CCGSubSurf *ss, int lvl, CCGFace **faces, int numFaces);
 
+CCGError	ccgSubSurf_buildStencils	(CCGSubSurf *ss);
+CCGError	ccgSubSurf_evalStencils		(CCGSubSurf *ss);
+int			ccgSubSurf_hasStencils		(CCGSubSurf *ss);
+void		ccgSubSurf_freeStencils		(CCGSubSurf *ss);
+
 CCGError	ccgSubSurf_setSubdivisionLevels		(CCGSubSurf *ss, int subdivisionLevels);
 
 CCGError	ccgSubSurf_setAllowEdgeCreation		(CCGSubSurf *ss, int allowEdgeCreation, float defaultCreaseValue, void *defaultUserData);
@@ -42,12 +42,15 @@
 #include "DNA_meshdata_types.h"
 #include "DNA_object_types.h"
 #include "DNA_scene_types.h" // N_T
+#include "DNA_userdef_types.h"
 
 #include "BLI_blenlib.h"
 #include "BLI_editVert.h"
+#include "BLI_ghash.h"
 #include "BLI_math.h"
 #include "BLI_memarena.h"
 #include "BLI_pbvh.h"
+#include "BLI_threads.h"
 #include "BLI_utildefines.h"
 
 #include "BKE_cdderivedmesh.h"
@@ -57,6 +60,7 @@
 #include "BKE_mesh.h"
 #include "BKE_object.h"
 #include "BKE_paint.h"
+#include "BKE_scene.h"
 #include "BKE_texture.h"
 #include "BKE_multires.h"
 
@@ -1657,6 +1661,383 @@ static void add_weight_mcol_dm(Object *ob, DerivedMesh *dm)
 	CustomData_add_layer(&dm->faceData, CD_WEIGHT_MCOL, CD_ASSIGN, wtcol, dm->numFaceData);
 }
 
+/* ************* Modifier result cache ************* */
+
+/* With a modifier cache limit set, the result of every constructive modifier
+ * in the viewport stack is kept, keyed on a hash of the base mesh, the leading
+ * deform result and the settings of all modifiers up to it. When the stack is
+ * evaluated again, it restarts after the last modifier with a matching key, so
+ * tweaking a modifier doesn't evaluate all modifiers below it again. Modifiers
+ * that depend on time or other datablocks can't be keyed like that, the cache
+ * isn't used from them on. The least recently used results are dropped first
+ * when the cache runs over the limit. */
+
+typedef struct ModifierCacheEntry {
+	struct ModifierCacheEntry *next, *prev;	/* least recently used first */
+
+	ModifierData *md;
+	uint64_t key;
+	DerivedMesh *dm;
+	size_t size;
+} ModifierCacheEntry;
+
+static GHash *modcache_hash = NULL;
+static ListBase modcache_lru = {NULL, NULL};
+static size_t modcache_size = 0;
+
+/* objects can be evaluated from several threads */
+static ThreadMutex modcache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* 64 bit FNV-1a, per word. a collision silently gives a wrong result, so
+ * the key is wider than usual */
+#define MODCACHE_HASH_INIT	(((uint64_t)0xcbf29ce4 << 32) | 0x84222325)
+#define MODCACHE_HASH_PRIME	(((uint64_t)0x00000100 << 32) | 0x000001b3)
+
+static uint64_t modcache_hash_data(uint64_t h, const void *data, size_t size)
+{
+	const unsigned char *p = data;
+	unsigned int word;
+
+	for(; size >= sizeof(word); size -= sizeof(word), p += sizeof(word)) {
+		memcpy(&word, p, sizeof(word));
+		h = (h ^ word) * MODCACHE_HASH_PRIME;
+	}
+	for(; size; size--, p++)
+		h = (h ^ *p) * MODCACHE_HASH_PRIME;
+
+	return h;
+}
+
+static uint64_t modcache_hash_int(uint64_t h, int value)
+{
+	return modcache_hash_data(h, &value, sizeof(value));
+}
+
+/* hashes the layer contents, returns 0 for layers that point to data
+ * that can't be hashed */
+static int modcache_hash_customdata(uint64_t *h, CustomData *data, int count)
+{
+	int i, j;
+
+	*h = modcache_hash_int(*h, data->totlayer);
+
+	for(i = 0; i < data->totlayer; i++) {
+		CustomDataLayer *layer = &data->layers[i];
+
+		*h = modcache_hash_int(*h, layer->type);
+		*h = modcache_hash_int(*h, layer->flag);
+		*h = modcache_hash_int(*h, layer->active);
+		*h = modcache_hash_data(*h, layer->name, sizeof(layer->name));
+
+		if(layer->type == CD_MDEFORMVERT) {
+			MDeformVert *dvert = layer->data;
+
+			/* the weights, not the pointers to them */
+			for(j = 0; j < count; j++, dvert++) {
+				*h = modcache_hash_int(*h, dvert->totweight);
+				*h = modcache_hash_int(*h, dvert->flag);
+				if(dvert->totweight)
+					*h = modcache_hash_data(*h, dvert->dw, sizeof(*dvert->dw)*dvert->totweight);
+			}
+		}
+		else if(layer->type == CD_MDISPS)
+			return 0;
+		else if(layer->data)
+			*h = modcache_hash_data(*h, layer->data, CustomData_sizeof(layer->type)*count);
+	}
+
+	return 1;
+}
+
+/* key for the input of the first non leading deform modifier, 0 if the
+ * cache can't be used */
+static uint64_t modcache_base_key(Scene *scene, Object *ob, float (*deformedVerts)[3], int numVerts,
+								  int needMapping, CustomDataMask dataMask)
+{
+	Mesh *me = ob->data;
+	bDeformGroup *dg;
+	uint64_t h = MODCACHE_HASH_INIT;
+
+	h = modcache_hash_int(h, me->totvert);
+	h = modcache_hash_int(h, me->totedge);
+	h = modcache_hash_int(h, me->totface);
+
+	if(!modcache_hash_customdata(&h, &me->vdata, me->totvert)) return 0;
+	if(!modcache_hash_customdata(&h, &me->edata, me->totedge)) return 0;
+	if(!modcache_hash_customdata(&h, &me->fdata, me->totface)) return 0;
+
+	if(deformedVerts)
+		h = modcache_hash_data(h, deformedVerts, sizeof(*deformedVerts)*numVerts);
+
+	/* vertex groups are looked up by name */
+	for(dg = ob->defbase.first; dg; dg = dg->next)
+		h = modcache_hash_data(h, dg->name, sizeof(dg->name));
+
+	h = modcache_hash_int(h, needMapping);
+	h = modcache_hash_data(h, &dataMask, sizeof(dataMask));
+	h = modcache_hash_int(h, get_render_subsurf_level(&scene->r, 0xffff));
+
+	return h? h: 1;
+}
+
+static void modcache_count_link(void *userData, Object *UNUSED(ob), ID **idpoin)
+{
+	if(*idpoin)
+		(*(int*)userData)++;
+}
+
+static void modcache_count_object_link(void *userData, Object *UNUSED(ob), Object **obpoin)
+{
+	if(*obpoin)
+		(*(int*)userData)++;
+}
+
+/* only modifiers whose result follows from the input and the settings */
+static int modcache_modifier_supported(Object *ob, ModifierData *md)
+{
+	ModifierTypeInfo *mti = modifierType_getInfo(md->type);
+	int totlink = 0;
+
+	if(mti->flags & eModifierTypeFlag_UsesPointCache)
+		return 0;
+	if(ELEM3(md->type, eModifierType_Multires, eModifierType_ShapeKey, eModifierType_ParticleSystem))
+		return 0;
+	if(mti->dependsOnTime && mti->dependsOnTime(md))
+		return 0;
+
+	if(mti->foreachIDLink)
+		mti->foreachIDLink(md, ob, modcache_count_link, &totlink);
+	else if(mti->foreachObjectLink)
+		mti->foreachObjectLink(md, ob, modcache_count_object_link, &totlink);
+
+	return (totlink == 0);
+}
+
+/* a copy leaves out runtime data like the subsurf cache */
+static uint64_t modcache_modifier_key(uint64_t h, ModifierData *md, CustomDataMask mask, CustomDataMask nextmask)
+{
+	ModifierTypeInfo *mti = modifierType_getInfo(md->type);
+	ModifierData *tmd = modifier_new(md->type);
+
+	modifier_copyData(md, tmd);
+
+	h = modcache_hash_int(h, md->type);
+	h = modcache_hash_data(h, (char*)tmd + sizeof(ModifierData), mti->structSize - sizeof(ModifierData));
+	h = modcache_hash_data(h, &mask, sizeof(mask));
+	h = modcache_hash_data(h, &nextmask, sizeof(nextmask));
+
+	modifier_free(tmd);
+
+	return h? h: 1;
+}
+
+static size_t modcache_customdata_size(CustomData *data, int count)
+{
+	size_t size = 0;
+	int i;
+
+	for(i = 0; i < data->totlayer; i++)
+		size += (size_t)CustomData_sizeof(data->layers[i].type)*count;
+
+	return size;
+}
+
+/* lock must be held */
+static void modcache_remove_entry(ModifierCacheEntry *entry)
+{
+	BLI_ghash_remove(modcache_hash, entry->md, NULL, NULL);
+	BLI_remlink(&modcache_lru, entry);
+	modcache_size -= entry->size;
+
+	entry->dm->release(entry->dm);
+	MEM_freeN(entry);
+}
+
+static int modcache_has(ModifierData *md, uint64_t key)
+{
+	ModifierCacheEntry *entry;
+	int found;
+
+	BLI_mutex_lock(&modcache_lock);
+	entry = modcache_hash? BLI_ghash_lookup(modcache_hash, md): NULL;
+	found = (entry && entry->key == key);
+	BLI_mutex_unlock(&modcache_lock);
+
+	return found;
+}
+
+/* a copy of the cached result of md, if its key matches */
+static DerivedMesh *modcache_lookup(ModifierData *md, uint64_t key)
+{
+	ModifierCacheEntry *entry;
+	DerivedMesh *dm = NULL;
+
+	BLI_mutex_lock(&modcache_lock);
+
+	entry = modcache_hash? BLI_ghash_lookup(modcache_hash, md): NULL;
+	if(entry && entry->key == key) {
+		BLI_remlink(&modcache_lru, entry);
+		BLI_addtail(&modcache_lru, entry);
+
+		dm = CDDM_copy(entry->dm);
+	}
+
+	BLI_mutex_unlock(&modcache_lock);
+
+	return dm;
+}
+
+static void modcache_insert(ModifierData *md, uint64_t key, DerivedMesh *dm)
+{
+	ModifierCacheEntry *entry;
+	size_t limit = ((size_t)U.modcachelimit)*1024*1024;
+	size_t size = modcache_customdata_size(&dm->vertData, dm->numVertData) +
+				  modcache_customdata_size(&dm->edgeData, dm->numEdgeData) +
+				  modcache_customdata_size(&dm->faceData, dm->numFaceData);
+
+	BLI_mutex_lock(&modcache_lock);
+
+	if(!modcache_hash)
+		modcache_hash = BLI_ghash_new(BLI_ghashutil_ptrhash, BLI_ghashutil_ptrcmp, "modcache_hash gh");
+
+	entry = BLI_ghash_lookup(modcache_hash, md);
+	if(entry)
+		modcache_remove_entry(entry);
+
+	if(size <= limit) {
+		while(modcache_lru.first && modcache_size + size > limit)
+			modcache_remove_entry(modcache_lru.first);
+
+		entry = MEM_callocN(sizeof(ModifierCacheEntry), "ModifierCacheEntry");
+		entry->md = md;
+		entry->key = key;
+		entry->size = size;
+		entry->dm = CDDM_copy(dm);
+
+		BLI_ghash_insert(modcache_hash, md, entry);
+		BLI_addtail(&modcache_lru, entry);
+		modcache_size += size;
+	}
+
+	BLI_mutex_unlock(&modcache_lock);
+}
+
+/* key for the result of md from the key of its input, 0 when neither its
+ * result nor that of any modifier after it can be cached */
+static uint64_t modcache_step_key(uint64_t key, Object *ob, ModifierData *md, LinkNode *curr,
+								  CustomDataMask dataMask)
+{
+	CustomDataMask mask = (CustomDataMask)GET_INT_FROM_POINTER(curr->link);
+	CustomDataMask nextmask = curr->next? (CustomDataMask)GET_INT_FROM_POINTER(curr->next->link): dataMask;
+
+	if(!key || !modcache_modifier_supported(ob, md))
+		return 0;
+	/* orco results are built in parallel, and not cached */
+	if((mask | nextmask) & (CD_MASK_ORCO|CD_MASK_CLOTH_ORCO))
+		return 0;
+
+	return modcache_modifier_key(key, md, mask, nextmask);
+}
+
+/* looks for the last modifier from *md_r on with a cached result, skipping
+ * modifiers like mesh_calc_modifiers does. returns a copy of the result, with
+ * md_r, curr_r and key_r set to continue evaluation after it */
+static DerivedMesh *modcache_restart(Scene *scene, Object *ob, ModifierData **md_r, LinkNode **curr_r,
+									 uint64_t *key_r, int required_mode, int needMapping,
+									 CustomDataMask dataMask)
+{
+	ModifierData *md, *lastmd = NULL;
+	LinkNode *curr, *lastcurr = NULL;
+	uint64_t key = *key_r, lastkey = 0;
+	DerivedMesh *dm;
+	int have_dm = 0;
+
+	for(md = *md_r, curr = *curr_r; md && key; md = md->next, curr = curr->next) {
+		ModifierTypeInfo *mti = modifierType_getInfo(md->type);
+
+		if(!modifier_isEnabled(scene, md, required_mode)) continue;
+		if((mti->flags & eModifierTypeFlag_RequiresOriginalData) && have_dm) continue;
+		if(needMapping && !modifier_supportsMapping(md)) continue;
+
+		key = modcache_step_key(key, ob, md, curr, dataMask);
+
+		if(key && mti->type != eModifierTypeType_OnlyDeform) {
+			have_dm = 1;
+
+			if(modcache_has(md, key)) {
+				lastmd = md;
+				lastcurr = curr;
+				lastkey = key;
+			}
+		}
+	}
+
+	/* could have been dropped by another thread meanwhile */
+	if(!lastmd || !(dm = modcache_lookup(lastmd, lastkey)))
+		return NULL;
+
+	*md_r = lastmd->next;
+	*curr_r = lastcurr->next;
+	*key_r = lastkey;
+
+	return dm;
+}
+
+void DM_modifier_cache_remove(ModifierData *md)
+{
+	ModifierCacheEntry *entry;
+
+	BLI_mutex_lock(&modcache_lock);
+
+	entry = modcache_hash? BLI_ghash_lookup(modcache_hash, md): NULL;
+	if(entry)
+		modcache_remove_entry(entry);
+
+	BLI_mutex_unlock(&modcache_lock);
+}
+
+void DM_modifier_cache_free(void)
+{
+	BLI_mutex_lock(&modcache_lock);
+
+	while(modcache_lru.first)
+		modcache_remove_entry(modcache_lru.first);
+
+	if(modcache_hash) {
+		BLI_ghash_free(modcache_hash, NULL, NULL);
+		modcache_hash = NULL;
+	}
+
+	BLI_mutex_unlock(&modcache_lock);
+}
+
+/* partial normal updates pay off while less than 1/4th of the verts moved */
+#define DM_PARTIAL_NORMALS_FAC	4
+
+/* applies deformed coordinates to a DerivedMesh made from the mesh. The mesh
+ * normals are valid for the verts that didn't move, so when only a few moved
+ * (hooks, partial shape keys), only the normals around them are recalculated */
+static void dm_apply_deformed_verts(DerivedMesh *dm, Mesh *me, float (*deformedVerts)[3])
+{
+	int maxdirty = me->totvert/DM_PARTIAL_NORMALS_FAC;
+	int *dirty = MEM_mallocN(sizeof(int)*(maxdirty + 1), "dm dirty verts");
+	int i, totdirty = 0;
+
+	/* stop comparing once too many moved, armatures move all of them */
+	for(i = 0; i < me->totvert && totdirty <= maxdirty; i++)
+		if(!equals_v3v3(deformedVerts[i], me->mvert[i].co))
+			dirty[totdirty++] = i;
+
+	CDDM_apply_vert_coords(dm, deformedVerts);
+
+	if(totdirty > maxdirty)
+		CDDM_calc_normals(dm);
+	else if(totdirty)
+		CDDM_calc_normals_partial(dm, mesh_get_vert_corner_map(me), dirty, totdirty);
+
+	MEM_freeN(dirty);
+}
+
 /* new value for useDeform -1  (hack for the gameengine):
  * - apply only the modifier stack of the object, skipping the virtual modifiers,
  * - don't apply the key
@@ -1667,6 +2048,7 @@ static void mesh_calc_modifiers(Scene *scene, Object *ob, float (*inputVertexCos
 								int useRenderParams, int useDeform,
 								int needMapping, CustomDataMask dataMask, int index, int useCache)
 {
+	VirtualModifierData virtualModifierData;
 	Mesh *me = ob->data;
 	ModifierData *firstmd, *md;
 	LinkNode *datamasks, *curr;
@@ -1680,12 +2062,16 @@ static void mesh_calc_modifiers(Scene *scene, Object *ob, float (*inputVertexCos
 	MultiresModifierData *mmd= get_multires_modifier(scene, ob, 0);
 	int has_multires = mmd != NULL, multires_applied = 0;
 	int sculpt_mode = ob->mode & OB_MODE_SCULPT && ob->sculpt;
+	/* only the viewport result of the whole stack is cached */
+	int useModCache = useCache && U.modcachelimit > 0 && useDeform > 0 && !useRenderParams &&
+					  index < 0 && !inputVertexCos && !sculpt_mode && !(ob->mode & OB_MODE_WEIGHT_PAINT);
+	uint64_t cachekey = 0;
 
 	if(mmd && !mmd->sculptlvl)
 		has_multires = 0;
 
 	if(!skipVirtualArmature) {
-		firstmd = modifiers_getVirtualModifierList(ob);
+		firstmd = modifiers_getVirtualModifierList(ob, &virtualModifierData);
 	}
 	else {
 		/* game engine exception */
@@ -1762,6 +2148,18 @@ static void mesh_calc_modifiers(Scene *scene, Object *ob, float (*inputVertexCos
 	orcodm = NULL;
 	clothorcodm = NULL;
 
+	/* continue after the last modifier with a cached result */
+	if(useModCache) {
+		cachekey = modcache_base_key(scene, ob, deformedVerts, numVerts, needMapping, dataMask);
+
+		if(cachekey && (dm = modcache_restart(scene, ob, &md, &curr, &cachekey, required_mode, needMapping, dataMask))) {
+			if(deformedVerts) {
+				MEM_freeN(deformedVerts);
+				deformedVerts = NULL;
+			}
+		}
+	}
+
 	for(;md; md = md->next, curr = curr->next) {
 		ModifierTypeInfo *mti = modifierType_getInfo(md->type);
 
@@ -1790,6 +2188,9 @@ static void mesh_calc_modifiers(Scene *scene, Object *ob, float (*inputVertexCos
 		if(needMapping && !modifier_supportsMapping(md)) continue;
 		if(useDeform < 0 && mti->dependsOnTime && mti->dependsOnTime(md)) continue;
 
+		if(cachekey)
+			cachekey = modcache_step_key(cachekey, ob, md, curr, dataMask);
+
 		/* add an orco layer if needed by this modifier */
 		if(mti->requiredDataMask)
 			mask = mti->requiredDataMask(ob, md);
@@ -1854,10 +2255,8 @@ static void mesh_calc_modifiers(Scene *scene, Object *ob, float (*inputVertexCos
 			} else {
 				dm = CDDM_from_mesh(me, ob);
 
-				if(deformedVerts) {
-					CDDM_apply_vert_coords(dm, deformedVerts);
-					CDDM_calc_normals(dm);
-				}
+				if(deformedVerts)
+					dm_apply_deformed_verts(dm, me, deformedVerts);
 
 				if((dataMask & CD_MASK_WEIGHT_MCOL) && (ob->mode & OB_MODE_WEIGHT_PAINT))
 					add_weight_mcol_dm(ob, dm);
@@ -1913,6 +2312,9 @@ static void mesh_calc_modifiers(Scene *scene, Object *ob, float (*inputVertexCos
 				}
 			} 
 
+			if(cachekey && !deformedVerts)
+				modcache_insert(md, cachekey, dm);
+
 			/* create an orco derivedmesh in parallel */
 			if(nextmask & CD_MASK_ORCO) {
 				if(!orcodm)
@@ -1978,10 +2380,8 @@ static void mesh_calc_modifiers(Scene *scene, Object *ob, float (*inputVertexCos
 	} else {
 		finaldm = CDDM_from_mesh(me, ob);
 
-		if(deformedVerts) {
-			CDDM_apply_vert_coords(finaldm, deformedVerts);
-			CDDM_calc_normals(finaldm);
-		}
+		if(deformedVerts)
+			dm_apply_deformed_verts(finaldm, me, deformedVerts);
 
 		if((dataMask & CD_MASK_WEIGHT_MCOL) && (ob->mode & OB_MODE_WEIGHT_PAINT))
 			add_weight_mcol_dm(ob, finaldm);
@@ -2040,6 +2440,7 @@ static void editmesh_calc_modifiers(Scene *scene, Object *ob, EditMesh *em, Deri
 									DerivedMesh **final_r,
 									CustomDataMask dataMask)
 {
+	VirtualModifierData virtualModifierData;
 	ModifierData *md;
 	float (*deformedVerts)[3] = NULL;
 	CustomDataMask mask;
@@ -2055,7 +2456,7 @@ static void editmesh_calc_modifiers(Scene *scene, Object *ob, EditMesh *em, Deri
 	}
 
 	dm = NULL;
-	md = modifiers_getVirtualModifierList(ob);
+	md = modifiers_getVirtualModifierList(ob, &virtualModifierData);
 
 	datamasks = modifiers_calcDataMasks(scene, ob, md, dataMask, required_mode);
 
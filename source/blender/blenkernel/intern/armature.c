@@ -424,13 +424,10 @@ static void equalize_bezier(float *data, int desired)
 	QUATCOPY(fp, temp[MAX_BBONE_SUBDIV]);
 }
 
-/* returns pointer to static array, filled with desired amount of bone->segments elements */
+/* fills result_array with desired amount of bone->segments elements */
 /* this calculation is done  within unit bone space */
-Mat4 *b_bone_spline_setup(bPoseChannel *pchan, int rest)
+void b_bone_spline_setup_array(bPoseChannel *pchan, int rest, Mat4 *result_array)
 {
-	static Mat4 bbone_array[MAX_BBONE_SUBDIV];
-	static Mat4 bbone_rest_array[MAX_BBONE_SUBDIV];
-	Mat4 *result_array= (rest)? bbone_rest_array: bbone_array;
 	bPoseChannel *next, *prev;
 	Bone *bone= pchan->bone;
 	float h1[3], h2[3], scale[3], length, hlength1, hlength2, roll1=0.0f, roll2;
@@ -584,7 +581,17 @@ Mat4 *b_bone_spline_setup(bPoseChannel *pchan, int rest)
 				scalemat, NULL, NULL, NULL, NULL, NULL);
 		}
 	}
-	
+}
+
+/* returns pointer to static array, not thread safe, use b_bone_spline_setup_array() for that */
+Mat4 *b_bone_spline_setup(bPoseChannel *pchan, int rest)
+{
+	static Mat4 bbone_array[MAX_BBONE_SUBDIV];
+	static Mat4 bbone_rest_array[MAX_BBONE_SUBDIV];
+	Mat4 *result_array= (rest)? bbone_rest_array: bbone_array;
+
+	b_bone_spline_setup_array(pchan, rest, result_array);
+
 	return result_array;
 }
 
@@ -599,13 +606,16 @@ typedef struct bPoseChanDeform {
 static void pchan_b_bone_defmats(bPoseChannel *pchan, bPoseChanDeform *pdef_info, int use_quaternion)
 {
 	Bone *bone= pchan->bone;
-	Mat4 *b_bone= b_bone_spline_setup(pchan, 0);
-	Mat4 *b_bone_rest= b_bone_spline_setup(pchan, 1);
+	Mat4 b_bone[MAX_BBONE_SUBDIV], b_bone_rest[MAX_BBONE_SUBDIV];
 	Mat4 *b_bone_mats;
 	DualQuat *b_bone_dual_quats= NULL;
 	float tmat[4][4]= MAT4_UNITY;
 	int a;
 	
+	/* objects can be deformed in threads, so no static arrays here */
+	b_bone_spline_setup_array(pchan, 0, b_bone);
+	b_bone_spline_setup_array(pchan, 1, b_bone_rest);
+
 	/* allocate b_bone matrices and dual quats */
 	b_bone_mats= MEM_mallocN((1+bone->segments)*sizeof(Mat4), "BBone defmats");
 	pdef_info->b_bone_mats= b_bone_mats;
@@ -114,6 +114,7 @@ void free_blender(void)
 
 	BLI_cb_finalize();
 
+	seq_prefetch_free();
 	seq_stripelem_cache_destruct();
 	
 	free_nodesystem();	
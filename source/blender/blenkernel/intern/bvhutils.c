@@ -40,6 +40,7 @@
 #include "DNA_meshdata_types.h"
 
 #include "BLI_editVert.h"
+#include "BLI_threads.h"
 #include "BLI_utildefines.h"
 
 #include "BKE_DerivedMesh.h"
@@ -508,10 +509,18 @@ static void mesh_edges_nearest_point(void *userdata, int index, const float *co,
 /*
  * BVH builders
  */
+
+/* objects targeting the same mesh can be updated in threads, the cache lock
+   makes sure a tree is only built and inserted once */
+static ThreadMutex bvhcache_lock = PTHREAD_MUTEX_INITIALIZER;
+
 // Builds a bvh tree.. where nodes are the vertexs of the given mesh
 BVHTree* bvhtree_from_mesh_verts(BVHTreeFromMesh *data, DerivedMesh *mesh, float epsilon, int tree_type, int axis)
 {
-	BVHTree *tree = bvhcache_find(&mesh->bvhCache, BVHTREE_FROM_VERTICES);
+	BVHTree *tree;
+
+	BLI_mutex_lock(&bvhcache_lock);
+	tree = bvhcache_find(&mesh->bvhCache, BVHTREE_FROM_VERTICES);
 
 	//Not in cache
 	if(tree == NULL)
@@ -542,6 +551,8 @@ BVHTree* bvhtree_from_mesh_verts(BVHTreeFromMesh *data, DerivedMesh *mesh, float
 //		printf("BVHTree is already build, using cached tree\n");
 	}
 
+	BLI_mutex_unlock(&bvhcache_lock);
+
 
 	//Setup BVHTreeFromMesh
 	memset(data, 0, sizeof(*data));
@@ -569,7 +580,10 @@ BVHTree* bvhtree_from_mesh_verts(BVHTreeFromMesh *data, DerivedMesh *mesh, float
 // Builds a bvh tree.. where nodes are the faces of the given mesh.
 BVHTree* bvhtree_from_mesh_faces(BVHTreeFromMesh *data, DerivedMesh *mesh, float epsilon, int tree_type, int axis)
 {
-	BVHTree *tree = bvhcache_find(&mesh->bvhCache, BVHTREE_FROM_FACES);
+	BVHTree *tree;
+
+	BLI_mutex_lock(&bvhcache_lock);
+	tree = bvhcache_find(&mesh->bvhCache, BVHTREE_FROM_FACES);
 
 	//Not in cache
 	if(tree == NULL)
@@ -627,6 +641,8 @@ BVHTree* bvhtree_from_mesh_faces(BVHTreeFromMesh *data, DerivedMesh *mesh, float
 //		printf("BVHTree is already build, using cached tree\n");
 	}
 
+	BLI_mutex_unlock(&bvhcache_lock);
+
 
 	//Setup BVHTreeFromMesh
 	memset(data, 0, sizeof(*data));
@@ -652,7 +668,10 @@ BVHTree* bvhtree_from_mesh_faces(BVHTreeFromMesh *data, DerivedMesh *mesh, float
 // Builds a bvh tree.. where nodes are the faces of the given mesh.
 BVHTree* bvhtree_from_mesh_edges(BVHTreeFromMesh *data, DerivedMesh *mesh, float epsilon, int tree_type, int axis)
 {
-	BVHTree *tree = bvhcache_find(&mesh->bvhCache, BVHTREE_FROM_EDGES);
+	BVHTree *tree;
+
+	BLI_mutex_lock(&bvhcache_lock);
+	tree = bvhcache_find(&mesh->bvhCache, BVHTREE_FROM_EDGES);
 
 	//Not in cache
 	if(tree == NULL)
@@ -689,6 +708,8 @@ BVHTree* bvhtree_from_mesh_edges(BVHTreeFromMesh *data, DerivedMesh *mesh, float
 //		printf("BVHTree is already build, using cached tree\n");
 	}
 
+	BLI_mutex_unlock(&bvhcache_lock);
+
 
 	//Setup BVHTreeFromMesh
 	memset(data, 0, sizeof(*data));
@@ -1857,6 +1857,30 @@ void CDDM_calc_normals(DerivedMesh *dm)
 	mesh_calc_normals(cddm->mvert, dm->numVertData, CDDM_get_faces(dm), dm->numFaceData, face_nors);
 }
 
+void CDDM_calc_normals_partial(DerivedMesh *dm, VertCornerMap *cmap, const int *dirty, int totdirty)
+{
+	CDDerivedMesh *cddm = (CDDerivedMesh*)dm;
+	VertCornerMap *tmpmap = NULL;
+	float (*face_nors)[3];
+
+	if(dm->numVertData == 0 || totdirty == 0) return;
+
+	/* we don't want to overwrite any referenced layers */
+	cddm->mvert = CustomData_duplicate_referenced_layer(&dm->vertData, CD_MVERT);
+
+	/* a face normal layer is only updated when there is one already,
+	 * adding it would need the normals of all faces */
+	face_nors = CustomData_get_layer(&dm->faceData, CD_NORMAL);
+
+	if(cmap == NULL)
+		cmap = tmpmap = make_vert_corner_map(CDDM_get_faces(dm), dm->numFaceData, dm->numVertData);
+
+	mesh_calc_normals_partial(cddm->mvert, dm->numVertData, CDDM_get_faces(dm), dm->numFaceData,
+							  face_nors, cmap, dirty, totdirty);
+
+	free_vert_corner_map(tmpmap);
+}
+
 void CDDM_calc_edges(DerivedMesh *dm)
 {
 	CDDerivedMesh *cddm = (CDDerivedMesh*)dm;
@@ -248,102 +248,68 @@ static BVHTree *bvhtree_build_from_cloth (ClothModifierData *clmd, float epsilon
 	return bvhtree;
 }
 
+static int bvhtree_cloth_face_cb(void *userdata, int index, float *co, float *co_moving)
+{
+	Cloth *cloth = userdata;
+	ClothVertex *verts = cloth->verts;
+	MFace *mface = cloth->mfaces + index;
+
+	VECCOPY(&co[0*3], verts[mface->v1].txold);
+	VECCOPY(&co[1*3], verts[mface->v2].txold);
+	VECCOPY(&co[2*3], verts[mface->v3].txold);
+	
+	if(mface->v4)
+		VECCOPY(&co[3*3], verts[mface->v4].txold);
+
+	// copy new locations into array
+	if(co_moving)
+	{
+		VECCOPY(&co_moving[0*3], verts[mface->v1].tx);
+		VECCOPY(&co_moving[1*3], verts[mface->v2].tx);
+		VECCOPY(&co_moving[2*3], verts[mface->v3].tx);
+		
+		if(mface->v4)
+			VECCOPY(&co_moving[3*3], verts[mface->v4].tx);
+	}
+
+	return (mface->v4 ? 4 : 3);
+}
+
+static int bvhtree_cloth_vert_cb(void *userdata, int index, float *co, float *co_moving)
+{
+	Cloth *cloth = userdata;
+	ClothVertex *vert = cloth->verts + index;
+
+	VECCOPY(co, vert->txold);
+
+	if(co_moving)
+		VECCOPY(co_moving, vert->tx);
+
+	return 1;
+}
+
 void bvhtree_update_from_cloth(ClothModifierData *clmd, int moving)
 {	
-	unsigned int i = 0;
 	Cloth *cloth = clmd->clothObject;
-	BVHTree *bvhtree = cloth->bvhtree;
-	ClothVertex *verts = cloth->verts;
-	MFace *mfaces;
-	float co[12], co_moving[12];
-	int ret = 0;
 	
-	if(!bvhtree)
+	if(!cloth->bvhtree)
 		return;
 	
-	mfaces = cloth->mfaces;
-	
 	// update vertex position in bvh tree
-	if(verts && mfaces)
-	{
-		for(i = 0; i < cloth->numfaces; i++, mfaces++)
-		{
-			VECCOPY(&co[0*3], verts[mfaces->v1].txold);
-			VECCOPY(&co[1*3], verts[mfaces->v2].txold);
-			VECCOPY(&co[2*3], verts[mfaces->v3].txold);
-			
-			if(mfaces->v4)
-				VECCOPY(&co[3*3], verts[mfaces->v4].txold);
-		
-			// copy new locations into array
-			if(moving)
-			{
-				// update moving positions
-				VECCOPY(&co_moving[0*3], verts[mfaces->v1].tx);
-				VECCOPY(&co_moving[1*3], verts[mfaces->v2].tx);
-				VECCOPY(&co_moving[2*3], verts[mfaces->v3].tx);
-				
-				if(mfaces->v4)
-					VECCOPY(&co_moving[3*3], verts[mfaces->v4].tx);
-				
-				ret = BLI_bvhtree_update_node(bvhtree, i, co, co_moving, (mfaces->v4 ? 4 : 3));
-			}
-			else
-			{
-				ret = BLI_bvhtree_update_node(bvhtree, i, co, NULL, (mfaces->v4 ? 4 : 3));
-			}
-			
-			// check if tree is already full
-			if(!ret)
-				break;
-		}
-		
-		BLI_bvhtree_update_tree(bvhtree);
-	}
+	if(cloth->verts && cloth->mfaces)
+		BLI_bvhtree_refit(cloth->bvhtree, bvhtree_cloth_face_cb, cloth, moving);
 }
 
 void bvhselftree_update_from_cloth(ClothModifierData *clmd, int moving)
 {	
-	unsigned int i = 0;
 	Cloth *cloth = clmd->clothObject;
-	BVHTree *bvhtree = cloth->bvhselftree;
-	ClothVertex *verts = cloth->verts;
-	MFace *mfaces;
-	float co[12], co_moving[12];
-	int ret = 0;
 	
-	if(!bvhtree)
+	if(!cloth->bvhselftree)
 		return;
 	
-	mfaces = cloth->mfaces;
-	
 	// update vertex position in bvh tree
-	if(verts && mfaces)
-	{
-		for(i = 0; i < cloth->numverts; i++, verts++)
-		{
-			VECCOPY(&co[0*3], verts->txold);
-			
-			// copy new locations into array
-			if(moving)
-			{
-				// update moving positions
-				VECCOPY(&co_moving[0*3], verts->tx);
-				
-				ret = BLI_bvhtree_update_node(bvhtree, i, co, co_moving, 1);
-			}
-			else
-			{
-				ret = BLI_bvhtree_update_node(bvhtree, i, co, NULL, 1);
-			}
-			
-			// check if tree is already full
-			if(!ret)
-				break;
-		}
-		
-		BLI_bvhtree_update_tree(bvhtree);
-	}
+	if(cloth->verts && cloth->mfaces)
+		BLI_bvhtree_refit(cloth->bvhselftree, bvhtree_cloth_vert_cb, cloth, moving);
 }
 
 void cloth_clear_cache(Object *ob, ClothModifierData *clmd, float framenr)
@@ -119,49 +119,50 @@ BVHTree *bvhtree_build_from_mvert ( MFace *mfaces, unsigned int numfaces, MVert
 	return tree;
 }
 
-void bvhtree_update_from_mvert ( BVHTree * bvhtree, MFace *faces, int numfaces, MVert *x, MVert *xnew, int UNUSED(numverts), int moving )
+typedef struct MVertTreeData
 {
-	int i;
-	MFace *mfaces = faces;
-	float co[12], co_moving[12];
-	int ret = 0;
+	MFace *mfaces;
+	MVert *x, *xnew;
+} MVertTreeData;
+
+static int bvhtree_mvert_leaf_cb ( void *userdata, int index, float *co, float *co_moving )
+{
+	MVertTreeData *data = userdata;
+	MFace *mface = data->mfaces + index;
+
+	VECCOPY ( &co[0*3], data->x[mface->v1].co );
+	VECCOPY ( &co[1*3], data->x[mface->v2].co );
+	VECCOPY ( &co[2*3], data->x[mface->v3].co );
+	if ( mface->v4 )
+		VECCOPY ( &co[3*3], data->x[mface->v4].co );
+
+	// copy new locations into array
+	if ( co_moving )
+	{
+		VECCOPY ( &co_moving[0*3], data->xnew[mface->v1].co );
+		VECCOPY ( &co_moving[1*3], data->xnew[mface->v2].co );
+		VECCOPY ( &co_moving[2*3], data->xnew[mface->v3].co );
+		if ( mface->v4 )
+			VECCOPY ( &co_moving[3*3], data->xnew[mface->v4].co );
+	}
+
+	return ( mface->v4 ? 4 : 3 );
+}
+
+void bvhtree_update_from_mvert ( BVHTree * bvhtree, MFace *faces, int UNUSED(numfaces), MVert *x, MVert *xnew, int UNUSED(numverts), int moving )
+{
+	MVertTreeData data;
 
 	if ( !bvhtree )
 		return;
 
 	if ( x )
 	{
-		for ( i = 0; i < numfaces; i++, mfaces++ )
-		{
-			VECCOPY ( &co[0*3], x[mfaces->v1].co );
-			VECCOPY ( &co[1*3], x[mfaces->v2].co );
-			VECCOPY ( &co[2*3], x[mfaces->v3].co );
-			if ( mfaces->v4 )
-				VECCOPY ( &co[3*3], x[mfaces->v4].co );
-
-			// copy new locations into array
-			if ( moving && xnew )
-			{
-				// update moving positions
-				VECCOPY ( &co_moving[0*3], xnew[mfaces->v1].co );
-				VECCOPY ( &co_moving[1*3], xnew[mfaces->v2].co );
-				VECCOPY ( &co_moving[2*3], xnew[mfaces->v3].co );
-				if ( mfaces->v4 )
-					VECCOPY ( &co_moving[3*3], xnew[mfaces->v4].co );
-
-				ret = BLI_bvhtree_update_node ( bvhtree, i, co, co_moving, ( mfaces->v4 ? 4 : 3 ) );
-			}
-			else
-			{
-				ret = BLI_bvhtree_update_node ( bvhtree, i, co, NULL, ( mfaces->v4 ? 4 : 3 ) );
-			}
-
-			// check if tree is already full
-			if ( !ret )
-				break;
-		}
+		data.mfaces = faces;
+		data.x = x;
+		data.xnew = xnew;
 
-		BLI_bvhtree_update_tree ( bvhtree );
+		BLI_bvhtree_refit ( bvhtree, bvhtree_mvert_leaf_cb, &data, ( moving && xnew ) );
 	}
 }
 
@@ -695,7 +695,8 @@ void makeDispListMBall_forRender(Scene *scene, Object *ob, ListBase *dispbase)
 
 static ModifierData *curve_get_tesselate_point(Scene *scene, Object *ob, int forRender, int editmode)
 {
-	ModifierData *md = modifiers_getVirtualModifierList(ob);
+	VirtualModifierData virtualModifierData;
+	ModifierData *md = modifiers_getVirtualModifierList(ob, &virtualModifierData);
 	ModifierData *preTesselatePoint;
 	int required_mode;
 
@@ -728,7 +729,8 @@ static ModifierData *curve_get_tesselate_point(Scene *scene, Object *ob, int for
 
 static void curve_calc_modifiers_pre(Scene *scene, Object *ob, int forRender, float (**originalVerts_r)[3], float (**deformedVerts_r)[3], int *numVerts_r)
 {
-	ModifierData *md = modifiers_getVirtualModifierList(ob);
+	VirtualModifierData virtualModifierData;
+	ModifierData *md = modifiers_getVirtualModifierList(ob, &virtualModifierData);
 	ModifierData *preTesselatePoint;
 	Curve *cu= ob->data;
 	ListBase *nurb= BKE_curve_nurbs(cu);
@@ -831,7 +833,8 @@ static void displist_apply_allverts(ListBase *dispbase, float (*allverts)[3])
 static void curve_calc_modifiers_post(Scene *scene, Object *ob, ListBase *dispbase,
 	DerivedMesh **derivedFinal, int forRender, float (*originalVerts)[3], float (*deformedVerts)[3])
 {
-	ModifierData *md = modifiers_getVirtualModifierList(ob);
+	VirtualModifierData virtualModifierData;
+	ModifierData *md = modifiers_getVirtualModifierList(ob, &virtualModifierData);
 	ModifierData *preTesselatePoint;
 	Curve *cu= ob->data;
 	ListBase *nurb= BKE_curve_nurbs(cu);
@@ -1037,10 +1040,11 @@ static void add_orco_dm(Scene *scene, Object *ob, DerivedMesh *dm, DerivedMesh *
 
 static void curve_calc_orcodm(Scene *scene, Object *ob, DerivedMesh *derivedFinal, int forRender)
 {
+	VirtualModifierData virtualModifierData;
 	/* this function represents logic of mesh's orcodm calculation */
 	/* for displist-based objects */
 
-	ModifierData *md = modifiers_getVirtualModifierList(ob);
+	ModifierData *md = modifiers_getVirtualModifierList(ob, &virtualModifierData);
 	ModifierData *preTesselatePoint;
 	Curve *cu= ob->data;
 	int required_mode;
@@ -99,6 +99,17 @@
 #define IMA_INDEX_FRAME(index)			(index>>10)
 #define IMA_INDEX_PASS(index)			(index & ~1023)
 
+/* load tiled and mipmapped files through the imbuf tile cache, set for renders */
+static int image_use_tile_cache= 0;
+
+/* when set, tiled mipmapped files (.tx) are not read into ibuf->rect,
+   render textures fetch their tiles on demand with IMB_gettile. only for
+   background renders, drawing needs ibuf->rect */
+void BKE_image_use_tile_cache(int use)
+{
+	image_use_tile_cache= use;
+}
+
 /* ******** IMAGE PROCESSING ************* */
 
 static void de_interlace_ng(struct ImBuf *ibuf)	/* neogeo fields */
@@ -1852,6 +1863,8 @@ static ImBuf *image_load_image_file(Image *ima, ImageUser *iuser, int cfra)
 		flag= IB_rect|IB_multilayer|IB_metadata;
 		if(ima->flag & IMA_DO_PREMUL)
 			flag |= IB_premul;
+		if(image_use_tile_cache && !(ima->flag & IMA_FIELDS))
+			flag |= IB_tilecache;
 			
 		/* get the right string */
 		BLI_strncpy(str, ima->name, sizeof(str));
@@ -32,6 +32,10 @@
  */
 
 
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
 #include "MEM_guardedalloc.h"
 
 #include "DNA_scene_types.h"
@@ -52,6 +56,11 @@
 
 #define CLOTH_OPENMP_LIMIT 512
 
+/* solver passes are split in chunks of vertices or springs, threads are only
+   started for more elements than CLOTH_THREADS_LIMIT */
+#define CLOTH_CHUNK_SIZE 1024
+#define CLOTH_THREADS_LIMIT 4096
+
 #ifdef _WIN32
 #include <windows.h>
 static LARGE_INTEGER _itstart, _itend;
@@ -77,7 +86,6 @@ double itval(void)
 #else
 #include <sys/time.h>
 // intrinsics need better compile flag checking
-// #include <xmmintrin.h>
 // #include <pmmintrin.h>
 // #include <pthread.h>
 
@@ -240,6 +248,7 @@ DO_INLINE void submul_lfvectorS(float (*to)[3], float (*fLongVector)[3], float s
 		VECSUBMUL(to[i], fLongVector[i], scalar);
 	}
 }
+#if 0
 /* dot product for big vector */
 DO_INLINE float dot_lfvector(float (*fLongVectorA)[3], float (*fLongVectorB)[3], unsigned int verts)
 {
@@ -256,6 +265,7 @@ DO_INLINE float dot_lfvector(float (*fLongVectorA)[3], float (*fLongVectorB)[3],
 	}
 	return temp;
 }
+#endif
 /* A = B + C  --> for big vector */
 DO_INLINE void add_lfvector_lfvector(float (*to)[3], float (*fLongVectorA)[3], float (*fLongVectorB)[3], unsigned int verts)
 {
@@ -288,6 +298,7 @@ DO_INLINE void add_lfvectorS_lfvectorS(float (*to)[3], float (*fLongVectorA)[3],
 		VECADDSS(to[i], fLongVectorA[i], aS, fLongVectorB[i], bS);
 	}
 }
+#if 0
 /* A = B - C * float --> for big vector */
 DO_INLINE void sub_lfvector_lfvectorS(float (*to)[3], float (*fLongVectorA)[3], float (*fLongVectorB)[3], float bS, unsigned int verts)
 {
@@ -309,6 +320,7 @@ DO_INLINE void sub_lfvector_lfvector(float (*to)[3], float (*fLongVectorA)[3], f
 	}
 
 }
+#endif
 ///////////////////////////
 // 3x3 matrix
 ///////////////////////////
@@ -493,6 +505,7 @@ DO_INLINE void mulsub_fmatrix_fmatrix(float to[3][3], float matrixA[3][3], float
 	mulsub_fvector_fmatrix(to[1], matrixA[1],matrixB);
 	mulsub_fvector_fmatrix(to[2], matrixA[2],matrixB);
 }
+#ifndef __SSE__
 /* 3x3 matrix multiplied+added by a vector */
 /* STATUS: verified */
 DO_INLINE void muladd_fmatrix_fvector(float to[3], float matrix[3][3], float from[3])
@@ -501,6 +514,7 @@ DO_INLINE void muladd_fmatrix_fvector(float to[3], float matrix[3][3], float fro
 	to[1] += INPR(matrix[1],from);
 	to[2] += INPR(matrix[2],from);	
 }
+#endif
 /* 3x3 matrix multiplied+sub'ed by a vector */
 DO_INLINE void mulsub_fmatrix_fvector(float to[3], float matrix[3][3], float from[3])
 {
@@ -590,6 +604,7 @@ DO_INLINE void mul_bfmatrix_S(fmatrix3x3 *matrix, float scalar)
 	}
 }
 
+#if 0
 /* SPARSE SYMMETRIC multiply big matrix with long vector*/
 /* STATUS: verified */
 DO_INLINE void mul_bfmatrix_lfvector( float (*to)[3], fmatrix3x3 *from, lfVector *fLongVector)
@@ -624,6 +639,7 @@ DO_INLINE void mul_bfmatrix_lfvector( float (*to)[3], fmatrix3x3 *from, lfVector
 	
 }
 
+#endif
 /* SPARSE SYMMETRIC multiply big matrix with long vector (for diagonal preconditioner) */
 /* STATUS: verified */
 DO_INLINE void mul_prevfmatrix_lfvector( float (*to)[3], fmatrix3x3 *from, lfVector *fLongVector)
@@ -730,8 +746,58 @@ typedef struct Implicit_Data
 {
 	lfVector *X, *V, *Xnew, *Vnew, *olddV, *F, *B, *dV, *z;
 	fmatrix3x3 *A, *dFdV, *dFdX, *S, *P, *Pinv, *bigI, *M; 
+
+	/* blocks of each vertex row, for threaded products. all big matrices
+	   share the layout of A, off diagonal blocks are in two rows */
+	unsigned int *rowstart, *rowblocks;
+	int *pinned;			/* index in S, -1 for free vertices */
+	ClothSpring **springs;
+	unsigned int numsprings;
+
+	struct ImplicitPool *pool;	/* workers of the running implicit_solver, NULL when serial */
+
+	/* statistics of the last frame */
+	int solves, iterations;
+	double solve_time;
 } Implicit_Data;
 
+static void implicit_init_rows(Implicit_Data *id, unsigned int numverts, unsigned int numsprings)
+{
+	fmatrix3x3 *A = id->A;
+	unsigned int *fill;
+	unsigned int i;
+
+	id->rowstart = MEM_callocN(sizeof(unsigned int)*(numverts+1), "cloth implicit rowstart");
+	id->rowblocks = MEM_mallocN(sizeof(unsigned int)*(numverts + 2*numsprings + 1), "cloth implicit rowblocks");
+	fill = MEM_mallocN(sizeof(unsigned int)*(numverts+1), "cloth implicit rowfill");
+
+	for(i = 0; i < numverts; i++)
+		id->rowstart[i+1] = 1;
+	for(i = numverts; i < numverts+numsprings; i++) {
+		id->rowstart[A[i].r+1]++;
+		id->rowstart[A[i].c+1]++;
+	}
+	for(i = 0; i < numverts; i++)
+		id->rowstart[i+1] += id->rowstart[i];
+
+	memcpy(fill, id->rowstart, sizeof(unsigned int)*(numverts+1));
+
+	for(i = 0; i < numverts; i++)
+		id->rowblocks[fill[i]++] = i;
+	for(i = numverts; i < numverts+numsprings; i++) {
+		id->rowblocks[fill[A[i].r]++] = i;
+		id->rowblocks[fill[A[i].c]++] = i;
+	}
+
+	MEM_freeN(fill);
+
+	id->pinned = MEM_mallocN(sizeof(int)*MAX2(numverts, 1), "cloth implicit pinned");
+	for(i = 0; i < numverts; i++)
+		id->pinned[i] = -1;
+	for(i = 0; i < id->S[0].vcount; i++)
+		id->pinned[id->S[i].r] = i;
+}
+
 int implicit_init (Object *UNUSED(ob), ClothModifierData *clmd)
 {
 	unsigned int i = 0;
@@ -774,6 +840,8 @@ int implicit_init (Object *UNUSED(ob), ClothModifierData *clmd)
 	id->B = create_lfvector(cloth->numverts);
 	id->dV = create_lfvector(cloth->numverts);
 	id->z = create_lfvector(cloth->numverts);
+	id->springs = MEM_callocN(sizeof(ClothSpring*)*MAX2(cloth->numsprings, 1), "cloth implicit springs");
+	id->numsprings = cloth->numsprings;
 	
 	for(i=0;i<cloth->numverts;i++) 
 	{
@@ -807,10 +875,13 @@ int implicit_init (Object *UNUSED(ob), ClothModifierData *clmd)
 				id->P[i+cloth->numverts].c = id->Pinv[i+cloth->numverts].c = id->bigI[i+cloth->numverts].c = id->M[i+cloth->numverts].c = spring->kl;
 
 		spring->matrix_index = i + cloth->numverts;
+		id->springs[i] = spring;
 		
 		search = search->next;
 	}
 	
+	implicit_init_rows(id, cloth->numverts, cloth->numsprings);
+
 	initdiag_bfmatrix(id->bigI, I);
 
 	for(i = 0; i < cloth->numverts; i++)
@@ -851,6 +922,11 @@ int	implicit_free (ClothModifierData *clmd)
 			del_lfvector(id->dV);
 			del_lfvector(id->z);
 
+			MEM_freeN(id->rowstart);
+			MEM_freeN(id->rowblocks);
+			MEM_freeN(id->pinned);
+			MEM_freeN(id->springs);
+
 			MEM_freeN(id);
 		}
 	}
@@ -909,87 +985,369 @@ DO_INLINE void filter(lfVector *V, fmatrix3x3 *S)
 	}
 }
 
-static int  cg_filtered(lfVector *ldV, fmatrix3x3 *lA, lfVector *lB, lfVector *z, fmatrix3x3 *S)
+// block diagonalizer
+DO_INLINE void BuildPPinv(fmatrix3x3 *lA, fmatrix3x3 *P, fmatrix3x3 *Pinv)
+{
+	unsigned int i = 0;
+	
+	// Take only the diagonal blocks of A
+// #pragma omp parallel for private(i) if(lA[0].vcount > CLOTH_OPENMP_LIMIT)
+	for(i = 0; i<lA[0].vcount; i++)
+	{
+		// block diagonalizer
+		cp_fmatrix(P[i].m, lA[i].m);
+		inverse_fmatrix(Pinv[i].m, P[i].m);
+		
+	}
+}
+/* Threaded passes of the solver. Elements are split in chunks of a fixed size,
+   and sums are added per chunk, so results don't depend on the amount of threads. */
+typedef void (*ImplicitPassFunc)(void *data, unsigned int start, unsigned int end);
+
+typedef struct ImplicitPassRange {
+	void *data;
+	ImplicitPassFunc func;
+	unsigned int start, end, tot;
+} ImplicitPassRange;
+
+static void implicit_pass_chunks(ImplicitPassRange *range)
+{
+	unsigned int chunk;
+
+	for(chunk = range->start; chunk < range->end; chunk++)
+		range->func(range->data, chunk*CLOTH_CHUNK_SIZE, MIN2((chunk+1)*CLOTH_CHUNK_SIZE, range->tot));
+}
+
+/* worker threads kept alive for one implicit_solver call, the solver runs
+   several passes per CG iteration, too short to start threads for each */
+typedef struct ImplicitPool {
+	ListBase threads;
+	ThreadQueue *todo, *done;
+	int totthread, budget;
+} ImplicitPool;
+
+static void *implicit_pool_exec(void *pool_v)
+{
+	ImplicitPool *pool = pool_v;
+	ImplicitPassRange *range;
+
+	while((range = BLI_thread_queue_pop(pool->todo))) {
+		implicit_pass_chunks(range);
+		BLI_thread_queue_push(pool->done, range);
+	}
+
+	/* nowait only wakes one worker, pass it on */
+	BLI_thread_queue_nowait(pool->todo);
+
+	return NULL;
+}
+
+/* returns NULL when the solver runs single threaded */
+static ImplicitPool *implicit_pool_start(ClothModifierData *clmd, unsigned int tot)
+{
+	Scene *scene = clmd->scene;
+	ImplicitPool *pool;
+	int i, totthread, budget;
+
+	if(tot < CLOTH_THREADS_LIMIT)
+		return NULL;
+
+	if(scene && (scene->r.mode & R_FIXED_THREADS))
+		totthread = scene->r.threads;
+	else
+		totthread = BLI_system_thread_count();
+
+	/* cloth can be simulated in scene update threads too */
+	budget = BLI_thread_budget_acquire(MIN2(totthread, BLENDER_MAX_THREADS));
+	if(budget < 2) {
+		BLI_thread_budget_release(budget);
+		return NULL;
+	}
+
+	pool = MEM_callocN(sizeof(ImplicitPool), "cloth implicit pool");
+	pool->todo = BLI_thread_queue_init();
+	pool->done = BLI_thread_queue_init();
+	pool->totthread = pool->budget = budget;
+
+	BLI_init_threads(&pool->threads, implicit_pool_exec, budget);
+	for(i = 0; i < budget; i++)
+		BLI_insert_thread(&pool->threads, pool);
+
+	return pool;
+}
+
+static void implicit_pool_end(ImplicitPool *pool)
+{
+	if(pool == NULL)
+		return;
+
+	BLI_thread_queue_nowait(pool->todo);
+	BLI_end_threads(&pool->threads);
+	BLI_thread_budget_release(pool->budget);
+
+	BLI_thread_queue_free(pool->todo);
+	BLI_thread_queue_free(pool->done);
+	MEM_freeN(pool);
+}
+
+static void implicit_run_pass(Implicit_Data *id, void *data, ImplicitPassFunc func, unsigned int tot)
+{
+	ImplicitPassRange ranges[BLENDER_MAX_THREADS];
+	ImplicitPool *pool = (tot >= CLOTH_THREADS_LIMIT)? id->pool: NULL;
+	unsigned int totchunk = (tot + CLOTH_CHUNK_SIZE - 1)/CLOTH_CHUNK_SIZE;
+	unsigned int i, totthread = (pool)? pool->totthread: 1, len;
+
+	len = (totchunk + totthread - 1)/totthread;
+	totthread = (len)? (totchunk + len - 1)/len: 0;
+
+	for(i = 0; i < MAX2(totthread, 1); i++) {
+		ranges[i].data = data;
+		ranges[i].func = func;
+		ranges[i].start = i*len;
+		ranges[i].end = (i == totthread-1)? totchunk: (i+1)*len;
+		ranges[i].tot = tot;
+	}
+
+	if(totthread <= 1) {
+		if(totthread)
+			implicit_pass_chunks(&ranges[0]);
+		return;
+	}
+
+	for(i = 0; i < totthread; i++)
+		BLI_thread_queue_push(pool->todo, &ranges[i]);
+	for(i = 0; i < totthread; i++)
+		BLI_thread_queue_pop(pool->done);
+}
+
+/* to = row v of matrix times vector. blocks are symmetric, the transposed
+   half of the product uses the same block, like mul_bfmatrix_lfvector */
+DO_INLINE void mul_bfmatrix_row(float to[3], Implicit_Data *id, fmatrix3x3 *from, lfVector *fLongVector, unsigned int v)
+{
+	unsigned int j, b, other;
+#ifdef __SSE__
+	/* sum of rows weighted by vector elements, equal to the product for symmetric blocks */
+	__m128 sum = _mm_setzero_ps();
+	float tmp[4];
+
+	for(j = id->rowstart[v]; j < id->rowstart[v+1]; j++) {
+		b = id->rowblocks[j];
+		other = (from[b].r == v)? from[b].c: from[b].r;
+
+		/* the last row ends the block, load it without reading past the end */
+		sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(from[b].m[0]), _mm_set1_ps(fLongVector[other][0])));
+		sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(from[b].m[1]), _mm_set1_ps(fLongVector[other][1])));
+		sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set_ps(0.0f, from[b].m[2][2], from[b].m[2][1], from[b].m[2][0]), _mm_set1_ps(fLongVector[other][2])));
+	}
+
+	_mm_storeu_ps(tmp, sum);
+	VECCOPY(to, tmp);
+#else
+	to[0] = to[1] = to[2] = 0.0f;
+
+	for(j = id->rowstart[v]; j < id->rowstart[v+1]; j++) {
+		b = id->rowblocks[j];
+		other = (from[b].r == v)? from[b].c: from[b].r;
+
+		muladd_fmatrix_fvector(to, from[b].m, fLongVector[other]);
+	}
+#endif
+}
+
+DO_INLINE void filter_vertex(Implicit_Data *id, float V[3], unsigned int v)
+{
+	if(id->pinned[v] != -1)
+		mul_fvector_fmatrix(V, V, id->S[id->pinned[v]].m);
+}
+
+typedef struct ImplicitCGData {
+	Implicit_Data *id;
+	fmatrix3x3 *A, *Pinv;	/* Pinv is NULL without preconditioner */
+	lfVector *X, *B, *r, *d, *q, *h;
+	float alpha, beta;
+	float *partial;			/* one sum per chunk */
+} ImplicitCGData;
+
+/* q = Ad */
+static void cg_pass_product(void *data_v, unsigned int start, unsigned int end)
+{
+	ImplicitCGData *data = data_v;
+	unsigned int v;
+
+	for(v = start; v < end; v++)
+		mul_bfmatrix_row(data->q[v], data->id, data->A, data->d, v);
+}
+
+/* h = S(P^-1 r), or r without preconditioner, returns r.h */
+DO_INLINE float cg_precondition(ImplicitCGData *data, unsigned int v)
+{
+	if(data->Pinv) {
+		mul_fmatrix_fvector(data->h[v], data->Pinv[v].m, data->r[v]);
+		filter_vertex(data->id, data->h[v], v);
+		return INPR(data->r[v], data->h[v]);
+	}
+
+	return INPR(data->r[v], data->r[v]);
+}
+
+/* r = S(B - AX), d = h */
+static void cg_pass_residual(void *data_v, unsigned int start, unsigned int end)
+{
+	ImplicitCGData *data = data_v;
+	float tmp[3], sum = 0.0f;
+	unsigned int v;
+
+	for(v = start; v < end; v++) {
+		mul_bfmatrix_row(tmp, data->id, data->A, data->X, v);
+		VECSUB(data->r[v], data->B[v], tmp);
+		filter_vertex(data->id, data->r[v], v);
+
+		sum += cg_precondition(data, v);
+		VECCOPY(data->d[v], data->h[v]);
+	}
+
+	data->partial[start/CLOTH_CHUNK_SIZE] = sum;
+}
+
+/* q = S(Ad), returns d.q */
+static void cg_pass_search(void *data_v, unsigned int start, unsigned int end)
+{
+	ImplicitCGData *data = data_v;
+	float sum = 0.0f;
+	unsigned int v;
+
+	for(v = start; v < end; v++) {
+		mul_bfmatrix_row(data->q[v], data->id, data->A, data->d, v);
+		filter_vertex(data->id, data->q[v], v);
+
+		sum += INPR(data->d[v], data->q[v]);
+	}
+
+	data->partial[start/CLOTH_CHUNK_SIZE] = sum;
+}
+
+/* X = X + d*alpha, r = r - q*alpha, returns r.h */
+static void cg_pass_update(void *data_v, unsigned int start, unsigned int end)
+{
+	ImplicitCGData *data = data_v;
+	float sum = 0.0f;
+	unsigned int v;
+
+	for(v = start; v < end; v++) {
+		VECADDS(data->X[v], data->X[v], data->d[v], data->alpha);
+		VECSUBS(data->r[v], data->r[v], data->q[v], data->alpha);
+
+		sum += cg_precondition(data, v);
+	}
+
+	data->partial[start/CLOTH_CHUNK_SIZE] = sum;
+}
+
+/* d = S(h + d*beta) */
+static void cg_pass_direction(void *data_v, unsigned int start, unsigned int end)
+{
+	ImplicitCGData *data = data_v;
+	unsigned int v;
+
+	for(v = start; v < end; v++) {
+		VECADDS(data->d[v], data->h[v], data->d[v], data->beta);
+		filter_vertex(data->id, data->d[v], v);
+	}
+}
+
+static float cg_sum_partial(ImplicitCGData *data, unsigned int numverts)
+{
+	unsigned int chunk, totchunk = (numverts + CLOTH_CHUNK_SIZE - 1)/CLOTH_CHUNK_SIZE;
+	float sum = 0.0f;
+
+	for(chunk = 0; chunk < totchunk; chunk++)
+		sum += data->partial[chunk];
+
+	return sum;
+}
+
+/* to = from * vector, threaded */
+static void mul_bfmatrix_lfvector_threaded(Implicit_Data *id, float (*to)[3], fmatrix3x3 *from, lfVector *fLongVector)
+{
+	ImplicitCGData data = {NULL};
+
+	data.id = id;
+	data.A = from;
+	data.d = fLongVector;
+	data.q = to;
+
+	implicit_run_pass(id, &data, cg_pass_product, from[0].vcount);
+}
+
+/* Solves for unknown X in equation AX=B, with the block Jacobi preconditioner
+   P = diag(A) when Pinv is given. Returns the amount of iterations. */
+static int cg_filtered(Implicit_Data *id, lfVector *ldV, fmatrix3x3 *lA, lfVector *lB, lfVector *z, fmatrix3x3 *S, fmatrix3x3 *P, fmatrix3x3 *Pinv)
 {
-	// Solves for unknown X in equation AX=B
 	unsigned int conjgrad_loopcount=0, conjgrad_looplimit=100;
-	float conjgrad_epsilon=0.0001f, conjgrad_lasterror=0;
-	lfVector *q, *d, *tmp, *r; 
-	float s, starget, a, s_prev;
+	float conjgrad_epsilon=0.0001f;
+	float s, starget, s_prev;
 	unsigned int numverts = lA[0].vcount;
-	q = create_lfvector(numverts);
-	d = create_lfvector(numverts);
-	tmp = create_lfvector(numverts);
-	r = create_lfvector(numverts);
+	ImplicitCGData data;
+
+	data.id = id;
+	data.A = lA;
+	data.Pinv = Pinv;
+	data.X = ldV;
+	data.B = lB;
+	data.r = create_lfvector(numverts);
+	data.d = create_lfvector(numverts);
+	data.q = create_lfvector(numverts);
+	data.h = (Pinv)? create_lfvector(numverts): data.r;
+	data.alpha = data.beta = 0.0f;
+	data.partial = MEM_callocN(sizeof(float)*((numverts + CLOTH_CHUNK_SIZE - 1)/CLOTH_CHUNK_SIZE + 1), "cloth cg partial");
+
+	if(Pinv)
+		BuildPPinv(lA, P, Pinv);
 
 	// zero_lfvector(ldV, CLOTHPARTICLES);
 	filter(ldV, S);
 
 	add_lfvector_lfvector(ldV, ldV, z, numverts);
 
-	// r = B - Mul(tmp,A,X);    // just use B if X known to be zero
-	cp_lfvector(r, lB, numverts);
-	mul_bfmatrix_lfvector(tmp, lA, ldV);
-	sub_lfvector_lfvector(r, r, tmp, numverts);
-
-	filter(r,S);
+	// r = S(B - AX), d = P^-1 r
+	implicit_run_pass(id, &data, cg_pass_residual, numverts);
 
-	cp_lfvector(d, r, numverts);
-
-	s = dot_lfvector(r, r, numverts);
+	s = cg_sum_partial(&data, numverts);
 	starget = s * sqrt(conjgrad_epsilon);
 
 	while(s>starget && conjgrad_loopcount < conjgrad_looplimit)
-	{	
-		// Mul(q,A,d); // q = A*d;
-		mul_bfmatrix_lfvector(q, lA, d);
-
-		filter(q,S);
-
-		a = s/dot_lfvector(d, q, numverts);
+	{
+		// q = A*d;
+		implicit_run_pass(id, &data, cg_pass_search, numverts);
 
-		// X = X + d*a;
-		add_lfvector_lfvectorS(ldV, ldV, d, a, numverts);
+		data.alpha = s/cg_sum_partial(&data, numverts);
 
-		// r = r - q*a;
-		sub_lfvector_lfvectorS(r, r, q, a, numverts);
+		// X = X + d*a, r = r - q*a;
+		implicit_run_pass(id, &data, cg_pass_update, numverts);
 
 		s_prev = s;
-		s = dot_lfvector(r, r, numverts);
-
-		//d = r+d*(s/s_prev);
-		add_lfvector_lfvectorS(d, r, d, (s/s_prev), numverts);
+		s = cg_sum_partial(&data, numverts);
 
-		filter(d,S);
+		// d = r+d*(s/s_prev);
+		data.beta = s/s_prev;
+		implicit_run_pass(id, &data, cg_pass_direction, numverts);
 
 		conjgrad_loopcount++;
 	}
-	conjgrad_lasterror = s;
 
-	del_lfvector(q);
-	del_lfvector(d);
-	del_lfvector(tmp);
-	del_lfvector(r);
+	if(Pinv)
+		del_lfvector(data.h);
+	del_lfvector(data.q);
+	del_lfvector(data.d);
+	del_lfvector(data.r);
+	MEM_freeN(data.partial);
+
 	// printf("W/O conjgrad_loopcount: %d\n", conjgrad_loopcount);
 
-	return conjgrad_loopcount<conjgrad_looplimit;  // true means we reached desired accuracy in given time - ie stable
+	// less than conjgrad_looplimit means we reached desired accuracy in given time - ie stable
+	return (int)conjgrad_loopcount;
 }
 
-// block diagonalizer
-DO_INLINE void BuildPPinv(fmatrix3x3 *lA, fmatrix3x3 *P, fmatrix3x3 *Pinv)
-{
-	unsigned int i = 0;
-	
-	// Take only the diagonal blocks of A
-// #pragma omp parallel for private(i) if(lA[0].vcount > CLOTH_OPENMP_LIMIT)
-	for(i = 0; i<lA[0].vcount; i++)
-	{
-		// block diagonalizer
-		cp_fmatrix(P[i].m, lA[i].m);
-		inverse_fmatrix(Pinv[i].m, P[i].m);
-		
-	}
-}
 #if 0
 /*
 // version 1.3
@@ -1562,6 +1920,23 @@ static void hair_velocity_smoothing(ClothModifierData *clmd, lfVector *lF, lfVec
 	free_collider_cache(&colliders);
 }
 
+typedef struct ImplicitSpringData {
+	ClothModifierData *clmd;
+	ClothSpring **springs;
+	lfVector *X, *V;
+	float time;
+} ImplicitSpringData;
+
+/* springs only write their own force and jacobians */
+static void cloth_calc_spring_force_pass(void *data_v, unsigned int start, unsigned int end)
+{
+	ImplicitSpringData *data = data_v;
+	unsigned int i;
+
+	for(i = start; i < end; i++)
+		cloth_calc_spring_force(data->clmd, data->springs[i], NULL, data->X, data->V, NULL, NULL, data->time);
+}
+
 static void cloth_calc_force(ClothModifierData *clmd, float UNUSED(frame), lfVector *lF, lfVector *lX, lfVector *lV, fmatrix3x3 *dFdV, fmatrix3x3 *dFdX, ListBase *effectors, float time, fmatrix3x3 *M)
 {
 	/* Collect forces and derivatives:  F,dFdX,dFdV */
@@ -1575,6 +1950,7 @@ static void cloth_calc_force(ClothModifierData *clmd, float UNUSED(frame), lfVec
 	LinkNode *search;
 	lfVector *winvec;
 	EffectedPoint epoint;
+	ImplicitSpringData springdata;
 
 	tm2[0][0]= tm2[1][1]= tm2[2][2]= -spring_air;
 	
@@ -1695,17 +2071,16 @@ static void cloth_calc_force(ClothModifierData *clmd, float UNUSED(frame), lfVec
 	}
 		
 	// calculate spring forces
-	search = cloth->springs;
-	while(search)
-	{
-		// only handle active springs
-		// if(((clmd->sim_parms->flags & CSIMSETT_FLAG_TEARING_ENABLED) && !(springs[i].flags & CSPRING_FLAG_DEACTIVATE))|| !(clmd->sim_parms->flags & CSIMSETT_FLAG_TEARING_ENABLED)){}
-		cloth_calc_spring_force(clmd, search->link, lF, lX, lV, dFdV, dFdX, time);
-
-		search = search->next;
-	}
-	
-	// apply spring forces
+	// only handle active springs
+	// if(((clmd->sim_parms->flags & CSIMSETT_FLAG_TEARING_ENABLED) && !(springs[i].flags & CSPRING_FLAG_DEACTIVATE))|| !(clmd->sim_parms->flags & CSIMSETT_FLAG_TEARING_ENABLED)){}
+	springdata.clmd = clmd;
+	springdata.springs = cloth->implicit->springs;
+	springdata.X = lX;
+	springdata.V = lV;
+	springdata.time = time;
+	implicit_run_pass(cloth->implicit, &springdata, cloth_calc_spring_force_pass, cloth->implicit->numsprings);
+	
+	// apply spring forces, serially since springs share vertices
 	search = cloth->springs;
 	while(search)
 	{
@@ -1717,9 +2092,10 @@ static void cloth_calc_force(ClothModifierData *clmd, float UNUSED(frame), lfVec
 	// printf("\n");
 }
 
-static void simulate_implicit_euler(lfVector *Vnew, lfVector *UNUSED(lX), lfVector *lV, lfVector *lF, fmatrix3x3 *dFdV, fmatrix3x3 *dFdX, float dt, fmatrix3x3 *A, lfVector *B, lfVector *dV, fmatrix3x3 *S, lfVector *z, lfVector *olddV, fmatrix3x3 *UNUSED(P), fmatrix3x3 *UNUSED(Pinv), fmatrix3x3 *M, fmatrix3x3 *UNUSED(bigI))
+static void simulate_implicit_euler(Implicit_Data *id, int precondition, lfVector *Vnew, lfVector *UNUSED(lX), lfVector *lV, lfVector *lF, fmatrix3x3 *dFdV, fmatrix3x3 *dFdX, float dt, fmatrix3x3 *A, lfVector *B, lfVector *dV, fmatrix3x3 *S, lfVector *z, lfVector *olddV, fmatrix3x3 *P, fmatrix3x3 *Pinv, fmatrix3x3 *M, fmatrix3x3 *UNUSED(bigI))
 {
 	unsigned int numverts = dFdV[0].vcount;
+	int iterations;
 
 	lfVector *dFdXmV = create_lfvector(numverts);
 	zero_lfvector(dV, numverts);
@@ -1728,17 +2104,21 @@ static void simulate_implicit_euler(lfVector *Vnew, lfVector *UNUSED(lX), lfVect
 	
 	subadd_bfmatrixS_bfmatrixS(A, dFdV, dt, dFdX, (dt*dt));
 
-	mul_bfmatrix_lfvector(dFdXmV, dFdX, lV);
+	mul_bfmatrix_lfvector_threaded(id, dFdXmV, dFdX, lV);
 
 	add_lfvectorS_lfvectorS(B, lF, dt, dFdXmV, (dt*dt), numverts);
 	
 	itstart();
 	
-	cg_filtered(dV, A, B, z, S); /* conjugate gradient algorithm to solve Ax=b */
-	// cg_filtered_pre(dV, A, B, z, S, P, Pinv, bigI);
+	/* conjugate gradient algorithm to solve Ax=b */
+	iterations = cg_filtered(id, dV, A, B, z, S, P, (precondition)? Pinv: NULL);
 	
 	itend();
 	// printf("cg_filtered calc time: %f\n", (float)itval());
+
+	id->solves++;
+	id->iterations += iterations;
+	id->solve_time += itval();
 	
 	cp_lfvector(olddV, dV, numverts);
 
@@ -1838,6 +2218,11 @@ int implicit_solver (Object *ob, float frame, ClothModifierData *clmd, ListBase
 	float (*initial_cos)[3] = MEM_callocN(sizeof(float)*3*cloth->numverts, "initial_cos implicit.c");
 	Implicit_Data *id = cloth->implicit;
 	int do_extra_solve;
+	int precondition = clmd->sim_parms->flags & CLOTH_SIMSETTINGS_FLAG_PRECONDITION;
+
+	id->solves = id->iterations = 0;
+	id->solve_time = 0.0;
+	id->pool = implicit_pool_start(clmd, MAX2(numverts, id->numsprings));
 
 	if(clmd->sim_parms->flags & CLOTH_SIMSETTINGS_FLAG_GOAL) /* do goal stuff */
 	{
@@ -1858,7 +2243,7 @@ int implicit_solver (Object *ob, float frame, ClothModifierData *clmd, ListBase
 		cloth_calc_force(clmd, frame, id->F, id->X, id->V, id->dFdV, id->dFdX, effectors, step, id->M);
 		
 		// calculate new velocity
-		simulate_implicit_euler(id->Vnew, id->X, id->V, id->F, id->dFdV, id->dFdX, dt, id->A, id->B, id->dV, id->S, id->z, id->olddV, id->P, id->Pinv, id->M, id->bigI);
+		simulate_implicit_euler(id, precondition, id->Vnew, id->X, id->V, id->F, id->dFdV, id->dFdX, dt, id->A, id->B, id->dV, id->S, id->z, id->olddV, id->P, id->Pinv, id->M, id->bigI);
 		
 		// advance positions
 		add_lfvector_lfvectorS(id->Xnew, id->X, id->Vnew, dt, numverts);
@@ -1941,7 +2326,7 @@ int implicit_solver (Object *ob, float frame, ClothModifierData *clmd, ListBase
 				// calculate 
 				cloth_calc_force(clmd, frame, id->F, id->X, id->V, id->dFdV, id->dFdX, effectors, step+dt, id->M);	
 				
-				simulate_implicit_euler(id->Vnew, id->X, id->V, id->F, id->dFdV, id->dFdX, dt / 2.0f, id->A, id->B, id->dV, id->S, id->z, id->olddV, id->P, id->Pinv, id->M, id->bigI);
+				simulate_implicit_euler(id, precondition, id->Vnew, id->X, id->V, id->F, id->dFdV, id->dFdX, dt / 2.0f, id->A, id->B, id->dV, id->S, id->z, id->olddV, id->P, id->Pinv, id->M, id->bigI);
 			}
 		}
 		else
@@ -1976,6 +2361,12 @@ int implicit_solver (Object *ob, float frame, ClothModifierData *clmd, ListBase
 	}
 	
 	MEM_freeN(initial_cos);
+
+	implicit_pool_end(id->pool);
+	id->pool = NULL;
+
+	if(G.f & G_DEBUG)
+		printf("implicit_solver: %d solves, %d cg iterations, %f s\n", id->solves, id->iterations, id->solve_time);
 	
 	return 1;
 }
@@ -45,6 +45,7 @@
 
 #include "BLI_blenlib.h"
 #include "BLI_math.h"
+#include "BLI_threads.h"
 #include "BLI_utildefines.h"
 
 #include "DNA_mesh_types.h"
@@ -821,6 +822,10 @@ void curve_deform_vector(Scene *scene, Object *cuOb, Object *target, float *orco
 
 }
 
+/* the deform data is stored in the lattice for the target object, objects
+   sharing a lattice can be deformed in threads, see scene_update_tagged() */
+static ThreadMutex lattice_deform_lock = PTHREAD_MUTEX_INITIALIZER;
+
 void lattice_deform_verts(Object *laOb, Object *target, DerivedMesh *dm,
 						  float (*vertexCos)[3], int numVerts, char *vgroup)
 {
@@ -830,6 +835,8 @@ void lattice_deform_verts(Object *laOb, Object *target, DerivedMesh *dm,
 	if(laOb->type != OB_LATTICE)
 		return;
 
+	BLI_mutex_lock(&lattice_deform_lock);
+
 	init_latt_deform(laOb, target);
 
 	/* check whether to use vertex groups (only possible if target is a Mesh)
@@ -868,6 +875,8 @@ void lattice_deform_verts(Object *laOb, Object *target, DerivedMesh *dm,
 		}
 	}
 	end_latt_deform(laOb);
+
+	BLI_mutex_unlock(&lattice_deform_lock);
 }
 
 int object_deform_mball(Object *ob, ListBase *dispbase)
@@ -991,8 +1000,9 @@ void lattice_applyVertexCos(struct Object *ob, float (*vertexCos)[3])
 
 void lattice_calc_modifiers(Scene *scene, Object *ob)
 {
+	VirtualModifierData virtualModifierData;
 	Lattice *lt= ob->data;
-	ModifierData *md = modifiers_getVirtualModifierList(ob);
+	ModifierData *md = modifiers_getVirtualModifierList(ob, &virtualModifierData);
 	float (*vertexCos)[3] = NULL;
 	int numVerts, editmode = (lt->editlatt!=NULL);
 
@@ -52,6 +52,7 @@
 #include "BLI_editVert.h"
 #include "BLI_math.h"
 #include "BLI_edgehash.h"
+#include "BLI_threads.h"
 #include "BLI_utildefines.h"
 
 #include "BKE_animsys.h"
@@ -151,6 +152,9 @@ void free_mesh(Mesh *me)
 	if(me->bb) MEM_freeN(me->bb);
 	if(me->mselect) MEM_freeN(me->mselect);
 	if(me->edit_mesh) MEM_freeN(me->edit_mesh);
+
+	free_vert_corner_map(me->cornermap);
+	me->cornermap= NULL;
 }
 
 void copy_dverts(MDeformVert *dst, MDeformVert *src, int copycount)
@@ -237,6 +241,7 @@ Mesh *copy_mesh(Mesh *me)
 	
 	men->mselect= NULL;
 	men->edit_mesh= NULL;
+	men->cornermap= NULL;
 	men->pv= NULL; /* looks like this is no-longer supported but NULL just incase */
 
 	men->bb= MEM_dupallocN(men->bb);
@@ -1281,12 +1286,148 @@ void mesh_set_smooth_flag(Object *meshOb, int enableSmooth)
 	mesh_calc_normals(me->mvert, me->totvert, me->mface, me->totface, NULL);
 }
 
-void mesh_calc_normals(MVert *mverts, int numVerts, MFace *mfaces, int numFaces, float (*faceNors_r)[3]) 
+/* below this many faces threads cost more than they save */
+#define MESH_NORMALS_THREAD_LIMIT	10000
+
+static void mesh_face_normal(MVert *mverts, MFace *mf, float f_no[3])
+{
+	if(mf->v4)
+		normal_quad_v3(f_no, mverts[mf->v1].co, mverts[mf->v2].co, mverts[mf->v3].co, mverts[mf->v4].co);
+	else
+		normal_tri_v3(f_no, mverts[mf->v1].co, mverts[mf->v2].co, mverts[mf->v3].co);
+}
+
+/* angle weight of one corner, computed exactly as accumulate_vertex_normals does */
+static float mesh_corner_angle(MVert *mverts, MFace *mf, int corner)
+{
+	unsigned int *v= &mf->v1;
+	const int nverts= (mf->v4)? 4: 3;
+	const float *co= mverts[v[corner]].co;
+	float cur_edge[3], prev_edge[3];
+
+	sub_v3_v3v3(cur_edge, mverts[v[(corner+1) % nverts]].co, co);
+	sub_v3_v3v3(prev_edge, co, mverts[v[(corner+nverts-1) % nverts]].co);
+	normalize_v3(cur_edge);
+	normalize_v3(prev_edge);
+
+	return saacos(-dot_v3v3(cur_edge, prev_edge));
+}
+
+/* sums the weighted normals of the faces around a vertex in face order, which
+ * gives the same result as accumulating them face by face. Face normals are
+ * taken from fnors, or computed when it's NULL */
+static void mesh_vert_normal(MVert *mverts, MFace *mfaces, float (*fnors)[3], VertCornerMap *cmap, int v)
 {
-	float (*tnorms)[3]= MEM_callocN(numVerts*sizeof(*tnorms), "tnorms");
-	float (*fnors)[3]= (faceNors_r)? faceNors_r: MEM_callocN(sizeof(*fnors)*numFaces, "meshnormals");
+	float no[3]= {0.0f, 0.0f, 0.0f}, f_no[3];
 	int i;
 
+	for(i=cmap->first[v]; i<cmap->first[v+1]; i++) {
+		MFace *mf= &mfaces[cmap->corner[i] >> 2];
+
+		if(fnors)
+			copy_v3_v3(f_no, fnors[cmap->corner[i] >> 2]);
+		else
+			mesh_face_normal(mverts, mf, f_no);
+
+		madd_v3_v3fl(no, f_no, mesh_corner_angle(mverts, mf, cmap->corner[i] & 3));
+	}
+
+	/* following Mesh convention; we use vertex coordinate itself for normal in this case */
+	if(normalize_v3(no) == 0.0f)
+		normalize_v3_v3(no, mverts[v].co);
+
+	normal_float_to_short_v3(mverts[v].no, no);
+}
+
+typedef struct MeshNormalsRange {
+	MVert *mverts;
+	MFace *mfaces;
+	float (*fnors)[3];
+	VertCornerMap *cmap;
+	int start, end, do_verts;
+} MeshNormalsRange;
+
+static void *mesh_normals_thread(void *data)
+{
+	MeshNormalsRange *range= data;
+	int i;
+
+	if(range->do_verts) {
+		for(i=range->start; i<range->end; i++)
+			mesh_vert_normal(range->mverts, range->mfaces, range->fnors, range->cmap, i);
+	}
+	else {
+		for(i=range->start; i<range->end; i++)
+			mesh_face_normal(range->mverts, &range->mfaces[i], range->fnors[i]);
+	}
+
+	return NULL;
+}
+
+static void mesh_normals_pass(MeshNormalsRange *ranges, int totthread, int tot, int do_verts)
+{
+	ListBase threads;
+	int i;
+
+	for(i=0; i<totthread; i++) {
+		ranges[i].start= tot*i/totthread;
+		ranges[i].end= tot*(i+1)/totthread;
+		ranges[i].do_verts= do_verts;
+	}
+
+	BLI_init_threads(&threads, mesh_normals_thread, totthread);
+	for(i=0; i<totthread; i++)
+		BLI_insert_thread(&threads, &ranges[i]);
+	BLI_end_threads(&threads);
+}
+
+/* face normals first, then each vertex gathers its faces through a corner
+ * map, so both passes split over threads without locking */
+static void mesh_calc_normals_threaded(MVert *mverts, int numVerts, MFace *mfaces, int numFaces, float (*faceNors_r)[3], int totthread)
+{
+	MeshNormalsRange ranges[BLENDER_MAX_THREADS];
+	float (*fnors)[3]= (faceNors_r)? faceNors_r: MEM_mallocN(sizeof(*fnors)*numFaces, "meshnormals");
+	VertCornerMap *cmap= make_vert_corner_map(mfaces, numFaces, numVerts);
+	int i;
+
+	for(i=0; i<totthread; i++) {
+		ranges[i].mverts= mverts;
+		ranges[i].mfaces= mfaces;
+		ranges[i].fnors= fnors;
+		ranges[i].cmap= cmap;
+	}
+
+	mesh_normals_pass(ranges, totthread, numFaces, 0);
+	mesh_normals_pass(ranges, totthread, numVerts, 1);
+
+	free_vert_corner_map(cmap);
+
+	if(fnors != faceNors_r)
+		MEM_freeN(fnors);
+}
+
+void mesh_calc_normals(MVert *mverts, int numVerts, MFace *mfaces, int numFaces, float (*faceNors_r)[3]) 
+{
+	float (*tnorms)[3], (*fnors)[3];
+	int i, totthread;
+
+	/* modifiers, scene update and render threads get here too, they only
+	 * split over the cores that are free */
+	if(numFaces >= MESH_NORMALS_THREAD_LIMIT) {
+		totthread= BLI_thread_budget_acquire(BLENDER_MAX_THREADS);
+
+		if(totthread > 1)
+			mesh_calc_normals_threaded(mverts, numVerts, mfaces, numFaces, faceNors_r, totthread);
+
+		BLI_thread_budget_release(totthread);
+
+		if(totthread > 1)
+			return;
+	}
+
+	tnorms= MEM_callocN(numVerts*sizeof(*tnorms), "tnorms");
+	fnors= (faceNors_r)? faceNors_r: MEM_callocN(sizeof(*fnors)*numFaces, "meshnormals");
+
 	for(i=0; i<numFaces; i++) {
 		MFace *mf= &mfaces[i];
 		float *f_no= fnors[i];
@@ -1319,6 +1460,49 @@ void mesh_calc_normals(MVert *mverts, int numVerts, MFace *mfaces, int numFaces,
 		MEM_freeN(fnors);
 }
 
+void mesh_calc_normals_partial(MVert *mverts, int numVerts, MFace *mfaces, int numFaces,
+	float (*faceNors)[3], VertCornerMap *cmap, const int *dirty, int totdirty)
+{
+	char *fflag= MEM_callocN(sizeof(char)*numFaces, "partial normals fflag");
+	char *vflag= MEM_callocN(sizeof(char)*numVerts, "partial normals vflag");
+	int *verts= MEM_mallocN(sizeof(int)*numVerts, "partial normals verts");
+	int a, i, j, totvert= 0;
+
+	/* the dirty faces, and every vertex using one of them */
+	for(a=0; a<totdirty; a++) {
+		if(!vflag[dirty[a]]) {
+			vflag[dirty[a]]= 1;
+			verts[totvert++]= dirty[a];
+		}
+
+		for(i=cmap->first[dirty[a]]; i<cmap->first[dirty[a]+1]; i++) {
+			int f= cmap->corner[i] >> 2;
+			MFace *mf= &mfaces[f];
+			unsigned int *v= &mf->v1;
+
+			if(fflag[f]) continue;
+			fflag[f]= 1;
+
+			if(faceNors)
+				mesh_face_normal(mverts, mf, faceNors[f]);
+
+			for(j=0; j<((mf->v4)? 4: 3); j++) {
+				if(!vflag[v[j]]) {
+					vflag[v[j]]= 1;
+					verts[totvert++]= v[j];
+				}
+			}
+		}
+	}
+
+	for(a=0; a<totvert; a++)
+		mesh_vert_normal(mverts, mfaces, faceNors, cmap, verts[a]);
+
+	MEM_freeN(fflag);
+	MEM_freeN(vflag);
+	MEM_freeN(verts);
+}
+
 float (*mesh_getVertexCos(Mesh *me, int *numVerts_r))[3]
 {
 	int i, numVerts = me->totvert;
@@ -1440,6 +1624,93 @@ void free_uv_vert_map(UvVertMap *vmap)
 	}
 }
 
+VertCornerMap *make_vert_corner_map(const MFace *mface, int totface, int totvert)
+{
+	VertCornerMap *cmap= MEM_callocN(sizeof(VertCornerMap), "VertCornerMap");
+	int *fill;
+	int i, j;
+
+	/* count the corners of each vertex, then turn the counts into offsets */
+	cmap->first= MEM_callocN(sizeof(int)*(totvert+1), "VertCornerMap first");
+	for(i=0; i<totface; i++)
+		for(j=0; j<(mface[i].v4? 4: 3); j++)
+			cmap->first[(&mface[i].v1)[j] + 1]++;
+
+	for(i=0; i<totvert; i++)
+		cmap->first[i+1] += cmap->first[i];
+
+	cmap->corner= MEM_mallocN(sizeof(int)*MAX2(cmap->first[totvert], 1), "VertCornerMap corner");
+	fill= MEM_mallocN(sizeof(int)*MAX2(totvert, 1), "VertCornerMap fill");
+	memcpy(fill, cmap->first, sizeof(int)*totvert);
+
+	/* filling in face order keeps the corners of each vertex sorted */
+	for(i=0; i<totface; i++)
+		for(j=0; j<(mface[i].v4? 4: 3); j++)
+			cmap->corner[fill[(&mface[i].v1)[j]]++]= i*4 + j;
+
+	MEM_freeN(fill);
+
+	cmap->totvert= totvert;
+	cmap->totface= totface;
+
+	return cmap;
+}
+
+void free_vert_corner_map(VertCornerMap *cmap)
+{
+	if(cmap) {
+		MEM_freeN(cmap->first);
+		MEM_freeN(cmap->corner);
+		MEM_freeN(cmap);
+	}
+}
+
+static ThreadMutex mesh_cornermap_lock = BLI_MUTEX_INITIALIZER;
+
+static unsigned int mesh_face_topology(const MFace *mface, int totface)
+{
+	unsigned int h= 2166136261u;
+	int i;
+
+	/* FNV-1a over the faces, the corners of a face are mixed independently
+	   so one pass is much cheaper than building the map */
+	for(i=0; i<totface; i++) {
+		unsigned int k= (mface[i].v1 * 0x9E3779B1u) ^ (mface[i].v2 * 0x85EBCA77u) ^
+		                (mface[i].v3 * 0xC2B2AE3Du) ^ (mface[i].v4 * 0x27D4EB2Fu);
+		h= (h ^ k) * 16777619u;
+	}
+
+	return h;
+}
+
+/* objects sharing the mesh can get it from scene update threads at the same
+ * time. the map is only replaced when the faces changed, which doesn't happen
+ * while objects using it are updated, so it stays valid for the caller */
+VertCornerMap *mesh_get_vert_corner_map(Mesh *me)
+{
+	VertCornerMap *cmap;
+	unsigned int topology= mesh_face_topology(me->mface, me->totface);
+
+	BLI_mutex_lock(&mesh_cornermap_lock);
+
+	cmap= me->cornermap;
+
+	if(cmap && (cmap->totvert != me->totvert || cmap->totface != me->totface || cmap->topology != topology)) {
+		free_vert_corner_map(cmap);
+		cmap= NULL;
+	}
+
+	if(cmap == NULL) {
+		cmap= make_vert_corner_map(me->mface, me->totface, me->totvert);
+		cmap->topology= topology;
+		me->cornermap= cmap;
+	}
+
+	BLI_mutex_unlock(&mesh_cornermap_lock);
+
+	return cmap;
+}
+
 /* Generates a map where the key is the vertex and the value is a list
    of faces that use that vertex as a corner. The lists are allocated
    from one memory pool. */
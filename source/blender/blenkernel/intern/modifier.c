@@ -51,9 +51,11 @@
 #include "DNA_object_types.h"
 #include "DNA_meshdata_types.h"
 
+#include "BLI_threads.h"
 #include "BLI_utildefines.h"
 
 #include "BKE_bmesh.h"
+#include "BKE_DerivedMesh.h"
 #include "BKE_cloth.h"
 #include "BKE_key.h"
 #include "BKE_multires.h"
@@ -108,6 +110,8 @@ void modifier_free(ModifierData *md)
 	if (mti->freeData) mti->freeData(md);
 	if (md->error) MEM_freeN(md->error);
 
+	DM_modifier_cache_remove(md);
+
 	MEM_freeN(md);
 }
 
@@ -261,7 +265,8 @@ void modifier_setError(ModifierData *md, const char *format, ...)
  */
 int modifiers_getCageIndex(struct Scene *scene, Object *ob, int *lastPossibleCageIndex_r, int virtual_)
 {
-	ModifierData *md = (virtual_)? modifiers_getVirtualModifierList(ob): ob->modifiers.first;
+	VirtualModifierData virtualModifierData;
+	ModifierData *md = (virtual_)? modifiers_getVirtualModifierList(ob, &virtualModifierData): ob->modifiers.first;
 	int i, cageIndex = -1;
 
 	if(lastPossibleCageIndex_r) {
@@ -371,83 +376,102 @@ LinkNode *modifiers_calcDataMasks(struct Scene *scene, Object *ob, ModifierData
 	return dataMasks;
 }
 
-ModifierData *modifiers_getVirtualModifierList(Object *ob)
+/* defaults for the virtual modifiers, copied for every caller */
+static VirtualModifierData virtualModifierCommonData;
+static int virtualModifierCommonInit = 1;
+static ThreadMutex virtualModifierCommonLock = PTHREAD_MUTEX_INITIALIZER;
+
+static void virtual_modifier_common_init(void)
 {
-		/* Kinda hacky, but should be fine since we are never
-	* reentrant and avoid free hassles.
-		*/
-	static ArmatureModifierData amd;
-	static CurveModifierData cmd;
-	static LatticeModifierData lmd;
-	static ShapeKeyModifierData smd;
-	static int init = 1;
 	ModifierData *md;
 
-	if (init) {
+	BLI_mutex_lock(&virtualModifierCommonLock);
+
+	if (virtualModifierCommonInit) {
 		md = modifier_new(eModifierType_Armature);
-		amd = *((ArmatureModifierData*) md);
+		virtualModifierCommonData.amd = *((ArmatureModifierData*) md);
 		modifier_free(md);
 
 		md = modifier_new(eModifierType_Curve);
-		cmd = *((CurveModifierData*) md);
+		virtualModifierCommonData.cmd = *((CurveModifierData*) md);
 		modifier_free(md);
 
 		md = modifier_new(eModifierType_Lattice);
-		lmd = *((LatticeModifierData*) md);
+		virtualModifierCommonData.lmd = *((LatticeModifierData*) md);
 		modifier_free(md);
 
 		md = modifier_new(eModifierType_ShapeKey);
-		smd = *((ShapeKeyModifierData*) md);
+		virtualModifierCommonData.smd = *((ShapeKeyModifierData*) md);
 		modifier_free(md);
 
-		amd.modifier.mode |= eModifierMode_Virtual;
-		cmd.modifier.mode |= eModifierMode_Virtual;
-		lmd.modifier.mode |= eModifierMode_Virtual;
-		smd.modifier.mode |= eModifierMode_Virtual;
+		virtualModifierCommonData.amd.modifier.mode |= eModifierMode_Virtual;
+		virtualModifierCommonData.cmd.modifier.mode |= eModifierMode_Virtual;
+		virtualModifierCommonData.lmd.modifier.mode |= eModifierMode_Virtual;
+		virtualModifierCommonData.smd.modifier.mode |= eModifierMode_Virtual;
 
-		init = 0;
+		virtualModifierCommonInit = 0;
 	}
 
+	BLI_mutex_unlock(&virtualModifierCommonLock);
+}
+
+/* the virtual modifiers are stored in virtualModifierData, so objects can be
+ * evaluated in several threads. it must stay around while the list is used */
+ModifierData *modifiers_getVirtualModifierList(Object *ob, VirtualModifierData *virtualModifierData)
+{
+	ArmatureModifierData *amd = &virtualModifierData->amd;
+	CurveModifierData *cmd = &virtualModifierData->cmd;
+	LatticeModifierData *lmd = &virtualModifierData->lmd;
+	ShapeKeyModifierData *smd = &virtualModifierData->smd;
+	ModifierData *md;
+
+	if (virtualModifierCommonInit)
+		virtual_modifier_common_init();
+
+	*virtualModifierData = virtualModifierCommonData;
+
 	md = ob->modifiers.first;
 
 	if(ob->parent) {
 		if(ob->parent->type==OB_ARMATURE && ob->partype==PARSKEL) {
-			amd.object = ob->parent;
-			amd.modifier.next = md;
-			amd.deformflag= ((bArmature *)(ob->parent->data))->deformflag;
-			md = &amd.modifier;
+			amd->object = ob->parent;
+			amd->modifier.next = md;
+			amd->deformflag= ((bArmature *)(ob->parent->data))->deformflag;
+			md = &amd->modifier;
 		} else if(ob->parent->type==OB_CURVE && ob->partype==PARSKEL) {
-			cmd.object = ob->parent;
-			cmd.defaxis = ob->trackflag + 1;
-			cmd.modifier.next = md;
-			md = &cmd.modifier;
+			cmd->object = ob->parent;
+			cmd->defaxis = ob->trackflag + 1;
+			cmd->modifier.next = md;
+			md = &cmd->modifier;
 		} else if(ob->parent->type==OB_LATTICE && ob->partype==PARSKEL) {
-			lmd.object = ob->parent;
-			lmd.modifier.next = md;
-			md = &lmd.modifier;
+			lmd->object = ob->parent;
+			lmd->modifier.next = md;
+			md = &lmd->modifier;
 		}
 	}
 
 	/* shape key modifier, not yet for curves */
 	if(ELEM(ob->type, OB_MESH, OB_LATTICE) && ob_get_key(ob)) {
 		if(ob->type == OB_MESH && (ob->shapeflag & OB_SHAPE_EDIT_MODE))
-			smd.modifier.mode |= eModifierMode_Editmode|eModifierMode_OnCage;
+			smd->modifier.mode |= eModifierMode_Editmode|eModifierMode_OnCage;
 		else
-			smd.modifier.mode &= ~eModifierMode_Editmode|eModifierMode_OnCage;
+			smd->modifier.mode &= ~eModifierMode_Editmode|eModifierMode_OnCage;
 
-		smd.modifier.next = md;
-		md = &smd.modifier;
+		smd->modifier.next = md;
+		md = &smd->modifier;
 	}
 
 	return md;
 }
+
 /* Takes an object and returns its first selected armature, else just its
  * armature
  * This should work for multiple armatures per object
  */
 Object *modifiers_isDeformedByArmature(Object *ob)
 {
-	ModifierData *md = modifiers_getVirtualModifierList(ob);
+	VirtualModifierData virtualModifierData;
+	ModifierData *md = modifiers_getVirtualModifierList(ob, &virtualModifierData);
 	ArmatureModifierData *amd= NULL;
 	
 	/* return the first selected armature, this lets us use multiple armatures
@@ -472,7 +496,8 @@ Object *modifiers_isDeformedByArmature(Object *ob)
 */
 Object *modifiers_isDeformedByLattice(Object *ob)
 {
-	ModifierData *md = modifiers_getVirtualModifierList(ob);
+	VirtualModifierData virtualModifierData;
+	ModifierData *md = modifiers_getVirtualModifierList(ob, &virtualModifierData);
 	LatticeModifierData *lmd= NULL;
 	
 	/* return the first selected lattice, this lets us use multiple lattices
@@ -495,7 +520,8 @@ Object *modifiers_isDeformedByLattice(Object *ob)
 
 int modifiers_usesArmature(Object *ob, bArmature *arm)
 {
-	ModifierData *md = modifiers_getVirtualModifierList(ob);
+	VirtualModifierData virtualModifierData;
+	ModifierData *md = modifiers_getVirtualModifierList(ob, &virtualModifierData);
 
 	for (; md; md=md->next) {
 		if (md->type==eModifierType_Armature) {
@@ -520,7 +546,8 @@ int modifier_isCorrectableDeformed(ModifierData *md)
 
 int modifiers_isCorrectableDeformed(Object *ob)
 {
-	ModifierData *md = modifiers_getVirtualModifierList(ob);
+	VirtualModifierData virtualModifierData;
+	ModifierData *md = modifiers_getVirtualModifierList(ob, &virtualModifierData);
 	
 	for (; md; md=md->next) {
 		if(ob->mode==OB_MODE_EDIT && (md->mode & eModifierMode_Editmode)==0);
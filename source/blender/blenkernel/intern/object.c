@@ -62,6 +62,7 @@
 #include "BLI_editVert.h"
 #include "BLI_math.h"
 #include "BLI_pbvh.h"
+#include "BLI_threads.h"
 #include "BLI_utildefines.h"
 
 #include "BKE_main.h"
@@ -1195,8 +1196,11 @@ static ParticleSystem *copy_particlesystem(ParticleSystem *psys)
 	psysn->childcache= NULL;
 	psysn->edit= NULL;
 	psysn->frand= NULL;
+	psysn->childcachesum= NULL;
 	psysn->pdd= NULL;
 	psysn->effectors= NULL;
+	psysn->tree= NULL;
+	psysn->spatialhash= NULL;
 	
 	psysn->pathcachebufs.first = psysn->pathcachebufs.last = NULL;
 	psysn->childcachebufs.first = psysn->childcachebufs.last = NULL;
@@ -2562,6 +2566,9 @@ void object_tfm_restore(Object *ob, void *obtfm_pt)
 /* proxy rule: lib_object->proxy_from == the one we borrow from, only set temporal and cleared here */
 /*           local_object->proxy      == pointer to library object, saved in files and read */
 
+/* objects can be updated in threads, see scene_update_tagged() */
+static ThreadMutex quick_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
 /* function below is polluted with proxy exceptions, cleanup will follow! */
 
 /* the main object update call, for object matrix, constraints, keys and displist (modifiers) */
@@ -2726,10 +2733,12 @@ void object_handle_update(Scene *scene, Object *ob)
 					continue;
 
 				if(pid->cache->flag & PTCACHE_OUTDATED || (pid->cache->flag & PTCACHE_SIMULATION_VALID)==0) {
+					BLI_mutex_lock(&quick_cache_lock);
 					scene->physics_settings.quick_cache_step =
 						scene->physics_settings.quick_cache_step ?
 						MIN2(scene->physics_settings.quick_cache_step, pid->cache->step) :
 						pid->cache->step;
+					BLI_mutex_unlock(&quick_cache_lock);
 				}
 			}
 
@@ -3138,8 +3147,9 @@ int object_is_modified(Scene *scene, Object *ob)
 	}
 	else {
 		ModifierData *md;
+		VirtualModifierData virtualModifierData;
 		/* cloth */
-		for(md=modifiers_getVirtualModifierList(ob); md && (flag != (eModifierMode_Render | eModifierMode_Realtime)); md=md->next) {
+		for(md=modifiers_getVirtualModifierList(ob, &virtualModifierData); md && (flag != (eModifierMode_Render | eModifierMode_Realtime)); md=md->next) {
 			if((flag & eModifierMode_Render) == 0	&& modifier_isEnabled(scene, md, eModifierMode_Render))		flag |= eModifierMode_Render;
 			if((flag & eModifierMode_Realtime) == 0	&& modifier_isEnabled(scene, md, eModifierMode_Realtime))	flag |= eModifierMode_Realtime;
 		}
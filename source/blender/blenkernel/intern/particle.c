@@ -54,6 +54,7 @@
 #include "BLI_math.h"
 #include "BLI_utildefines.h"
 #include "BLI_kdtree.h"
+#include "BLI_spatialhash.h"
 #include "BLI_rand.h"
 #include "BLI_threads.h"
 
@@ -445,6 +446,11 @@ static void free_child_path_cache(ParticleSystem *psys)
 	psys_free_path_cache_buffers(psys->childcache, &psys->childcachebufs);
 	psys->childcache = NULL;
 	psys->totchildcache = 0;
+
+	if(psys->childcachesum) {
+		MEM_freeN(psys->childcachesum);
+		psys->childcachesum = NULL;
+	}
 }
 void psys_free_path_cache(ParticleSystem *psys, PTCacheEdit *edit)
 {
@@ -564,7 +570,7 @@ void psys_free(Object *ob, ParticleSystem * psys)
 		
 		BLI_freelistN(&psys->targets);
 
-		BLI_bvhtree_free(psys->bvhtree);
+		BLI_spatialhash_free(psys->spatialhash);
 		BLI_kdtree_free(psys->tree);
  
 		if(psys->fluid_springs)
@@ -1065,7 +1071,7 @@ typedef struct ParticleInterpolationData {
 /* It uses ParticleInterpolationData->pm to store the current memory cache frame so it's thread safe. */
 static void get_pointcache_keys_for_time(Object *UNUSED(ob), PointCache *cache, PTCacheMem **cur, int index, float t, ParticleKey *key1, ParticleKey *key2)
 {
-	static PTCacheMem *pm = NULL;
+	PTCacheMem *pm;
 	int index1, index2;
 
 	if(index < 0) { /* initialize */
@@ -2727,35 +2733,163 @@ static void psys_thread_create_path(ParticleThread *thread, struct ChildParticle
 		child_keys->steps = -1;
 }
 
+/* children threads take from the context */
+#define PSYS_CHILD_CHUNK 256
+
+/* checksum of size bytes of data, added to sum */
+static unsigned int child_cache_checksum(unsigned int sum, const void *data, int size)
+{
+	const unsigned int *word= data;
+	int i;
+
+	for(i=0; i<size/(int)sizeof(unsigned int); i++)
+		sum= (sum ^ word[i]) * 16777619u;
+
+	return sum;
+}
+
+/* checksums of what child paths are made from: the first one of the emitter
+ * and settings, then one for each parent path. NULL if the children depend on
+ * things that can't be checked, like time or other objects */
+static unsigned int *psys_child_cache_checksums(ParticleThreadContext *ctx)
+{
+	ParticleSystem *psys= ctx->sim.psys;
+	ParticleSettings *part= psys->part;
+	ParticleCacheKey **pcache= psys_in_edit_mode(ctx->sim.scene, psys) ? psys->edit->pathcache : psys->pathcache;
+	DerivedMesh *dm= ctx->sim.psmd->dm;
+	MVert *mvert;
+	unsigned int *sum;
+	float *vg[6];
+	int ival[5];
+	int p, m, totvert;
+
+	if(psys->renderdata || ctx->editupdate || psys->recalc || psys->lattice || !pcache || !dm)
+		return NULL;
+
+	if(part->flag & PART_CHILD_EFFECT)
+		return NULL;
+
+	for(m=0; m<MAX_MTEX; m++) {
+		if(part->mtex[m] && (part->mtex[m]->mapto & (PAMAP_CHILD|PAMAP_DENS)))
+			return NULL;
+	}
+
+	sum= MEM_callocN(sizeof(unsigned int)*(psys->totpart+1), "child cache checksums");
+
+	sum[0]= 2166136261u;
+	sum[0]= child_cache_checksum(sum[0], &ctx->steps, sizeof(int));
+	sum[0]= child_cache_checksum(sum[0], &ctx->totchild, sizeof(int));
+	sum[0]= child_cache_checksum(sum[0], &ctx->totparent, sizeof(int));
+	sum[0]= child_cache_checksum(sum[0], &ctx->between, sizeof(int));
+	sum[0]= child_cache_checksum(sum[0], ctx->sim.ob->obmat, sizeof(float)*16);
+
+	/* the child settings can be animated or driven, that only tags the object
+	 * for an update and not the particle system */
+	ival[0]= part->flag; ival[1]= part->childtype; ival[2]= part->draw_col;
+	ival[3]= part->kink; ival[4]= part->kink_axis;
+	sum[0]= child_cache_checksum(sum[0], ival, sizeof(ival));
+	sum[0]= child_cache_checksum(sum[0], &part->randlength, sizeof(float));
+	sum[0]= child_cache_checksum(sum[0], &part->child_nbr,
+		(char*)(&part->branch_thres + 1) - (char*)&part->child_nbr);
+	sum[0]= child_cache_checksum(sum[0], &psys->seed, sizeof(int)*2);
+
+	if(ctx->ma) {
+		sum[0]= child_cache_checksum(sum[0], &ctx->ma->r, sizeof(float)*3);
+		sum[0]= child_cache_checksum(sum[0], &ctx->ma->strand_surfnor, sizeof(float));
+	}
+
+	/* children are placed on the emitter and weighted by its vertex groups */
+	totvert= dm->getNumVerts(dm);
+	mvert= dm->getVertArray(dm);
+	for(p=0; p<totvert; p++)
+		sum[0]= child_cache_checksum(sum[0], mvert[p].co, sizeof(float)*3);
+
+	vg[0]= ctx->vg_length; vg[1]= ctx->vg_clump; vg[2]= ctx->vg_kink;
+	vg[3]= ctx->vg_rough1; vg[4]= ctx->vg_rough2; vg[5]= ctx->vg_roughe;
+	for(m=0; m<6; m++) {
+		if(vg[m])
+			sum[0]= child_cache_checksum(sum[0], vg[m], sizeof(float)*totvert);
+	}
+
+	for(p=0; p<psys->totpart; p++) {
+		ParticleCacheKey *key= pcache[p];
+
+		sum[p+1]= child_cache_checksum(2166136261u, &key->steps, sizeof(int));
+		if(key->steps >= 0)
+			sum[p+1]= child_cache_checksum(sum[p+1], key, sizeof(ParticleCacheKey)*(key->steps+1));
+	}
+
+	return sum;
+}
+
+/* children of virtual parents also follow those */
+static int child_parents_moved(ParticleThreadContext *ctx, ChildParticle *cpa, int i)
+{
+	int w;
+
+	if(!ctx->between)
+		return ctx->parent_moved[cpa->parent];
+
+	for(w=0; w<4 && cpa->pa[w]>=0; w++) {
+		if(ctx->parent_moved[cpa->pa[w]])
+			return 1;
+	}
+
+	if(ctx->totparent && i >= ctx->totparent)
+		return child_parents_moved(ctx, ctx->sim.psys->child + cpa->parent, cpa->parent);
+
+	return 0;
+}
+
 static void *exec_child_path_cache(void *data)
 {
 	ParticleThread *thread= (ParticleThread*)data;
 	ParticleThreadContext *ctx= thread->ctx;
 	ParticleSystem *psys= ctx->sim.psys;
 	ParticleCacheKey **cache= psys->childcache;
-	ChildParticle *cpa;
-	int i, totchild= ctx->totchild, first= 0;
+	int i, start, end, totchild= ctx->totchild;
 
-	if(thread->tot > 1){
-		first= ctx->parent_pass? 0 : ctx->totparent;
+	if(thread->tot > 1)
 		totchild= ctx->parent_pass? ctx->totparent : ctx->totchild;
+
+	/* children differ a lot in cost (hidden, reused, kinked), so instead of
+	 * a fixed part each thread takes chunks of them until none are left */
+	while(1) {
+		if(ctx->child_lock)
+			BLI_mutex_lock(ctx->child_lock);
+		start= ctx->child_next;
+		end= ctx->child_next= MIN2(start + PSYS_CHILD_CHUNK, totchild);
+		if(ctx->child_lock)
+			BLI_mutex_unlock(ctx->child_lock);
+
+		if(start >= totchild)
+			break;
+
+		for(i=start; i<end; i++) {
+			if(ctx->parent_moved) {
+				if(!child_parents_moved(ctx, psys->child + i, i))
+					continue;
+
+				memset(cache[i], 0, sizeof(ParticleCacheKey)*(ctx->steps+1));
+			}
+
+			psys_thread_create_path(thread, psys->child + i, cache[i], i);
+		}
 	}
-	
-	cpa= psys->child + first + thread->num;
-	for(i=first+thread->num; i<totchild; i+=thread->tot, cpa+=thread->tot)
-		psys_thread_create_path(thread, cpa, cache[i], i);
 
 	return 0;
 }
 
 void psys_cache_child_paths(ParticleSimulationData *sim, float cfra, int editupdate)
 {
+	ParticleSystem *psys= sim->psys;
 	ParticleThread *pthreads;
 	ParticleThreadContext *ctx;
 	ListBase threads;
-	int i, totchild, totparent, totthread;
+	unsigned int *sum;
+	int i, totchild, totparent, totthread, totmoved= 0;
 
-	if(sim->psys->flag & PSYS_GLOBAL_HAIR)
+	if(psys->flag & PSYS_GLOBAL_HAIR)
 		return;
 
 	pthreads= psys_threads_create(sim);
@@ -2769,44 +2903,73 @@ void psys_cache_child_paths(ParticleSimulationData *sim, float cfra, int editupd
 	totchild= ctx->totchild;
 	totparent= ctx->totparent;
 
-	if(editupdate && sim->psys->childcache && totchild == sim->psys->totchildcache) {
+	sum= psys_child_cache_checksums(ctx);
+
+	if(editupdate && psys->childcache && totchild == psys->totchildcache) {
 		; /* just overwrite the existing cache */
 	}
+	else if(sum && psys->childcache && totchild == psys->totchildcache && psys->childcachesum &&
+		MEM_allocN_len(psys->childcachesum) == MEM_allocN_len(sum) && psys->childcachesum[0] == sum[0]) {
+		/* only recalculate children of parents that moved */
+		ctx->parent_moved= MEM_callocN(sizeof(char)*psys->totpart, "parent moved");
+
+		for(i=0; i<psys->totpart; i++) {
+			if(psys->childcachesum[i+1] != sum[i+1]) {
+				ctx->parent_moved[i]= 1;
+				totmoved++;
+			}
+		}
+	}
 	else {
 		/* clear out old and create new empty path cache */
-		free_child_path_cache(sim->psys);
-		sim->psys->childcache= psys_alloc_path_cache_buffers(&sim->psys->childcachebufs, totchild, ctx->steps+1);
-		sim->psys->totchildcache = totchild;
+		free_child_path_cache(psys);
+		psys->childcache= psys_alloc_path_cache_buffers(&psys->childcachebufs, totchild, ctx->steps+1);
+		psys->totchildcache = totchild;
+	}
+
+	if(psys->childcachesum)
+		MEM_freeN(psys->childcachesum);
+	psys->childcachesum= sum;
+
+	if(ctx->parent_moved && totmoved == 0) {
+		psys_threads_free(pthreads);
+		return;
 	}
 
 	totthread= pthreads[0].tot;
 
 	if(totthread > 1) {
+		ctx->child_lock= MEM_callocN(sizeof(ThreadMutex), "child path lock");
+		BLI_mutex_init(ctx->child_lock);
 
 		/* make virtual child parents thread safe by calculating them first */
 		if(totparent) {
 			BLI_init_threads(&threads, exec_child_path_cache, totthread);
 			
-			for(i=0; i<totthread; i++) {
-				pthreads[i].ctx->parent_pass = 1;
+			ctx->parent_pass = 1;
+			ctx->child_next = 0;
+
+			for(i=0; i<totthread; i++)
 				BLI_insert_thread(&threads, &pthreads[i]);
-			}
 
 			BLI_end_threads(&threads);
 
-			for(i=0; i<totthread; i++)
-				pthreads[i].ctx->parent_pass = 0;
+			ctx->parent_pass = 0;
 		}
 
 		BLI_init_threads(&threads, exec_child_path_cache, totthread);
 
+		ctx->child_next = totparent;
+
 		for(i=0; i<totthread; i++)
 			BLI_insert_thread(&threads, &pthreads[i]);
 
 		BLI_end_threads(&threads);
 	}
-	else
+	else {
+		ctx->child_next = 0;
 		exec_child_path_cache(&pthreads[0]);
+	}
 
 	psys_threads_free(pthreads);
 }
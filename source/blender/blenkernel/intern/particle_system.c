@@ -65,6 +65,7 @@
 #include "BLI_math.h"
 #include "BLI_blenlib.h"
 #include "BLI_kdtree.h"
+#include "BLI_spatialhash.h"
 #include "BLI_kdopbvh.h"
 #include "BLI_listbase.h"
 #include "BLI_threads.h"
@@ -967,7 +968,9 @@ static void *distribute_threads_exec_cb(void *data)
 	return 0;
 }
 
-/* not thread safe, but qsort doesn't take userdata argument */
+/* qsort doesn't take userdata argument, compare_orig_index_lock guards it
+   since particle systems of different objects can be distributed in threads */
+static ThreadMutex compare_orig_index_lock = PTHREAD_MUTEX_INITIALIZER;
 static int *COMPARE_ORIG_INDEX = NULL;
 static int distribute_compare_orig_index(const void *p1, const void *p2)
 {
@@ -1272,6 +1275,7 @@ static int distribute_threads_init_data(ParticleThread *threads, Scene *scene, D
 	/* For hair, sort by origindex (allows optimizations in rendering), */
 	/* however with virtual parents the children need to be in random order. */
 	if(part->type == PART_HAIR && !(part->childtype==PART_CHILD_FACES && part->parents!=0.0f)) {
+		BLI_mutex_lock(&compare_orig_index_lock);
 		COMPARE_ORIG_INDEX = NULL;
 
 		if(from == PART_FROM_VERT) {
@@ -1287,6 +1291,7 @@ static int distribute_threads_init_data(ParticleThread *threads, Scene *scene, D
 			qsort(particle_element, totpart, sizeof(int), distribute_compare_orig_index);
 			COMPARE_ORIG_INDEX = NULL;
 		}
+		BLI_mutex_unlock(&compare_orig_index_lock);
 	}
 
 	/* Create jittering if needed */
@@ -1458,6 +1463,12 @@ void psys_threads_free(ParticleThread *threads)
 		MEM_freeN(ctx->vg_rough2);
 	if(ctx->vg_roughe)
 		MEM_freeN(ctx->vg_roughe);
+	if(ctx->parent_moved)
+		MEM_freeN(ctx->parent_moved);
+	if(ctx->child_lock) {
+		BLI_mutex_end(ctx->child_lock);
+		MEM_freeN(ctx->child_lock);
+	}
 
 	if(ctx->sim.psys->lattice){
 		end_latt_deform(ctx->sim.psys->lattice);
@@ -1474,12 +1485,18 @@ void psys_threads_free(ParticleThread *threads)
 	//if(ctx->vertpart) MEM_freeN(ctx->vertpart);
 	BLI_kdtree_free(ctx->tree);
 
+	/* dynamics */
+	if(ctx->springhash)
+		BLI_edgehash_free(ctx->springhash, NULL);
+
 	/* threads */
 	for(i=0; i<totthread; i++) {
 		if(threads[i].rng)
 			rng_free(threads[i].rng);
 		if(threads[i].rng_path)
 			rng_free(threads[i].rng_path);
+		if(threads[i].fluid_springs)
+			MEM_freeN(threads[i].fluid_springs);
 	}
 
 	MEM_freeN(ctx);
@@ -2013,31 +2030,42 @@ void psys_get_pointcache_start_end(Scene *scene, ParticleSystem *psys, int *sfra
 /************************************************/
 /*			Effectors							*/
 /************************************************/
-static void psys_update_particle_bvhtree(ParticleSystem *psys, float cfra)
+/* SPH search radius of particles with the base size */
+static float sph_search_radius(ParticleSettings *part)
+{
+	SPHFluidSettings *fluid = part->fluid;
+
+	return fluid->radius * (fluid->flag & SPH_FAC_RADIUS ? 4.f*part->size : 1.f);
+}
+/* the hash is kept between steps, only particles that moved to another cell
+   are relinked. cellsize should be the largest search radius */
+static void psys_update_particle_spatialhash(ParticleSystem *psys, float cfra, float cellsize)
 {
 	if(psys) {
 		PARTICLE_P;
-		int totpart = 0;
 
-		if(!psys->bvhtree || psys->bvhtree_frame != cfra) {
-			LOOP_SHOWN_PARTICLES {
-				totpart++;
-			}
-			
-			BLI_bvhtree_free(psys->bvhtree);
-			psys->bvhtree = BLI_bvhtree_new(totpart, 0.0, 4, 6);
+		if(psys->spatialhash && (BLI_spatialhash_maxsize(psys->spatialhash) != psys->totpart
+			|| BLI_spatialhash_cellsize(psys->spatialhash) != cellsize)) {
+			BLI_spatialhash_free(psys->spatialhash);
+			psys->spatialhash = NULL;
+		}
 
-			LOOP_SHOWN_PARTICLES {
-				if(pa->alive == PARS_ALIVE) {
+		if(!psys->spatialhash || psys->spatialhash_frame != cfra) {
+			if(!psys->spatialhash)
+				psys->spatialhash = BLI_spatialhash_new(psys->totpart, cellsize);
+
+			LOOP_PARTICLES {
+				if(pa->alive == PARS_ALIVE && !(pa->flag & (PARS_UNEXIST|PARS_NO_DISP))) {
 					if(pa->state.time == cfra)
-						BLI_bvhtree_insert(psys->bvhtree, p, pa->prev_state.co, 1);
+						BLI_spatialhash_update(psys->spatialhash, p, pa->prev_state.co);
 					else
-						BLI_bvhtree_insert(psys->bvhtree, p, pa->state.co, 1);
+						BLI_spatialhash_update(psys->spatialhash, p, pa->state.co);
 				}
+				else
+					BLI_spatialhash_remove(psys->spatialhash, p);
 			}
-			BLI_bvhtree_balance(psys->bvhtree);
 
-			psys->bvhtree_frame = cfra;
+			psys->spatialhash_frame = cfra;
 		}
 	}
 }
@@ -2219,23 +2247,27 @@ static void integrate_particle(ParticleSettings *part, ParticleData *pa, float d
 
 ***********************************************************************************************************/
 #define PSYS_FLUID_SPRINGS_INITIAL_SIZE 256
-static ParticleSpring *sph_spring_add(ParticleSystem *psys, ParticleSpring *spring)
+static ParticleSpring *sph_spring_array_add(ParticleSpring **springs, int *tot, int *alloc, ParticleSpring *spring)
 {
 	/* Are more refs required? */
-	if(psys->alloc_fluidsprings == 0 || psys->fluid_springs == NULL) {
-		psys->alloc_fluidsprings = PSYS_FLUID_SPRINGS_INITIAL_SIZE;
-		psys->fluid_springs = (ParticleSpring*)MEM_callocN(psys->alloc_fluidsprings * sizeof(ParticleSpring), "Particle Fluid Springs");
+	if(*alloc == 0 || *springs == NULL) {
+		*alloc = PSYS_FLUID_SPRINGS_INITIAL_SIZE;
+		*springs = (ParticleSpring*)MEM_callocN(*alloc * sizeof(ParticleSpring), "Particle Fluid Springs");
 	}
-	else if(psys->tot_fluidsprings == psys->alloc_fluidsprings) {
+	else if(*tot == *alloc) {
 		/* Double the number of refs allocated */
-		psys->alloc_fluidsprings *= 2;
-		psys->fluid_springs = (ParticleSpring*)MEM_reallocN(psys->fluid_springs, psys->alloc_fluidsprings * sizeof(ParticleSpring));
+		*alloc *= 2;
+		*springs = (ParticleSpring*)MEM_reallocN(*springs, *alloc * sizeof(ParticleSpring));
 	}
 
-	memcpy(psys->fluid_springs + psys->tot_fluidsprings, spring, sizeof(ParticleSpring));
-	psys->tot_fluidsprings++;
+	memcpy(*springs + *tot, spring, sizeof(ParticleSpring));
+	(*tot)++;
 
-	return psys->fluid_springs + psys->tot_fluidsprings - 1;
+	return *springs + *tot - 1;
+}
+static ParticleSpring *sph_spring_add(ParticleSystem *psys, ParticleSpring *spring)
+{
+	return sph_spring_array_add(&psys->fluid_springs, &psys->tot_fluidsprings, &psys->alloc_fluidsprings, spring);
 }
 static void sph_spring_delete(ParticleSystem *psys, int j)
 {
@@ -2333,6 +2365,8 @@ typedef struct SPHData {
 	float mass;
 	EdgeHash *eh;
 	float *gravity;
+	/* new springs are collected per thread, the system's array is shared */
+	ParticleThread *thread;
 }SPHData;
 static void sph_density_accum_cb(void *userdata, int index, float squared_dist)
 {
@@ -2408,7 +2442,7 @@ static void sph_force_cb(void *sphdata_v, ParticleKey *state, float *force, floa
 		pfr.massfac = psys[i]->part->mass*inv_mass;
 		pfr.use_size = psys[i]->part->flag & PART_SIZEMASS;
 
-		BLI_bvhtree_range_query(psys[i]->bvhtree, state->co, h, sph_density_accum_cb, &pfr);
+		BLI_spatialhash_range_query(psys[i]->spatialhash, state->co, h, sph_density_accum_cb, &pfr);
 	}
 
 	pressure =  stiffness * (pfr.density - rest_density);
@@ -2462,7 +2496,8 @@ static void sph_force_cb(void *sphdata_v, ParticleKey *state, float *force, floa
 					temp_spring.rest_length = (fluid->flag & SPH_CURRENT_REST_LENGTH) ? rij : rest_length;
 					temp_spring.delete_flag = 0;
 								
-					sph_spring_add(psys[0], &temp_spring);
+					sph_spring_array_add(&sphdata->thread->fluid_springs, &sphdata->thread->tot_fluidsprings,
+						&sphdata->thread->alloc_fluidsprings, &temp_spring);
 				}
 			}
 			else {/* PART_SPRING_HOOKES - Hooke's spring force */
@@ -2476,9 +2511,8 @@ static void sph_force_cb(void *sphdata_v, ParticleKey *state, float *force, floa
 		madd_v3_v3fl(force, gravity, fluid->buoyancy * (pfr.density-rest_density));
 }
 
-static void sph_integrate(ParticleSimulationData *sim, ParticleData *pa, float dfra, float *gravity, EdgeHash *springhash){
-	ParticleTarget *pt;
-	int i;
+static void sph_integrate(ParticleSimulationData *sim, ParticleThread *thread, ParticleData *pa, float dfra){
+	ParticleThreadContext *ctx = thread->ctx;
 
 	ParticleSettings *part = sim->psys->part;
 	// float timestep = psys_get_timestep(sim); // UNUSED
@@ -2488,14 +2522,13 @@ static void sph_integrate(ParticleSimulationData *sim, ParticleData *pa, float d
 	float effector_acceleration[3];
 	SPHData sphdata;
 
-	sphdata.psys[0] = sim->psys;
-	for(i=1, pt=sim->psys->targets.first; i<10; i++, pt=(pt?pt->next:NULL))
-		sphdata.psys[i] = pt ? psys_get_target_system(sim->ob, pt) : NULL;
+	memcpy(sphdata.psys, ctx->sph_psys, sizeof(sphdata.psys));
 
 	sphdata.pa = pa;
-	sphdata.gravity = gravity;
+	sphdata.gravity = ctx->gravity;
 	sphdata.mass = pa_mass;
-	sphdata.eh = springhash;
+	sphdata.eh = ctx->springhash;
+	sphdata.thread = thread;
 
 	/* restore previous state and treat gravity & effectors as external acceleration*/
 	sub_v3_v3v3(effector_acceleration, pa->state.vel, pa->prev_state.vel);
@@ -2514,6 +2547,7 @@ typedef struct EfData
 	ParticleTexture ptex;
 	ParticleSimulationData *sim;
 	ParticleData *pa;
+	RNG *rng;
 } EfData;
 static void basic_force_cb(void *efdata_v, ParticleKey *state, float *force, float *impulse)
 {
@@ -2537,13 +2571,13 @@ static void basic_force_cb(void *efdata_v, ParticleKey *state, float *force, flo
 
 	/* brownian force */
 	if(part->brownfac != 0.0f){
-		force[0] += (BLI_frand()-0.5f) * part->brownfac;
-		force[1] += (BLI_frand()-0.5f) * part->brownfac;
-		force[2] += (BLI_frand()-0.5f) * part->brownfac;
+		force[0] += (rng_getFloat(efdata->rng)-0.5f) * part->brownfac;
+		force[1] += (rng_getFloat(efdata->rng)-0.5f) * part->brownfac;
+		force[2] += (rng_getFloat(efdata->rng)-0.5f) * part->brownfac;
 	}
 }
 /* gathers all forces that effect particles and calculates a new state for the particle */
-static void basic_integrate(ParticleSimulationData *sim, int p, float dfra, float cfra)
+static void basic_integrate(ParticleSimulationData *sim, int p, float dfra, float cfra, RNG *rng)
 {
 	ParticleSettings *part = sim->psys->part;
 	ParticleData *pa = sim->psys->particles + p;
@@ -2556,6 +2590,7 @@ static void basic_integrate(ParticleSimulationData *sim, int p, float dfra, floa
 
 	efdata.pa = pa;
 	efdata.sim = sim;
+	efdata.rng = rng;
 
 	/* add global acceleration (gravitation) */
 	if(psys_uses_gravity(sim)
@@ -3080,7 +3115,12 @@ static int collision_detect(ParticleData *pa, ParticleCollision *col, BVHTreeRay
 
 	return hit->index >= 0;
 }
-static int collision_response(ParticleData *pa, ParticleCollision *col, BVHTreeRayHit *hit, int kill, int dynamic_rotation)
+/* threads pass their own generator, boids still use the global one */
+static float collision_frand(RNG *rng)
+{
+	return rng ? rng_getFloat(rng) : BLI_frand();
+}
+static int collision_response(ParticleData *pa, ParticleCollision *col, BVHTreeRayHit *hit, int kill, int dynamic_rotation, RNG *rng)
 {
 	ParticleCollisionElement *pce = &col->pce;
 	PartDeflect *pd = col->hit->pd;
@@ -3089,7 +3129,7 @@ static int collision_response(ParticleData *pa, ParticleCollision *col, BVHTreeR
 	float f = col->f + x * (1.0f - col->f);				/* time factor of collision between timestep */
 	float dt1 = (f - col->f) * col->total_time;			/* time since previous collision (in seconds) */
 	float dt2 = (1.0f - f) * col->total_time;			/* time left after collision (in seconds) */
-	int through = (BLI_frand() < pd->pdef_perm) ? 1 : 0; /* did particle pass through the collision surface? */
+	int through = (collision_frand(rng) < pd->pdef_perm) ? 1 : 0; /* did particle pass through the collision surface? */
 
 	/* calculate exact collision location */
 	interp_v3_v3v3(co, col->co1, col->co2, x);
@@ -3114,8 +3154,8 @@ static int collision_response(ParticleData *pa, ParticleCollision *col, BVHTreeR
 		float v0_tan[3];/* tangential component of v0 */
 		float vc_tan[3];/* tangential component of collision surface velocity */
 		float v0_dot, vc_dot;
-		float damp = pd->pdef_damp + pd->pdef_rdamp * 2 * (BLI_frand() - 0.5f);
-		float frict = pd->pdef_frict + pd->pdef_rfrict * 2 * (BLI_frand() - 0.5f);
+		float damp = pd->pdef_damp + pd->pdef_rdamp * 2 * (collision_frand(rng) - 0.5f);
+		float frict = pd->pdef_frict + pd->pdef_rfrict * 2 * (collision_frand(rng) - 0.5f);
 		float distance, nor[3], dot;
 
 		CLAMP(damp,0.0f, 1.0f);
@@ -3276,7 +3316,7 @@ static void collision_fail(ParticleData *pa, ParticleCollision *col)
  * -uses Newton-Rhapson iteration to find the collisions
  * -handles spherical particles and (nearly) point like particles
  */
-static void collision_check(ParticleSimulationData *sim, int p, float dfra, float cfra){
+static void collision_check(ParticleSimulationData *sim, int p, float dfra, float cfra, RNG *rng){
 	ParticleSettings *part = sim->psys->part;
 	ParticleData *pa = sim->psys->particles + p;
 	ParticleCollision col;
@@ -3321,7 +3361,7 @@ static void collision_check(ParticleSimulationData *sim, int p, float dfra, floa
 
 			if(collision_count == COLLISION_MAX_COLLISIONS)
 				collision_fail(pa, &col);
-			else if(collision_response(pa, &col, &hit, part->flag & PART_DIE_ON_COL, part->flag & PART_ROT_DYN)==0)
+			else if(collision_response(pa, &col, &hit, part->flag & PART_DIE_ON_COL, part->flag & PART_ROT_DYN, rng)==0)
 				return;
 		}
 		else
@@ -3346,6 +3386,12 @@ static void psys_update_path_cache(ParticleSimulationData *sim, float cfra)
 		distr=1;
 
 	if(distr){
+		/* new children, the child cache can't be reused */
+		if(psys->childcachesum) {
+			MEM_freeN(psys->childcachesum);
+			psys->childcachesum= NULL;
+		}
+
 		if(alloc)
 			realloc_particles(sim, sim->psys->totpart);
 
@@ -3590,6 +3636,122 @@ static void save_hair(ParticleSimulationData *sim, float UNUSED(cfra)){
 /************************************************/
 /*			System Core							*/
 /************************************************/
+static void *dynamics_threads_exec_cb(void *data)
+{
+	ParticleThread *thread = (ParticleThread*)data;
+	ParticleThreadContext *ctx = thread->ctx;
+	ParticleSimulationData *sim = &ctx->sim;
+	ParticleSystem *psys = sim->psys;
+	ParticleSettings *part = psys->part;
+	float cfra = ctx->cfra;
+	float timestep = psys_get_timestep(sim);
+	/* seeded per particle and substep, so results don't depend on the amount of threads */
+	int step = (int)floorf(cfra * (part->subframes + 1) + 0.5f);
+	unsigned int seed = 31415926 + psys->seed + step * psys->totpart;
+	int start = (psys->totpart * thread->num) / thread->tot;
+	int end = (psys->totpart * (thread->num + 1)) / thread->tot;
+	PARTICLE_P;
+
+	for(p=start, pa=psys->particles+start; p<end; p++, pa++) {
+		if(pa->state.time <= 0.f)
+			continue;
+
+		rng_srandom(thread->rng, seed + p);
+
+		/* do global forces & effectors */
+		basic_integrate(sim, p, pa->state.time, cfra, thread->rng);
+
+		/* actual fluids calculations */
+		if(part->phystype == PART_PHYS_FLUID)
+			sph_integrate(sim, thread, pa, pa->state.time);
+
+		/* deflection */
+		if(sim->colliders)
+			collision_check(sim, p, pa->state.time, cfra, thread->rng);
+
+		/* rotations, SPH particles are not physical particles, just interpolation particles,
+		 * thus rotation has not a direct sense for them */
+		basic_rotate(part, pa, pa->state.time, timestep);
+	}
+
+	return NULL;
+}
+
+/* particles only change their own state, neighbours and effectors are read
+   from the previous state. effectors using the system's own particles and
+   noise, which shares the effector's random generator, are done serially */
+static int dynamics_threads_init(ParticleThread *threads, float cfra)
+{
+	ParticleThreadContext *ctx = threads[0].ctx;
+	ParticleSimulationData *sim = &ctx->sim;
+	ParticleSystem *psys = sim->psys;
+	EffectorCache *eff;
+	int i, totthread = threads[0].tot;
+
+	if(psys->totpart < 1000)
+		totthread = 1;
+
+	if(psys->effectors) {
+		for(eff = psys->effectors->first; eff; eff = eff->next) {
+			if(eff->psys == psys || (eff->pd && eff->pd->f_noise > 0.0f))
+				totthread = 1;
+		}
+	}
+
+	ctx->cfra = cfra;
+
+	if(psys->part->phystype == PART_PHYS_FLUID) {
+		ParticleTarget *pt;
+
+		/* targets are looked up once, the lookup flags them as valid */
+		ctx->sph_psys[0] = psys;
+		for(i=1, pt=psys->targets.first; i<10; i++, pt=(pt?pt->next:NULL))
+			ctx->sph_psys[i] = pt ? psys_get_target_system(sim->ob, pt) : NULL;
+
+		ctx->springhash = sph_springhash_build(psys);
+
+		if(psys_uses_gravity(sim))
+			ctx->gravity = sim->scene->physics_settings.gravity;
+	}
+
+	for(i=0; i<totthread; i++) {
+		threads[i].rng = rng_new(0);
+		threads[i].tot = totthread;
+	}
+
+	return totthread;
+}
+
+static void dynamics_threads(ParticleSimulationData *sim, float cfra)
+{
+	ParticleSystem *psys = sim->psys;
+	ParticleThread *pthreads;
+	ListBase threads;
+	int i, j, totthread;
+
+	pthreads = psys_threads_create(sim);
+	totthread = dynamics_threads_init(pthreads, cfra);
+
+	if(totthread > 1) {
+		BLI_init_threads(&threads, dynamics_threads_exec_cb, totthread);
+
+		for(i=0; i<totthread; i++)
+			BLI_insert_thread(&threads, &pthreads[i]);
+
+		BLI_end_threads(&threads);
+	}
+	else
+		dynamics_threads_exec_cb(&pthreads[0]);
+
+	/* in particle order, same as when adding them directly */
+	for(i=0; i<totthread; i++) {
+		for(j=0; j<pthreads[i].tot_fluidsprings; j++)
+			sph_spring_add(psys, pthreads[i].fluid_springs + j);
+	}
+
+	psys_threads_free(pthreads);
+}
+
 /* unbaked particles are calculated dynamically */
 static void dynamics_step(ParticleSimulationData *sim, float cfra)
 {
@@ -3652,11 +3814,15 @@ static void dynamics_step(ParticleSimulationData *sim, float cfra)
 		case PART_PHYS_FLUID:
 		{
 			ParticleTarget *pt = psys->targets.first;
-			psys_update_particle_bvhtree(psys, psys->cfra);
+			ParticleSystem *tpsys;
+			float cellsize = sph_search_radius(part);
+
+			psys_update_particle_spatialhash(psys, psys->cfra, cellsize);
 			
 			for(; pt; pt=pt->next) {  /* Updating others systems particle tree for fluid-fluid interaction */
-				if(pt->ob)
-					psys_update_particle_bvhtree(BLI_findlink(&pt->ob->particlesystem, pt->psys-1), psys->cfra);
+				tpsys = psys_get_target_system(sim->ob, pt);
+				if(tpsys && tpsys != psys)
+					psys_update_particle_spatialhash(tpsys, psys->cfra, tpsys->part->fluid ? sph_search_radius(tpsys->part) : cellsize);
 			}
 			break;
 		}
@@ -3705,18 +3871,12 @@ static void dynamics_step(ParticleSimulationData *sim, float cfra)
 
 	switch(part->phystype) {
 		case PART_PHYS_NEWTON:
+		case PART_PHYS_FLUID:
 		{
-			LOOP_DYNAMIC_PARTICLES {
-				/* do global forces & effectors */
-				basic_integrate(sim, p, pa->state.time, cfra);
-	
-				/* deflection */
-				if(sim->colliders)
-					collision_check(sim, p, pa->state.time, cfra);
+			dynamics_threads(sim, cfra);
 
-				/* rotations */
-				basic_rotate(part, pa, pa->state.time, timestep);
-			}
+			if(part->phystype == PART_PHYS_FLUID)
+				sph_springs_modify(psys, timestep);
 			break;
 		}
 		case PART_PHYS_BOIDS:
@@ -3731,41 +3891,11 @@ static void dynamics_step(ParticleSimulationData *sim, float cfra)
 
 					/* deflection */
 					if(sim->colliders)
-						collision_check(sim, p, pa->state.time, cfra);
+						collision_check(sim, p, pa->state.time, cfra, NULL);
 				}
 			}
 			break;
 		}
-		case PART_PHYS_FLUID:
-		{
-			EdgeHash *springhash = sph_springhash_build(psys);
-			float *gravity = NULL;
-
-			if(psys_uses_gravity(sim))
-				gravity = sim->scene->physics_settings.gravity;
-
-			LOOP_DYNAMIC_PARTICLES {
-				/* do global forces & effectors */
-				basic_integrate(sim, p, pa->state.time, cfra);
-
-				/* actual fluids calculations */
-				sph_integrate(sim, pa, pa->state.time, gravity, springhash);
-
-				if(sim->colliders)
-					collision_check(sim, p, pa->state.time, cfra);
-				
-				/* SPH particles are not physical particles, just interpolation particles,  thus rotation has not a direct sense for them */	
-				basic_rotate(part, pa, pa->state.time, timestep);  
-			}
-
-			sph_springs_modify(psys, timestep);
-
-			if(springhash) {
-				BLI_edgehash_free(springhash, NULL);
-				springhash = NULL;
-			}
-			break;
-		}
 	}
 
 	/* finalize particle state and time after dynamics */
@@ -52,6 +52,8 @@
 #include "BLI_math.h"
 #include "BLI_utildefines.h"
 
+#include "BLO_sys_types.h" // for uint64_t support
+
 #include "PIL_time.h"
 
 #include "WM_api.h"
@@ -92,6 +94,7 @@
 #ifndef WIN32
   #include <dirent.h>
 #include <unistd.h>
+#include <sys/mman.h>
 #else
 #include <process.h>
   #include "BLI_winstuff.h"
@@ -981,20 +984,10 @@ static int ptcache_filename(PTCacheID *pid, char *filename, int cfra, short do_p
 }
 
 /* youll need to close yourself after! */
-static PTCacheFile *ptcache_file_open(PTCacheID *pid, int mode, int cfra)
+static PTCacheFile *ptcache_file_open_filename(const char *filename, int mode, int cfra)
 {
 	PTCacheFile *pf;
 	FILE *fp = NULL;
-	char filename[(FILE_MAXDIR+FILE_MAXFILE)*2];
-
-#ifndef DURIAN_POINTCACHE_LIB_OK
-	/* don't allow writing for linked objects */
-	if(pid->ob->id.lib && mode == PTCACHE_FILE_WRITE)
-		return NULL;
-#endif
-	if (!G.relbase_valid && (pid->cache->flag & PTCACHE_EXTERNAL)==0) return NULL; /* save blend file before using disk pointcache */
-	
-	ptcache_filename(pid, filename, cfra, 1, 1);
 
 	if (mode==PTCACHE_FILE_READ) {
 		if (!BLI_exists(filename)) {
@@ -1019,6 +1012,21 @@ static PTCacheFile *ptcache_file_open(PTCacheID *pid, int mode, int cfra)
 
 	return pf;
 }
+static PTCacheFile *ptcache_file_open(PTCacheID *pid, int mode, int cfra)
+{
+	char filename[(FILE_MAXDIR+FILE_MAXFILE)*2];
+
+#ifndef DURIAN_POINTCACHE_LIB_OK
+	/* don't allow writing for linked objects */
+	if(pid->ob->id.lib && mode == PTCACHE_FILE_WRITE)
+		return NULL;
+#endif
+	if (!G.relbase_valid && (pid->cache->flag & PTCACHE_EXTERNAL)==0) return NULL; /* save blend file before using disk pointcache */
+	
+	ptcache_filename(pid, filename, cfra, 1, 1);
+
+	return ptcache_file_open_filename(filename, mode, cfra);
+}
 static void ptcache_file_close(PTCacheFile *pf)
 {
 	if(pf) {
@@ -1399,12 +1407,524 @@ static void ptcache_find_frames_around(PTCacheID *pid, unsigned int frame, int *
 	}
 }
 
+static void ptcache_frame_free(PTCacheMem *pm);
+
+/* Packed disk cache, PTCACHE_DISK_PACKED: all frames of a point cache in one
+ * file, with each data type of a frame in its own uncompressed block, so
+ * reading maps the file and uses the blocks in place:
+ *
+ * PTCachePackHeader
+ * frame blocks and index blocks, aligned to PTCACHE_PACK_ALIGN
+ *
+ * The header points to the index, sorted by frame. Nothing the header points
+ * to is overwritten: a new frame is added at the end of the file, the new
+ * index goes to the block of the index before the current one, or the end
+ * of the file when it doesn't fit, and only then the header is written. A
+ * write that is interrupted leaves the file with the frames it had before.
+ *
+ * Space of removed or rewritten frames is only given back when the whole
+ * cache is cleared. Stream caches (smoke) keep using a file per frame. */
+
+#define PTCACHE_PACK_ALIGN		16
+#define PTCACHE_PACK_VERSION	2
+
+/* 64 bit file offsets, pack files can grow past 2GB. msvc
+ * maps fseek and ftell to the 64 bit versions, see BLI_winstuff.h */
+#if defined(WIN32) && !defined(FREE_WINDOWS)
+typedef __int64 ptcache_off_t;
+#define ptcache_fseek(fp, offset, origin)	fseek(fp, offset, origin)
+#define ptcache_ftell(fp)					ftell(fp)
+#else
+typedef off_t ptcache_off_t;
+#define ptcache_fseek(fp, offset, origin)	fseeko(fp, offset, origin)
+#define ptcache_ftell(fp)					ftello(fp)
+#endif
+
+/* PTCacheMem.flag of frames that point into a mapped pack file */
+#define PTCACHE_MEM_MAPPED		1
+
+typedef struct PTCachePackFrame {
+	unsigned int frame, totpoint, data_types, totextra;
+	uint64_t data[BPHYS_TOT_DATA];	/* file offsets of the data blocks */
+	uint64_t extra;	/* totextra times type, totdata and the data */
+} PTCachePackFrame;
+
+typedef struct PTCachePackHeader {
+	char id[8];
+	unsigned int version, type;
+	uint64_t index;		/* file offset of the index */
+	unsigned int totframe, indexcap;	/* frames in the index, and room in its block */
+	uint64_t spare;		/* block of the previous index, free for the next one */
+	unsigned int sparecap, pad;
+} PTCachePackHeader;
+
+typedef struct PTCachePackMem {
+	PTCacheMem pm;	/* first, so frames can be freed as PTCacheMem */
+	void *map;
+	size_t maplen;
+} PTCachePackMem;
+
+/* disk frames are in the pack file, also while toggling the disk cache */
+static int ptcache_pack_format(PTCacheID *pid)
+{
+	int flag = pid->cache->flag & (PTCACHE_DISK_PACKED|PTCACHE_EXTERNAL);
+
+	return (flag == PTCACHE_DISK_PACKED && pid->read_stream == NULL);
+}
+
+static int ptcache_use_pack(PTCacheID *pid)
+{
+	return (pid->cache->flag & PTCACHE_DISK_CACHE) && ptcache_pack_format(pid);
+}
+
+static int ptcache_pack_filename(PTCacheID *pid, char *filename)
+{
+	int len;
+
+	if(pid->cache->index < 0)
+		pid->cache->index = pid->stack_index = object_insert_ptcache(pid->ob);
+
+	len = ptcache_filename(pid, filename, 0, 1, 0);
+	if(len == 0)
+		return 0;
+
+	sprintf(filename + len, "_%02d"PTCACHE_PACK_EXT, pid->stack_index);
+
+	return 1;
+}
+
+/* returns the number of frames, or -1 if the file isn't a valid pack */
+static int ptcache_pack_read_index(FILE *fp, PTCachePackHeader *head, PTCachePackFrame **r_frames)
+{
+	*r_frames = NULL;
+
+	if(ptcache_fseek(fp, 0, SEEK_SET) || fread(head, sizeof(PTCachePackHeader), 1, fp) != 1)
+		return -1;
+
+	if(strncmp(head->id, "BPHYSPAK", 8) || head->version != PTCACHE_PACK_VERSION || head->totframe > head->indexcap)
+		return -1;
+
+	if(head->totframe) {
+		*r_frames = MEM_mallocN(sizeof(PTCachePackFrame) * head->totframe, "PTCachePackFrame");
+
+		if(ptcache_fseek(fp, (ptcache_off_t)head->index, SEEK_SET) ||
+		   fread(*r_frames, sizeof(PTCachePackFrame), head->totframe, fp) != head->totframe) {
+			MEM_freeN(*r_frames);
+			*r_frames = NULL;
+			return -1;
+		}
+	}
+
+	return head->totframe;
+}
+
+static ptcache_off_t ptcache_pack_pad(FILE *fp, ptcache_off_t offset)
+{
+	for(; offset % PTCACHE_PACK_ALIGN; offset++)
+		fputc(0, fp);
+
+	return offset;
+}
+
+/* end is the end of the file. the index written before the current one is
+ * overwritten, the header is only changed once the new index is complete */
+static int ptcache_pack_write_index(FILE *fp, PTCachePackHeader *head, ptcache_off_t end, PTCachePackFrame *frames, int totframe)
+{
+	ptcache_off_t offset;
+	unsigned int cap, a;
+
+	if(head->spare && (unsigned int)totframe <= head->sparecap) {
+		offset = (ptcache_off_t)head->spare;
+		cap = head->sparecap;
+
+		if(ptcache_fseek(fp, offset, SEEK_SET))
+			return 0;
+	}
+	else {
+		/* room to grow, so the two index blocks can be swapped for a while */
+		offset = end;
+		cap = MAX2(2 * totframe, 16);
+
+		if(ptcache_fseek(fp, offset, SEEK_SET))
+			return 0;
+		offset = ptcache_pack_pad(fp, offset);
+	}
+
+	if(totframe && fwrite(frames, sizeof(PTCachePackFrame), totframe, fp) != (size_t)totframe)
+		return 0;
+
+	/* fill the block, so frames added after it don't overlap */
+	for(a = totframe * sizeof(PTCachePackFrame); a < cap * sizeof(PTCachePackFrame); a++)
+		fputc(0, fp);
+
+	if(fflush(fp))
+		return 0;
+
+	if(head->totframe || head->indexcap) {
+		head->spare = head->index;
+		head->sparecap = head->indexcap;
+	}
+	head->index = offset;
+	head->indexcap = cap;
+	head->totframe = totframe;
+
+	return (ptcache_fseek(fp, 0, SEEK_SET) == 0 &&
+			fwrite(head, sizeof(PTCachePackHeader), 1, fp) == 1 &&
+			fflush(fp) == 0);
+}
+
+static int ptcache_pack_frame_find(PTCachePackFrame *frames, int totframe, unsigned int frame)
+{
+	int low = 0, high = totframe - 1;
+
+	while(low <= high) {
+		int mid = (low + high) / 2;
+
+		if(frames[mid].frame < frame)
+			low = mid + 1;
+		else if(frames[mid].frame > frame)
+			high = mid - 1;
+		else
+			return mid;
+	}
+
+	return -1;
+}
+
+/* index of the pack file, returns the number of frames */
+static void ptcache_write_lock_idle(PointCache *cache);
+static void ptcache_write_unlock(void);
+
+static int ptcache_pack_index(PTCacheID *pid, PTCachePackFrame **r_frames)
+{
+	char filename[MAX_PTCACHE_FILE];
+	PTCachePackHeader head;
+	FILE *fp;
+	int totframe = 0;
+
+	*r_frames = NULL;
+
+	/* a frame being written can still change the header, and no new
+	 * write of this cache starts while the lock is held */
+	ptcache_write_lock_idle(pid->cache);
+
+	if(ptcache_pack_filename(pid, filename) && (fp = fopen(filename, "rb"))) {
+		totframe = ptcache_pack_read_index(fp, &head, r_frames);
+		fclose(fp);
+	}
+
+	ptcache_write_unlock();
+
+	return MAX2(totframe, 0);
+}
+
+static int ptcache_pack_exist(PTCacheID *pid, int cfra)
+{
+	PTCachePackFrame *frames;
+	int totframe = ptcache_pack_index(pid, &frames), found;
+
+	found = (ptcache_pack_frame_find(frames, totframe, cfra) != -1);
+
+	if(frames)
+		MEM_freeN(frames);
+
+	return found;
+}
+
+static int ptcache_pack_frame_write(PTCacheID *pid, PTCacheMem *pm, const char *filename)
+{
+	PTCachePackHeader head;
+	PTCachePackFrame *frames = NULL, *pf;
+	PTCacheExtra *extra;
+	FILE *fp;
+	ptcache_off_t offset;
+	int totframe, a, i, error = 0;
+
+	BLI_make_existing_file(filename);
+
+	fp = fopen(filename, "rb+");
+	totframe = fp ? ptcache_pack_read_index(fp, &head, &frames) : -1;
+
+	if(totframe >= 0 && head.type == (unsigned int)pid->type) {
+		/* the frame goes after everything in use */
+		ptcache_fseek(fp, 0, SEEK_END);
+		offset = ptcache_ftell(fp);
+	}
+	else {
+		/* new or unusable file, start over */
+		if(fp)
+			fclose(fp);
+		if(frames)
+			MEM_freeN(frames);
+
+		fp = fopen(filename, "wb+");
+		if(fp == NULL)
+			return 0;
+
+		memset(&head, 0, sizeof(head));
+		memcpy(head.id, "BPHYSPAK", 8);
+		head.version = PTCACHE_PACK_VERSION;
+		head.type = pid->type;
+
+		fwrite(&head, sizeof(head), 1, fp);
+		offset = sizeof(head);
+		frames = NULL;
+		totframe = 0;
+	}
+
+	/* the frame replaces a frame with the same number */
+	for(a=0; a<totframe && frames[a].frame < pm->frame; a++);
+
+	if(a == totframe || frames[a].frame != pm->frame) {
+		PTCachePackFrame *newframes = MEM_mallocN(sizeof(PTCachePackFrame) * (totframe+1), "PTCachePackFrame");
+
+		if(frames) {
+			memcpy(newframes, frames, sizeof(PTCachePackFrame) * a);
+			memcpy(newframes + a + 1, frames + a, sizeof(PTCachePackFrame) * (totframe - a));
+			MEM_freeN(frames);
+		}
+
+		frames = newframes;
+		totframe++;
+	}
+
+	pf = &frames[a];
+	memset(pf, 0, sizeof(PTCachePackFrame));
+	pf->frame = pm->frame;
+	pf->totpoint = pm->totpoint;
+	pf->data_types = pm->data_types;
+
+	ptcache_fseek(fp, offset, SEEK_SET);
+
+	for(i=0; i<BPHYS_TOT_DATA && !error; i++) {
+		if(pm->data[i] && (pm->data_types & (1<<i))) {
+			size_t len = pm->totpoint * ptcache_data_size[i];
+
+			offset = ptcache_pack_pad(fp, offset);
+			pf->data[i] = offset;
+			error = (fwrite(pm->data[i], 1, len, fp) != len);
+			offset += len;
+		}
+	}
+
+	offset = ptcache_pack_pad(fp, offset);
+	pf->extra = offset;
+
+	for(extra=pm->extradata.first; extra && !error; extra=extra->next) {
+		size_t len = extra->totdata * ptcache_extra_datasize[extra->type];
+
+		if(extra->data == NULL || extra->totdata == 0)
+			continue;
+
+		error = (fwrite(&extra->type, sizeof(unsigned int), 1, fp) != 1 ||
+				 fwrite(&extra->totdata, sizeof(unsigned int), 1, fp) != 1 ||
+				 fwrite(extra->data, 1, len, fp) != len);
+		offset += 2 * sizeof(unsigned int) + len;
+		pf->totextra++;
+	}
+
+	offset = ptcache_pack_pad(fp, offset);
+
+	if(!error)
+		error = !ptcache_pack_write_index(fp, &head, offset, frames, totframe);
+
+	fclose(fp);
+	MEM_freeN(frames);
+
+	if (error && G.f & G_DEBUG) 
+		printf("Error writing to disk cache\n");
+
+	return error == 0;
+}
+
+/* with map set the frame data points into the mapped file, which is not
+ * shared, so it can still be changed. free with ptcache_frame_free() */
+static PTCacheMem *ptcache_pack_frame_to_mem(PTCacheID *pid, int cfra, int map)
+{
+	char filename[MAX_PTCACHE_FILE];
+	PTCachePackHeader head;
+	PTCachePackFrame *frames = NULL, *pf;
+	PTCacheMem *pm = NULL;
+	FILE *fp;
+	void *addr = NULL;
+	ptcache_off_t filelen;
+	int totframe, a, i, error = 0;
+
+	BKE_ptcache_write_flush(pid->cache);
+
+	if(!ptcache_pack_filename(pid, filename) || (fp = fopen(filename, "rb")) == NULL)
+		return NULL;
+
+	totframe = ptcache_pack_read_index(fp, &head, &frames);
+	a = ptcache_pack_frame_find(frames, MAX2(totframe, 0), cfra);
+
+	if(a == -1 || head.type != (unsigned int)pid->type) {
+		if(frames)
+			MEM_freeN(frames);
+		fclose(fp);
+		return NULL;
+	}
+
+	pf = &frames[a];
+	ptcache_fseek(fp, 0, SEEK_END);
+	filelen = ptcache_ftell(fp);
+
+#ifndef WIN32
+	/* files too large for the address space are read instead */
+	if(map && (uint64_t)(size_t)filelen == (uint64_t)filelen) {
+		addr = mmap(NULL, filelen, PROT_READ|PROT_WRITE, MAP_PRIVATE, fileno(fp), 0);
+		if(addr == MAP_FAILED)
+			addr = NULL;
+	}
+#endif
+
+	if(addr) {
+		PTCachePackMem *pmm = MEM_callocN(sizeof(PTCachePackMem), "Pointcache mapped mem");
+
+		pmm->map = addr;
+		pmm->maplen = filelen;
+		pm = &pmm->pm;
+		pm->flag |= PTCACHE_MEM_MAPPED;
+	}
+	else
+		pm = MEM_callocN(sizeof(PTCacheMem), "Pointcache mem");
+
+	pm->frame = pf->frame;
+	pm->totpoint = pf->totpoint;
+	pm->data_types = pf->data_types;
+
+	for(i=0; i<BPHYS_TOT_DATA && !error; i++) {
+		if(pf->data_types & (1<<i)) {
+			size_t len = pm->totpoint * ptcache_data_size[i];
+
+			if(pf->data[i] + len > (uint64_t)filelen)
+				error = 1;
+			else if(addr)
+				pm->data[i] = (char*)addr + pf->data[i];
+			else {
+				pm->data[i] = MEM_mallocN(MAX2(len, 1), "PTCache Data");
+				error = (ptcache_fseek(fp, (ptcache_off_t)pf->data[i], SEEK_SET) || fread(pm->data[i], 1, len, fp) != len);
+			}
+		}
+	}
+
+	if(!error && pf->totextra) {
+		ptcache_fseek(fp, (ptcache_off_t)pf->extra, SEEK_SET);
+
+		for(i=0; i<(int)pf->totextra && !error; i++) {
+			PTCacheExtra *extra = MEM_callocN(sizeof(PTCacheExtra), "Pointcache extradata");
+
+			BLI_addtail(&pm->extradata, extra);
+
+			if(fread(&extra->type, sizeof(unsigned int), 1, fp) != 1 ||
+			   fread(&extra->totdata, sizeof(unsigned int), 1, fp) != 1 ||
+			   extra->type >= sizeof(ptcache_extra_datasize)/sizeof(int)) {
+				error = 1;
+			}
+			else {
+				size_t len = extra->totdata * ptcache_extra_datasize[extra->type];
+
+				extra->data = MEM_mallocN(MAX2(len, 1), "Pointcache extradata->data");
+				error = (fread(extra->data, 1, len, fp) != len);
+			}
+		}
+	}
+
+	/* the mapping stays valid after closing */
+	fclose(fp);
+	MEM_freeN(frames);
+
+	if(error) {
+		ptcache_frame_free(pm);
+		pm = NULL;
+
+		if (G.f & G_DEBUG) 
+			printf("Error reading from disk cache\n");
+	}
+
+	return pm;
+}
+
+static void ptcache_pack_clear(PTCacheID *pid, int mode, unsigned int cfra)
+{
+	PointCache *cache = pid->cache;
+	char filename[MAX_PTCACHE_FILE];
+	PTCachePackHeader head;
+	PTCachePackFrame *frames;
+	FILE *fp;
+	unsigned int sta = cache->startframe, end = cache->endframe;
+	int totframe, a, b;
+
+	if(!ptcache_pack_filename(pid, filename))
+		return;
+
+	if(mode == PTCACHE_CLEAR_ALL) {
+		cache->last_exact = MIN2(cache->startframe, 0);
+		BLI_delete(filename, 0, 0);
+
+		if(cache->cached_frames)
+			memset(cache->cached_frames, 0, MEM_allocN_len(cache->cached_frames));
+		return;
+	}
+
+	if((fp = fopen(filename, "rb+")) == NULL)
+		return;
+
+	totframe = ptcache_pack_read_index(fp, &head, &frames);
+
+	/* only the index changes, removed frames stay in the file */
+	for(a=0, b=0; a<totframe; a++) {
+		unsigned int frame = frames[a].frame;
+
+		if((mode==PTCACHE_CLEAR_BEFORE && frame < cfra) ||
+		   (mode==PTCACHE_CLEAR_AFTER && frame > cfra) ||
+		   (mode==PTCACHE_CLEAR_FRAME && frame == cfra)) {
+			if(cache->cached_frames && frame >= sta && frame <= end)
+				cache->cached_frames[frame-sta] = 0;
+		}
+		else
+			frames[b++] = frames[a];
+	}
+
+	if(totframe > 0 && b != totframe) {
+		ptcache_fseek(fp, 0, SEEK_END);
+		ptcache_pack_write_index(fp, &head, ptcache_ftell(fp), frames, b);
+	}
+
+	fclose(fp);
+
+	if(frames)
+		MEM_freeN(frames);
+}
+
+/* frees a frame read from disk */
+static void ptcache_frame_free(PTCacheMem *pm)
+{
+	if(pm->flag & PTCACHE_MEM_MAPPED) {
+#ifndef WIN32
+		PTCachePackMem *pmm = (PTCachePackMem*)pm;
+		munmap(pmm->map, pmm->maplen);
+#endif
+	}
+	else
+		ptcache_data_free(pm);
+
+	ptcache_extra_free(pm);
+	MEM_freeN(pm);
+}
 static PTCacheMem *ptcache_disk_frame_to_mem(PTCacheID *pid, int cfra)
 {
-	PTCacheFile *pf = ptcache_file_open(pid, PTCACHE_FILE_READ, cfra);
+	PTCacheFile *pf;
 	PTCacheMem *pm = NULL;
 	unsigned int i, error = 0;
 
+	if(ptcache_pack_format(pid))
+		return ptcache_pack_frame_to_mem(pid, cfra, 0);
+
+	BKE_ptcache_write_flush(pid->cache);
+
+	pf = ptcache_file_open(pid, PTCACHE_FILE_READ, cfra);
+
 	if(pf == NULL)
 		return NULL;
 
@@ -1480,14 +2000,31 @@ static PTCacheMem *ptcache_disk_frame_to_mem(PTCacheID *pid, int cfra)
 	
 	return pm;
 }
-static int ptcache_mem_frame_to_disk(PTCacheID *pid, PTCacheMem *pm)
+/* the file a frame is written to */
+static int ptcache_frame_filename_write(PTCacheID *pid, int cfra, char *filename)
+{
+#ifndef DURIAN_POINTCACHE_LIB_OK
+	/* don't allow writing for linked objects */
+	if(pid->ob->id.lib)
+		return 0;
+#endif
+
+	if(ptcache_pack_format(pid))
+		return ptcache_pack_filename(pid, filename);
+
+	return ptcache_filename(pid, filename, cfra, 1, 1) != 0;
+}
+/* doesn't use pid->ob or pid->calldata, so it can run after they're freed */
+static int ptcache_frame_write(PTCacheID *pid, PTCacheMem *pm, const char *filename)
 {
 	PTCacheFile *pf = NULL;
 	unsigned int i, error = 0;
-	
-	BKE_ptcache_id_clear(pid, PTCACHE_CLEAR_FRAME, pm->frame);
 
-	pf = ptcache_file_open(pid, PTCACHE_FILE_WRITE, pm->frame);
+	if(ptcache_pack_format(pid))
+		return ptcache_pack_frame_write(pid, pm, filename);
+
+	/* an existing file for the frame is truncated */
+	pf = ptcache_file_open_filename(filename, PTCACHE_FILE_WRITE, pm->frame);
 
 	if(pf==NULL) {
 		if (G.f & G_DEBUG) 
@@ -1565,6 +2102,314 @@ static int ptcache_mem_frame_to_disk(PTCacheID *pid, PTCacheMem *pm)
 	return error==0;
 }
 
+static int ptcache_mem_frame_to_disk(PTCacheID *pid, PTCacheMem *pm)
+{
+	char filename[MAX_PTCACHE_FILE];
+
+	if(!ptcache_frame_filename_write(pid, pm->frame, filename))
+		return 0;
+
+	/* after the frames that are written in the background */
+	BKE_ptcache_write_flush(pid->cache);
+
+	return ptcache_frame_write(pid, pm, filename);
+}
+
+/* Frames written by BKE_ptcache_write to a disk cache are compressed and
+ * written by background threads, so the simulation can continue with the
+ * next frame. The queued frames own their data, and the file name and cache
+ * settings are copied when queueing. Frames of the same file are written in
+ * order, one at a time. Everything that reads or removes disk cache files
+ * flushes the writes of that cache first, except BKE_ptcache_id_exist which
+ * looks at the queue, and reading the pack index which only waits for the
+ * frame being written. A queued frame that gets overwritten is taken back
+ * from the queue. Stream caches (smoke) are still written directly. */
+
+/* queued frames wait when they'd take more memory than this */
+#define PTCACHE_WRITE_MAX_MEM	(256 * 1024 * 1024)
+/* seconds without writes before the writing threads are ended */
+#define PTCACHE_WRITE_IDLE_TIME	2.0
+
+typedef struct PTCacheWrite {
+	struct PTCacheWrite *next, *prev;
+
+	PTCacheID pid;		/* pid.cache points to the copy below */
+	PointCache cache;
+	PointCache *orig;	/* only compared, may be freed already */
+	PTCacheMem *pm;
+	size_t size;
+	char filename[MAX_PTCACHE_FILE];
+} PTCacheWrite;
+
+static ListBase ptcache_write_queue = {NULL, NULL};
+static ListBase ptcache_write_busy = {NULL, NULL};
+static ListBase ptcache_write_threads = {NULL, NULL};
+static size_t ptcache_write_mem = 0;
+static int ptcache_write_totthread = 0;
+static int ptcache_write_exit = 0;
+static double ptcache_write_last = 0.0;	/* time the last write finished */
+
+static pthread_mutex_t ptcache_write_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t ptcache_write_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t ptcache_write_done_cond = PTHREAD_COND_INITIALIZER;
+
+static size_t ptcache_frame_size(PTCacheMem *pm)
+{
+	PTCacheExtra *extra;
+	size_t size = sizeof(PTCacheMem);
+	int i;
+
+	for(i=0; i<BPHYS_TOT_DATA; i++)
+		if(pm->data[i])
+			size += MEM_allocN_len(pm->data[i]);
+
+	for(extra=pm->extradata.first; extra; extra=extra->next)
+		if(extra->data)
+			size += MEM_allocN_len(extra->data);
+
+	return size;
+}
+
+/* a packed cache is one file, otherwise only writes of the same frame collide */
+static int ptcache_write_collides(PTCacheWrite *wr, PTCacheWrite *other)
+{
+	return (wr->orig == other->orig &&
+		(ptcache_pack_format(&wr->pid) || wr->pm->frame == other->pm->frame));
+}
+
+/* first queued write that doesn't have to wait for another, with the lock held */
+static PTCacheWrite *ptcache_write_next(void)
+{
+	PTCacheWrite *wr, *other;
+
+	for(wr=ptcache_write_queue.first; wr; wr=wr->next) {
+		for(other=ptcache_write_busy.first; other; other=other->next)
+			if(ptcache_write_collides(wr, other))
+				break;
+
+		if(other == NULL) {
+			for(other=ptcache_write_queue.first; other != wr; other=other->next)
+				if(ptcache_write_collides(wr, other))
+					break;
+
+			if(other == wr)
+				return wr;
+		}
+	}
+
+	return NULL;
+}
+
+/* queued or being written, with the lock held. cfra -1 for any frame */
+static int ptcache_write_find(PointCache *cache, int cfra)
+{
+	ListBase *lb[2] = {&ptcache_write_queue, &ptcache_write_busy};
+	PTCacheWrite *wr;
+	int i;
+
+	for(i=0; i<2; i++)
+		for(wr=lb[i]->first; wr; wr=wr->next)
+			if(wr->orig == cache && (cfra == -1 || wr->pm->frame == (unsigned int)cfra))
+				return 1;
+
+	return 0;
+}
+
+static void *ptcache_write_thread(void *UNUSED(arg))
+{
+	PTCacheWrite *wr;
+
+	pthread_mutex_lock(&ptcache_write_lock);
+
+	while(1) {
+		wr = ptcache_write_next();
+
+		if(wr == NULL) {
+			if(ptcache_write_exit && ptcache_write_queue.first == NULL)
+				break;
+
+			pthread_cond_wait(&ptcache_write_cond, &ptcache_write_lock);
+			continue;
+		}
+
+		BLI_remlink(&ptcache_write_queue, wr);
+		BLI_addtail(&ptcache_write_busy, wr);
+
+		pthread_mutex_unlock(&ptcache_write_lock);
+
+		if(!ptcache_frame_write(&wr->pid, wr->pm, wr->filename) && (G.f & G_DEBUG))
+			printf("Error writing frame %d to %s\n", wr->pm->frame, wr->filename);
+
+		ptcache_frame_free(wr->pm);
+
+		pthread_mutex_lock(&ptcache_write_lock);
+
+		BLI_remlink(&ptcache_write_busy, wr);
+		ptcache_write_mem -= wr->size;
+		ptcache_write_last = PIL_check_seconds_timer();
+		MEM_freeN(wr);
+
+		/* writes that collided with this one can start now */
+		pthread_cond_broadcast(&ptcache_write_cond);
+		pthread_cond_broadcast(&ptcache_write_done_cond);
+	}
+
+	pthread_mutex_unlock(&ptcache_write_lock);
+
+	return NULL;
+}
+
+/* takes ownership of the frame */
+static int ptcache_write_queue_frame(PTCacheID *pid, PTCacheMem *pm)
+{
+	PTCacheWrite *wr;
+	int a;
+
+	wr = MEM_callocN(sizeof(PTCacheWrite), "PTCacheWrite");
+
+	if(!ptcache_frame_filename_write(pid, pm->frame, wr->filename)) {
+		ptcache_frame_free(pm);
+		MEM_freeN(wr);
+		return 0;
+	}
+
+	wr->pid = *pid;
+	wr->cache = *pid->cache;
+	wr->pid.cache = &wr->cache;
+	wr->pid.ob = NULL;
+	wr->pid.calldata = NULL;
+	wr->pid.next = wr->pid.prev = NULL;
+	wr->orig = pid->cache;
+	wr->pm = pm;
+	wr->size = ptcache_frame_size(pm);
+
+	pthread_mutex_lock(&ptcache_write_lock);
+
+	if(ptcache_write_totthread == 0) {
+		/* one core is left for the simulation */
+		ptcache_write_totthread = MAX2(BLI_system_thread_count() - 1, 1);
+		ptcache_write_exit = 0;
+
+		BLI_init_threads(&ptcache_write_threads, ptcache_write_thread, ptcache_write_totthread);
+
+		for(a=0; a<ptcache_write_totthread; a++)
+			BLI_insert_thread(&ptcache_write_threads, NULL);
+	}
+
+	/* don't let the simulation run too far ahead of the disk */
+	while(ptcache_write_mem && ptcache_write_mem + wr->size > PTCACHE_WRITE_MAX_MEM)
+		pthread_cond_wait(&ptcache_write_done_cond, &ptcache_write_lock);
+
+	BLI_addtail(&ptcache_write_queue, wr);
+	ptcache_write_mem += wr->size;
+
+	pthread_cond_signal(&ptcache_write_cond);
+	pthread_mutex_unlock(&ptcache_write_lock);
+
+	return 1;
+}
+
+/* waits until no frame of the cache is being written, and keeps the lock */
+static void ptcache_write_lock_idle(PointCache *cache)
+{
+	PTCacheWrite *wr;
+
+	pthread_mutex_lock(&ptcache_write_lock);
+
+	for(wr=ptcache_write_busy.first; wr; ) {
+		if(wr->orig == cache) {
+			pthread_cond_wait(&ptcache_write_done_cond, &ptcache_write_lock);
+			wr = ptcache_write_busy.first;
+		}
+		else
+			wr = wr->next;
+	}
+}
+
+static void ptcache_write_unlock(void)
+{
+	pthread_mutex_unlock(&ptcache_write_lock);
+}
+
+/* gives back a frame that is still queued, so it can be changed without reading it from disk */
+static PTCacheMem *ptcache_write_unqueue(PointCache *cache, int cfra)
+{
+	PTCacheWrite *wr;
+	PTCacheMem *pm = NULL;
+
+	pthread_mutex_lock(&ptcache_write_lock);
+
+	for(wr=ptcache_write_queue.first; wr; wr=wr->next) {
+		if(wr->orig == cache && wr->pm->frame == (unsigned int)cfra) {
+			BLI_remlink(&ptcache_write_queue, wr);
+			ptcache_write_mem -= wr->size;
+			pm = wr->pm;
+			MEM_freeN(wr);
+
+			pthread_cond_broadcast(&ptcache_write_done_cond);
+			break;
+		}
+	}
+
+	pthread_mutex_unlock(&ptcache_write_lock);
+
+	return pm;
+}
+
+static int ptcache_write_pending(PointCache *cache, int cfra)
+{
+	int found;
+
+	pthread_mutex_lock(&ptcache_write_lock);
+	found = ptcache_write_find(cache, cfra);
+	pthread_mutex_unlock(&ptcache_write_lock);
+
+	return found;
+}
+
+static void ptcache_write_end_threads(void)
+{
+	/* threads exit once the queue is empty */
+	ptcache_write_exit = 1;
+	pthread_cond_broadcast(&ptcache_write_cond);
+	pthread_mutex_unlock(&ptcache_write_lock);
+
+	BLI_end_threads(&ptcache_write_threads);
+
+	ptcache_write_totthread = 0;
+}
+
+void BKE_ptcache_write_flush(PointCache *cache)
+{
+	pthread_mutex_lock(&ptcache_write_lock);
+
+	if(ptcache_write_totthread == 0) {
+		pthread_mutex_unlock(&ptcache_write_lock);
+		return;
+	}
+
+	if(cache) {
+		while(ptcache_write_find(cache, -1))
+			pthread_cond_wait(&ptcache_write_done_cond, &ptcache_write_lock);
+
+		pthread_mutex_unlock(&ptcache_write_lock);
+	}
+	else
+		ptcache_write_end_threads();
+}
+
+void BKE_ptcache_write_end_idle(void)
+{
+	pthread_mutex_lock(&ptcache_write_lock);
+
+	/* running threads keep the malloc lock on, end them when nothing was written for a while */
+	if(ptcache_write_totthread && !ptcache_write_queue.first && !ptcache_write_busy.first &&
+		PIL_check_seconds_timer() - ptcache_write_last > PTCACHE_WRITE_IDLE_TIME)
+		ptcache_write_end_threads();
+	else
+		pthread_mutex_unlock(&ptcache_write_lock);
+}
+
 static int ptcache_read_stream(PTCacheID *pid, int cfra)
 {
 	PTCacheFile *pf = ptcache_file_open(pid, PTCACHE_FILE_READ, cfra);
@@ -1605,8 +2450,11 @@ static int ptcache_read(PTCacheID *pid, int cfra)
 	int i;
 	int *index = &i;
 
-	/* get a memory cache to read from */
-	if(pid->cache->flag & PTCACHE_DISK_CACHE) {
+	/* get a memory cache to read from, packed disk caches are read in place */
+	if(ptcache_use_pack(pid)) {
+		pm = ptcache_pack_frame_to_mem(pid, cfra, 1);
+	}
+	else if(pid->cache->flag & PTCACHE_DISK_CACHE) {
 		pm = ptcache_disk_frame_to_mem(pid, cfra);
 	}
 	else {
@@ -1638,11 +2486,8 @@ static int ptcache_read(PTCacheID *pid, int cfra)
 			pid->read_extra_data(pid->calldata, pm, (float)pm->frame);
 
 		/* clean up temporary memory cache */
-		if(pid->cache->flag & PTCACHE_DISK_CACHE) {
-			ptcache_data_free(pm);
-			ptcache_extra_free(pm);
-			MEM_freeN(pm);
-		}
+		if(pid->cache->flag & PTCACHE_DISK_CACHE)
+			ptcache_frame_free(pm);
 	}
 
 	return 1;
@@ -1653,8 +2498,11 @@ static int ptcache_interpolate(PTCacheID *pid, float cfra, int cfra1, int cfra2)
 	int i;
 	int *index = &i;
 
-	/* get a memory cache to read from */
-	if(pid->cache->flag & PTCACHE_DISK_CACHE) {
+	/* get a memory cache to read from, packed disk caches are read in place */
+	if(ptcache_use_pack(pid)) {
+		pm = ptcache_pack_frame_to_mem(pid, cfra2, 1);
+	}
+	else if(pid->cache->flag & PTCACHE_DISK_CACHE) {
 		pm = ptcache_disk_frame_to_mem(pid, cfra2);
 	}
 	else {
@@ -1685,11 +2533,8 @@ static int ptcache_interpolate(PTCacheID *pid, float cfra, int cfra1, int cfra2)
 			pid->interpolate_extra_data(pid->calldata, pm, cfra, (float)cfra1, (float)cfra2);
 
 		/* clean up temporary memory cache */
-		if(pid->cache->flag & PTCACHE_DISK_CACHE) {
-			ptcache_data_free(pm);
-			ptcache_extra_free(pm);
-			MEM_freeN(pm);
-		}
+		if(pid->cache->flag & PTCACHE_DISK_CACHE)
+			ptcache_frame_free(pm);
 	}
 
 	return 1;
@@ -1823,7 +2668,10 @@ static int ptcache_write(PTCacheID *pid, int cfra, int overwrite)
 			while(fra >= cache->startframe && !BKE_ptcache_id_exist(pid, fra))
 				fra--;
 			
-			pm2 = ptcache_disk_frame_to_mem(pid, fra);
+			/* usually the previous frame wasn't written yet */
+			pm2 = ptcache_write_unqueue(cache, fra);
+			if(pm2 == NULL)
+				pm2 = ptcache_disk_frame_to_mem(pid, fra);
 		}
 		else
 			pm2 = cache->mem_cache.last;
@@ -1848,21 +2696,11 @@ static int ptcache_write(PTCacheID *pid, int cfra, int overwrite)
 	pm->frame = cfra;
 
 	if(cache->flag & PTCACHE_DISK_CACHE) {
-		error += !ptcache_mem_frame_to_disk(pid, pm);
-
-		// if(pm) /* pm is always set */
-		{
-			ptcache_data_free(pm);
-			ptcache_extra_free(pm);
-			MEM_freeN(pm);
-		}
+		/* the frames are freed after writing */
+		error += !ptcache_write_queue_frame(pid, pm);
 
-		if(pm2) {
-			error += !ptcache_mem_frame_to_disk(pid, pm2);
-			ptcache_data_free(pm2);
-			ptcache_extra_free(pm2);
-			MEM_freeN(pm2);
-		}
+		if(pm2)
+			error += !ptcache_write_queue_frame(pid, pm2);
 	}
 	else {
 		BLI_addtail(&cache->mem_cache, pm);
@@ -1987,13 +2825,19 @@ void BKE_ptcache_id_clear(PTCacheID *pid, int mode, unsigned int cfra)
 #endif
 
 	/*if (!G.relbase_valid) return; *//* save blend file before using pointcache */
+
+	/* files can't be removed while they're written */
+	BKE_ptcache_write_flush(pid->cache);
 	
 	/* clear all files in the temp dir with the prefix of the ID and the ".bphys" suffix */
 	switch (mode) {
 	case PTCACHE_CLEAR_ALL:
 	case PTCACHE_CLEAR_BEFORE:	
 	case PTCACHE_CLEAR_AFTER:
-		if(pid->cache->flag & PTCACHE_DISK_CACHE) {
+		if(ptcache_use_pack(pid)) {
+			ptcache_pack_clear(pid, mode, cfra);
+		}
+		else if(pid->cache->flag & PTCACHE_DISK_CACHE) {
 			ptcache_path(pid, path);
 			
 			len = ptcache_filename(pid, filename, cfra, 0, 0); /* no path */
@@ -2073,7 +2917,10 @@ void BKE_ptcache_id_clear(PTCacheID *pid, int mode, unsigned int cfra)
 		break;
 		
 	case PTCACHE_CLEAR_FRAME:
-		if(pid->cache->flag & PTCACHE_DISK_CACHE) {
+		if(ptcache_use_pack(pid)) {
+			ptcache_pack_clear(pid, mode, cfra);
+		}
+		else if(pid->cache->flag & PTCACHE_DISK_CACHE) {
 			if(BKE_ptcache_id_exist(pid, cfra)) {
 				ptcache_filename(pid, filename, cfra, 1, 1); /* no path */
 				BLI_delete(filename, 0, 0);
@@ -2109,8 +2956,14 @@ int  BKE_ptcache_id_exist(PTCacheID *pid, int cfra)
 	if(pid->cache->cached_frames &&	pid->cache->cached_frames[cfra-pid->cache->startframe]==0)
 		return 0;
 	
-	if(pid->cache->flag & PTCACHE_DISK_CACHE) {
+	if(ptcache_use_pack(pid)) {
+		return ptcache_write_pending(pid->cache, cfra) || ptcache_pack_exist(pid, cfra);
+	}
+	else if(pid->cache->flag & PTCACHE_DISK_CACHE) {
 		char filename[MAX_PTCACHE_FILE];
+
+		if(ptcache_write_pending(pid->cache, cfra))
+			return 1;
 		
 		ptcache_filename(pid, filename, cfra, 1, 1);
 
@@ -2187,7 +3040,22 @@ void BKE_ptcache_id_time(PTCacheID *pid, Scene *scene, float cfra, int *startfra
 
 		cache->cached_frames = MEM_callocN(sizeof(char) * (cache->endframe-cache->startframe+1), "cached frames array");
 
-		if(pid->cache->flag & PTCACHE_DISK_CACHE) {
+		if(cache->flag & PTCACHE_DISK_CACHE)
+			BKE_ptcache_write_flush(cache);
+
+		if(ptcache_use_pack(pid)) {
+			PTCachePackFrame *frames;
+			int a, totframe = ptcache_pack_index(pid, &frames);
+
+			for(a=0; a<totframe; a++) {
+				if(frames[a].frame >= sta && frames[a].frame <= end)
+					cache->cached_frames[frames[a].frame-sta] = 1;
+			}
+
+			if(frames)
+				MEM_freeN(frames);
+		}
+		else if(pid->cache->flag & PTCACHE_DISK_CACHE) {
 			/* mode is same as fopen's modes */
 			DIR *dir; 
 			struct dirent *de;
@@ -2778,6 +3646,9 @@ void BKE_ptcache_bake(PTCacheBaker* baker)
 		BLI_freelistN(&pidlist);
 	}
 
+	/* wait for the frames that are still being written */
+	BKE_ptcache_write_flush(NULL);
+
 	scene->r.framelen = frameleno;
 	CFRA = cfrao;
 	
@@ -2876,6 +3747,55 @@ void BKE_ptcache_toggle_disk_cache(PTCacheID *pid)
 	BKE_ptcache_update_info(pid);
 }
 
+/* the flag is toggled already, convert existing disk cache frames */
+void BKE_ptcache_toggle_disk_packed(PTCacheID *pid)
+{
+	PointCache *cache = pid->cache;
+	int last_exact = cache->last_exact;
+	int baked = cache->flag & PTCACHE_BAKED;
+
+	if(cache->flag & PTCACHE_DISK_CACHE) {
+		ListBase frames = {NULL, NULL};
+		PTCacheMem *pm, *pmnext;
+		int cfra;
+
+		/* read the frames in the old format */
+		cache->flag ^= PTCACHE_DISK_PACKED;
+
+		for(cfra=cache->startframe; cfra <= cache->endframe; cfra++) {
+			pm = ptcache_disk_frame_to_mem(pid, cfra);
+
+			if(pm)
+				BLI_addtail(&frames, pm);
+		}
+
+		/* remove the old files */
+		cache->flag &= ~PTCACHE_BAKED;
+		BKE_ptcache_id_clear(pid, PTCACHE_CLEAR_ALL, 0);
+		cache->flag |= baked;
+
+		/* and write them in the new one */
+		cache->flag ^= PTCACHE_DISK_PACKED;
+
+		for(pm=frames.first; pm; pm=pmnext) {
+			pmnext = pm->next;
+			ptcache_mem_frame_to_disk(pid, pm);
+			ptcache_frame_free(pm);
+		}
+	}
+
+	if(cache->cached_frames) {
+		MEM_freeN(cache->cached_frames);
+		cache->cached_frames=NULL;
+	}
+
+	cache->last_exact = last_exact;
+
+	BKE_ptcache_id_time(pid, NULL, 0.0f, NULL, NULL, NULL);
+
+	BKE_ptcache_update_info(pid);
+}
+
 void BKE_ptcache_disk_cache_rename(PTCacheID *pid, char *from, char *to)
 {
 	char old_name[80];
@@ -2889,9 +3809,24 @@ void BKE_ptcache_disk_cache_rename(PTCacheID *pid, char *from, char *to)
 	char old_path_full[MAX_PTCACHE_FILE];
 	char ext[MAX_PTCACHE_PATH];
 
+	BKE_ptcache_write_flush(pid->cache);
+
 	/* save old name */
 	strcpy(old_name, pid->cache->name);
 
+	if(ptcache_use_pack(pid)) {
+		strcpy(pid->cache->name, from);
+		ptcache_pack_filename(pid, old_path_full);
+		strcpy(pid->cache->name, to);
+		ptcache_pack_filename(pid, new_path_full);
+
+		if(BLI_exists(old_path_full))
+			BLI_rename(old_path_full, new_path_full);
+
+		strcpy(pid->cache->name, old_name);
+		return;
+	}
+
 	/* get "from" filename */
 	strcpy(pid->cache->name, from);
 
@@ -3068,6 +4003,26 @@ void BKE_ptcache_update_info(PTCacheID *pid)
 			else
 				sprintf(mem_info, "%i cells cached", totpoint);
 		}
+		else if(ptcache_use_pack(pid)) {
+			PTCachePackFrame *frames;
+			int a, tot = ptcache_pack_index(pid, &frames);
+
+			for(a=0; a<tot; a++) {
+				if((int)frames[a].frame >= cache->startframe && (int)frames[a].frame <= cache->endframe)
+					totframes++;
+			}
+
+			/* and frames that are still being written */
+			for(a=cache->startframe; a<=cache->endframe; a++) {
+				if(ptcache_write_pending(cache, a) && ptcache_pack_frame_find(frames, tot, a) == -1)
+					totframes++;
+			}
+
+			if(frames)
+				MEM_freeN(frames);
+
+			sprintf(mem_info, "%i frames on disk", totframes);
+		}
 		else {
 			int cfra = cache->startframe;
 
@@ -47,7 +47,10 @@
 #include "MEM_guardedalloc.h"
 
 #include "DNA_anim_types.h"
+#include "DNA_constraint_types.h"
 #include "DNA_group_types.h"
+#include "DNA_key_types.h"
+#include "DNA_modifier_types.h"
 #include "DNA_object_types.h"
 #include "DNA_scene_types.h"
 #include "DNA_screen_types.h"
@@ -55,6 +58,8 @@
 
 #include "BLI_math.h"
 #include "BLI_blenlib.h"
+#include "BLI_ghash.h"
+#include "BLI_threads.h"
 #include "BLI_utildefines.h"
 
 #include "BKE_anim.h"
@@ -63,8 +68,10 @@
 #include "BKE_global.h"
 #include "BKE_group.h"
 #include "BKE_idprop.h"
+#include "BKE_key.h"
 #include "BKE_library.h"
 #include "BKE_main.h"
+#include "BKE_modifier.h"
 #include "BKE_node.h"
 #include "BKE_object.h"
 #include "BKE_paint.h"
@@ -75,6 +82,8 @@
 
 #include "BKE_sound.h"
 
+#include "depsgraph_private.h"
+
 //XXX #include "BIF_previewrender.h"
 //XXX #include "BIF_editseq.h"
 
@@ -937,11 +946,388 @@ static void scene_update_drivers(Main *UNUSED(bmain), Scene *scene)
 	}
 }
 
-static void scene_update_tagged_recursive(Main *bmain, Scene *scene, Scene *scene_parent)
+/* ******************** threaded object update ******************** */
+
+/* Objects are updated in threads, in depsgraph order: an object is queued
+   as soon as all objects it depends on are updated. Objects that use global
+   or shared data, or run python, are only updated by the main thread, which
+   takes part in the update too. G is only read during the update. */
+
+typedef struct SceneUpdateTask {
+	struct SceneUpdateTask *next;		/* in ready list */
+	Base *base;
+	struct SceneUpdateTask **children;	/* tasks that depend on this one */
+	int totchild, valency;				/* valency: dependencies not updated yet */
+	int mainthread;
+} SceneUpdateTask;
+
+typedef struct SceneUpdateState {
+	Scene *scene_parent;
+	SceneUpdateTask *tasks;
+	int tottask, totdone;
+
+	/* tasks of which all dependencies are updated */
+	SceneUpdateTask *ready, *ready_main;
+
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+} SceneUpdateState;
+
+static int scene_adt_has_python_drivers(AnimData *adt)
+{
+	FCurve *fcu;
+
+	if(adt) {
+		for(fcu= adt->drivers.first; fcu; fcu= fcu->next)
+			if(fcu->driver && fcu->driver->type == DRIVER_TYPE_PYTHON)
+				return 1;
+	}
+
+	return 0;
+}
+
+static int scene_constraints_have_python(ListBase *conlist)
+{
+	bConstraint *con;
+
+	for(con= conlist->first; con; con= con->next)
+		if(con->type == CONSTRAINT_TYPE_PYTHON)
+			return 1;
+
+	return 0;
+}
+
+/* objects that can only be updated by the main thread */
+static int scene_object_update_mainthread(Scene *scene, Object *ob)
+{
+	ID *data= ob->data;
+	Key *key= ob_get_key(ob);
+	ModifierData *md;
+	bPoseChannel *pchan;
+
+	/* metaballs and text use global data in mball.c and font.c */
+	if(ELEM(ob->type, OB_MBALL, OB_FONT))
+		return 1;
+
+	/* shared data would be updated by each of its users */
+	if(data && data->us > 1)
+		return 1;
+
+	/* proxies and dupligroups update other objects */
+	if(ob->proxy || ob->proxy_from || ob->proxy_group || (ob->dup_group && (ob->transflag & OB_DUPLIGROUP)))
+		return 1;
+
+	/* editors keep pointers into edit and paint mode data */
+	if(ob == scene->obedit || (ob->mode & (OB_MODE_EDIT|OB_MODE_ALL_PAINT|OB_MODE_PARTICLE_EDIT)))
+		return 1;
+
+	/* physics use the global random generator, point caches and threads of their own */
+	if(ob->particlesystem.first || ob->soft)
+		return 1;
+
+	for(md= ob->modifiers.first; md; md= md->next) {
+		ModifierTypeInfo *mti= modifierType_getInfo(md->type);
+
+		if((mti->flags & eModifierTypeFlag_UsesPointCache) || md->type == eModifierType_ParticleInstance)
+			return 1;
+	}
+
+	/* python needs the interpreter lock, which the main thread may be holding */
+	if(scene_adt_has_python_drivers(ob->adt) || scene_adt_has_python_drivers(BKE_animdata_from_id(data)))
+		return 1;
+	if(key && scene_adt_has_python_drivers(key->adt))
+		return 1;
+	if(scene_constraints_have_python(&ob->constraints))
+		return 1;
+
+	if(ob->pose) {
+		for(pchan= ob->pose->chanbase.first; pchan; pchan= pchan->next)
+			if(scene_constraints_have_python(&pchan->constraints))
+				return 1;
+	}
+
+	return 0;
+}
+
+static void scene_update_base(Scene *scene_parent, Base *base)
+{
+	Object *ob= base->object;
+
+	object_handle_update(scene_parent, ob);
+
+	if(ob->dup_group && (ob->transflag & OB_DUPLIGROUP))
+		group_handle_recalc_and_update(scene_parent, ob, ob->dup_group);
+
+	/* always update layer, so that animating layers works */
+	base->lay= ob->lay;
+}
+
+/* add dependencies of task, following the depsgraph through nodes
+   that are not updated as a base, like object data and group objects */
+static void scene_update_task_add_children(SceneUpdateTask *task, DagNode *node, GHash *taskhash, int stamp)
 {
+	DagAdjList *itA;
+
+	for(itA= node->child; itA; itA= itA->next) {
+		DagNode *child= itA->node;
+		SceneUpdateTask *ctask;
+
+		if(child->color == stamp)
+			continue;
+		child->color= stamp;
+
+		ctask= BLI_ghash_lookup(taskhash, child->ob);
+
+		if(ctask == task)
+			continue;
+		else if(ctask) {
+			task->children[task->totchild++]= ctask;
+			ctask->valency++;
+		}
+		else
+			scene_update_task_add_children(task, child, taskhash, stamp);
+	}
+}
+
+/* returns 0 when the depsgraph has cycles */
+static int scene_update_tasks_acyclic(SceneUpdateState *state)
+{
+	SceneUpdateTask **stack;
+	int *valency, a, tot= 0, totdone= 0;
+
+	stack= MEM_mallocN(sizeof(SceneUpdateTask*)*state->tottask, "scene update stack");
+	valency= MEM_mallocN(sizeof(int)*state->tottask, "scene update valency");
+
+	for(a=0; a<state->tottask; a++) {
+		valency[a]= state->tasks[a].valency;
+		if(valency[a] == 0)
+			stack[tot++]= &state->tasks[a];
+	}
+
+	while(tot) {
+		SceneUpdateTask *task= stack[--tot];
+
+		for(a=0; a<task->totchild; a++)
+			if(--valency[task->children[a] - state->tasks] == 0)
+				stack[tot++]= task->children[a];
+
+		totdone++;
+	}
+
+	MEM_freeN(stack);
+	MEM_freeN(valency);
+
+	return (totdone == state->tottask);
+}
+
+static void scene_update_tasks_free(SceneUpdateState *state)
+{
+	int a;
+
+	for(a=0; a<state->tottask; a++)
+		if(state->tasks[a].children)
+			MEM_freeN(state->tasks[a].children);
+
+	MEM_freeN(state->tasks);
+}
+
+/* returns 0 when the objects should be updated in base order instead */
+static int scene_update_tasks_init(SceneUpdateState *state, Scene *scene)
+{
+	DagForest *dag= scene->theDag;
+	DagNode *node;
+	GHash *taskhash;
+	SceneUpdateTask **children;
 	Base *base;
-	
-	
+	int a, totupdate= 0;
+
+	if(dag == NULL || dag->nodeHash == NULL)
+		return 0;
+
+	/* most redraws don't tag anything, skip the setup when no more
+	   than one object needs an update */
+	state->tottask= 0;
+	for(base= scene->base.first; base; base= base->next) {
+		if(base->object->recalc & OB_RECALC_ALL)
+			totupdate++;
+		state->tottask++;
+	}
+
+	if(totupdate < 2)
+		return 0;
+	totupdate= 0;
+
+	state->tasks= MEM_callocN(sizeof(SceneUpdateTask)*state->tottask, "scene update tasks");
+	taskhash= BLI_ghash_new(BLI_ghashutil_ptrhash, BLI_ghashutil_ptrcmp, "scene update tasks gh");
+
+	for(a=0, base= scene->base.first; base; base= base->next, a++) {
+		SceneUpdateTask *task= &state->tasks[a];
+
+		task->base= base;
+		task->mainthread= scene_object_update_mainthread(scene, base->object);
+
+		if(!task->mainthread && (base->object->recalc & OB_RECALC_ALL))
+			totupdate++;
+
+		BLI_ghash_insert(taskhash, base->object, task);
+	}
+
+	/* nothing to gain from threads */
+	if(totupdate < 2) {
+		BLI_ghash_free(taskhash, NULL, NULL);
+		scene_update_tasks_free(state);
+		return 0;
+	}
+
+	/* node->color is free for temporal storage, stamp visited nodes with the
+	   task number so every dependency is only added once */
+	for(node= dag->DagNode.first; node; node= node->next)
+		node->color= 0;
+
+	children= MEM_mallocN(sizeof(SceneUpdateTask*)*state->tottask, "scene update children");
+
+	for(a=0; a<state->tottask; a++) {
+		SceneUpdateTask *task= &state->tasks[a];
+
+		node= dag_find_node(dag, task->base->object);
+		if(node == NULL)
+			continue;
+
+		task->children= children;
+		scene_update_task_add_children(task, node, taskhash, a+1);
+
+		if(task->totchild) {
+			task->children= MEM_mallocN(sizeof(SceneUpdateTask*)*task->totchild, "scene update task children");
+			memcpy(task->children, children, sizeof(SceneUpdateTask*)*task->totchild);
+		}
+		else
+			task->children= NULL;
+	}
+
+	MEM_freeN(children);
+	BLI_ghash_free(taskhash, NULL, NULL);
+
+	/* DAG_scene_sort() only reports cycles, base order is what we can do then */
+	if(!scene_update_tasks_acyclic(state)) {
+		scene_update_tasks_free(state);
+		return 0;
+	}
+
+	for(a=0; a<state->tottask; a++) {
+		SceneUpdateTask *task= &state->tasks[a];
+
+		if(task->valency == 0) {
+			if(task->mainthread) {
+				task->next= state->ready_main;
+				state->ready_main= task;
+			}
+			else {
+				task->next= state->ready;
+				state->ready= task;
+			}
+		}
+	}
+
+	return 1;
+}
+
+/* must be called with state->lock held */
+static void scene_update_task_done(SceneUpdateState *state, SceneUpdateTask *task)
+{
+	int a;
+
+	for(a=0; a<task->totchild; a++) {
+		SceneUpdateTask *ctask= task->children[a];
+
+		if(--ctask->valency == 0) {
+			if(ctask->mainthread) {
+				ctask->next= state->ready_main;
+				state->ready_main= ctask;
+			}
+			else {
+				ctask->next= state->ready;
+				state->ready= ctask;
+			}
+		}
+	}
+
+	state->totdone++;
+	pthread_cond_broadcast(&state->cond);
+}
+
+/* update tasks until all are done, the main thread also takes main thread only tasks */
+static void scene_update_tasks_run(SceneUpdateState *state, int mainthread)
+{
+	SceneUpdateTask *task;
+
+	pthread_mutex_lock(&state->lock);
+
+	while(state->totdone < state->tottask) {
+		if(mainthread && state->ready_main) {
+			task= state->ready_main;
+			state->ready_main= task->next;
+		}
+		else if(state->ready) {
+			task= state->ready;
+			state->ready= task->next;
+		}
+		else {
+			pthread_cond_wait(&state->cond, &state->lock);
+			continue;
+		}
+
+		pthread_mutex_unlock(&state->lock);
+		scene_update_base(state->scene_parent, task->base);
+		pthread_mutex_lock(&state->lock);
+
+		scene_update_task_done(state, task);
+	}
+
+	pthread_mutex_unlock(&state->lock);
+}
+
+static void *scene_update_thread(void *state_v)
+{
+	scene_update_tasks_run(state_v, 0);
+	return NULL;
+}
+
+static void scene_update_objects(Scene *scene, Scene *scene_parent)
+{
+	SceneUpdateState state;
+	ListBase threads;
+	Base *base;
+	int a, totthread= BLI_system_thread_count() - 1;
+
+	memset(&state, 0, sizeof(state));
+	state.scene_parent= scene_parent;
+
+	/* render threads update their scene in base order */
+	if(totthread < 1 || !BLI_thread_is_main() || !scene_update_tasks_init(&state, scene)) {
+		for(base= scene->base.first; base; base= base->next)
+			scene_update_base(scene_parent, base);
+		return;
+	}
+
+	pthread_mutex_init(&state.lock, NULL);
+	pthread_cond_init(&state.cond, NULL);
+
+	BLI_init_threads(&threads, scene_update_thread, totthread);
+	for(a=0; a<totthread; a++)
+		BLI_insert_thread(&threads, &state);
+
+	scene_update_tasks_run(&state, 1);
+
+	BLI_end_threads(&threads);
+
+	pthread_cond_destroy(&state.cond);
+	pthread_mutex_destroy(&state.lock);
+
+	scene_update_tasks_free(&state);
+}
+
+static void scene_update_tagged_recursive(Main *bmain, Scene *scene, Scene *scene_parent)
+{
 	scene->customdata_mask= scene_parent->customdata_mask;
 
 	/* sets first, we allow per definition current scene to have
@@ -950,17 +1336,7 @@ static void scene_update_tagged_recursive(Main *bmain, Scene *scene, Scene *scen
 		scene_update_tagged_recursive(bmain, scene->set, scene_parent);
 	
 	/* scene objects */
-	for (base= scene->base.first; base; base= base->next) {
-		Object *ob= base->object;
-		
-		object_handle_update(scene_parent, ob);
-		
-		if(ob->dup_group && (ob->transflag & OB_DUPLIGROUP))
-			group_handle_recalc_and_update(scene_parent, ob, ob->dup_group);
-			
-		/* always update layer, so that animating layers works */
-		base->lay= ob->lay;
-	}
+	scene_update_objects(scene, scene_parent);
 	
 	/* scene drivers... */
 	scene_update_drivers(bmain, scene);
@@ -990,6 +1366,9 @@ void scene_update_tagged(Main *bmain, Scene *scene)
 	if (scene->physics_settings.quick_cache_step)
 		BKE_ptcache_quick_cache_all(bmain, scene);
 
+	/* frames written during playback leave the writing threads running */
+	BKE_ptcache_write_end_idle();
+
 	/* in the future this should handle updates for all datablocks, not
 	   only objects and scenes. - brecht */
 }
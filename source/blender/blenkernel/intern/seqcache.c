@@ -33,18 +33,27 @@
 #include <math.h>
 
 #include "MEM_guardedalloc.h"
-#include "MEM_CacheLimiterC-Api.h"
 
 #include "DNA_sequence_types.h"
+#include "DNA_userdef_types.h"
 #include "BKE_sequencer.h"
 #include "BLI_utildefines.h"
 #include "BLI_ghash.h"
+#include "BLI_listbase.h"
 #include "BLI_mempool.h"
 #include <pthread.h>
 
 #include "IMB_imbuf.h"
 #include "IMB_imbuf_types.h"
 
+/* Every cache stage (raw stills, preprocessed strips, composited stacks) has
+   its own memory budget, a percentage of the memory cache limit. When a stage
+   runs over budget, the entries that are cheapest to render again and furthest
+   from the playhead are dropped first. */
+
+/* keeps entries that rendered in no time from all scoring the same */
+#define SEQ_CACHE_MIN_COST	0.001f
+
 typedef struct seqCacheKey 
 {
 	struct Sequence * seq;
@@ -55,17 +64,103 @@ typedef struct seqCacheKey
 
 typedef struct seqCacheEntry
 {
+	struct seqCacheEntry *next, *prev;	/* in the list of its stage */
+
+	seqCacheKey * key;
 	ImBuf * ibuf;
-	MEM_CacheLimiterHandleC * c_handle;
+	int stage;
+	size_t size;
+	float cfra;		/* scene frame, for the distance to the playhead */
+	float cost;		/* seconds it took to render */
 } seqCacheEntry;
 
+typedef struct seqCacheStage
+{
+	ListBase entries;
+	size_t size;
+	int hits, misses, evictions;
+} seqCacheStage;
+
 static GHash * hash = NULL;
-static MEM_CacheLimiterC * limitor = NULL;
 static struct BLI_mempool * entrypool = NULL;
 static struct BLI_mempool * keypool = NULL;
+static seqCacheStage stages[SEQ_CACHE_TOT_STAGE];
 static int ibufs_in  = 0;
 static int ibufs_rem = 0;
 
+static float cache_playhead = 0.0f;
+static int cache_direction = 1;
+
+/* sequencer prefetch threads fill in the cache while drawing reads it */
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int cache_stage(seq_stripelem_ibuf_t type)
+{
+	switch (type) {
+	case SEQ_STRIPELEM_IBUF_STARTSTILL:
+	case SEQ_STRIPELEM_IBUF_ENDSTILL:
+		return SEQ_CACHE_STAGE_RAW;
+	case SEQ_STRIPELEM_IBUF_COMP:
+		return SEQ_CACHE_STAGE_COMPOSITE;
+	case SEQ_STRIPELEM_IBUF:
+	default:
+		return SEQ_CACHE_STAGE_PREPROCESSED;
+	}
+}
+
+/* budget in bytes, 0 is unlimited */
+static size_t cache_stage_budget(int stage)
+{
+	size_t limit = ((size_t)U.memcachelimit) * 1024 * 1024;
+	int percentage;
+
+	switch (stage) {
+	case SEQ_CACHE_STAGE_RAW:
+		percentage = U.seqcache_raw;
+		break;
+	case SEQ_CACHE_STAGE_COMPOSITE:
+		percentage = U.seqcache_composite;
+		break;
+	default:
+		percentage = U.seqcache_preprocess;
+		break;
+	}
+
+	if (limit == 0 || percentage <= 0) {
+		return limit;
+	}
+
+	return MAX2(limit / 100 * percentage, 1);
+}
+
+static size_t cache_ibuf_size(ImBuf * ibuf)
+{
+	size_t size = sizeof(ImBuf);
+	size_t pixels = (size_t)ibuf->x * ibuf->y;
+
+	if (ibuf->rect) {
+		size += pixels * sizeof(unsigned int);
+	}
+	if (ibuf->rect_float) {
+		size += pixels * 4 * sizeof(float);
+	}
+
+	return size;
+}
+
+/* entries with the lowest priority are evicted first */
+static float cache_entry_priority(seqCacheEntry * e)
+{
+	float dist = (e->cfra - cache_playhead) * cache_direction;
+
+	/* frames behind the playhead are only needed again after a jump */
+	if (dist < 0.0f) {
+		dist = -2.0f * dist;
+	}
+
+	return (e->cost + SEQ_CACHE_MIN_COST) / (1.0f + dist);
+}
+
 static unsigned int HashHash(const void *key_)
 {
 	const seqCacheKey *key = (seqCacheKey*) key_;
@@ -115,40 +210,64 @@ static void HashKeyFree(void *key)
 static void HashValFree(void *val)
 {
 	seqCacheEntry* e = (seqCacheEntry*) val;
+	seqCacheStage* stage = &stages[e->stage];
 
 	if (e->ibuf) {
 		/* fprintf(stderr, "Removing: %p, cnt: %d\n", e->ibuf, 
 		   e->ibuf->refcounter); */
 		IMB_freeImBuf(e->ibuf);
-		MEM_CacheLimiter_unmanage(e->c_handle);
 		ibufs_rem++;
 	}
 
+	BLI_remlink(&stage->entries, e);
+	stage->size -= e->size;
+
 	e->ibuf = NULL;
-	e->c_handle = NULL;
 
 	BLI_mempool_free(entrypool, e);
 }
 
-static void IMB_seq_cache_destructor(void * p)
+/* drop the lowest priority entries of the stage until it fits its budget,
+   except for keep, the entry just added */
+static void cache_enforce_budget(int stage_nr, seqCacheEntry * keep)
 {
-	seqCacheEntry* e = (seqCacheEntry*) p;
-	
-	if (e && e->ibuf) {
-		/* fprintf(stderr, "Removing: %p, cnt: %d\n", e->ibuf,
-		   e->ibuf->refcounter); */
-		IMB_freeImBuf(e->ibuf);
-		ibufs_rem++;
+	seqCacheStage* stage = &stages[stage_nr];
+	size_t budget = cache_stage_budget(stage_nr);
+
+	if (budget == 0) {
+		return;
+	}
+
+	while (stage->size > budget) {
+		seqCacheEntry *e, *evict = NULL;
+		float evict_priority = 0.0f;
 
-		e->ibuf = NULL;
-		e->c_handle = NULL;
+		for (e = stage->entries.first; e; e = e->next) {
+			float priority;
+
+			if (e == keep) {
+				continue;
+			}
+
+			priority = cache_entry_priority(e);
+			if (evict == NULL || priority < evict_priority) {
+				evict = e;
+				evict_priority = priority;
+			}
+		}
+
+		if (evict == NULL) {
+			break;
+		}
+
+		stage->evictions++;
+		BLI_ghash_remove(hash, evict->key, HashKeyFree, HashValFree);
 	}
 }
 
 void seq_stripelem_cache_init(void)
 {
 	hash = BLI_ghash_new(HashHash, HashCmp, "seq stripelem cache hash");
-	limitor = new_MEM_CacheLimiter( IMB_seq_cache_destructor );
 
 	entrypool = BLI_mempool_create(sizeof(seqCacheEntry), 64, 64, 0);
 	keypool = BLI_mempool_create(sizeof(seqCacheKey), 64, 64, 0);
@@ -160,7 +279,6 @@ void seq_stripelem_cache_destruct(void)
 		return;
 	}
 	BLI_ghash_free(hash, HashKeyFree, HashValFree);
-	delete_MEM_CacheLimiter(limitor);
 	BLI_mempool_destroy(entrypool);
 	BLI_mempool_destroy(keypool);
 }
@@ -174,8 +292,10 @@ void seq_stripelem_cache_cleanup(void)
 	/* fprintf(stderr, "Stats before cleanup: in: %d rem: %d\n",
 	   ibufs_in, ibufs_rem); */
 
+	pthread_mutex_lock(&cache_lock);
 	BLI_ghash_free(hash, HashKeyFree, HashValFree);
 	hash = BLI_ghash_new(HashHash, HashCmp, "seq stripelem cache hash");
+	pthread_mutex_unlock(&cache_lock);
 
 	/* fprintf(stderr, "Stats after cleanup: in: %d rem: %d\n",
 	   ibufs_in, ibufs_rem); */
@@ -193,29 +313,37 @@ struct ImBuf * seq_stripelem_cache_get(
 		return NULL;
 	}
 
-	if (!entrypool) {
-		seq_stripelem_cache_init();
-	}
-
 	key.seq = seq;
 	key.context = context;
 	key.cfra = cfra - seq->start;
 	key.type = type;
 	
+	pthread_mutex_lock(&cache_lock);
+
+	if (!entrypool) {
+		seq_stripelem_cache_init();
+	}
+
 	e = (seqCacheEntry*) BLI_ghash_lookup(hash, &key);
 
 	if (e && e->ibuf) {
-		IMB_refImBuf(e->ibuf);
+		ImBuf * ibuf = e->ibuf;
+
+		IMB_refImBuf(ibuf);
 
-		MEM_CacheLimiter_touch(e->c_handle);
-		return e->ibuf;
+		stages[e->stage].hits++;
+		pthread_mutex_unlock(&cache_lock);
+		return ibuf;
 	}
+
+	stages[cache_stage(type)].misses++;
+	pthread_mutex_unlock(&cache_lock);
 	return NULL;
 }
 
 void seq_stripelem_cache_put(
 	SeqRenderData context, struct Sequence * seq, 
-	float cfra, seq_stripelem_ibuf_t type, struct ImBuf * i)
+	float cfra, seq_stripelem_ibuf_t type, struct ImBuf * i, float cost)
 {
 	seqCacheKey * key;
 	seqCacheEntry * e;
@@ -224,12 +352,14 @@ void seq_stripelem_cache_put(
 		return;
 	}
 
-	ibufs_in++;
+	pthread_mutex_lock(&cache_lock);
 
 	if (!entrypool) {
 		seq_stripelem_cache_init();
 	}
 
+	ibufs_in++;
+
 	key = (seqCacheKey*) BLI_mempool_alloc(keypool);
 
 	key->seq = seq;
@@ -241,15 +371,50 @@ void seq_stripelem_cache_put(
 
 	e = (seqCacheEntry*) BLI_mempool_alloc(entrypool);
 
+	e->key = key;
 	e->ibuf = i;
-	e->c_handle = NULL;
+	e->stage = cache_stage(type);
+	e->size = cache_ibuf_size(i);
+	e->cfra = cfra;
+	e->cost = cost;
 
 	BLI_ghash_remove(hash, key, HashKeyFree, HashValFree);
 	BLI_ghash_insert(hash, key, e);
 
-	e->c_handle = MEM_CacheLimiter_insert(limitor, e);
+	BLI_addtail(&stages[e->stage].entries, e);
+	stages[e->stage].size += e->size;
+
+	cache_enforce_budget(e->stage, e);
+
+	pthread_mutex_unlock(&cache_lock);
+}
+
+void seq_stripelem_cache_playhead(float cfra)
+{
+	pthread_mutex_lock(&cache_lock);
+
+	if (cfra != cache_playhead) {
+		cache_direction = (cfra < cache_playhead)? -1: 1;
+		cache_playhead = cfra;
+	}
+
+	pthread_mutex_unlock(&cache_lock);
+}
+
+void seq_stripelem_cache_stats(SeqCacheStats * stats)
+{
+	int i;
+
+	pthread_mutex_lock(&cache_lock);
+
+	for (i = 0; i < SEQ_CACHE_TOT_STAGE; i++) {
+		stats->size[i] = stages[i].size;
+		stats->budget[i] = cache_stage_budget(i);
+		stats->totentry[i] = BLI_countlist(&stages[i].entries);
+		stats->hits[i] = stages[i].hits;
+		stats->misses[i] = stages[i].misses;
+		stats->evictions[i] = stages[i].evictions;
+	}
 
-	MEM_CacheLimiter_ref(e->c_handle);
-	MEM_CacheLimiter_enforce_limits(limitor);
-	MEM_CacheLimiter_unref(e->c_handle);
+	pthread_mutex_unlock(&cache_lock);
 }
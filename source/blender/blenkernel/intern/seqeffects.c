@@ -40,6 +40,7 @@
 #include "BLI_dynlib.h"
 
 #include "BLI_math.h" /* windows needs for M_PI */
+#include "BLI_threads.h"
 #include "BLI_utildefines.h"
 
 #include "DNA_scene_types.h"
@@ -59,6 +60,10 @@
 
 #include "RNA_access.h"
 
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
 /* **** XXX **** */
 static void error(const char *UNUSED(error), ...) {}
 
@@ -120,6 +125,155 @@ static struct ImBuf * prepare_effect_imbufs(
 	return out;
 }
 
+/* **********************************************************************
+   THREADED SLICES
+   ********************************************************************** */
+
+/* effects that compute each output row from the same row of their inputs
+   are split up in slices of rows, rendered in parallel. slices start at even
+   rows, since the kernels alternate facf0 and facf1 for fields */
+
+#define SEQ_SLICE_MIN_LINES	32
+
+typedef struct SeqSliceThread {
+	SeqSliceFunc func;
+	void *userdata;
+	int start_line, total_lines;
+} SeqSliceThread;
+
+static void *do_slice_thread(void *slice_v)
+{
+	SeqSliceThread *slice = slice_v;
+
+	slice->func(slice->userdata, slice->start_line, slice->total_lines);
+
+	return NULL;
+}
+
+void seq_execute_slices(int recty, SeqSliceFunc func, void *userdata)
+{
+	SeqSliceThread slices[BLENDER_MAX_THREADS];
+	ListBase threads;
+	int i, budget, totthread, slice_lines, start_line;
+
+	if (recty < 2*SEQ_SLICE_MIN_LINES) {
+		func(userdata, 0, recty);
+		return;
+	}
+
+	/* prefetch threads take their cores from the budget too */
+	budget = BLI_thread_budget_acquire(MIN2(recty / SEQ_SLICE_MIN_LINES, BLENDER_MAX_THREADS));
+
+	slice_lines = (recty + budget - 1) / budget;
+	slice_lines = MAX2(slice_lines + (slice_lines & 1), SEQ_SLICE_MIN_LINES);
+	totthread = (recty + slice_lines - 1) / slice_lines;
+
+	if (totthread <= 1) {
+		BLI_thread_budget_release(budget);
+		func(userdata, 0, recty);
+		return;
+	}
+
+	BLI_init_threads(&threads, do_slice_thread, totthread);
+
+	for (i = 0, start_line = 0; i < totthread; i++, start_line += slice_lines) {
+		slices[i].func = func;
+		slices[i].userdata = userdata;
+		slices[i].start_line = start_line;
+		slices[i].total_lines = MIN2(slice_lines, recty - start_line);
+
+		BLI_insert_thread(&threads, &slices[i]);
+	}
+
+	BLI_end_threads(&threads);
+	BLI_thread_budget_release(budget);
+}
+
+typedef void (*SeqEffectFloatFunc)(float facf0, float facf1, int x, int y,
+				   float *rect1, float *rect2, float *out);
+typedef void (*SeqEffectByteFunc)(float facf0, float facf1, int x, int y,
+				  unsigned char *rect1, unsigned char *rect2, unsigned char *out);
+
+typedef struct SeqEffectSlice {
+	SeqRenderData context;
+	Sequence *seq;
+	float facf0, facf1;
+	struct ImBuf *ibuf1, *ibuf2, *ibuf3, *out;
+
+	/* kernels for do_rect_effect_slice */
+	SeqEffectFloatFunc do_float;
+	SeqEffectByteFunc do_byte;
+} SeqEffectSlice;
+
+/* also allocates the output buffer */
+static void init_effect_slice(
+	SeqEffectSlice *slice, SeqRenderData context, Sequence *seq,
+	float facf0, float facf1,
+	struct ImBuf *ibuf1, struct ImBuf *ibuf2, struct ImBuf *ibuf3)
+{
+	memset(slice, 0, sizeof(SeqEffectSlice));
+
+	slice->context = context;
+	slice->seq = seq;
+	slice->facf0 = facf0;
+	slice->facf1 = facf1;
+	slice->ibuf1 = ibuf1;
+	slice->ibuf2 = ibuf2;
+	slice->ibuf3 = ibuf3;
+	slice->out = prepare_effect_imbufs(context, ibuf1, ibuf2, ibuf3);
+}
+
+static float *slice_rect_float(SeqEffectSlice *slice, struct ImBuf *ibuf, int start_line)
+{
+	if (ibuf == NULL || ibuf->rect_float == NULL)
+		return NULL;
+	return ibuf->rect_float + 4*start_line*slice->context.rectx;
+}
+
+static unsigned char *slice_rect_byte(SeqEffectSlice *slice, struct ImBuf *ibuf, int start_line)
+{
+	if (ibuf == NULL || ibuf->rect == NULL)
+		return NULL;
+	return (unsigned char*) ibuf->rect + 4*start_line*slice->context.rectx;
+}
+
+static void do_rect_effect_slice(void *slice_v, int start_line, int total_lines)
+{
+	SeqEffectSlice *slice = slice_v;
+
+	if (slice->out->rect_float) {
+		slice->do_float(
+			slice->facf0, slice->facf1,
+			slice->context.rectx, total_lines,
+			slice_rect_float(slice, slice->ibuf1, start_line),
+			slice_rect_float(slice, slice->ibuf2, start_line),
+			slice_rect_float(slice, slice->out, start_line));
+	} else {
+		slice->do_byte(
+			slice->facf0, slice->facf1,
+			slice->context.rectx, total_lines,
+			slice_rect_byte(slice, slice->ibuf1, start_line),
+			slice_rect_byte(slice, slice->ibuf2, start_line),
+			slice_rect_byte(slice, slice->out, start_line));
+	}
+}
+
+static struct ImBuf *do_rect_effect(
+	SeqRenderData context, Sequence *seq, float facf0, float facf1,
+	struct ImBuf *ibuf1, struct ImBuf *ibuf2, struct ImBuf *ibuf3,
+	SeqEffectFloatFunc do_float, SeqEffectByteFunc do_byte)
+{
+	SeqEffectSlice slice;
+
+	init_effect_slice(&slice, context, seq, facf0, facf1, ibuf1, ibuf2, ibuf3);
+	slice.do_float = do_float;
+	slice.do_byte = do_byte;
+
+	seq_execute_slices(context.recty, do_rect_effect_slice, &slice);
+
+	return slice.out;
+}
+
 /* **********************************************************************
    PLUGINS
    ********************************************************************** */
@@ -406,16 +560,16 @@ static void init_alpha_over_or_under(Sequence * seq)
 }
 
 static void do_alphaover_effect_byte(float facf0, float facf1, int x, int y, 
-					 char * rect1, char *rect2, char *out)
+					 unsigned char *rect1, unsigned char *rect2, unsigned char *out)
 {
 	int fac2, mfac, fac, fac4;
 	int xo, tempc;
-	char *rt1, *rt2, *rt;
+	unsigned char *rt1, *rt2, *rt;
 
 	xo= x;
-	rt1= (char *)rect1;
-	rt2= (char *)rect2;
-	rt= (char *)out;
+	rt1= rect1;
+	rt2= rect2;
+	rt= out;
 
 	fac2= (int)(256.0f*facf0);
 	fac4= (int)(256.0f*facf1);
@@ -501,10 +655,15 @@ static void do_alphaover_effect_float(float facf0, float facf1, int x, int y,
 			} else if(mfac <=0) {
 				memcpy(rt, rt1, 4 * sizeof(float));
 			} else {
+#ifdef __SSE__
+				_mm_storeu_ps(rt, _mm_add_ps(_mm_mul_ps(_mm_set_ps1(fac), _mm_loadu_ps(rt1)),
+				                             _mm_mul_ps(_mm_set_ps1(mfac), _mm_loadu_ps(rt2))));
+#else
 				rt[0] = fac*rt1[0] + mfac*rt2[0];
 				rt[1] = fac*rt1[1] + mfac*rt2[1];
 				rt[2] = fac*rt1[2] + mfac*rt2[2];
 				rt[3] = fac*rt1[3] + mfac*rt2[3];
+#endif
 			}
 			rt1+= 4; rt2+= 4; rt+= 4;
 		}
@@ -523,10 +682,15 @@ static void do_alphaover_effect_float(float facf0, float facf1, int x, int y,
 			} else if(mfac <= 0.0f) {
 				memcpy(rt, rt1, 4 * sizeof(float));
 			} else {
+#ifdef __SSE__
+				_mm_storeu_ps(rt, _mm_add_ps(_mm_mul_ps(_mm_set_ps1(fac), _mm_loadu_ps(rt1)),
+				                             _mm_mul_ps(_mm_set_ps1(mfac), _mm_loadu_ps(rt2))));
+#else
 				rt[0] = fac*rt1[0] + mfac*rt2[0];
 				rt[1] = fac*rt1[1] + mfac*rt2[1];
 				rt[2] = fac*rt1[2] + mfac*rt2[2];
 				rt[3] = fac*rt1[3] + mfac*rt2[3];
+#endif
 			}
 			rt1+= 4; rt2+= 4; rt+= 4;
 		}
@@ -534,25 +698,13 @@ static void do_alphaover_effect_float(float facf0, float facf1, int x, int y,
 }
 
 static struct ImBuf * do_alphaover_effect(
-	SeqRenderData context, Sequence *UNUSED(seq), float UNUSED(cfra),
+	SeqRenderData context, Sequence *seq, float UNUSED(cfra),
 	float facf0, float facf1, 
 	struct ImBuf *ibuf1, struct ImBuf *ibuf2, 
 	struct ImBuf *ibuf3)
 {
-	struct ImBuf * out = prepare_effect_imbufs(context,ibuf1, ibuf2, ibuf3);
-
-	if (out->rect_float) {
-		do_alphaover_effect_float(
-			facf0, facf1, context.rectx, context.recty,
-			ibuf1->rect_float, ibuf2->rect_float,
-			out->rect_float);
-	} else {
-		do_alphaover_effect_byte(
-			facf0, facf1, context.rectx, context.recty,
-			(char*) ibuf1->rect, (char*) ibuf2->rect,
-			(char*) out->rect);
-	}
-	return out;
+	return do_rect_effect(context, seq, facf0, facf1, ibuf1, ibuf2, ibuf3,
+			      do_alphaover_effect_float, do_alphaover_effect_byte);
 }
 
 
@@ -561,12 +713,12 @@ static struct ImBuf * do_alphaover_effect(
    ********************************************************************** */
 
 static void do_alphaunder_effect_byte(
-	float facf0, float facf1, int x, int y, char *rect1, 
-	char *rect2, char *out)
+	float facf0, float facf1, int x, int y, unsigned char *rect1, 
+	unsigned char *rect2, unsigned char *out)
 {
 	int fac2, mfac, fac, fac4;
 	int xo;
-	char *rt1, *rt2, *rt;
+	unsigned char *rt1, *rt2, *rt;
 
 	xo= x;
 	rt1= rect1;
@@ -705,26 +857,13 @@ static void do_alphaunder_effect_float(float facf0, float facf1, int x, int y,
 }
 
 static struct ImBuf* do_alphaunder_effect(
-	SeqRenderData context, Sequence *UNUSED(seq), float UNUSED(cfra),
+	SeqRenderData context, Sequence *seq, float UNUSED(cfra),
 	float facf0, float facf1, 
 	struct ImBuf *ibuf1, struct ImBuf *ibuf2, 
 	struct ImBuf *ibuf3)
 {
-	struct ImBuf * out = prepare_effect_imbufs(
-		context, ibuf1, ibuf2, ibuf3);
-
-	if (out->rect_float) {
-		do_alphaunder_effect_float(
-			facf0, facf1, context.rectx, context.recty,
-			ibuf1->rect_float, ibuf2->rect_float,
-			out->rect_float);
-	} else {
-		do_alphaunder_effect_byte(
-			facf0, facf1, context.rectx, context.recty,
-			(char*) ibuf1->rect, (char*) ibuf2->rect,
-			(char*) out->rect);
-	}
-	return out;
+	return do_rect_effect(context, seq, facf0, facf1, ibuf1, ibuf2, ibuf3,
+			      do_alphaunder_effect_float, do_alphaunder_effect_byte);
 }
 
 
@@ -733,12 +872,12 @@ static struct ImBuf* do_alphaunder_effect(
    ********************************************************************** */
 
 static void do_cross_effect_byte(float facf0, float facf1, int x, int y, 
-			  char *rect1, char *rect2, 
-			  char *out)
+			  unsigned char *rect1, unsigned char *rect2, 
+			  unsigned char *out)
 {
 	int fac1, fac2, fac3, fac4;
 	int xo;
-	char *rt1, *rt2, *rt;
+	unsigned char *rt1, *rt2, *rt;
 
 	xo= x;
 	rt1= rect1;
@@ -802,10 +941,15 @@ static void do_cross_effect_float(float facf0, float facf1, int x, int y,
 		x= xo;
 		while(x--) {
 
+#ifdef __SSE__
+			_mm_storeu_ps(rt, _mm_add_ps(_mm_mul_ps(_mm_set_ps1(fac1), _mm_loadu_ps(rt1)),
+			                             _mm_mul_ps(_mm_set_ps1(fac2), _mm_loadu_ps(rt2))));
+#else
 			rt[0]= fac1*rt1[0] + fac2*rt2[0];
 			rt[1]= fac1*rt1[1] + fac2*rt2[1];
 			rt[2]= fac1*rt1[2] + fac2*rt2[2];
 			rt[3]= fac1*rt1[3] + fac2*rt2[3];
+#endif
 
 			rt1+= 4; rt2+= 4; rt+= 4;
 		}
@@ -816,10 +960,15 @@ static void do_cross_effect_float(float facf0, float facf1, int x, int y,
 		x= xo;
 		while(x--) {
 
+#ifdef __SSE__
+			_mm_storeu_ps(rt, _mm_add_ps(_mm_mul_ps(_mm_set_ps1(fac3), _mm_loadu_ps(rt1)),
+			                             _mm_mul_ps(_mm_set_ps1(fac4), _mm_loadu_ps(rt2))));
+#else
 			rt[0]= fac3*rt1[0] + fac4*rt2[0];
 			rt[1]= fac3*rt1[1] + fac4*rt2[1];
 			rt[2]= fac3*rt1[2] + fac4*rt2[2];
 			rt[3]= fac3*rt1[3] + fac4*rt2[3];
+#endif
 
 			rt1+= 4; rt2+= 4; rt+= 4;
 		}
@@ -830,26 +979,13 @@ static void do_cross_effect_float(float facf0, float facf1, int x, int y,
 /* carefull: also used by speed effect! */
 
 static struct ImBuf* do_cross_effect(
-	SeqRenderData context, Sequence *UNUSED(seq), float UNUSED(cfra),
+	SeqRenderData context, Sequence *seq, float UNUSED(cfra),
 	float facf0, float facf1, 
 	struct ImBuf *ibuf1, struct ImBuf *ibuf2, 
 	struct ImBuf *ibuf3)
 {
-	struct ImBuf * out = prepare_effect_imbufs(
-		context, ibuf1, ibuf2, ibuf3);
-
-	if (out->rect_float) {
-		do_cross_effect_float(
-			facf0, facf1, context.rectx, context.recty,
-			ibuf1->rect_float, ibuf2->rect_float,
-			out->rect_float);
-	} else {
-		do_cross_effect_byte(
-			facf0, facf1, context.rectx, context.recty,
-			(char*) ibuf1->rect, (char*) ibuf2->rect,
-			(char*) out->rect);
-	}
-	return out;
+	return do_rect_effect(context, seq, facf0, facf1, ibuf1, ibuf2, ibuf3,
+			      do_cross_effect_float, do_cross_effect_byte);
 }
 
 
@@ -1098,27 +1234,15 @@ static void do_gammacross_effect_float(float facf0, float UNUSED(facf1),
 
 static struct ImBuf * do_gammacross_effect(
 	SeqRenderData context,
-	Sequence *UNUSED(seq), float UNUSED(cfra),
+	Sequence *seq, float UNUSED(cfra),
 	float facf0, float facf1, 
 	struct ImBuf *ibuf1, struct ImBuf *ibuf2, 
 	struct ImBuf *ibuf3)
 {
-	struct ImBuf * out = prepare_effect_imbufs(context,ibuf1, ibuf2, ibuf3);
-
 	build_gammatabs();
 
-	if (out->rect_float) {
-		do_gammacross_effect_float(
-			facf0, facf1, context.rectx, context.recty,
-			ibuf1->rect_float, ibuf2->rect_float,
-			out->rect_float);
-	} else {
-		do_gammacross_effect_byte(
-			facf0, facf1, context.rectx, context.recty,
-			(unsigned char*) ibuf1->rect, (unsigned char*) ibuf2->rect,
-			(unsigned char*) out->rect);
-	}
-	return out;
+	return do_rect_effect(context, seq, facf0, facf1, ibuf1, ibuf2, ibuf3,
+			      do_gammacross_effect_float, do_gammacross_effect_byte);
 }
 
 
@@ -1196,45 +1320,51 @@ static void do_add_effect_float(float facf0, float facf1, int x, int y,
 
 	while(y--) {
 
+#ifdef __SSE__
+		x= xo;
+		while(x--) {
+			_mm_storeu_ps(rt, _mm_add_ps(_mm_loadu_ps(rt1), _mm_mul_ps(_mm_set_ps1(fac1), _mm_loadu_ps(rt2))));
+
+			rt1+= 4; rt2+= 4; rt+= 4;
+		}
+#else
 		x= xo * 4;
 		while(x--) {
 			*rt = *rt1 + fac1 * (*rt2);
 
 			rt1++; rt2++; rt++;
 		}
+#endif
 
 		if(y==0) break;
 		y--;
 
+#ifdef __SSE__
+		x= xo;
+		while(x--) {
+			_mm_storeu_ps(rt, _mm_add_ps(_mm_loadu_ps(rt1), _mm_mul_ps(_mm_set_ps1(fac3), _mm_loadu_ps(rt2))));
+
+			rt1+= 4; rt2+= 4; rt+= 4;
+		}
+#else
 		x= xo * 4;
 		while(x--) {
 			*rt = *rt1 + fac3 * (*rt2);
 
 			rt1++; rt2++; rt++;
 		}
+#endif
 	}
 }
 
 static struct ImBuf * do_add_effect(SeqRenderData context, 
-				    Sequence *UNUSED(seq), float UNUSED(cfra),
+				    Sequence *seq, float UNUSED(cfra),
 				    float facf0, float facf1,
 				    struct ImBuf *ibuf1, struct ImBuf *ibuf2, 
 				    struct ImBuf *ibuf3)
 {
-	struct ImBuf * out = prepare_effect_imbufs(context,ibuf1, ibuf2, ibuf3);
-
-	if (out->rect_float) {
-		do_add_effect_float(
-			facf0, facf1, context.rectx, context.recty,
-			ibuf1->rect_float, ibuf2->rect_float,
-			out->rect_float);
-	} else {
-		do_add_effect_byte(
-			facf0, facf1, context.rectx, context.recty,
-			(unsigned char*) ibuf1->rect, (unsigned char*) ibuf2->rect,
-			(unsigned char*) out->rect);
-	}
-	return out;
+	return do_rect_effect(context, seq, facf0, facf1, ibuf1, ibuf2, ibuf3,
+			      do_add_effect_float, do_add_effect_byte);
 }
 
 
@@ -1244,15 +1374,15 @@ static struct ImBuf * do_add_effect(SeqRenderData context,
 
 static void do_sub_effect_byte(float facf0, float facf1, 
 				   int x, int y, 
-				   char *rect1, char *rect2, char *out)
+				   unsigned char *rect1, unsigned char *rect2, unsigned char *out)
 {
 	int col, xo, fac1, fac3;
-	char *rt1, *rt2, *rt;
+	unsigned char *rt1, *rt2, *rt;
 
 	xo= x;
-	rt1= (char *)rect1;
-	rt2= (char *)rect2;
-	rt= (char *)out;
+	rt1= rect1;
+	rt2= rect2;
+	rt= out;
 
 	fac1= (int)(256.0f*facf0);
 	fac3= (int)(256.0f*facf1);
@@ -1312,45 +1442,51 @@ static void do_sub_effect_float(float facf0, float facf1, int x, int y,
 
 	while(y--) {
 
+#ifdef __SSE__
+		x= xo;
+		while(x--) {
+			_mm_storeu_ps(rt, _mm_sub_ps(_mm_loadu_ps(rt1), _mm_mul_ps(_mm_set_ps1(fac1), _mm_loadu_ps(rt2))));
+
+			rt1+= 4; rt2+= 4; rt+= 4;
+		}
+#else
 		x= xo * 4;
 		while(x--) {
 			*rt = *rt1 - fac1 * (*rt2);
 
 			rt1++; rt2++; rt++;
 		}
+#endif
 
 		if(y==0) break;
 		y--;
 
+#ifdef __SSE__
+		x= xo;
+		while(x--) {
+			_mm_storeu_ps(rt, _mm_sub_ps(_mm_loadu_ps(rt1), _mm_mul_ps(_mm_set_ps1(fac3), _mm_loadu_ps(rt2))));
+
+			rt1+= 4; rt2+= 4; rt+= 4;
+		}
+#else
 		x= xo * 4;
 		while(x--) {
 			*rt = *rt1 - fac3 * (*rt2);
 
 			rt1++; rt2++; rt++;
 		}
+#endif
 	}
 }
 
 static struct ImBuf * do_sub_effect(
-	SeqRenderData context, Sequence *UNUSED(seq), float UNUSED(cfra),
+	SeqRenderData context, Sequence *seq, float UNUSED(cfra),
 	float facf0, float facf1, 
 	struct ImBuf *ibuf1, struct ImBuf *ibuf2, 
 	struct ImBuf *ibuf3)
 {
-	struct ImBuf * out = prepare_effect_imbufs(context,ibuf1, ibuf2, ibuf3);
-
-	if (out->rect_float) {
-		do_sub_effect_float(
-			facf0, facf1, context.rectx, context.recty,
-			ibuf1->rect_float, ibuf2->rect_float,
-			out->rect_float);
-	} else {
-		do_sub_effect_byte(
-			facf0, facf1, context.rectx, context.recty,
-			(char*) ibuf1->rect, (char*) ibuf2->rect,
-			(char*) out->rect);
-	}
-	return out;
+	return do_rect_effect(context, seq, facf0, facf1, ibuf1, ibuf2, ibuf3,
+			      do_sub_effect_float, do_sub_effect_byte);
 }
 
 /* **********************************************************************
@@ -1520,10 +1656,16 @@ static void do_mul_effect_float(float facf0, float facf1, int x, int y,
 		x= xo;
 		while(x--) {
 
+#ifdef __SSE__
+			__m128 a= _mm_loadu_ps(rt1);
+			__m128 b= _mm_sub_ps(_mm_loadu_ps(rt2), _mm_set_ps1(1.0f));
+			_mm_storeu_ps(rt, _mm_add_ps(a, _mm_mul_ps(_mm_mul_ps(_mm_set_ps1(fac1), a), b)));
+#else
 			rt[0]= rt1[0] + fac1*rt1[0]*(rt2[0]-1.0f);
 			rt[1]= rt1[1] + fac1*rt1[1]*(rt2[1]-1.0f);
 			rt[2]= rt1[2] + fac1*rt1[2]*(rt2[2]-1.0f);
 			rt[3]= rt1[3] + fac1*rt1[3]*(rt2[3]-1.0f);
+#endif
 
 			rt1+= 4; rt2+= 4; rt+= 4;
 		}
@@ -1534,10 +1676,16 @@ static void do_mul_effect_float(float facf0, float facf1, int x, int y,
 		x= xo;
 		while(x--) {
 
+#ifdef __SSE__
+			__m128 a= _mm_loadu_ps(rt1);
+			__m128 b= _mm_sub_ps(_mm_loadu_ps(rt2), _mm_set_ps1(1.0f));
+			_mm_storeu_ps(rt, _mm_add_ps(a, _mm_mul_ps(_mm_mul_ps(_mm_set_ps1(fac3), a), b)));
+#else
 			rt[0]= rt1[0] + fac3*rt1[0]*(rt2[0]-1.0f);
 			rt[1]= rt1[1] + fac3*rt1[1]*(rt2[1]-1.0f);
 			rt[2]= rt1[2] + fac3*rt1[2]*(rt2[2]-1.0f);
 			rt[3]= rt1[3] + fac3*rt1[3]*(rt2[3]-1.0f);
+#endif
 
 			rt1+= 4; rt2+= 4; rt+= 4;
 		}
@@ -1545,26 +1693,13 @@ static void do_mul_effect_float(float facf0, float facf1, int x, int y,
 }
 
 static struct ImBuf * do_mul_effect(
-	SeqRenderData context, Sequence *UNUSED(seq), float UNUSED(cfra),
+	SeqRenderData context, Sequence *seq, float UNUSED(cfra),
 	float facf0, float facf1, 
 	struct ImBuf *ibuf1, struct ImBuf *ibuf2, 
 	struct ImBuf *ibuf3)
 {
-	struct ImBuf * out = prepare_effect_imbufs(context,ibuf1, ibuf2, ibuf3);
-
-	if (out->rect_float) {
-		do_mul_effect_float(
-			facf0, facf1, context.rectx, context.recty,
-			ibuf1->rect_float, ibuf2->rect_float,
-			out->rect_float);
-	} else {
-		do_mul_effect_byte(
-			facf0, facf1, context.rectx, context.recty,
-			(unsigned char*) ibuf1->rect, (unsigned char*) ibuf2->rect,
-			(unsigned char*) out->rect);
-	}
-
-	return out;
+	return do_rect_effect(context, seq, facf0, facf1, ibuf1, ibuf2, ibuf3,
+			      do_mul_effect_float, do_mul_effect_byte);
 }
 
 /* **********************************************************************
@@ -1879,7 +2014,7 @@ static void copy_wipe_effect(Sequence *dst, Sequence *src)
 }
 
 static void do_wipe_effect_byte(Sequence *seq, float facf0, float UNUSED(facf1), 
-				int x, int y, 
+				int x, int y, int start_line, int total_lines,
 				unsigned char *rect1, 
 				unsigned char *rect2, unsigned char *out)
 {
@@ -1895,8 +2030,8 @@ static void do_wipe_effect_byte(Sequence *seq, float facf0, float UNUSED(facf1),
 	rt = (char *)out;
 
 	xo = x;
-	yo = y;
-	for(y=0;y<yo;y++) {
+	yo = start_line + total_lines;
+	for(y=start_line;y<yo;y++) {
 		for(x=0;x<xo;x++) {
 			float check = check_zone(&wipezone,x,y,seq,facf0);
 			if (check) {
@@ -1937,7 +2072,7 @@ static void do_wipe_effect_byte(Sequence *seq, float facf0, float UNUSED(facf1),
 }
 
 static void do_wipe_effect_float(Sequence *seq, float facf0, float UNUSED(facf1), 
-				 int x, int y, 
+				 int x, int y, int start_line, int total_lines,
 				 float *rect1, 
 				 float *rect2, float *out)
 {
@@ -1953,8 +2088,8 @@ static void do_wipe_effect_float(Sequence *seq, float facf0, float UNUSED(facf1)
 	rt = out;
 
 	xo = x;
-	yo = y;
-	for(y=0;y<yo;y++) {
+	yo = start_line + total_lines;
+	for(y=start_line;y<yo;y++) {
 		for(x=0;x<xo;x++) {
 			float check = check_zone(&wipezone,x,y,seq,facf0);
 			if (check) {
@@ -1994,27 +2129,41 @@ static void do_wipe_effect_float(Sequence *seq, float facf0, float UNUSED(facf1)
 	}
 }
 
+static void do_wipe_effect_slice(void *slice_v, int start_line, int total_lines)
+{
+	SeqEffectSlice *slice = slice_v;
+	SeqRenderData *context = &slice->context;
+
+	if (slice->out->rect_float) {
+		do_wipe_effect_float(slice->seq,
+				     slice->facf0, slice->facf1, context->rectx, context->recty,
+				     start_line, total_lines,
+				     slice_rect_float(slice, slice->ibuf1, start_line),
+				     slice_rect_float(slice, slice->ibuf2, start_line),
+				     slice_rect_float(slice, slice->out, start_line));
+	} else {
+		do_wipe_effect_byte(slice->seq,
+				    slice->facf0, slice->facf1, context->rectx, context->recty,
+				    start_line, total_lines,
+				    slice_rect_byte(slice, slice->ibuf1, start_line),
+				    slice_rect_byte(slice, slice->ibuf2, start_line),
+				    slice_rect_byte(slice, slice->out, start_line));
+	}
+}
+
 static struct ImBuf * do_wipe_effect(
 	SeqRenderData context, Sequence *seq, float UNUSED(cfra),
 	float facf0, float facf1, 
 	struct ImBuf *ibuf1, struct ImBuf *ibuf2, 
 	struct ImBuf *ibuf3)
 {
-	struct ImBuf * out = prepare_effect_imbufs(context,ibuf1, ibuf2, ibuf3);
+	SeqEffectSlice slice;
 
-	if (out->rect_float) {
-		do_wipe_effect_float(seq,
-				     facf0, facf1, context.rectx, context.recty,
-				     ibuf1->rect_float, ibuf2->rect_float,
-				     out->rect_float);
-	} else {
-		do_wipe_effect_byte(seq,
-				    facf0, facf1, context.rectx, context.recty,
-				    (unsigned char*) ibuf1->rect, (unsigned char*) ibuf2->rect,
-				    (unsigned char*) out->rect);
-	}
+	init_effect_slice(&slice, context, seq, facf0, facf1, ibuf1, ibuf2, ibuf3);
 
-	return out;
+	seq_execute_slices(context.recty, do_wipe_effect_slice, &slice);
+
+	return slice.out;
 }
 /* **********************************************************************
    TRANSFORM
@@ -2062,7 +2211,8 @@ static void copy_transform_effect(Sequence *dst, Sequence *src)
 	dst->effectdata = MEM_dupallocN(src->effectdata);
 }
 
-static void transform_image(int x, int y, struct ImBuf *ibuf1, struct ImBuf *out, 
+static void transform_image(int x, int y, int start_line, int total_lines,
+			    struct ImBuf *ibuf1, struct ImBuf *out, 
 			    float scale_x, float scale_y, float translate_x, float translate_y, 
 			    float rotate, int interpolation)
 {
@@ -2077,7 +2227,7 @@ static void transform_image(int x, int y, struct ImBuf *ibuf1, struct ImBuf *out
 	s= sin(rotate);
 	c= cos(rotate);
 
-	for (yi = 0; yi < yo; yi++) {
+	for (yi = start_line; yi < start_line + total_lines; yi++) {
 		for (xi = 0; xi < xo; xi++) {
 
 			//translate point
@@ -2113,7 +2263,7 @@ static void transform_image(int x, int y, struct ImBuf *ibuf1, struct ImBuf *out
 }
 
 static void do_transform(Scene *scene, Sequence *seq, float UNUSED(facf0), int x, int y, 
-			  struct ImBuf *ibuf1,struct ImBuf *out)
+			  int start_line, int total_lines, struct ImBuf *ibuf1,struct ImBuf *out)
 {
 	TransformVars *transform = (TransformVars *)seq->effectdata;
 	float scale_x, scale_y, translate_x, translate_y, rotate_radians;
@@ -2140,7 +2290,16 @@ static void do_transform(Scene *scene, Sequence *seq, float UNUSED(facf0), int x
 	// Rotate
 	rotate_radians = ((float)M_PI*transform->rotIni)/180.0f;
 
-	transform_image(x,y, ibuf1, out, scale_x, scale_y, translate_x, translate_y, rotate_radians, transform->interpolation);
+	transform_image(x,y, start_line, total_lines, ibuf1, out, scale_x, scale_y, translate_x, translate_y, rotate_radians, transform->interpolation);
+}
+
+static void do_transform_effect_slice(void *slice_v, int start_line, int total_lines)
+{
+	SeqEffectSlice *slice = slice_v;
+
+	do_transform(slice->context.scene, slice->seq, slice->facf0,
+		     slice->context.rectx, slice->context.recty,
+		     start_line, total_lines, slice->ibuf1, slice->out);
 }
 
 
@@ -2150,12 +2309,13 @@ static struct ImBuf * do_transform_effect(
 	struct ImBuf *ibuf1, struct ImBuf *ibuf2, 
 	struct ImBuf *ibuf3)
 {
-	struct ImBuf * out = prepare_effect_imbufs(context,ibuf1, ibuf2, ibuf3);
+	SeqEffectSlice slice;
 
-	do_transform(context.scene, seq, facf0, 
-		     context.rectx, context.recty, ibuf1, out);
+	init_effect_slice(&slice, context, seq, facf0, 0.0f, ibuf1, ibuf2, ibuf3);
 
-	return out;
+	seq_execute_slices(context.recty, do_transform_effect_slice, &slice);
+
+	return slice.out;
 }
 
 
@@ -3223,8 +3383,8 @@ static struct ImBuf * do_overdrop_effect(SeqRenderData context,
 			(char*) out->rect);
 		do_alphaover_effect_byte(
 			facf0, facf1, x, y,
-			(char*) ibuf1->rect, (char*) ibuf2->rect,
-			(char*) out->rect);
+			(unsigned char*) ibuf1->rect, (unsigned char*) ibuf2->rect,
+			(unsigned char*) out->rect);
 	}
 
 	return out;
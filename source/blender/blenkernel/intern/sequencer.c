@@ -45,6 +45,7 @@
 #include "DNA_anim_types.h"
 #include "DNA_object_types.h"
 #include "DNA_sound_types.h"
+#include "DNA_userdef_types.h"
 
 #include "BLI_math.h"
 #include "BLI_fileops.h"
@@ -54,6 +55,8 @@
 #include "BLI_threads.h"
 #include "BLI_utildefines.h"
 
+#include "PIL_time.h"
+
 #include "BKE_animsys.h"
 #include "BKE_global.h"
 #include "BKE_image.h"
@@ -92,6 +95,10 @@ static ImBuf * seq_render_strip(
 
 static void seq_free_animdata(Scene *scene, Sequence *seq);
 
+/* strip data that prefetch threads can't use at the same time: movie and
+   proxy file handles, and the speed effect frame map */
+static pthread_mutex_t seq_render_lock = PTHREAD_MUTEX_INITIALIZER;
+
 
 /* **** XXX ******** */
 #define SELECT 1
@@ -189,6 +196,9 @@ void seq_free_strip(Strip *strip)
 
 void seq_free_sequence(Scene *scene, Sequence *seq)
 {
+	/* prefetch threads may be rendering this strip */
+	seq_prefetch_cancel();
+
 	if(seq->strip) seq_free_strip(seq->strip);
 
 	if(seq->anim) IMB_free_anim(seq->anim);
@@ -262,6 +272,8 @@ void seq_free_editing(Scene *scene)
 	if(ed==NULL)
 		return;
 
+	seq_prefetch_cancel();
+
 	SEQ_BEGIN(ed, seq) {
 		seq_free_sequence(scene, seq);
 	}
@@ -1195,18 +1207,20 @@ static struct ImBuf * seq_proxy_fetch(SeqRenderData context, Sequence * seq, int
 
 	if (seq->flag & SEQ_USE_PROXY_CUSTOM_FILE) {
 		int frameno = (int) give_stripelem_index(seq, cfra) + seq->anim_startofs;
+		struct ImBuf * ibuf = NULL;
+
+		pthread_mutex_lock(&seq_render_lock);
 		if (seq->strip->proxy->anim == NULL) {
-			if (seq_proxy_get_fname(context, seq, cfra, name)==0) {
-				return NULL;
+			if (seq_proxy_get_fname(context, seq, cfra, name)) {
+				seq->strip->proxy->anim = openanim(name, IB_rect);
 			}
- 
-			seq->strip->proxy->anim = openanim(name, IB_rect);
 		}
-		if (seq->strip->proxy->anim==NULL) {
-			return NULL;
+		if (seq->strip->proxy->anim) {
+			ibuf = IMB_anim_absolute(seq->strip->proxy->anim, frameno);
 		}
+		pthread_mutex_unlock(&seq_render_lock);
  
-		return IMB_anim_absolute(seq->strip->proxy->anim, frameno);
+		return ibuf;
 	}
  
 	if (seq_proxy_get_fname(context, seq, cfra, name) == 0) {
@@ -1439,19 +1453,21 @@ static void make_cb_table_float(float lift, float gain, float gamma,
 	}
 }
 
-static void color_balance_byte_byte(Sequence * seq, ImBuf* ibuf, float mul)
-{
-	unsigned char cb_tab[3][256];
-	int c;
-	unsigned char * p = (unsigned char*) ibuf->rect;
-	unsigned char * e = p + ibuf->x * 4 * ibuf->y;
-
-	StripColorBalance cb = calc_cb(seq->strip->color_balance);
+/* tables are made once, the pixels are done in slices of rows */
+typedef struct ColorBalanceData {
+	ImBuf *ibuf;
+	StripColorBalance cb;
+	float mul;
+	unsigned char cb_tab_byte[3][256];
+	float cb_tab_float[4][256];
+} ColorBalanceData;
 
-	for (c = 0; c < 3; c++) {
-		make_cb_table_byte(cb.lift[c], cb.gain[c], cb.gamma[c],
-				   cb_tab[c], mul);
-	}
+static void color_balance_byte_byte(void *cbd_v, int start_line, int total_lines)
+{
+	ColorBalanceData *cbd = cbd_v;
+	unsigned char (*cb_tab)[256] = cbd->cb_tab_byte;
+	unsigned char * p = (unsigned char*) cbd->ibuf->rect + cbd->ibuf->x * 4 * start_line;
+	unsigned char * e = p + cbd->ibuf->x * 4 * total_lines;
 
 	while (p < e) {
 		p[0] = cb_tab[0][p[0]];
@@ -1462,28 +1478,13 @@ static void color_balance_byte_byte(Sequence * seq, ImBuf* ibuf, float mul)
 	}
 }
 
-static void color_balance_byte_float(Sequence * seq, ImBuf* ibuf, float mul)
+static void color_balance_byte_float(void *cbd_v, int start_line, int total_lines)
 {
-	float cb_tab[4][256];
-	int c,i;
-	unsigned char * p = (unsigned char*) ibuf->rect;
-	unsigned char * e = p + ibuf->x * 4 * ibuf->y;
-	float * o;
-	StripColorBalance cb;
-
-	imb_addrectfloatImBuf(ibuf);
-
-	o = ibuf->rect_float;
-
-	cb = calc_cb(seq->strip->color_balance);
-
-	for (c = 0; c < 3; c++) {
-		make_cb_table_float(cb.lift[c], cb.gain[c], cb.gamma[c], cb_tab[c], mul);
-	}
-
-	for (i = 0; i < 256; i++) {
-		cb_tab[3][i] = ((float)i)*(1.0f/255.0f);
-	}
+	ColorBalanceData *cbd = cbd_v;
+	float (*cb_tab)[256] = cbd->cb_tab_float;
+	unsigned char * p = (unsigned char*) cbd->ibuf->rect + cbd->ibuf->x * 4 * start_line;
+	unsigned char * e = p + cbd->ibuf->x * 4 * total_lines;
+	float * o = cbd->ibuf->rect_float + cbd->ibuf->x * 4 * start_line;
 
 	while (p < e) {
 		o[0] = cb_tab[0][p[0]];
@@ -1495,16 +1496,18 @@ static void color_balance_byte_float(Sequence * seq, ImBuf* ibuf, float mul)
 	}
 }
 
-static void color_balance_float_float(Sequence * seq, ImBuf* ibuf, float mul)
+static void color_balance_float_float(void *cbd_v, int start_line, int total_lines)
 {
-	float * p = ibuf->rect_float;
-	float * e = ibuf->rect_float + ibuf->x * 4* ibuf->y;
-	StripColorBalance cb = calc_cb(seq->strip->color_balance);
+	ColorBalanceData *cbd = cbd_v;
+	StripColorBalance *cb = &cbd->cb;
+	float * p = cbd->ibuf->rect_float + cbd->ibuf->x * 4 * start_line;
+	float * e = p + cbd->ibuf->x * 4 * total_lines;
+	float mul = cbd->mul;
 
 	while (p < e) {
 		int c;
 		for (c = 0; c < 3; c++) {
-			p[c]= color_balance_fl(p[c], cb.lift[c], cb.gain[c], cb.gamma[c], mul);
+			p[c]= color_balance_fl(p[c], cb->lift[c], cb->gain[c], cb->gamma[c], mul);
 		}
 		p += 4;
 	}
@@ -1512,12 +1515,35 @@ static void color_balance_float_float(Sequence * seq, ImBuf* ibuf, float mul)
 
 static void color_balance(Sequence * seq, ImBuf* ibuf, float mul)
 {
+	ColorBalanceData cbd;
+	int c, i;
+
+	cbd.ibuf = ibuf;
+	cbd.cb = calc_cb(seq->strip->color_balance);
+	cbd.mul = mul;
+
 	if (ibuf->rect_float) {
-		color_balance_float_float(seq, ibuf, mul);
+		seq_execute_slices(ibuf->y, color_balance_float_float, &cbd);
 	} else if(seq->flag & SEQ_MAKE_FLOAT) {
-		color_balance_byte_float(seq, ibuf, mul);
+		imb_addrectfloatImBuf(ibuf);
+
+		for (c = 0; c < 3; c++) {
+			make_cb_table_float(cbd.cb.lift[c], cbd.cb.gain[c], cbd.cb.gamma[c],
+					    cbd.cb_tab_float[c], mul);
+		}
+
+		for (i = 0; i < 256; i++) {
+			cbd.cb_tab_float[3][i] = ((float)i)*(1.0f/255.0f);
+		}
+
+		seq_execute_slices(ibuf->y, color_balance_byte_float, &cbd);
 	} else {
-		color_balance_byte_byte(seq, ibuf, mul);
+		for (c = 0; c < 3; c++) {
+			make_cb_table_byte(cbd.cb.lift[c], cbd.cb.gain[c], cbd.cb.gamma[c],
+					   cbd.cb_tab_byte[c], mul);
+		}
+
+		seq_execute_slices(ibuf->y, color_balance_byte_byte, &cbd);
 	}
 }
 
@@ -1712,7 +1738,7 @@ static ImBuf * copy_from_ibuf_still(SeqRenderData context, Sequence * seq,
 }
 
 static void copy_to_ibuf_still(SeqRenderData context, Sequence * seq, float nr,
-			       ImBuf * ibuf)
+			       ImBuf * ibuf, float cost)
 {
 	if (nr == 0 || nr == seq->len - 1) {
 		/* we have to store a copy, since the passed ibuf
@@ -1723,13 +1749,13 @@ static void copy_to_ibuf_still(SeqRenderData context, Sequence * seq, float nr,
 		if (nr == 0) {
 			seq_stripelem_cache_put(
 				context, seq, seq->start, 
-				SEQ_STRIPELEM_IBUF_STARTSTILL, ibuf);
+				SEQ_STRIPELEM_IBUF_STARTSTILL, ibuf, cost);
 		} 
 
 		if (nr == seq->len - 1) {
 			seq_stripelem_cache_put(
 				context, seq, seq->start, 
-				SEQ_STRIPELEM_IBUF_ENDSTILL, ibuf);
+				SEQ_STRIPELEM_IBUF_ENDSTILL, ibuf, cost);
 		}
 
 		IMB_freeImBuf(ibuf);
@@ -2005,16 +2031,17 @@ static ImBuf * seq_render_strip(SeqRenderData context, Sequence * seq, float cfr
 	float nr = give_stripelem_index(seq, cfra);
 	/* all effects are handled similarly with the exception of speed effect */
 	int type = (seq->type & SEQ_EFFECT && seq->type != SEQ_SPEED) ? SEQ_EFFECT : seq->type;
+	double begin = PIL_check_seconds_timer();
 
 	ibuf = seq_stripelem_cache_get(context, seq, cfra, SEQ_STRIPELEM_IBUF);
 
 	/* currently, we cache preprocessed images in SEQ_STRIPELEM_IBUF,
-	   but not(!) on SEQ_STRIPELEM_IBUF_ENDSTILL and ..._STARTSTILL */
+	   but not(!) on SEQ_STRIPELEM_IBUF_ENDSTILL and ..._STARTSTILL.
+	   don't put it back, that would replace its render cost */
 	if (ibuf)
-		use_preprocess = FALSE;
+		return ibuf;
 
-	if (ibuf == NULL)
-		ibuf = copy_from_ibuf_still(context, seq, nr);
+	ibuf = copy_from_ibuf_still(context, seq, nr);
 	
 	if (ibuf == NULL)
 		ibuf = seq_proxy_fetch(context, seq, cfra);
@@ -2048,7 +2075,9 @@ static ImBuf * seq_render_strip(SeqRenderData context, Sequence * seq, float cfr
 			float f_cfra;
 			SpeedControlVars * s = (SpeedControlVars *)seq->effectdata;
 
+			pthread_mutex_lock(&seq_render_lock);
 			sequence_effect_speed_rebuild_map(context.scene,seq, 0);
+			pthread_mutex_unlock(&seq_render_lock);
 
 			/* weeek! */
 			f_cfra = seq->start + s->frameMap[(int) nr];
@@ -2095,7 +2124,8 @@ static ImBuf * seq_render_strip(SeqRenderData context, Sequence * seq, float cfr
 //				if(ibuf->profile == IB_PROFILE_LINEAR_RGB)
 					IMB_convert_profile(ibuf, seq_cs);
 
-				copy_to_ibuf_still(context, seq, nr, ibuf);
+				copy_to_ibuf_still(context, seq, nr, ibuf,
+						   (float)(PIL_check_seconds_timer() - begin));
 
 				s_elem->orig_width  = ibuf->x;
 				s_elem->orig_height = ibuf->y;
@@ -2104,6 +2134,8 @@ static ImBuf * seq_render_strip(SeqRenderData context, Sequence * seq, float cfr
 		}
 		case SEQ_MOVIE:
 		{
+			pthread_mutex_lock(&seq_render_lock);
+
 			if(seq->anim==NULL) {
 				BLI_join_dirfile(name, sizeof(name), seq->strip->dir, seq->strip->stripdata->name);
 				BLI_path_abs(name, G.main->name);
@@ -2123,7 +2155,11 @@ static ImBuf * seq_render_strip(SeqRenderData context, Sequence * seq, float cfr
 					seq->strip->stripdata->orig_height = ibuf->y;
 				}
 			}
-			copy_to_ibuf_still(context, seq, nr, ibuf);
+
+			pthread_mutex_unlock(&seq_render_lock);
+
+			copy_to_ibuf_still(context, seq, nr, ibuf,
+					   (float)(PIL_check_seconds_timer() - begin));
 			break;
 		}
 		case SEQ_SCENE:
@@ -2133,7 +2169,8 @@ static ImBuf * seq_render_strip(SeqRenderData context, Sequence * seq, float cfr
 			/* Scene strips update all animation, so we need to restore original state.*/
 			BKE_animsys_evaluate_all_animation(context.bmain, cfra);
 
-			copy_to_ibuf_still(context, seq, nr, ibuf);
+			copy_to_ibuf_still(context, seq, nr, ibuf,
+					   (float)(PIL_check_seconds_timer() - begin));
 			break;
 		}
 	}
@@ -2147,7 +2184,8 @@ static ImBuf * seq_render_strip(SeqRenderData context, Sequence * seq, float cfr
 	if (use_preprocess)
 		ibuf = input_preprocess(context, seq, cfra, ibuf);
 
-	seq_stripelem_cache_put(context, seq, cfra, SEQ_STRIPELEM_IBUF, ibuf);
+	seq_stripelem_cache_put(context, seq, cfra, SEQ_STRIPELEM_IBUF, ibuf,
+				(float)(PIL_check_seconds_timer() - begin));
 
 	return ibuf;
 }
@@ -2197,6 +2235,7 @@ static ImBuf* seq_render_strip_stack(
 	int count;
 	int i;
 	ImBuf* out = NULL;
+	double begin = PIL_check_seconds_timer();
 
 	count = get_shown_sequences(seqbasep, cfra, chanshown, (Sequence **)&seq_arr);
 
@@ -2222,7 +2261,8 @@ static ImBuf* seq_render_strip_stack(
 	if(count == 1) {
 		out = seq_render_strip(context, seq_arr[0], cfra);
 		seq_stripelem_cache_put(context, seq_arr[0], cfra, 
-					SEQ_STRIPELEM_IBUF_COMP, out);
+					SEQ_STRIPELEM_IBUF_COMP, out,
+					(float)(PIL_check_seconds_timer() - begin));
 
 		return out;
 	}
@@ -2268,7 +2308,8 @@ static ImBuf* seq_render_strip_stack(
 	}
 
 	seq_stripelem_cache_put(context, seq_arr[i], cfra, 
-				SEQ_STRIPELEM_IBUF_COMP, out);
+				SEQ_STRIPELEM_IBUF_COMP, out,
+				(float)(PIL_check_seconds_timer() - begin));
 
 
 	i++;
@@ -2299,7 +2340,8 @@ static ImBuf* seq_render_strip_stack(
 		}
 
 		seq_stripelem_cache_put(context, seq_arr[i], cfra,
-					SEQ_STRIPELEM_IBUF_COMP, out);
+					SEQ_STRIPELEM_IBUF_COMP, out,
+					(float)(PIL_check_seconds_timer() - begin));
 	}
 
 	return out;
@@ -2318,6 +2360,10 @@ ImBuf *give_ibuf_seq(SeqRenderData context, float cfra, int chanshown)
 	
 	if(ed==NULL) return NULL;
 
+	/* prefetch and render threads don't move the playhead */
+	if(BLI_thread_is_main())
+		seq_stripelem_cache_playhead(cfra);
+
 	count = BLI_countlist(&ed->metastack);
 	if((chanshown < 0) && (count > 0)) {
 		count = MAX2(count + chanshown, 0);
@@ -2354,333 +2400,289 @@ static int seq_can_blend(Sequence *seq)
 
 /* *********************** threading api ******************* */
 
+/* During playback, prefetch threads render the frames following the current
+   one, in playback direction, into the stripelem cache. The drawing code then
+   gets them from the cache with give_ibuf_seq(). At most U.prefetchframes
+   frames are queued, and the queue is cleared when the current frame jumps.
+   Threads only read strip data, so everything that changes strips has to
+   cancel running prefetches first, see seq_prefetch_cancel(). */
+
 static ListBase running_threads;
 static ListBase prefetch_wait;
-static ListBase prefetch_done;
 
 static pthread_mutex_t queue_lock          = PTHREAD_MUTEX_INITIALIZER;
-static pthread_mutex_t wakeup_lock         = PTHREAD_MUTEX_INITIALIZER;
 static pthread_cond_t  wakeup_cond         = PTHREAD_COND_INITIALIZER;
-
-//static pthread_mutex_t prefetch_ready_lock = PTHREAD_MUTEX_INITIALIZER;
-//static pthread_cond_t  prefetch_ready_cond = PTHREAD_COND_INITIALIZER;
-
-static pthread_mutex_t frame_done_lock     = PTHREAD_MUTEX_INITIALIZER;
 static pthread_cond_t  frame_done_cond     = PTHREAD_COND_INITIALIZER;
 
-static volatile int seq_thread_shutdown = TRUE; 
-static volatile int seq_last_given_monoton_cfra = 0;
-static int monoton_cfra = 0;
+static volatile int seq_thread_shutdown = TRUE;
+static float prefetch_last_cfra = 0.0f;
+static int prefetch_direction = 1;
 
 typedef struct PrefetchThread {
 	struct PrefetchThread *next, *prev;
-	
-	Scene *scene;
+
 	struct PrefetchQueueElem *current;
 	pthread_t pthread;
-	int running;
-	
 } PrefetchThread;
 
 typedef struct PrefetchQueueElem {
 	struct PrefetchQueueElem *next, *prev;
-	
-	int rectx;
-	int recty;
+
+	SeqRenderData context;
 	float cfra;
 	int chanshown;
-	int preview_render_size;
-
-	int monoton_cfra;
-
-	struct ImBuf * ibuf;
 } PrefetchQueueElem;
 
-#if 0
+static int prefetch_elem_match(PrefetchQueueElem *e, SeqRenderData *context, float cfra, int chanshown)
+{
+	return (e->cfra == cfra && e->chanshown == chanshown &&
+		seq_cmp_render_data(&e->context, context) == 0);
+}
+
 static void *seq_prefetch_thread(void * This_)
 {
 	PrefetchThread * This = This_;
 
+	pthread_mutex_lock(&queue_lock);
+
 	while (!seq_thread_shutdown) {
-		PrefetchQueueElem *e;
-		int s_last;
+		PrefetchQueueElem *e = prefetch_wait.first;
+		ImBuf *ibuf;
 
-		pthread_mutex_lock(&queue_lock);
-		e = prefetch_wait.first;
-		if (e) {
-			BLI_remlink(&prefetch_wait, e);
+		if (!e) {
+			pthread_cond_wait(&wakeup_cond, &queue_lock);
+			continue;
 		}
-		s_last = seq_last_given_monoton_cfra;
 
+		BLI_remlink(&prefetch_wait, e);
 		This->current = e;
 
 		pthread_mutex_unlock(&queue_lock);
 
-		if (!e) {
-			pthread_mutex_lock(&prefetch_ready_lock);
-
-			This->running = FALSE;
-
-			pthread_cond_signal(&prefetch_ready_cond);
-			pthread_mutex_unlock(&prefetch_ready_lock);
-
-			pthread_mutex_lock(&wakeup_lock);
-			if (!seq_thread_shutdown) {
-				pthread_cond_wait(&wakeup_cond, &wakeup_lock);
-			}
-			pthread_mutex_unlock(&wakeup_lock);
-			continue;
-		}
-
-		This->running = TRUE;
-		
-		if (e->cfra >= s_last) { 
-			e->ibuf = give_ibuf_seq_impl(This->scene, 
-				e->rectx, e->recty, e->cfra, e->chanshown,
-				e->preview_render_size);
-		}
+		/* result stays in the stripelem cache */
+		ibuf = give_ibuf_seq(e->context, e->cfra, e->chanshown);
+		IMB_freeImBuf(ibuf);
 
 		pthread_mutex_lock(&queue_lock);
 
-		BLI_addtail(&prefetch_done, e);
-
-		for (e = prefetch_wait.first; e; e = e->next) {
-			if (s_last > e->monoton_cfra) {
-				BLI_remlink(&prefetch_wait, e);
-				MEM_freeN(e);
-			}
-		}
+		This->current = NULL;
+		MEM_freeN(e);
 
-		for (e = prefetch_done.first; e; e = e->next) {
-			if (s_last > e->monoton_cfra) {
-				if (e->ibuf) {
-					IMB_cache_limiter_unref(e->ibuf);
-				}
-				BLI_remlink(&prefetch_done, e);
-				MEM_freeN(e);
-			}
-		}
+		pthread_cond_broadcast(&frame_done_cond);
+	}
 
-		pthread_mutex_unlock(&queue_lock);
+	pthread_mutex_unlock(&queue_lock);
 
-		pthread_mutex_lock(&frame_done_lock);
-		pthread_cond_signal(&frame_done_cond);
-		pthread_mutex_unlock(&frame_done_lock);
-	}
-	return 0;
+	return NULL;
 }
 
-static void seq_start_threads(Scene *scene)
+static void seq_start_threads(void)
 {
-	int i;
+	int i, totthread = MAX2(BLI_system_thread_count() - 1, 1);
 
 	running_threads.first = running_threads.last = NULL;
 	prefetch_wait.first = prefetch_wait.last = NULL;
-	prefetch_done.first = prefetch_done.last = NULL;
 
 	seq_thread_shutdown = FALSE;
-	seq_last_given_monoton_cfra = monoton_cfra = 0;
-
-	/* since global structures are modified during the processing
-	   of one frame, only one render thread is currently possible... 
 
-	   (but we code, in the hope, that we can remove this restriction
-	   soon...)
-	*/
+	/* init malloc mutex */
+	BLI_init_threads(0, 0, 0);
 
-	fprintf(stderr, "SEQ-THREAD: seq_start_threads\n");
+	/* one core is left for drawing and the current frame, the others are
+	   taken from the thread budget while prefetch runs */
+	BLI_thread_budget_add(totthread);
 
-	for (i = 0; i < 1; i++) {
+	for (i = 0; i < totthread; i++) {
 		PrefetchThread *t = MEM_callocN(sizeof(PrefetchThread), "prefetch_thread");
-		t->scene= scene;
-		t->running = TRUE;
 		BLI_addtail(&running_threads, t);
 
 		pthread_create(&t->pthread, NULL, seq_prefetch_thread, t);
 	}
-
-	/* init malloc mutex */
-	BLI_init_threads(0, 0, 0);
 }
 
-static void seq_stop_threads()
+static void seq_stop_threads(void)
 {
 	PrefetchThread *tslot;
-	PrefetchQueueElem *e;
-
-	fprintf(stderr, "SEQ-THREAD: seq_stop_threads()\n");
 
 	if (seq_thread_shutdown) {
-		fprintf(stderr, "SEQ-THREAD: ... already stopped\n");
 		return;
 	}
-	
-	pthread_mutex_lock(&wakeup_lock);
 
+	pthread_mutex_lock(&queue_lock);
 	seq_thread_shutdown = TRUE;
-
-		pthread_cond_broadcast(&wakeup_cond);
-		pthread_mutex_unlock(&wakeup_lock);
+	pthread_cond_broadcast(&wakeup_cond);
+	pthread_mutex_unlock(&queue_lock);
 
 	for(tslot = running_threads.first; tslot; tslot= tslot->next) {
 		pthread_join(tslot->pthread, NULL);
 	}
 
+	BLI_freelistN(&prefetch_wait);
+	BLI_thread_budget_add(-BLI_countlist(&running_threads));
+	BLI_freelistN(&running_threads);
 
-	for (e = prefetch_wait.first; e; e = e->next) {
-		BLI_remlink(&prefetch_wait, e);
-		MEM_freeN(e);
+	/* deinit malloc mutex */
+	BLI_end_threads(0);
+}
+
+/* clear the queue and wait for frames being rendered, call before changing strips */
+void seq_prefetch_cancel(void)
+{
+	PrefetchThread *tslot;
+
+	if (seq_thread_shutdown) {
+		return;
 	}
 
-	for (e = prefetch_done.first; e; e = e->next) {
-		if (e->ibuf) {
-			IMB_cache_limiter_unref(e->ibuf);
+	pthread_mutex_lock(&queue_lock);
+
+	BLI_freelistN(&prefetch_wait);
+
+	for(tslot = running_threads.first; tslot; ) {
+		if (tslot->current) {
+			pthread_cond_wait(&frame_done_cond, &queue_lock);
+			tslot = running_threads.first;
 		}
-		BLI_remlink(&prefetch_done, e);
-		MEM_freeN(e);
+		else
+			tslot = tslot->next;
 	}
 
-	BLI_freelistN(&running_threads);
+	pthread_mutex_unlock(&queue_lock);
+}
 
-	/* deinit malloc mutex */
-	BLI_end_threads(0);
+void seq_prefetch_free(void)
+{
+	seq_stop_threads();
 }
-#endif
 
-void give_ibuf_prefetch_request(SeqRenderData context, float cfra, int chanshown)
+static int seq_fcurves_animate_strips(ListBase *curves)
 {
-	PrefetchQueueElem *e;
-	if (seq_thread_shutdown) {
-		return;
+	FCurve *fcu;
+
+	for (fcu = curves->first; fcu; fcu = fcu->next)
+		if (fcu->rna_path && strstr(fcu->rna_path, "sequence_editor.sequences_all["))
+			return TRUE;
+
+	return FALSE;
+}
+
+/* strip animation is only evaluated for the current frame, on the main
+   thread, so later frames can't be rendered ahead when strips are animated */
+static int seq_scene_animates_strips(Scene *scene)
+{
+	AnimData *adt = scene->adt;
+
+	if (adt == NULL)
+		return FALSE;
+	if (adt->action && seq_fcurves_animate_strips(&adt->action->curves))
+		return TRUE;
+
+	return seq_fcurves_animate_strips(&adt->drivers);
+}
+
+/* scene strips render and evaluate animation of other scenes, and plugins
+   may keep state, neither can be rendered by several threads */
+static int seq_can_prefetch(ListBase *seqbase)
+{
+	Sequence *seq;
+
+	for (seq = seqbase->first; seq; seq = seq->next) {
+		if (ELEM(seq->type, SEQ_SCENE, SEQ_PLUGIN))
+			return FALSE;
+		if (seq->type == SEQ_META && !seq_can_prefetch(&seq->seqbase))
+			return FALSE;
 	}
 
+	return TRUE;
+}
+
+/* queue a frame, unless it's already queued or being rendered,
+   must be called with queue_lock held */
+static void seq_prefetch_queue(SeqRenderData context, float cfra, int chanshown)
+{
+	PrefetchQueueElem *e;
+	PrefetchThread *tslot;
+
+	for (e = prefetch_wait.first; e; e = e->next)
+		if (prefetch_elem_match(e, &context, cfra, chanshown))
+			return;
+
+	for (tslot = running_threads.first; tslot; tslot= tslot->next)
+		if (tslot->current && prefetch_elem_match(tslot->current, &context, cfra, chanshown))
+			return;
+
 	e = MEM_callocN(sizeof(PrefetchQueueElem), "prefetch_queue_elem");
-	e->rectx = context.rectx;
-	e->recty = context.recty;
+	e->context = context;
 	e->cfra = cfra;
 	e->chanshown = chanshown;
-	e->preview_render_size = context.preview_render_size;
-	e->monoton_cfra = monoton_cfra++;
 
-	pthread_mutex_lock(&queue_lock);
 	BLI_addtail(&prefetch_wait, e);
-	pthread_mutex_unlock(&queue_lock);
-	
-	pthread_mutex_lock(&wakeup_lock);
 	pthread_cond_signal(&wakeup_cond);
-	pthread_mutex_unlock(&wakeup_lock);
 }
 
-#if 0
-static void seq_wait_for_prefetch_ready()
+void give_ibuf_prefetch_request(SeqRenderData context, float cfra, int chanshown)
 {
-	PrefetchThread *tslot;
-
 	if (seq_thread_shutdown) {
 		return;
 	}
 
-	fprintf(stderr, "SEQ-THREAD: rendering prefetch frames...\n");
-
-	pthread_mutex_lock(&prefetch_ready_lock);
-
-	for(;;) {
-		for(tslot = running_threads.first; tslot; tslot= tslot->next) {
-			if (tslot->running) {
-				break;
-			}
-		}
-		if (!tslot) {
-			break;
-		}
-		pthread_cond_wait(&prefetch_ready_cond, &prefetch_ready_lock);
-	}
-
-	pthread_mutex_unlock(&prefetch_ready_lock);
-
-	fprintf(stderr, "SEQ-THREAD: prefetch done\n");
+	pthread_mutex_lock(&queue_lock);
+	seq_prefetch_queue(context, cfra, chanshown);
+	pthread_mutex_unlock(&queue_lock);
 }
-#endif
 
 ImBuf *give_ibuf_seq_threaded(SeqRenderData context, float cfra, int chanshown)
 {
-	PrefetchQueueElem *e = NULL;
-	int found_something = FALSE;
+	Editing *ed= seq_give_editing(context.scene, FALSE);
+	PrefetchQueueElem *e, *enext;
+	PrefetchThread *tslot;
+	int i, direction;
 
-	if (seq_thread_shutdown) {
+	if (ed == NULL || U.prefetchframes <= 0 || seq_scene_animates_strips(context.scene) ||
+		!seq_can_prefetch(&ed->seqbase)) {
+		seq_prefetch_cancel();
 		return give_ibuf_seq(context, cfra, chanshown);
 	}
 
-	while (!e) {
-		int success = FALSE;
-		pthread_mutex_lock(&queue_lock);
-
-		for (e = prefetch_done.first; e; e = e->next) {
-			if (cfra == e->cfra &&
-				chanshown == e->chanshown &&
-				context.rectx == e->rectx && 
-				context.recty == e->recty &&
-				context.preview_render_size == e->preview_render_size) {
-				success = TRUE;
-				found_something = TRUE;
-				break;
-			}
-		}
+	if (seq_thread_shutdown) {
+		seq_start_threads();
+	}
 
-		if (!e) {
-			for (e = prefetch_wait.first; e; e = e->next) {
-				if (cfra == e->cfra &&
-					chanshown == e->chanshown &&
-					context.rectx == e->rectx && 
-					context.recty == e->recty &&
-					context.preview_render_size == e->preview_render_size) {
-					found_something = TRUE;
-					break;
-				}
-			}
-		}
+	pthread_mutex_lock(&queue_lock);
 
-		if (!e) {
-			PrefetchThread *tslot;
-
-			for(tslot = running_threads.first; 
-				tslot; tslot= tslot->next) {
-				if (tslot->current &&
-					cfra == tslot->current->cfra &&
-					chanshown == tslot->current->chanshown &&
-					context.rectx == tslot->current->rectx && 
-					context.recty == tslot->current->recty &&
-					context.preview_render_size== tslot->current->preview_render_size){
-					found_something = TRUE;
-					break;
-				}
-			}
+	/* playback direction, when the frame jumps drop what was queued */
+	direction = (cfra < prefetch_last_cfra)? -1: 1;
+	if (direction != prefetch_direction || fabsf(cfra - prefetch_last_cfra) > 1.0f)
+		BLI_freelistN(&prefetch_wait);
+	prefetch_direction = direction;
+	prefetch_last_cfra = cfra;
+
+	/* frames that are behind are no use anymore */
+	for (e = prefetch_wait.first; e; e = enext) {
+		enext = e->next;
+		if (direction*(e->cfra - cfra) <= 0.0f) {
+			BLI_remlink(&prefetch_wait, e);
+			MEM_freeN(e);
 		}
+	}
 
-		/* e->ibuf is unrefed by render thread on next round. */
+	for (i = 1; i <= U.prefetchframes; i++)
+		seq_prefetch_queue(context, cfra + direction*i, chanshown);
 
-		if (e) {
-			seq_last_given_monoton_cfra = e->monoton_cfra;
+	/* frame already being rendered by a prefetch thread? wait for it */
+	for (tslot = running_threads.first; tslot; ) {
+		if (tslot->current && prefetch_elem_match(tslot->current, &context, cfra, chanshown)) {
+			pthread_cond_wait(&frame_done_cond, &queue_lock);
+			tslot = running_threads.first;
 		}
+		else
+			tslot = tslot->next;
+	}
 
-		pthread_mutex_unlock(&queue_lock);
-
-		if (!success) {
-			e = NULL;
+	pthread_mutex_unlock(&queue_lock);
 
-			if (!found_something) {
-				fprintf(stderr, 
-					"SEQ-THREAD: Requested frame "
-					"not in queue ???\n");
-				break;
-			}
-			pthread_mutex_lock(&frame_done_lock);
-			pthread_cond_wait(&frame_done_cond, &frame_done_lock);
-			pthread_mutex_unlock(&frame_done_lock);
-		}
-	}
-	
-	return e ? e->ibuf : NULL;
+	/* prefetched frames come from the cache, otherwise render now */
+	return give_ibuf_seq(context, cfra, chanshown);
 }
 
 /* Functions to free imbuf and anim data on changes */
@@ -2722,6 +2724,7 @@ void free_imbuf_seq(Scene *scene, ListBase * seqbase, int check_mem_usage,
 		}
 	}
 
+	seq_prefetch_cancel();
 	seq_stripelem_cache_cleanup();
 	
 	for(seq= seqbase->first; seq; seq= seq->next) {
@@ -2793,6 +2796,8 @@ void update_changed_seq_and_deps(Scene *scene, Sequence *changed_seq, int len_ch
 	
 	if (ed==NULL) return;
 	
+	seq_prefetch_cancel();
+
 	for (seq=ed->seqbase.first; seq; seq=seq->next)
 		update_changed_seq_recurs(scene, seq, changed_seq, len_change, ibuf_change);
 }
@@ -118,6 +118,13 @@ typedef struct ReferenceState {
 }ReferenceState ;
 
 
+/* worker threads kept alive for one softbody_step, fed through queues */
+typedef struct SB_thread_pool {
+	ListBase threads;
+	ThreadQueue *todo, *done;
+	int totthread;
+}SB_thread_pool;
+
 /*private scratch pad for caching and other data only needed when alive*/
 typedef struct SBScratch {
 	GHash *colliderhash;
@@ -127,9 +134,11 @@ typedef struct SBScratch {
 	int totface;
 	float aabbmin[3],aabbmax[3];
 	ReferenceState Ref;
+	SB_thread_pool *pool;
 }SBScratch;
 
 typedef struct  SB_thread_context {
+		void *(*exec)(void *data);
 		Scene *scene;
 		Object *ob;
 		float forcetime;
@@ -285,8 +294,150 @@ typedef struct ccd_Mesh {
 	/* Axis Aligned Bounding Box AABB */
 	float bbmin[3];
 	float bbmax[3];
+	/* uniform grid of the faces over the AABB, faces are in all cells their
+	   padded bounds overlap, in face order. rebuilt with the mesh every step */
+	int res[3];
+	float gridscale[3];
+	int *cellstart, *cellfaces;
 }ccd_Mesh;
 
+#define CCD_FACES_PER_CELL 4
+#define CCD_MAX_CANDIDATES 256
+
+static int ccd_grid_coord(ccd_Mesh *ccdm, int axis, float co)
+{
+	float c = (co - ccdm->bbmin[axis]) * ccdm->gridscale[axis];
+
+	/* clamp before converting, queries can reach far outside the grid */
+	if(!(c > 0.0f))
+		return 0;
+	if(c >= (float)(ccdm->res[axis]-1))
+		return ccdm->res[axis]-1;
+
+	return (int)c;
+}
+
+static int ccd_grid_cell(ccd_Mesh *ccdm, int x, int y, int z)
+{
+	return (z*ccdm->res[1] + y)*ccdm->res[0] + x;
+}
+
+static void ccd_mesh_grid_build(ccd_Mesh *ccdm)
+{
+	ccdf_minmax *mima;
+	float size[3], cellsize;
+	int i, x, y, z, lo[3], hi[3], totcell;
+
+	if(ccdm->cellstart) MEM_freeN(ccdm->cellstart);
+	if(ccdm->cellfaces) MEM_freeN(ccdm->cellfaces);
+	ccdm->cellstart = ccdm->cellfaces = NULL;
+
+	if(ccdm->totface < CCD_FACES_PER_CELL*2)
+		return;
+
+	/* cubic cells with about CCD_FACES_PER_CELL faces each */
+	for(i=0; i<3; i++)
+		size[i] = MAX2(ccdm->bbmax[i] - ccdm->bbmin[i], FLT_EPSILON);
+
+	cellsize = (float)pow(size[0]*size[1]*size[2]*CCD_FACES_PER_CELL/(double)ccdm->totface, 1.0/3.0);
+	for(i=0; i<3; i++) {
+		ccdm->res[i] = (cellsize > 0.0f)? (int)ceil(size[i]/cellsize): 1;
+		CLAMP(ccdm->res[i], 1, 64);
+		ccdm->gridscale[i] = ccdm->res[i]/size[i];
+	}
+
+	totcell = ccdm->res[0]*ccdm->res[1]*ccdm->res[2];
+	ccdm->cellstart = MEM_callocN(sizeof(int)*(totcell+1), "ccd_Mesh_cellstart");
+
+	/* count, offsets, then fill in face order */
+	for(i=0, mima=ccdm->mima; i<ccdm->totface; i++, mima++) {
+		lo[0] = ccd_grid_coord(ccdm, 0, mima->minx); hi[0] = ccd_grid_coord(ccdm, 0, mima->maxx);
+		lo[1] = ccd_grid_coord(ccdm, 1, mima->miny); hi[1] = ccd_grid_coord(ccdm, 1, mima->maxy);
+		lo[2] = ccd_grid_coord(ccdm, 2, mima->minz); hi[2] = ccd_grid_coord(ccdm, 2, mima->maxz);
+
+		for(z=lo[2]; z<=hi[2]; z++)
+			for(y=lo[1]; y<=hi[1]; y++)
+				for(x=lo[0]; x<=hi[0]; x++)
+					ccdm->cellstart[ccd_grid_cell(ccdm, x, y, z)+1]++;
+	}
+
+	for(i=0; i<totcell; i++)
+		ccdm->cellstart[i+1] += ccdm->cellstart[i];
+
+	ccdm->cellfaces = MEM_mallocN(sizeof(int)*MAX2(ccdm->cellstart[totcell], 1), "ccd_Mesh_cellfaces");
+
+	for(i=0, mima=ccdm->mima; i<ccdm->totface; i++, mima++) {
+		lo[0] = ccd_grid_coord(ccdm, 0, mima->minx); hi[0] = ccd_grid_coord(ccdm, 0, mima->maxx);
+		lo[1] = ccd_grid_coord(ccdm, 1, mima->miny); hi[1] = ccd_grid_coord(ccdm, 1, mima->maxy);
+		lo[2] = ccd_grid_coord(ccdm, 2, mima->minz); hi[2] = ccd_grid_coord(ccdm, 2, mima->maxz);
+
+		for(z=lo[2]; z<=hi[2]; z++)
+			for(y=lo[1]; y<=hi[1]; y++)
+				for(x=lo[0]; x<=hi[0]; x++)
+					ccdm->cellfaces[ccdm->cellstart[ccd_grid_cell(ccdm, x, y, z)]++] = i;
+	}
+
+	/* filling moved the offsets one cell up */
+	for(i=totcell; i>0; i--)
+		ccdm->cellstart[i] = ccdm->cellstart[i-1];
+	ccdm->cellstart[0] = 0;
+}
+
+static int ccd_face_cmp(const void *a, const void *b)
+{
+	return *(const int*)a - *(const int*)b;
+}
+
+/* faces of the collider that can overlap the box, in face order so the forces add
+   up the same as when checking all faces. points into the grid when the box is in
+   one cell, else gathers them in buf. returns NULL when all faces have to be checked */
+static int *ccd_mesh_faces(ccd_Mesh *ccdm, float min[3], float max[3], int buf[CCD_MAX_CANDIDATES], int *r_tot)
+{
+	int i, j, x, y, z, cell, len, lo[3], hi[3], tot = 0;
+
+	*r_tot = ccdm->totface;
+
+	if(!ccdm->cellstart)
+		return NULL;
+
+	for(i=0; i<3; i++) {
+		lo[i] = ccd_grid_coord(ccdm, i, min[i]);
+		hi[i] = ccd_grid_coord(ccdm, i, max[i]);
+	}
+
+	if(lo[0] == hi[0] && lo[1] == hi[1] && lo[2] == hi[2]) {
+		cell = ccd_grid_cell(ccdm, lo[0], lo[1], lo[2]);
+		*r_tot = ccdm->cellstart[cell+1] - ccdm->cellstart[cell];
+		return ccdm->cellfaces + ccdm->cellstart[cell];
+	}
+
+	for(z=lo[2]; z<=hi[2]; z++) {
+		for(y=lo[1]; y<=hi[1]; y++) {
+			for(x=lo[0]; x<=hi[0]; x++) {
+				cell = ccd_grid_cell(ccdm, x, y, z);
+				len = ccdm->cellstart[cell+1] - ccdm->cellstart[cell];
+
+				if(tot + len > CCD_MAX_CANDIDATES)
+					return NULL;
+
+				memcpy(buf + tot, ccdm->cellfaces + ccdm->cellstart[cell], sizeof(int)*len);
+				tot += len;
+			}
+		}
+	}
+
+	/* faces overlapping several cells are in all of them */
+	qsort(buf, tot, sizeof(int), ccd_face_cmp);
+
+	for(i=0, j=0; i<tot; i++) {
+		if(j == 0 || buf[j-1] != buf[i])
+			buf[j++] = buf[i];
+	}
+
+	*r_tot = j;
+	return buf;
+}
+
 
 
 
@@ -312,6 +463,8 @@ static ccd_Mesh *ccd_mesh_make(Object *ob)
 	pccd_M->bbmin[0]=pccd_M->bbmin[1]=pccd_M->bbmin[2]=1e30f;
 	pccd_M->bbmax[0]=pccd_M->bbmax[1]=pccd_M->bbmax[2]=-1e30f;
 	pccd_M->mprevvert=NULL;
+	pccd_M->cellstart=NULL;
+	pccd_M->cellfaces=NULL;
 
 
 	/* blow it up with forcefield ranges */
@@ -386,6 +539,9 @@ static ccd_Mesh *ccd_mesh_make(Object *ob)
 	mface++;
 
 	}
+
+	ccd_mesh_grid_build(pccd_M);
+
 	return pccd_M;
 }
 static void ccd_mesh_update(Object *ob,ccd_Mesh *pccd_M)
@@ -525,6 +681,9 @@ static void ccd_mesh_update(Object *ob,ccd_Mesh *pccd_M)
 	mface++;
 
 	}
+
+	ccd_mesh_grid_build(pccd_M);
+
 	return ;
 }
 
@@ -535,6 +694,8 @@ static void ccd_mesh_free(ccd_Mesh *ccdm)
 		MEM_freeN(ccdm->mvert);
 		if (ccdm->mprevvert) MEM_freeN(ccdm->mprevvert);
 		MEM_freeN(ccdm->mima);
+		if (ccdm->cellstart) MEM_freeN(ccdm->cellstart);
+		if (ccdm->cellfaces) MEM_freeN(ccdm->cellfaces);
 		MEM_freeN(ccdm);
 		ccdm = NULL;
 	}
@@ -905,6 +1066,93 @@ static void free_softbody_baked(SoftBody *sb)
 	sb->keys= NULL;
 	sb->totkey= 0;
 }
+/* --- thread pool --- */
+/* spawning threads for every force evaluation costs more than the work on
+ * moderate meshes, so the workers live for one softbody_step and are fed
+ * slices through a queue */
+static void *sb_pool_exec(void *data)
+{
+	SB_thread_pool *pool = (SB_thread_pool*)data;
+	SB_thread_context *pctx;
+
+	while ((pctx = BLI_thread_queue_pop(pool->todo))) {
+		pctx->exec(pctx);
+		BLI_thread_queue_push(pool->done, pctx);
+	}
+	/* nowait only wakes one worker, pass it on */
+	BLI_thread_queue_nowait(pool->todo);
+	return NULL;
+}
+
+static int sb_totthread(Scene *scene)
+{
+	if(scene->r.mode & R_FIXED_THREADS)
+		return scene->r.threads;
+	return BLI_system_thread_count();
+}
+
+/* returns NULL when running single threaded */
+static SB_thread_pool *sb_pool_get(Scene *scene, SoftBody *sb)
+{
+	SB_thread_pool *pool = sb->scratch->pool;
+	int i, totthread;
+
+	if (pool == NULL) {
+		totthread = sb_totthread(scene);
+		if (totthread < 2) return NULL;
+
+		pool = MEM_callocN(sizeof(SB_thread_pool), "SBThreadPool");
+		pool->todo = BLI_thread_queue_init();
+		pool->done = BLI_thread_queue_init();
+		pool->totthread = totthread;
+
+		BLI_init_threads(&pool->threads, sb_pool_exec, totthread);
+		for(i=0; i<totthread; i++)
+			BLI_insert_thread(&pool->threads, pool);
+
+		sb->scratch->pool = pool;
+	}
+	return pool;
+}
+
+/* runs all contexts and waits for them to finish */
+static void sb_pool_run(SB_thread_pool *pool, SB_thread_context *sb_threads, int tot)
+{
+	int i;
+
+	for(i=0; i<tot; i++)
+		BLI_thread_queue_push(pool->todo, &sb_threads[i]);
+	for(i=0; i<tot; i++)
+		BLI_thread_queue_pop(pool->done);
+}
+
+static void sb_pool_free(SBScratch *scratch)
+{
+	SB_thread_pool *pool = scratch->pool;
+
+	if (pool == NULL) return;
+
+	BLI_thread_queue_nowait(pool->todo);
+	BLI_end_threads(&pool->threads);
+
+	BLI_thread_queue_free(pool->todo);
+	BLI_thread_queue_free(pool->done);
+	MEM_freeN(pool);
+	scratch->pool = NULL;
+}
+
+/* splits tot items in slices of at least lowtot, a few per thread so
+ * uneven slices (colliders, effectors) balance out */
+static int sb_pool_slices(SB_thread_pool *pool, int tot, int lowtot)
+{
+	int totslice;
+
+	if (pool == NULL) return 1;
+
+	totslice = MIN2(tot/lowtot, pool->totthread*4);
+	return MAX2(totslice, 1);
+}
+
 static void free_scratch(SoftBody *sb)
 {
 	if(sb->scratch){
@@ -920,6 +1168,7 @@ static void free_scratch(SoftBody *sb)
 		if (sb->scratch->Ref.ivert){
 			MEM_freeN(sb->scratch->Ref.ivert);
 		}
+		sb_pool_free(sb->scratch);
 		MEM_freeN(sb->scratch);
 		sb->scratch = NULL;
 	}
@@ -1189,7 +1438,8 @@ static int sb_detect_face_collisionCached(float face_v1[3],float face_v2[3],floa
 	GHashIterator *ihash;
 	float nv1[3], nv2[3], nv3[3], nv4[3], edge1[3], edge2[3], d_nvect[3], aabbmin[3],aabbmax[3];
 	float t,tune = 10.0f;
-	int a, deflected=0;
+	int *faces, candidates[CCD_MAX_CANDIDATES];
+	int a, c, deflected=0;
 
 	aabbmin[0] = MIN3(face_v1[0],face_v2[0],face_v3[0]);
 	aabbmin[1] = MIN3(face_v1[1],face_v2[1],face_v3[1]);
@@ -1215,7 +1465,6 @@ static int sb_detect_face_collisionCached(float face_v1[3],float face_v2[3],floa
 					mvert= ccdm->mvert;
 					mprevvert= ccdm->mprevvert;
 					mima= ccdm->mima;
-					a = ccdm->totface;
 
 					if ((aabbmax[0] < ccdm->bbmin[0]) ||
 						(aabbmax[1] < ccdm->bbmin[1]) ||
@@ -1238,7 +1487,12 @@ static int sb_detect_face_collisionCached(float face_v1[3],float face_v2[3],floa
 
 
 				/* use mesh*/
-				while (a--) {
+				/* only faces in the grid cells around */
+				faces = ccd_mesh_faces(ccdm, aabbmin, aabbmax, candidates, &a);
+				for (c = 0; c < a; c++) {
+					mface = ccdm->mface + ((faces)? faces[c]: c);
+					mima = ccdm->mima + ((faces)? faces[c]: c);
+
 					if (
 						(aabbmax[0] < mima->minx) ||
 						(aabbmin[0] > mima->maxx) ||
@@ -1247,8 +1501,6 @@ static int sb_detect_face_collisionCached(float face_v1[3],float face_v2[3],floa
 						(aabbmax[2] < mima->minz) ||
 						(aabbmin[2] > mima->maxz)
 						) {
-						mface++;
-						mima++;
 						continue;
 					}
 
@@ -1307,9 +1559,7 @@ static int sb_detect_face_collisionCached(float face_v1[3],float face_v2[3],floa
 							deflected = 2;
 						}
 					}
-					mface++;
-					mima++;
-				}/* while a */
+				}/* for c */
 			} /* if(ob->pd && ob->pd->deflect) */
 			BLI_ghashIterator_step(ihash);
 	} /* while () */
@@ -1415,7 +1665,8 @@ static int sb_detect_edge_collisionCached(float edge_v1[3],float edge_v2[3],floa
 	GHashIterator *ihash;
 	float nv1[3], nv2[3], nv3[3], nv4[3], edge1[3], edge2[3], d_nvect[3], aabbmin[3],aabbmax[3];
 	float t,el;
-	int a, deflected=0;
+	int *faces, candidates[CCD_MAX_CANDIDATES];
+	int a, c, deflected=0;
 
 	aabbmin[0] = MIN2(edge_v1[0],edge_v2[0]);
 	aabbmin[1] = MIN2(edge_v1[1],edge_v2[1]);
@@ -1443,7 +1694,6 @@ static int sb_detect_edge_collisionCached(float edge_v1[3],float edge_v2[3],floa
 					mvert= ccdm->mvert;
 					mprevvert= ccdm->mprevvert;
 					mima= ccdm->mima;
-					a = ccdm->totface;
 
 					if ((aabbmax[0] < ccdm->bbmin[0]) ||
 						(aabbmax[1] < ccdm->bbmin[1]) ||
@@ -1466,7 +1716,12 @@ static int sb_detect_edge_collisionCached(float edge_v1[3],float edge_v2[3],floa
 
 
 				/* use mesh*/
-				while (a--) {
+				/* only faces in the grid cells around */
+				faces = ccd_mesh_faces(ccdm, aabbmin, aabbmax, candidates, &a);
+				for (c = 0; c < a; c++) {
+					mface = ccdm->mface + ((faces)? faces[c]: c);
+					mima = ccdm->mima + ((faces)? faces[c]: c);
+
 					if (
 						(aabbmax[0] < mima->minx) ||
 						(aabbmin[0] > mima->maxx) ||
@@ -1475,8 +1730,6 @@ static int sb_detect_edge_collisionCached(float edge_v1[3],float edge_v2[3],floa
 						(aabbmax[2] < mima->minz) ||
 						(aabbmin[2] > mima->maxz)
 						) {
-						mface++;
-						mima++;
 						continue;
 					}
 
@@ -1546,9 +1799,7 @@ static int sb_detect_edge_collisionCached(float edge_v1[3],float edge_v2[3],floa
 							deflected = 2;
 						}
 					}
-					mface++;
-					mima++;
-				}/* while a */
+				}/* for c */
 			} /* if(ob->pd && ob->pd->deflect) */
 			BLI_ghashIterator_step(ihash);
 	} /* while () */
@@ -1650,54 +1901,35 @@ static void *exec_scan_for_ext_spring_forces(void *data)
 static void sb_sfesf_threads_run(Scene *scene, struct Object *ob, float timenow,int totsprings,int *UNUSED(ptr_to_break_func(void)))
 {
 	ListBase *do_effector = NULL;
-	ListBase threads;
+	SB_thread_pool *pool;
 	SB_thread_context *sb_threads;
-	int i, totthread,left,dec;
-	int lowsprings =100; /* wild guess .. may increase with better thread management 'above' or even be UI option sb->spawn_cf_threads_nopts */
+	int i, totslice;
+	int lowsprings =100; /* below that a slice is not worth handing to a thread */
 
 	do_effector= pdInitEffectors(scene, ob, NULL, ob->soft->effector_weights);
 
-	/* figure the number of threads while preventing pretty pointless threading overhead */
-	if(scene->r.mode & R_FIXED_THREADS)
-		totthread= scene->r.threads;
-	else
-		totthread= BLI_system_thread_count();
-	/* what if we got zillions of CPUs running but less to spread*/
-	while ((totsprings/totthread < lowsprings) && (totthread > 1)) {
-		totthread--;
-	}
+	/* figure the number of slices while preventing pretty pointless threading overhead */
+	pool = (totsprings >= 2*lowsprings)? sb_pool_get(scene, ob->soft): NULL;
+	totslice = sb_pool_slices(pool, totsprings, lowsprings);
 
-	sb_threads= MEM_callocN(sizeof(SB_thread_context)*totthread, "SBSpringsThread");
-	memset(sb_threads, 0, sizeof(SB_thread_context)*totthread);
-	left = totsprings;
-	dec = totsprings/totthread +1;
-	for(i=0; i<totthread; i++) {
+	sb_threads= MEM_callocN(sizeof(SB_thread_context)*totslice, "SBSpringsThread");
+	for(i=0; i<totslice; i++) {
+		sb_threads[i].exec = exec_scan_for_ext_spring_forces;
 		sb_threads[i].scene = scene;
 		sb_threads[i].ob = ob;
 		sb_threads[i].forcetime = 0.0; // not used here
 		sb_threads[i].timenow = timenow;
-		sb_threads[i].ilast   = left;
-		left = left - dec;
-		if (left >0){
-			sb_threads[i].ifirst  = left;
-		}
-		else
-			sb_threads[i].ifirst  = 0;
+		sb_threads[i].ifirst  = totsprings*i/totslice;
+		sb_threads[i].ilast   = totsprings*(i+1)/totslice;
 		sb_threads[i].do_effector = do_effector;
 		sb_threads[i].do_deflector = 0;// not used here
 		sb_threads[i].fieldfactor = 0.0f;// not used here
 		sb_threads[i].windfactor  = 0.0f;// not used here
 		sb_threads[i].nr= i;
-		sb_threads[i].tot= totthread;
-	}
-	if(totthread > 1) {
-		BLI_init_threads(&threads, exec_scan_for_ext_spring_forces, totthread);
-
-		for(i=0; i<totthread; i++)
-			BLI_insert_thread(&threads, &sb_threads[i]);
-
-		BLI_end_threads(&threads);
+		sb_threads[i].tot= totslice;
 	}
+	if(totslice > 1)
+		sb_pool_run(pool, sb_threads, totslice);
 	else
 		exec_scan_for_ext_spring_forces(&sb_threads[0]);
 	/* clean up */
@@ -1749,7 +1981,8 @@ static int sb_detect_vertex_collisionCached(float opco[3], float facenormal[3],
 		facedist,n_mag,force_mag_norm,minx,miny,minz,maxx,maxy,maxz,
 		innerfacethickness = -0.5f, outerfacethickness = 0.2f,
 		ee = 5.0f, ff = 0.1f, fa=1;
-	int a, deflected=0, cavel=0,ci=0;
+	int *faces, candidates[CCD_MAX_CANDIDATES];
+	int a, c, deflected=0, cavel=0,ci=0;
 /* init */
 	*intrusion = 0.0f;
 	hash  = vertexowner->soft->scratch->colliderhash;
@@ -1773,7 +2006,6 @@ static int sb_detect_vertex_collisionCached(float opco[3], float facenormal[3],
 					mvert= ccdm->mvert;
 					mprevvert= ccdm->mprevvert;
 					mima= ccdm->mima;
-					a = ccdm->totface;
 
 					minx =ccdm->bbmin[0];
 					miny =ccdm->bbmin[1];
@@ -1810,7 +2042,12 @@ static int sb_detect_vertex_collisionCached(float opco[3], float facenormal[3],
 				fa = 1.0f/fa;
 				avel[0]=avel[1]=avel[2]=0.0f;
 				/* use mesh*/
-				while (a--) {
+				/* only faces in the grid cells around */
+				faces = ccd_mesh_faces(ccdm, opco, opco, candidates, &a);
+				for (c = 0; c < a; c++) {
+					mface = ccdm->mface + ((faces)? faces[c]: c);
+					mima = ccdm->mima + ((faces)? faces[c]: c);
+
 					if (
 						(opco[0] < mima->minx) ||
 						(opco[0] > mima->maxx) ||
@@ -1819,8 +2056,6 @@ static int sb_detect_vertex_collisionCached(float opco[3], float facenormal[3],
 						(opco[2] < mima->minz) ||
 						(opco[2] > mima->maxz)
 						) {
-							mface++;
-							mima++;
 							continue;
 					}
 
@@ -1990,9 +2225,7 @@ static int sb_detect_vertex_collisionCached(float opco[3], float facenormal[3],
 
 						}
 					}
-					mface++;
-					mima++;
-				}/* while a */
+				}/* for c */
 			} /* if(ob->pd && ob->pd->deflect) */
 			BLI_ghashIterator_step(ihash);
 	} /* while () */
@@ -2382,56 +2615,36 @@ static void *exec_softbody_calc_forces(void *data)
 
 static void sb_cf_threads_run(Scene *scene, Object *ob, float forcetime, float timenow,int totpoint,int *UNUSED(ptr_to_break_func(void)),struct ListBase *do_effector,int do_deflector,float fieldfactor, float windfactor)
 {
-	ListBase threads;
+	SB_thread_pool *pool;
 	SB_thread_context *sb_threads;
-	int i, totthread,left,dec;
-	int lowpoints =100; /* wild guess .. may increase with better thread management 'above' or even be UI option sb->spawn_cf_threads_nopts */
+	int i, totslice;
+	int lowpoints =100; /* below that a slice is not worth handing to a thread */
 
-	/* figure the number of threads while preventing pretty pointless threading overhead */
-	if(scene->r.mode & R_FIXED_THREADS)
-		totthread= scene->r.threads;
-	else
-		totthread= BLI_system_thread_count();
-	/* what if we got zillions of CPUs running but less to spread*/
-	while ((totpoint/totthread < lowpoints) && (totthread > 1)) {
-		totthread--;
-	}
+	/* figure the number of slices while preventing pretty pointless threading overhead */
+	pool = (totpoint >= 2*lowpoints)? sb_pool_get(scene, ob->soft): NULL;
+	totslice = sb_pool_slices(pool, totpoint, lowpoints);
 
-	/* printf("sb_cf_threads_run spawning %d threads \n",totthread); */
+	/* printf("sb_cf_threads_run %d slices \n",totslice); */
 
-	sb_threads= MEM_callocN(sizeof(SB_thread_context)*totthread, "SBThread");
-	memset(sb_threads, 0, sizeof(SB_thread_context)*totthread);
-	left = totpoint;
-	dec = totpoint/totthread +1;
-	for(i=0; i<totthread; i++) {
+	sb_threads= MEM_callocN(sizeof(SB_thread_context)*totslice, "SBThread");
+	for(i=0; i<totslice; i++) {
+		sb_threads[i].exec = exec_softbody_calc_forces;
 		sb_threads[i].scene = scene;
 		sb_threads[i].ob = ob;
 		sb_threads[i].forcetime = forcetime;
 		sb_threads[i].timenow = timenow;
-		sb_threads[i].ilast   = left;
-		left = left - dec;
-		if (left >0){
-			sb_threads[i].ifirst  = left;
-		}
-		else
-			sb_threads[i].ifirst  = 0;
+		sb_threads[i].ifirst  = totpoint*i/totslice;
+		sb_threads[i].ilast   = totpoint*(i+1)/totslice;
 		sb_threads[i].do_effector = do_effector;
 		sb_threads[i].do_deflector = do_deflector;
 		sb_threads[i].fieldfactor = fieldfactor;
 		sb_threads[i].windfactor  = windfactor;
 		sb_threads[i].nr= i;
-		sb_threads[i].tot= totthread;
+		sb_threads[i].tot= totslice;
 	}
 
-
-	if(totthread > 1) {
-		BLI_init_threads(&threads, exec_softbody_calc_forces, totthread);
-
-		for(i=0; i<totthread; i++)
-			BLI_insert_thread(&threads, &sb_threads[i]);
-
-		BLI_end_threads(&threads);
-	}
+	if(totslice > 1)
+		sb_pool_run(pool, sb_threads, totslice);
 	else
 		exec_softbody_calc_forces(&sb_threads[0]);
 	/* clean up */
@@ -4038,6 +4251,9 @@ static void softbody_step(Scene *scene, Object *ob, SoftBody *sb, float dtime)
 	}/*SOLVER SELECT*/
 	if(sb->plastic){ apply_spring_memory(ob);}
 
+	/* don't keep workers (and the malloc lock) around between frames */
+	sb_pool_free(sb->scratch);
+
 	if(sb->solverflags & SBSO_MONITOR ){
 		sct=PIL_check_seconds_timer();
 		if ((sct-sst > 0.5f) || (G.f & G_DEBUG)) printf(" solver time %f sec %s \n",sct-sst,ob->id.name);
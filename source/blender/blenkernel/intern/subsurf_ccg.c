@@ -507,6 +507,92 @@ static void ss_sync_from_derivedmesh(CCGSubSurf *ss, DerivedMesh *dm,
 	ccgSubSurf_processSync(ss);
 }
 
+/* when the topology and creases are the same as on the last sync, only
+ * update the positions and evaluate the stencils, returns 0 when a full
+ * sync is needed */
+static int ss_sync_stencils_from_derivedmesh(CCGSubSurf *ss, DerivedMesh *dm,
+											 float (*vertexCos)[3], int useFlatSubdiv)
+{
+	float creaseFactor = (float) ccgSubSurf_getSubdivisionLevels(ss);
+	int totvert = dm->getNumVerts(dm);
+	int totedge = dm->getNumEdges(dm);
+	int totface = dm->getNumFaces(dm);
+	int i, changed = 0;
+	int *index;
+	MVert *mvert = dm->getVertArray(dm);
+	MEdge *medge = dm->getEdgeArray(dm);
+	MFace *mface = dm->getFaceArray(dm);
+
+	if(totvert != ccgSubSurf_getNumVerts(ss) ||
+	   totedge != ccgSubSurf_getNumEdges(ss) ||
+	   totface != ccgSubSurf_getNumFaces(ss))
+		return 0;
+
+	for(i = 0; i < totedge; i++) {
+		CCGEdge *e = ccgSubSurf_getEdge(ss, SET_INT_IN_POINTER(i));
+		float crease = useFlatSubdiv ? creaseFactor :
+									   medge[i].crease * creaseFactor / 255.0f;
+
+		if(!e ||
+		   ccgSubSurf_getVertVertHandle(ccgSubSurf_getEdgeVert0(e)) != SET_INT_IN_POINTER(medge[i].v1) ||
+		   ccgSubSurf_getVertVertHandle(ccgSubSurf_getEdgeVert1(e)) != SET_INT_IN_POINTER(medge[i].v2) ||
+		   ccgSubSurf_getEdgeCrease(e) != crease)
+			return 0;
+	}
+
+	for(i = 0; i < totface; i++) {
+		CCGFace *f = ccgSubSurf_getFace(ss, SET_INT_IN_POINTER(i));
+		MFace *mf = &mface[i];
+		unsigned int fVerts[4] = {mf->v1, mf->v2, mf->v3, mf->v4};
+		int S, numVerts = mf->v4 ? 4 : 3;
+
+		if(!f || ccgSubSurf_getFaceNumVerts(f) != numVerts)
+			return 0;
+
+		for(S = 0; S < numVerts; S++)
+			if(ccgSubSurf_getVertVertHandle(ccgSubSurf_getFaceVert(ss, f, S)) != SET_INT_IN_POINTER(fVerts[S]))
+				return 0;
+	}
+
+	for(i = 0; i < totvert && !changed; i++) {
+		CCGVert *v = ccgSubSurf_getVert(ss, SET_INT_IN_POINTER(i));
+		float *co = ccgSubSurf_getVertLevelData(ss, v, 0);
+
+		if(!equals_v3v3(co, (vertexCos)? vertexCos[i]: mvert[i].co))
+			changed = 1;
+	}
+
+	/* built from the synced positions, so only once they change */
+	if(changed && ccgSubSurf_buildStencils(ss) != eCCGError_None)
+		return 0;
+
+	index = (int *)dm->getVertDataArray(dm, CD_ORIGINDEX);
+	for(i = 0; i < totvert; i++) {
+		CCGVert *v = ccgSubSurf_getVert(ss, SET_INT_IN_POINTER(i));
+
+		copy_v3_v3(ccgSubSurf_getVertLevelData(ss, v, 0), (vertexCos)? vertexCos[i]: mvert[i].co);
+
+		((int*)ccgSubSurf_getVertUserData(ss, v))[1] = (index)? *index++: i;
+	}
+
+	index = (int *)dm->getEdgeDataArray(dm, CD_ORIGINDEX);
+	for(i = 0; i < totedge; i++) {
+		CCGEdge *e = ccgSubSurf_getEdge(ss, SET_INT_IN_POINTER(i));
+		((int*)ccgSubSurf_getEdgeUserData(ss, e))[1] = (index)? *index++: i;
+	}
+
+	index = (int *)dm->getFaceDataArray(dm, CD_ORIGINDEX);
+	for(i = 0; i < totface; i++) {
+		CCGFace *f = ccgSubSurf_getFace(ss, SET_INT_IN_POINTER(i));
+		((int*)ccgSubSurf_getFaceUserData(ss, f))[1] = (index)? *index++: i;
+	}
+
+	if(changed)
+		ccgSubSurf_evalStencils(ss);
+
+	return 1;
+}
+
 /***/
 
 static int ccgDM_getVertMapIndex(CCGSubSurf *ss, CCGVert *v) {
@@ -2657,6 +2743,7 @@ struct DerivedMesh *subsurf_make_derived_from_derived(
 		result->freeSS = 1;
 	} else {
 		int useIncremental = (smd->flags & eSubsurfModifierFlag_Incremental);
+		int useStencils = (smd->flags & eSubsurfModifierFlag_Stencils);
 		int useAging = smd->flags & eSubsurfModifierFlag_DebugIncr;
 		int levels= (smd->modifier.scene)? get_render_subsurf_level(&smd->modifier.scene->r, smd->levels): smd->levels;
 		CCGSubSurf *ss;
@@ -2677,11 +2764,12 @@ struct DerivedMesh *subsurf_make_derived_from_derived(
 			smd->emCache = NULL;
 		}
 
-		if(useIncremental && isFinalCalc) {
+		if((useIncremental || useStencils) && isFinalCalc) {
 			smd->mCache = ss = _getSubSurf(smd->mCache, levels,
 										   useAging, 0, useSimple);
 
-			ss_sync_from_derivedmesh(ss, dm, vertCos, useSimple);
+			if(!useStencils || !ss_sync_stencils_from_derivedmesh(ss, dm, vertCos, useSimple))
+				ss_sync_from_derivedmesh(ss, dm, vertCos, useSimple);
 
 			result = getCCGDerivedMesh(smd->mCache,
 									   drawInteriorEdges,
@@ -83,6 +83,11 @@ typedef void (*BVHTree_RayCastCallback) (void *userdata, int index, const BVHTre
 /* callback to range search query */
 typedef void (*BVHTree_RangeQuery) (void *userdata, int index, float squared_dist);
 
+/* callback to refit, fills co (and co_moving if given) with at most BVH_MAX_LEAF_POINTS points
+   of the leaf with the given index and returns the number of points, called from threads */
+#define BVH_MAX_LEAF_POINTS 4
+typedef int (*BVHTree_UpdateLeafCallback) (void *userdata, int index, float *co, float *co_moving);
+
 BVHTree *BLI_bvhtree_new(int maxsize, float epsilon, char tree_type, char axis);
 void BLI_bvhtree_free(BVHTree *tree);
 
@@ -90,10 +95,14 @@ void BLI_bvhtree_free(BVHTree *tree);
 int BLI_bvhtree_insert(BVHTree *tree, int index, float *co, int numpoints);
 void BLI_bvhtree_balance(BVHTree *tree);
 
-/* update: first update points/nodes, then call update_tree to refit the bounding volumes */
+/* update: first update points/nodes, then call update_tree to refit the bounding volumes,
+   update_tree rebuilds the tree when the refit one got much worse than the balanced one */
 int BLI_bvhtree_update_node(BVHTree *tree, int index, float *co, float *co_moving, int numpoints);
 void BLI_bvhtree_update_tree(BVHTree *tree);
 
+/* update all leafs from the callback and then the tree, in parallel for big trees */
+void BLI_bvhtree_refit(BVHTree *tree, BVHTree_UpdateLeafCallback callback, void *userdata, int moving);
+
 /* collision/overlap: check two trees if they overlap, alloc's *overlap with length of the int return value */
 BVHTreeOverlap *BLI_bvhtree_overlap(BVHTree *tree1, BVHTree *tree2, unsigned int *result);
 
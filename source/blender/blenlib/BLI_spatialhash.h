@@ -0,0 +1,59 @@
+/*
+ * $Id$
+ *
+ * ***** BEGIN GPL LICENSE BLOCK *****
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * The Original Code is: all of this file.
+ *
+ * Contributor(s): none yet.
+ *
+ * ***** END GPL LICENSE BLOCK *****
+ */
+
+#ifndef BLI_SPATIALHASH_H
+#define BLI_SPATIALHASH_H
+
+/** \file BLI_spatialhash.h
+ *  \ingroup bli
+ *  \brief A uniform grid for fixed radius neighbour search of moving points.
+ */
+
+struct SpatialHash;
+typedef struct SpatialHash SpatialHash;
+
+/* same as BVHTree_RangeQuery, so callbacks can be shared */
+typedef void (*SpatialHashRangeCallback)(void *userdata, int index, float squared_dist);
+
+/* Creates or free a spatial hash for points with index 0 to maxsize-1.
+ * Queries are fastest with a cell size equal to the largest query radius. */
+SpatialHash *BLI_spatialhash_new(int maxsize, float cellsize);
+void BLI_spatialhash_free(SpatialHash *hash);
+
+int BLI_spatialhash_maxsize(SpatialHash *hash);
+float BLI_spatialhash_cellsize(SpatialHash *hash);
+
+/* Inserts a point or moves it to a new location, only points that move
+ * to another cell have to be relinked, so updating every step is cheap */
+void BLI_spatialhash_update(SpatialHash *hash, int index, const float co[3]);
+void BLI_spatialhash_remove(SpatialHash *hash, int index);
+
+/* Calls callback for all points within radius of co, returns number of points
+ * found. Queries only read the hash, so they can be done from several threads. */
+int BLI_spatialhash_range_query(SpatialHash *hash, const float co[3], float radius, SpatialHashRangeCallback callback, void *userdata);
+
+#endif
+
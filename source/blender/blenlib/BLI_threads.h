@@ -61,6 +61,20 @@ int BLI_thread_is_main(void);
 
 int		BLI_system_thread_count(void); /* gets the number of threads the system can make use of */
 
+/* Thread Budget
+ *
+ * Work that splits itself over threads can run inside other threads (a
+ * modifier in a scene update or render thread, a compositor node), where the
+ * cores may already be busy. Threads started with BLI_insert_thread count as
+ * busy while they run. Acquiring returns how many threads, between 1 and max,
+ * the caller may start and wait for, and counts them until they are released
+ * again. Threads started within an acquired budget are not counted twice. */
+
+int		BLI_thread_budget_acquire(int max);
+void	BLI_thread_budget_release(int tot);
+/* for threads not started with BLI_insert_thread, tot is negative to remove them */
+void	BLI_thread_budget_add(int tot);
+
 /* Global Mutex Locks
  * 
  * One custom lock available now. can be extended. */
@@ -32,15 +32,19 @@
 
 
 #include <assert.h>
+#include <string.h>
 
 #include "MEM_guardedalloc.h"
 
+#include "DNA_listBase.h"
+
 #include "BLI_utildefines.h"
 
 
 
 #include "BLI_kdopbvh.h"
 #include "BLI_math.h"
+#include "BLI_threads.h"
 
 #ifdef _OPENMP
 #include <omp.h>
@@ -51,6 +55,10 @@
 #define MAX_TREETYPE 32
 #define DEFAULT_FIND_NEAREST_HEAP_SIZE 1024
 
+#define BVH_THREADS_LIMIT 4096			/* nodes in a refit pass or leafs in an overlap query before using threads */
+#define BVH_OVERLAP_FRONT_PER_THREAD 16	/* node pairs to split the overlap traversal in, per thread */
+#define BVH_REBUILD_DEGRADATION 1.5f	/* rebuild when the refit tree cost grows by this factor */
+
 typedef struct BVHNode
 {
 	struct BVHNode **children;
@@ -74,6 +82,7 @@ struct BVHTree
 	char 	tree_type; // type of tree (4 => quadtree)
 	char 	axis; // kdop type (6 => OBB, 7 => AABB, ...)
 	char 	start_axis, stop_axis; // KDOP_AXES array indices according to axis
+	float	build_cost; // tree cost when it was balanced, to detect degradation on refit
 };
 
 typedef struct BVHOverlapData 
@@ -829,6 +838,182 @@ static void non_recursive_bvh_div_nodes(BVHTree *tree, BVHNode *branches_array,
 }
 
 
+/*
+ * Refit, the leafs get new bounding volumes and the branches are joined bottom up
+ */
+typedef struct BVHRefitData
+{
+	BVHTree *tree;
+	BVHNode **nodes;
+	BVHTree_UpdateLeafCallback callback;
+	void *userdata;
+	int moving;
+} BVHRefitData;
+
+typedef float (*BVHPassFunc)(BVHRefitData *data, int start, int end);
+
+typedef struct BVHPassRange
+{
+	BVHRefitData *data;
+	BVHPassFunc func;
+	int start, end;
+	float result;
+} BVHPassRange;
+
+static void leaf_hull(BVHTree *tree, BVHNode *node, float *co, float *co_moving, int numpoints)
+{
+	int i;
+
+	create_kdop_hull(tree, node, co, numpoints, 0);
+
+	if(co_moving)
+		create_kdop_hull(tree, node, co_moving, numpoints, 1);
+
+	// inflate the bv with some epsilon
+	for (i = tree->start_axis; i < tree->stop_axis; i++)
+	{
+		node->bv[(2 * i)] -= tree->epsilon; // minimum 
+		node->bv[(2 * i) + 1] += tree->epsilon; // maximum 
+	}
+}
+
+// sum of the extents along all axes, unused branches don't count
+static float node_cost(BVHTree *tree, BVHNode *node)
+{
+	float cost = 0.0f;
+	int i;
+
+	if(!node->totnode)
+		return 0.0f;
+
+	for (i = tree->start_axis; i < tree->stop_axis; i++)
+		cost += node->bv[(2 * i) + 1] - node->bv[(2 * i)];
+
+	return cost;
+}
+
+// cost of all branches relative to the root, so it doesn't change when all leafs move or scale together
+static float bvh_relative_cost(BVHTree *tree, float cost)
+{
+	float root_cost = node_cost(tree, tree->nodes[tree->totleaf]);
+
+	return (root_cost > 0.0f)? cost / root_cost: 0.0f;
+}
+
+static float bvh_join_pass(BVHRefitData *data, int start, int end)
+{
+	float cost = 0.0f;
+	int i;
+
+	for(i = start; i < end; i++) {
+		node_join(data->tree, data->nodes[i]);
+		cost += node_cost(data->tree, data->nodes[i]);
+	}
+
+	return cost;
+}
+
+static float bvh_refit_leaf_pass(BVHRefitData *data, int start, int end)
+{
+	float co[BVH_MAX_LEAF_POINTS*3], co_moving[BVH_MAX_LEAF_POINTS*3];
+	int i, numpoints;
+
+	for(i = start; i < end; i++) {
+		BVHNode *node = data->nodes[i];
+
+		numpoints = data->callback(data->userdata, node->index, co, (data->moving)? co_moving: NULL);
+		leaf_hull(data->tree, node, co, (data->moving)? co_moving: NULL, numpoints);
+	}
+
+	return 0.0f;
+}
+
+static void *bvh_pass_thread(void *range_v)
+{
+	BVHPassRange *range = range_v;
+
+	range->result = range->func(range->data, range->start, range->end);
+
+	return NULL;
+}
+
+// runs func on the range, split over threads when it's big enough.
+// returns the sum of the results, added in range order so it doesn't depend on the thread count
+static float bvh_run_pass(BVHPassFunc func, BVHRefitData *data, int start, int end)
+{
+	BVHPassRange ranges[BLENDER_MAX_THREADS];
+	ListBase threads;
+	float result = 0.0f;
+	int i, len, totthread = 1;
+
+	if(end - start < BVH_THREADS_LIMIT)
+		return func(data, start, end);
+
+	//trees also get refit from modifiers in scene update threads, only use the threads left free
+	totthread = BLI_thread_budget_acquire(BLENDER_MAX_THREADS);
+	if(totthread < 2)
+	{
+		BLI_thread_budget_release(totthread);
+		return func(data, start, end);
+	}
+
+	len = (end - start + totthread - 1) / totthread;
+
+	for(i = 0; i < totthread; i++)
+	{
+		ranges[i].data = data;
+		ranges[i].func = func;
+		ranges[i].start = MIN2(start + i*len, end);
+		ranges[i].end = (i == totthread-1)? end: MIN2(start + (i+1)*len, end);
+		ranges[i].result = 0.0f;
+	}
+
+	BLI_init_threads(&threads, bvh_pass_thread, totthread);
+
+	for(i = 0; i < totthread; i++)
+		BLI_insert_thread(&threads, &ranges[i]);
+
+	BLI_end_threads(&threads);
+	BLI_thread_budget_release(totthread);
+
+	for(i = 0; i < totthread; i++)
+		result += ranges[i].result;
+
+	return result;
+}
+
+// (re)build the branches on top of the leafs in the nodes array
+static void bvh_build(BVHTree *tree)
+{
+	BVHNode*  branches_array = tree->nodearray + tree->totleaf;
+	BVHNode** leafs_array    = tree->nodes;
+	float cost = 0.0f;
+	int i;
+
+	//a rebuild keeps the layout (it only depends on the number of leafs) but clear old links anyway
+	for(i = 0; i < tree->totbranch; i++)
+	{
+		memset(branches_array[i].children, 0, sizeof(BVHNode*) * tree->tree_type);
+		branches_array[i].totnode = 0;
+	}
+
+	//Build the implicit tree
+	non_recursive_bvh_div_nodes(tree, branches_array, leafs_array, tree->totleaf);
+
+	//current code expects the branches to be linked to the nodes array
+	//we perform that linkage here
+	tree->totbranch = implicit_needed_branches(tree->tree_type, tree->totleaf);
+	for(i = 0; i < tree->totbranch; i++)
+	{
+		tree->nodes[tree->totleaf + i] = branches_array + i;
+		cost += node_cost(tree, branches_array + i);
+	}
+
+	build_skip_links(tree, tree->nodes[tree->totleaf], NULL, NULL);
+
+	tree->build_cost = bvh_relative_cost(tree, cost);
+}
+
 /*
  * BLI_bvhtree api
  */
@@ -952,30 +1137,15 @@ void BLI_bvhtree_free(BVHTree *tree)
 
 void BLI_bvhtree_balance(BVHTree *tree)
 {
-	int i;
-
-	BVHNode*  branches_array = tree->nodearray + tree->totleaf;
-	BVHNode** leafs_array    = tree->nodes;
-
 	//This function should only be called once (some big bug goes here if its being called more than once per tree)
 	assert(tree->totbranch == 0);
 
-	//Build the implicit tree
-	non_recursive_bvh_div_nodes(tree, branches_array, leafs_array, tree->totleaf);
-
-	//current code expects the branches to be linked to the nodes array
-	//we perform that linkage here
-	tree->totbranch = implicit_needed_branches(tree->tree_type, tree->totleaf);
-	for(i = 0; i < tree->totbranch; i++)
-		tree->nodes[tree->totleaf + i] = branches_array + i;
-
-	build_skip_links(tree, tree->nodes[tree->totleaf], NULL, NULL);
+	bvh_build(tree);
 	//bvhtree_info(tree);
 }
 
 int BLI_bvhtree_insert(BVHTree *tree, int index, float *co, int numpoints)
 {
-	int i;
 	BVHNode *node = NULL;
 	
 	// insert should only possible as long as tree->totbranch is 0
@@ -990,15 +1160,8 @@ int BLI_bvhtree_insert(BVHTree *tree, int index, float *co, int numpoints)
 	node = tree->nodes[tree->totleaf] = &(tree->nodearray[tree->totleaf]);
 	tree->totleaf++;
 	
-	create_kdop_hull(tree, node, co, numpoints, 0);
+	leaf_hull(tree, node, co, NULL, numpoints);
 	node->index= index;
-	
-	// inflate the bv with some epsilon
-	for (i = tree->start_axis; i < tree->stop_axis; i++)
-	{
-		node->bv[(2 * i)] -= tree->epsilon; // minimum 
-		node->bv[(2 * i) + 1] += tree->epsilon; // maximum 
-	}
 
 	return 1;
 }
@@ -1007,26 +1170,11 @@ int BLI_bvhtree_insert(BVHTree *tree, int index, float *co, int numpoints)
 // call before BLI_bvhtree_update_tree()
 int BLI_bvhtree_update_node(BVHTree *tree, int index, float *co, float *co_moving, int numpoints)
 {
-	int i;
-	BVHNode *node= NULL;
-	
 	// check if index exists
 	if(index > tree->totleaf)
 		return 0;
 	
-	node = tree->nodearray + index;
-	
-	create_kdop_hull(tree, node, co, numpoints, 0);
-	
-	if(co_moving)
-		create_kdop_hull(tree, node, co_moving, numpoints, 1);
-	
-	// inflate the bv with some epsilon
-	for (i = tree->start_axis; i < tree->stop_axis; i++)
-	{
-		node->bv[(2 * i)] -= tree->epsilon; // minimum 
-		node->bv[(2 * i) + 1] += tree->epsilon; // maximum 
-	}
+	leaf_hull(tree, tree->nodearray + index, co, co_moving, numpoints);
 
 	return 1;
 }
@@ -1036,13 +1184,45 @@ void BLI_bvhtree_update_tree(BVHTree *tree)
 {
 	//Update bottom=>top
 	//TRICKY: the way we build the tree all the childs have an index greater than the parent
-	//This allows us todo a bottom up update by starting on the biger numbered branch
+	//and the childs of a level are all on the next levels, so we can update a level at a
+	//time starting on the deepest one, and the nodes of a level in parallel
+	BVHRefitData data;
+	int level[33];
+	int i, totlevel = 0;
+	float cost = 0.0f;
+
+	if(tree->totbranch == 0)
+		return;
+
+	for(i = 1; i <= tree->totbranch && totlevel < 32; i = i*tree->tree_type + 2 - tree->tree_type)
+		level[totlevel++] = i - 1;
+	level[totlevel] = tree->totbranch;
+
+	data.tree = tree;
+	data.nodes = tree->nodes + tree->totleaf;
+
+	for(i = totlevel-1; i >= 0; i--)
+		cost += bvh_run_pass(bvh_join_pass, &data, level[i], level[i+1]);
+
+	//refit doesn't change the tree layout, once leafs moved far from the ones they were
+	//grouped with the branches overlap a lot and queries slow down, rebuild it then
+	if(tree->build_cost > 0.0f && bvh_relative_cost(tree, cost) > tree->build_cost * BVH_REBUILD_DEGRADATION)
+		bvh_build(tree);
+}
+
+void BLI_bvhtree_refit(BVHTree *tree, BVHTree_UpdateLeafCallback callback, void *userdata, int moving)
+{
+	BVHRefitData data;
 
-	BVHNode** root  = tree->nodes + tree->totleaf;
-	BVHNode** index = tree->nodes + tree->totleaf + tree->totbranch-1;
+	data.tree = tree;
+	data.nodes = tree->nodes;
+	data.callback = callback;
+	data.userdata = userdata;
+	data.moving = moving;
+
+	bvh_run_pass(bvh_refit_leaf_pass, &data, 0, tree->totleaf);
 
-	for (; index >= root; index--)
-		node_join(tree, *index);
+	BLI_bvhtree_update_tree(tree);
 }
 
 float BLI_bvhtree_getepsilon(BVHTree *tree)
@@ -1134,12 +1314,112 @@ static void traverse(BVHOverlapData *data, BVHNode *node1, BVHNode *node2)
 	return;
 }
 
+// split the traversal in a front of node pairs, each one traversed on its own. the pairs are
+// descended the same way traverse does, so concatenating their results in order gives the same
+// overlaps in the same order as one traversal from the roots.
+static BVHNode **overlap_front(BVHOverlapData *data, BVHNode *root1, BVHNode *root2, int totwanted, int *r_totpair)
+{
+	BVHNode **front, **next, **tmp;
+	int i, j, totpair = 1, totnext, descended = 1;
+
+	front = MEM_mallocN(sizeof(BVHNode*)*2, "BVHOverlapFront");
+	front[0] = root1;
+	front[1] = root2;
+
+	while(descended && totpair < totwanted)
+	{
+		descended = 0;
+		totnext = 0;
+
+		next = MEM_mallocN(sizeof(BVHNode*)*2*totpair*MAX2(data->tree1->tree_type, data->tree2->tree_type), "BVHOverlapFront");
+
+		for(i = 0; i < totpair; i++)
+		{
+			BVHNode *node1 = front[2*i], *node2 = front[2*i+1];
+
+			if(!tree_overlap(node1, node2, data->start_axis, data->stop_axis))
+				continue;
+
+			if(node1->totnode)
+			{
+				for(j = 0; j < data->tree1->tree_type; j++)
+				{
+					if(node1->children[j])
+					{
+						next[2*totnext] = node1->children[j];
+						next[2*totnext+1] = node2;
+						totnext++;
+					}
+				}
+				descended = 1;
+			}
+			else if(node2->totnode)
+			{
+				for(j = 0; j < data->tree2->tree_type; j++)
+				{
+					if(node2->children[j])
+					{
+						next[2*totnext] = node1;
+						next[2*totnext+1] = node2->children[j];
+						totnext++;
+					}
+				}
+				descended = 1;
+			}
+			else
+			{
+				next[2*totnext] = node1;
+				next[2*totnext+1] = node2;
+				totnext++;
+			}
+		}
+
+		tmp = front;
+		front = next;
+		MEM_freeN(tmp);
+		totpair = totnext;
+	}
+
+	*r_totpair = totpair;
+	return front;
+}
+
+typedef struct BVHOverlapThread
+{
+	BVHOverlapData *data;	// one per front pair
+	BVHNode **front;
+	int totpair, next;
+	ThreadMutex mutex;
+} BVHOverlapThread;
+
+static void *overlap_thread(void *othread_v)
+{
+	BVHOverlapThread *othread = othread_v;
+	int i;
+
+	while(1)
+	{
+		// pairs take very different amounts of work, hand them out one at a time
+		BLI_mutex_lock(&othread->mutex);
+		i = othread->next++;
+		BLI_mutex_unlock(&othread->mutex);
+
+		if(i >= othread->totpair)
+			break;
+
+		traverse(&othread->data[i], othread->front[2*i], othread->front[2*i+1]);
+	}
+
+	return NULL;
+}
+
 BVHTreeOverlap *BLI_bvhtree_overlap(BVHTree *tree1, BVHTree *tree2, unsigned int *result)
 {
-	int j;
+	int j, totthread = 1, totpair = 1, budget = 0;
 	unsigned int total = 0;
 	BVHTreeOverlap *overlap = NULL, *to = NULL;
-	BVHOverlapData **data;
+	BVHOverlapData *data, settings;
+	BVHNode **front = NULL;
 	
 	// check for compatibility of both trees (can't compare 14-DOP with 18-DOP)
 	if((tree1->axis != tree2->axis) && (tree1->axis == 14 || tree2->axis == 14) && (tree1->axis == 18 || tree2->axis == 18))
@@ -1149,45 +1429,75 @@ BVHTreeOverlap *BLI_bvhtree_overlap(BVHTree *tree1, BVHTree *tree2, unsigned int
 	if(!tree_overlap(tree1->nodes[tree1->totleaf], tree2->nodes[tree2->totleaf], MIN2(tree1->start_axis, tree2->start_axis), MIN2(tree1->stop_axis, tree2->stop_axis)))
 		return NULL;
 
-	data = MEM_callocN(sizeof(BVHOverlapData *)* tree1->tree_type, "BVHOverlapData_star");
+	settings.tree1 = tree1;
+	settings.tree2 = tree2;
+	settings.overlap = NULL;
+	settings.i = settings.max_overlap = 0;
+	settings.start_axis = MIN2(tree1->start_axis, tree2->start_axis);
+	settings.stop_axis  = MIN2(tree1->stop_axis,  tree2->stop_axis );
+
+	if(tree1->totleaf + tree2->totleaf >= BVH_THREADS_LIMIT)
+		budget = totthread = BLI_thread_budget_acquire(BLENDER_MAX_THREADS);
+
+	if(totthread > 1)
+		front = overlap_front(&settings, tree1->nodes[tree1->totleaf], tree2->nodes[tree2->totleaf], totthread * BVH_OVERLAP_FRONT_PER_THREAD, &totpair);
+
+	data = MEM_callocN(sizeof(BVHOverlapData) * MAX2(totpair, 1), "BVHOverlapData");
 	
-	for(j = 0; j < tree1->tree_type; j++)
+	for(j = 0; j < totpair; j++)
 	{
-		data[j] = (BVHOverlapData *)MEM_callocN(sizeof(BVHOverlapData), "BVHOverlapData");
-		
-		// init BVHOverlapData
-		data[j]->overlap = (BVHTreeOverlap *)malloc(sizeof(BVHTreeOverlap)*MAX2(tree1->totleaf, tree2->totleaf));
-		data[j]->tree1 = tree1;
-		data[j]->tree2 = tree2;
-		data[j]->max_overlap = MAX2(tree1->totleaf, tree2->totleaf);
-		data[j]->i = 0;
-		data[j]->start_axis = MIN2(tree1->start_axis, tree2->start_axis);
-		data[j]->stop_axis  = MIN2(tree1->stop_axis,  tree2->stop_axis );
+		// init BVHOverlapData, the traversal is split so start small, it grows as needed
+		data[j] = settings;
+		data[j].max_overlap = (front)? MAX2(tree1->totleaf, tree2->totleaf) / totpair + 1: MAX2(tree1->totleaf, tree2->totleaf);
+		data[j].overlap = (BVHTreeOverlap *)malloc(sizeof(BVHTreeOverlap)*data[j].max_overlap);
+		data[j].i = 0;
 	}
 
-#pragma omp parallel for private(j) schedule(static)
-	for(j = 0; j < MIN2(tree1->tree_type, tree1->nodes[tree1->totleaf]->totnode); j++)
+	if(!front)
 	{
-		traverse(data[j], tree1->nodes[tree1->totleaf]->children[j], tree2->nodes[tree2->totleaf]);
+		traverse(&data[0], tree1->nodes[tree1->totleaf], tree2->nodes[tree2->totleaf]);
 	}
+	else if(totpair > 0)
+	{
+		BVHOverlapThread othread;
+		ListBase threads;
+
+		othread.data = data;
+		othread.front = front;
+		othread.totpair = totpair;
+		othread.next = 0;
+		BLI_mutex_init(&othread.mutex);
+
+		totthread = MIN2(totthread, totpair);
+		BLI_init_threads(&threads, overlap_thread, totthread);
+
+		for(j = 0; j < totthread; j++)
+			BLI_insert_thread(&threads, &othread);
+
+		BLI_end_threads(&threads);
+		BLI_mutex_end(&othread.mutex);
+	}
+
+	if(budget)
+		BLI_thread_budget_release(budget);
 	
-	for(j = 0; j < tree1->tree_type; j++)
-		total += data[j]->i;
+	for(j = 0; j < totpair; j++)
+		total += data[j].i;
 	
 	to = overlap = (BVHTreeOverlap *)MEM_callocN(sizeof(BVHTreeOverlap)*total, "BVHTreeOverlap");
 	
-	for(j = 0; j < tree1->tree_type; j++)
+	for(j = 0; j < totpair; j++)
 	{
-		memcpy(to, data[j]->overlap, data[j]->i*sizeof(BVHTreeOverlap));
-		to+=data[j]->i;
+		memcpy(to, data[j].overlap, data[j].i*sizeof(BVHTreeOverlap));
+		to+=data[j].i;
 	}
 	
-	for(j = 0; j < tree1->tree_type; j++)
-	{
-		free(data[j]->overlap);
-		MEM_freeN(data[j]);
-	}
+	for(j = 0; j < totpair; j++)
+		free(data[j].overlap);
 	MEM_freeN(data);
+
+	if(front)
+		MEM_freeN(front);
 	
 	(*result) = total;
 	return overlap;
@@ -0,0 +1,229 @@
+/*
+ * $Id$
+ *
+ * ***** BEGIN GPL LICENSE BLOCK *****
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * The Original Code is: all of this file.
+ *
+ * Contributor(s): none yet.
+ *
+ * ***** END GPL LICENSE BLOCK *****
+ */
+
+/** \file blender/blenlib/intern/BLI_spatialhash.c
+ *  \ingroup bli
+ */
+
+#include <math.h>
+
+#include "MEM_guardedalloc.h"
+
+#include "BLI_math.h"
+#include "BLI_spatialhash.h"
+#include "BLI_utildefines.h"
+
+/* points are linked in a list per bucket, cells of the infinite grid are
+   hashed to a fixed amount of buckets. different cells can end up in the
+   same bucket, queries check the distance of every point anyway */
+
+#define SH_MAX_QUERY_BUCKETS	64
+#define SH_MAX_CELL				(1<<28)
+
+struct SpatialHash {
+	float (*co)[3];
+	int *pointbucket;		/* bucket of the point, -1 if not inserted */
+	int *next, *prev;		/* links of points in a bucket */
+	int *bucket;			/* first point of the bucket, -1 if empty */
+
+	int maxsize, totbucket;
+	float cellsize, invcellsize;
+};
+
+SpatialHash *BLI_spatialhash_new(int maxsize, float cellsize)
+{
+	SpatialHash *hash= MEM_callocN(sizeof(SpatialHash), "SpatialHash");
+	int a;
+
+	hash->maxsize= MAX2(maxsize, 1);
+	hash->cellsize= (cellsize > 0.0f)? cellsize: 1.0f;
+	hash->invcellsize= 1.0f/hash->cellsize;
+
+	/* power of two, about two buckets per point */
+	for(hash->totbucket= 64; hash->totbucket < 2*hash->maxsize; hash->totbucket*= 2);
+
+	hash->co= MEM_mallocN(sizeof(float)*3*hash->maxsize, "SpatialHash co");
+	hash->pointbucket= MEM_mallocN(sizeof(int)*hash->maxsize, "SpatialHash pointbucket");
+	hash->next= MEM_mallocN(sizeof(int)*hash->maxsize, "SpatialHash next");
+	hash->prev= MEM_mallocN(sizeof(int)*hash->maxsize, "SpatialHash prev");
+	hash->bucket= MEM_mallocN(sizeof(int)*hash->totbucket, "SpatialHash bucket");
+
+	for(a=0; a<hash->maxsize; a++)
+		hash->pointbucket[a]= -1;
+	for(a=0; a<hash->totbucket; a++)
+		hash->bucket[a]= -1;
+
+	return hash;
+}
+
+void BLI_spatialhash_free(SpatialHash *hash)
+{
+	if(hash == NULL)
+		return;
+
+	MEM_freeN(hash->co);
+	MEM_freeN(hash->pointbucket);
+	MEM_freeN(hash->next);
+	MEM_freeN(hash->prev);
+	MEM_freeN(hash->bucket);
+	MEM_freeN(hash);
+}
+
+int BLI_spatialhash_maxsize(SpatialHash *hash)
+{
+	return hash->maxsize;
+}
+
+float BLI_spatialhash_cellsize(SpatialHash *hash)
+{
+	return hash->cellsize;
+}
+
+static int spatialhash_cell(SpatialHash *hash, float f)
+{
+	f= floorf(f*hash->invcellsize);
+	CLAMP(f, -SH_MAX_CELL, SH_MAX_CELL);
+
+	return (int)f;
+}
+
+static int spatialhash_bucket(SpatialHash *hash, int x, int y, int z)
+{
+	unsigned int key= ((unsigned int)x*73856093u) ^ ((unsigned int)y*19349663u) ^ ((unsigned int)z*83492791u);
+
+	return (int)(key & (unsigned int)(hash->totbucket - 1));
+}
+
+static void spatialhash_unlink(SpatialHash *hash, int index)
+{
+	int b= hash->pointbucket[index];
+
+	if(hash->prev[index] != -1)
+		hash->next[hash->prev[index]]= hash->next[index];
+	else
+		hash->bucket[b]= hash->next[index];
+
+	if(hash->next[index] != -1)
+		hash->prev[hash->next[index]]= hash->prev[index];
+
+	hash->pointbucket[index]= -1;
+}
+
+void BLI_spatialhash_update(SpatialHash *hash, int index, const float co[3])
+{
+	int b;
+
+	if(index < 0 || index >= hash->maxsize)
+		return;
+
+	copy_v3_v3(hash->co[index], co);
+
+	b= spatialhash_bucket(hash, spatialhash_cell(hash, co[0]), spatialhash_cell(hash, co[1]), spatialhash_cell(hash, co[2]));
+
+	/* still in the same bucket, nothing to relink */
+	if(hash->pointbucket[index] == b)
+		return;
+
+	if(hash->pointbucket[index] != -1)
+		spatialhash_unlink(hash, index);
+
+	hash->pointbucket[index]= b;
+	hash->prev[index]= -1;
+	hash->next[index]= hash->bucket[b];
+	if(hash->bucket[b] != -1)
+		hash->prev[hash->bucket[b]]= index;
+	hash->bucket[b]= index;
+}
+
+void BLI_spatialhash_remove(SpatialHash *hash, int index)
+{
+	if(index < 0 || index >= hash->maxsize)
+		return;
+
+	if(hash->pointbucket[index] != -1)
+		spatialhash_unlink(hash, index);
+}
+
+static int spatialhash_query_bucket(SpatialHash *hash, int b, const float co[3], float radius_sq, SpatialHashRangeCallback callback, void *userdata)
+{
+	float dist_sq;
+	int index, tot= 0;
+
+	for(index= hash->bucket[b]; index != -1; index= hash->next[index]) {
+		dist_sq= len_squared_v3v3(hash->co[index], co);
+
+		if(dist_sq <= radius_sq) {
+			callback(userdata, index, dist_sq);
+			tot++;
+		}
+	}
+
+	return tot;
+}
+
+int BLI_spatialhash_range_query(SpatialHash *hash, const float co[3], float radius, SpatialHashRangeCallback callback, void *userdata)
+{
+	int buckets[SH_MAX_QUERY_BUCKETS];
+	int min[3], max[3], x, y, z, a, b, totcell= 1, totb= 0, tot= 0;
+	float radius_sq= radius*radius;
+
+	for(a=0; a<3; a++) {
+		min[a]= spatialhash_cell(hash, co[a] - radius);
+		max[a]= spatialhash_cell(hash, co[a] + radius);
+
+		if(totcell <= SH_MAX_QUERY_BUCKETS)
+			totcell *= MIN2(max[a] - min[a] + 1, SH_MAX_QUERY_BUCKETS + 1);
+	}
+
+	/* radius much larger than the cells, visit all buckets */
+	if(totcell > SH_MAX_QUERY_BUCKETS) {
+		for(b=0; b<hash->totbucket; b++)
+			tot += spatialhash_query_bucket(hash, b, co, radius_sq, callback, userdata);
+
+		return tot;
+	}
+
+	/* cells can share a bucket, visit each bucket only once */
+	for(z=min[2]; z<=max[2]; z++) {
+		for(y=min[1]; y<=max[1]; y++) {
+			for(x=min[0]; x<=max[0]; x++) {
+				b= spatialhash_bucket(hash, x, y, z);
+
+				for(a=0; a<totb; a++)
+					if(buckets[a] == b)
+						break;
+
+				if(a == totb) {
+					buckets[totb++]= b;
+					tot += spatialhash_query_bucket(hash, b, co, radius_sq, callback, userdata);
+				}
+			}
+		}
+	}
+
+	return tot;
+}
+
@@ -42,6 +42,9 @@
 #include "BLI_blenlib.h"
 #include "BLI_gsqueue.h"
 #include "BLI_threads.h"
+#include "BLI_utildefines.h"
+
+#include "BLO_sys_types.h" // for intptr_t support
 
 #include "PIL_time.h"
 
@@ -114,9 +117,15 @@ static pthread_mutex_t _viewer_lock = PTHREAD_MUTEX_INITIALIZER;
 static pthread_mutex_t _custom1_lock = PTHREAD_MUTEX_INITIALIZER;
 static pthread_mutex_t _rcache_lock = PTHREAD_MUTEX_INITIALIZER;
 static pthread_mutex_t _opengl_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t _thread_levels_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t _budget_lock = PTHREAD_MUTEX_INITIALIZER;
 static pthread_t mainid;
 static int thread_levels= 0;	/* threads can be invoked inside threads */
 
+/* threads using a core besides the main thread, see BLI_thread_budget_acquire */
+static int thread_budget_used= 0;
+static pthread_key_t thread_budget_key;	/* budgets acquired by the calling thread */
+
 /* just a max for security reasons */
 #define RE_MAX_THREAD BLENDER_MAX_THREADS
 
@@ -126,6 +135,7 @@ typedef struct ThreadSlot {
 	void *callerdata;
 	pthread_t pthread;
 	int avail;
+	int budgeted;	/* counted in thread_budget_used while it runs */
 } ThreadSlot;
 
 static void BLI_lock_malloc_thread(void)
@@ -141,6 +151,7 @@ static void BLI_unlock_malloc_thread(void)
 void BLI_threadapi_init(void)
 {
 	mainid = pthread_self();
+	pthread_key_create(&thread_budget_key, NULL);
 }
 
 /* tot = 0 only initializes malloc mutex in a safe way (see sequence.c)
@@ -165,6 +176,9 @@ void BLI_init_threads(ListBase *threadbase, void *(*do_thread)(void *), int tot)
 		}
 	}
 	
+	/* threads may start threads too */
+	pthread_mutex_lock(&_thread_levels_lock);
+
 	if(thread_levels == 0) {
 		MEM_set_lock_callback(BLI_lock_malloc_thread, BLI_unlock_malloc_thread);
 
@@ -177,6 +191,8 @@ void BLI_init_threads(ListBase *threadbase, void *(*do_thread)(void *), int tot)
 	}
 
 	thread_levels++;
+
+	pthread_mutex_unlock(&_thread_levels_lock);
 }
 
 /* amount of available threads */
@@ -208,6 +224,7 @@ int BLI_available_thread_index(ListBase *threadbase)
 static void *tslot_thread_start(void *tslot_p)
 {
 	ThreadSlot *tslot= (ThreadSlot*)tslot_p;
+	void *result;
 
 #if defined(__APPLE__) && (PARALLEL == 1) && (__GNUC__ == 4) && (__GNUC_MINOR__ == 2)
 	/* workaround for Apple gcc 4.2.1 omp vs background thread bug,
@@ -215,7 +232,15 @@ static void *tslot_thread_start(void *tslot_p)
 	pthread_setspecific (gomp_tls_key, thread_tls_data);
 #endif
 
-	return tslot->do_thread(tslot->callerdata);
+	result= tslot->do_thread(tslot->callerdata);
+
+	if(tslot->budgeted) {
+		pthread_mutex_lock(&_budget_lock);
+		thread_budget_used--;
+		pthread_mutex_unlock(&_budget_lock);
+	}
+
+	return result;
 }
 
 int BLI_thread_is_main(void) {
@@ -230,6 +255,15 @@ void BLI_insert_thread(ListBase *threadbase, void *callerdata)
 		if(tslot->avail) {
 			tslot->avail= 0;
 			tslot->callerdata= callerdata;
+
+			/* threads started within an acquired budget are counted there */
+			tslot->budgeted= (pthread_getspecific(thread_budget_key) == NULL);
+			if(tslot->budgeted) {
+				pthread_mutex_lock(&_budget_lock);
+				thread_budget_used++;
+				pthread_mutex_unlock(&_budget_lock);
+			}
+
 			pthread_create(&tslot->pthread, NULL, tslot_thread_start, tslot);
 			return;
 		}
@@ -294,9 +328,61 @@ void BLI_end_threads(ListBase *threadbase)
 		BLI_freelistN(threadbase);
 	}
 
+	pthread_mutex_lock(&_thread_levels_lock);
+
 	thread_levels--;
 	if(thread_levels==0)
 		MEM_set_lock_callback(NULL, NULL);
+
+	pthread_mutex_unlock(&_thread_levels_lock);
+}
+
+/* Thread Budget */
+
+/* the main thread is not counted, it waits for or only draws while
+   other threads work. any other thread already uses a core, the threads it
+   starts while it waits for them can use that one too */
+static int thread_budget_own(void)
+{
+	return BLI_thread_is_main()? 0: 1;
+}
+
+int BLI_thread_budget_acquire(int max)
+{
+	intptr_t depth;
+	int tot;
+
+	pthread_mutex_lock(&_budget_lock);
+
+	tot= BLI_system_thread_count() - thread_budget_used + thread_budget_own();
+	CLAMP(tot, 1, max);
+	thread_budget_used += tot - thread_budget_own();
+
+	pthread_mutex_unlock(&_budget_lock);
+
+	depth= (intptr_t)pthread_getspecific(thread_budget_key);
+	pthread_setspecific(thread_budget_key, (void*)(depth + 1));
+
+	return tot;
+}
+
+void BLI_thread_budget_release(int tot)
+{
+	intptr_t depth;
+
+	pthread_mutex_lock(&_budget_lock);
+	thread_budget_used -= tot - thread_budget_own();
+	pthread_mutex_unlock(&_budget_lock);
+
+	depth= (intptr_t)pthread_getspecific(thread_budget_key);
+	pthread_setspecific(thread_budget_key, (void*)(depth - 1));
+}
+
+void BLI_thread_budget_add(int tot)
+{
+	pthread_mutex_lock(&_budget_lock);
+	thread_budget_used += tot;
+	pthread_mutex_unlock(&_budget_lock);
 }
 
 /* System Information */
@@ -3360,6 +3360,7 @@ static void direct_link_particlesystems(FileData *fd, ListBase *particles)
 		psys->pathcachebufs.first = psys->pathcachebufs.last = NULL;
 		psys->childcachebufs.first = psys->childcachebufs.last = NULL;
 		psys->frand = NULL;
+		psys->childcachesum = NULL;
 		psys->pdd = NULL;
 		psys->renderdata = NULL;
 		
@@ -3384,7 +3385,7 @@ static void direct_link_particlesystems(FileData *fd, ListBase *particles)
 		}
 
 		psys->tree = NULL;
-		psys->bvhtree = NULL;
+		psys->spatialhash = NULL;
 	}
 	return;
 }
@@ -3554,6 +3555,7 @@ static void direct_link_mesh(FileData *fd, Mesh *mesh)
 	mesh->bb= NULL;
 	mesh->mselect = NULL;
 	mesh->edit_mesh= NULL;
+	mesh->cornermap= NULL;
 	
 	/* Multires data */
 	mesh->mr= newdataadr(fd, mesh->mr);
@@ -853,6 +853,7 @@ static uiLayout *draw_modifier(uiLayout *layout, Scene *scene, Object *ob, Modif
 
 uiLayout *uiTemplateModifier(uiLayout *layout, bContext *C, PointerRNA *ptr)
 {
+	VirtualModifierData virtualModifierData;
 	Scene *scene = CTX_data_scene(C);
 	Object *ob;
 	ModifierData *md, *vmd;
@@ -878,7 +879,7 @@ uiLayout *uiTemplateModifier(uiLayout *layout, bContext *C, PointerRNA *ptr)
 	cageIndex = modifiers_getCageIndex(scene, ob, &lastCageIndex, 0);
 
 	// XXX virtual modifiers are not accesible for python
-	vmd = modifiers_getVirtualModifierList(ob);
+	vmd = modifiers_getVirtualModifierList(ob, &virtualModifierData);
 
 	for(i=0; vmd; i++, vmd=vmd->next) {
 		if(md == vmd)
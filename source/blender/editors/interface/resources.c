@@ -1572,6 +1572,11 @@ void init_userdef_do_versions(void)
 	if (U.memcachelimit <= 0) {
 		U.memcachelimit = 32;
 	}
+	if (U.seqcache_raw == 0 && U.seqcache_preprocess == 0 && U.seqcache_composite == 0) {
+		U.seqcache_raw = 10;
+		U.seqcache_preprocess = 40;
+		U.seqcache_composite = 50;
+	}
 	if (U.frameserverport == 0) {
 		U.frameserverport = 8080;
 	}
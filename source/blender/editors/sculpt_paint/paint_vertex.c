@@ -1231,6 +1231,7 @@ struct WPaintData {
 
 static char *wpaint_make_validmap(Object *ob)
 {
+	VirtualModifierData virtualModifierData;
 	bDeformGroup *dg;
 	ModifierData *md;
 	char *validmap;
@@ -1251,7 +1252,7 @@ static char *wpaint_make_validmap(Object *ob)
 	validmap = MEM_callocN(i, "wpaint valid map");
 
 	/*now loop through the armature modifiers and identify deform bones*/
-	for (md = ob->modifiers.first; md; md= !md->next && step1 ? (step1=0), modifiers_getVirtualModifierList(ob) : md->next) {
+	for (md = ob->modifiers.first; md; md= !md->next && step1 ? (step1=0), modifiers_getVirtualModifierList(ob, &virtualModifierData) : md->next) {
 		if (!(md->mode & (eModifierMode_Realtime|eModifierMode_Virtual)))
 			continue;
 
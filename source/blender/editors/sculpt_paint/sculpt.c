@@ -132,6 +132,7 @@ void ED_sculpt_modifiers_changed(Object *ob)
    it's the last modifier on the stack and it is not on the first level */
 struct MultiresModifierData *sculpt_multires_active(Scene *scene, Object *ob)
 {
+	VirtualModifierData virtualModifierData;
 	Mesh *me= (Mesh*)ob->data;
 	ModifierData *md;
 
@@ -140,7 +141,7 @@ struct MultiresModifierData *sculpt_multires_active(Scene *scene, Object *ob)
 		return NULL;
 	}
 
-	for(md= modifiers_getVirtualModifierList(ob); md; md= md->next) {
+	for(md= modifiers_getVirtualModifierList(ob, &virtualModifierData); md; md= md->next) {
 		if(md->type == eModifierType_Multires) {
 			MultiresModifierData *mmd= (MultiresModifierData*)md;
 
@@ -158,9 +159,10 @@ struct MultiresModifierData *sculpt_multires_active(Scene *scene, Object *ob)
 /* Check if there are any active modifiers in stack (used for flushing updates at enter/exit sculpt mode) */
 static int sculpt_has_active_modifiers(Scene *scene, Object *ob)
 {
+	VirtualModifierData virtualModifierData;
 	ModifierData *md;
 
-	md= modifiers_getVirtualModifierList(ob);
+	md= modifiers_getVirtualModifierList(ob, &virtualModifierData);
 
 	/* exception for shape keys because we can edit those */
 	for(; md; md= md->next) {
@@ -174,6 +176,7 @@ static int sculpt_has_active_modifiers(Scene *scene, Object *ob)
 /* Checks if there are any supported deformation modifiers active */
 static int sculpt_modifiers_active(Scene *scene, Sculpt *sd, Object *ob)
 {
+	VirtualModifierData virtualModifierData;
 	ModifierData *md;
 	Mesh *me= (Mesh*)ob->data;
 	MultiresModifierData *mmd= sculpt_multires_active(scene, ob);
@@ -184,7 +187,7 @@ static int sculpt_modifiers_active(Scene *scene, Sculpt *sd, Object *ob)
 	if((ob->shapeflag&OB_SHAPE_LOCK)==0 && me->key && ob->shapenr)
 		return 1;
 
-	md= modifiers_getVirtualModifierList(ob);
+	md= modifiers_getVirtualModifierList(ob, &virtualModifierData);
 
 	/* exception for shape keys because we can edit those */
 	for(; md; md= md->next) {
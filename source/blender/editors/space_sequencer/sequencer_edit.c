@@ -932,6 +932,8 @@ static int sequencer_snap_exec(bContext *C, wmOperator *op)
 	Sequence *seq;
 	int snap_frame;
 
+	seq_prefetch_cancel();
+
 	snap_frame= RNA_int_get(op->ptr, "frame");
 
 	/* also check metas */
@@ -1020,6 +1022,8 @@ static int sequencer_mute_exec(bContext *C, wmOperator *op)
 	Sequence *seq;
 	int selected;
 
+	seq_prefetch_cancel();
+
 	selected= !RNA_boolean_get(op->ptr, "unselected");
 	
 	for(seq= ed->seqbasep->first; seq; seq= seq->next) {
@@ -1067,6 +1071,8 @@ static int sequencer_unmute_exec(bContext *C, wmOperator *op)
 	Sequence *seq;
 	int selected;
 
+	seq_prefetch_cancel();
+
 	selected= !RNA_boolean_get(op->ptr, "unselected");
 	
 	for(seq= ed->seqbasep->first; seq; seq= seq->next) {
@@ -1179,6 +1185,8 @@ static int sequencer_reload_exec(bContext *C, wmOperator *UNUSED(op))
 	Editing *ed= seq_give_editing(scene, FALSE);
 	Sequence *seq;
 
+	seq_prefetch_cancel();
+
 	for(seq= ed->seqbasep->first; seq; seq= seq->next) {
 		if(seq->flag & SELECT) {
 			update_changed_seq_and_deps(scene, seq, 0, 1);
@@ -1211,6 +1219,8 @@ static int sequencer_refresh_all_exec(bContext *C, wmOperator *UNUSED(op))
 	Scene *scene= CTX_data_scene(C);
 	Editing *ed= seq_give_editing(scene, FALSE);
 
+	seq_prefetch_cancel();
+
 	free_imbuf_seq(scene, &ed->seqbase, FALSE, FALSE);
 
 	WM_event_add_notifier(C, NC_SCENE|ND_SEQUENCER, scene);
@@ -1236,6 +1246,8 @@ static int sequencer_reassign_inputs_exec(bContext *C, wmOperator *op)
 	Sequence *seq1, *seq2, *seq3, *last_seq = seq_active_get(scene);
 	const char *error_msg;
 
+	seq_prefetch_cancel();
+
 	if(!seq_effect_find_selected(scene, last_seq, last_seq->type, &seq1, &seq2, &seq3, &error_msg)) {
 		BKE_report(op->reports, RPT_ERROR, error_msg);
 		return OPERATOR_CANCELLED;
@@ -1296,6 +1308,8 @@ static int sequencer_swap_inputs_exec(bContext *C, wmOperator *op)
 	Scene *scene= CTX_data_scene(C);
 	Sequence *seq, *last_seq = seq_active_get(scene);
 
+	seq_prefetch_cancel();
+
 	if(last_seq->seq1==NULL || last_seq->seq2 == NULL) {
 		BKE_report(op->reports, RPT_ERROR, "No valid inputs to swap");
 		return OPERATOR_CANCELLED;
@@ -1343,6 +1357,8 @@ static int sequencer_cut_exec(bContext *C, wmOperator *op)
 	ListBase newlist;
 	int changed;
 
+	seq_prefetch_cancel();
+
 	cut_frame= RNA_int_get(op->ptr, "frame");
 	cut_hard= RNA_enum_get(op->ptr, "type");
 	cut_side= RNA_enum_get(op->ptr, "side");
@@ -1442,6 +1458,8 @@ static int sequencer_add_duplicate_exec(bContext *C, wmOperator *UNUSED(op))
 
 	ListBase nseqbase= {NULL, NULL};
 
+	seq_prefetch_cancel();
+
 	if(ed==NULL)
 		return OPERATOR_CANCELLED;
 
@@ -1500,6 +1518,8 @@ static int sequencer_delete_exec(bContext *C, wmOperator *UNUSED(op))
 	MetaStack *ms;
 	int nothingSelected = TRUE;
 
+	seq_prefetch_cancel();
+
 	seq=seq_active_get(scene);
 	if (seq && seq->flag & SELECT) { /* avoid a loop since this is likely to be selected */
 		nothingSelected = FALSE;
@@ -1569,6 +1589,8 @@ static int sequencer_offset_clear_exec(bContext *C, wmOperator *UNUSED(op))
 	Editing *ed= seq_give_editing(scene, FALSE);
 	Sequence *seq;
 
+	seq_prefetch_cancel();
+
 	/* for effects, try to find a replacement input */
 	for(seq=ed->seqbasep->first; seq; seq=seq->next) {
 		if((seq->type & SEQ_EFFECT)==0 && (seq->flag & SELECT)) {
@@ -1626,6 +1648,8 @@ static int sequencer_separate_images_exec(bContext *C, wmOperator *op)
 	int start_ofs, cfra, frame_end;
 	int step= RNA_int_get(op->ptr, "length");
 
+	seq_prefetch_cancel();
+
 	seq= ed->seqbasep->first; /* poll checks this is valid */
 
 	while (seq) {
@@ -1718,6 +1742,8 @@ static int sequencer_meta_toggle_exec(bContext *C, wmOperator *UNUSED(op))
 	Sequence *last_seq= seq_active_get(scene);
 	MetaStack *ms;
 
+	seq_prefetch_cancel();
+
 	if(last_seq && last_seq->type==SEQ_META && last_seq->flag & SELECT) {
 		/* Enter Metastrip */
 		ms= MEM_mallocN(sizeof(MetaStack), "metastack");
@@ -1787,6 +1813,8 @@ static int sequencer_meta_make_exec(bContext *C, wmOperator *op)
 	Sequence *seq, *seqm, *next, *last_seq = seq_active_get(scene);
 	int channel_max= 1;
 
+	seq_prefetch_cancel();
+
 	if(seqbase_isolated_sel_check(ed->seqbasep)==FALSE) {
 		BKE_report(op->reports, RPT_ERROR, "Please select all related strips");
 		return OPERATOR_CANCELLED;
@@ -1863,6 +1891,8 @@ static int sequencer_meta_separate_exec(bContext *C, wmOperator *UNUSED(op))
 
 	Sequence *seq, *last_seq = seq_active_get(scene); /* last_seq checks ed==NULL */
 
+	seq_prefetch_cancel();
+
 	if(last_seq==NULL || last_seq->type!=SEQ_META)
 		return OPERATOR_CANCELLED;
 
@@ -2322,6 +2352,8 @@ static int sequencer_swap_exec(bContext *C, wmOperator *op)
 	Sequence *seq, *iseq;
 	int side= RNA_enum_get(op->ptr, "side");
 
+	seq_prefetch_cancel();
+
 	if(active_seq==NULL) return OPERATOR_CANCELLED;
 
 	seq = find_next_prev_sequence(scene, active_seq, side, -1);
@@ -2400,6 +2432,7 @@ static int sequencer_rendersize_exec(bContext *C, wmOperator *UNUSED(op))
 	if(active_seq==NULL)
 		return OPERATOR_CANCELLED;
 
+	seq_prefetch_cancel();
 
 	if (active_seq->strip) {
 		switch (active_seq->type) {
@@ -2535,6 +2568,8 @@ static int sequencer_paste_exec(bContext *C, wmOperator *UNUSED(op))
 	int ofs;
 	Sequence *iseq;
 
+	seq_prefetch_cancel();
+
 	deselect_all_seq(scene);
 	ofs = scene->r.cfra - seqbase_clipboard_frame;
 
@@ -2585,6 +2620,8 @@ static int sequencer_swap_data_exec(bContext *C, wmOperator *op)
 	Sequence *seq_other;
 	const char *error_msg;
 
+	seq_prefetch_cancel();
+
 	if(seq_active_pair_get(scene, &seq_act, &seq_other) == 0) {
 		BKE_report(op->reports, RPT_ERROR, "Must select 2 strips");
 		return OPERATOR_CANCELLED;
@@ -2708,6 +2745,8 @@ static int sequencer_change_effect_input_exec(bContext *C, wmOperator *op)
 
 	Sequence **seq_1, **seq_2;
 
+	seq_prefetch_cancel();
+
 	switch(RNA_enum_get(op->ptr, "swap")) {
 		case 0:
 			seq_1= &seq->seq1;
@@ -2768,6 +2807,8 @@ static int sequencer_change_effect_type_exec(bContext *C, wmOperator *op)
 	/* free previous effect and init new effect */
 	struct SeqEffectHandle sh;
 
+	seq_prefetch_cancel();
+
 	if ((seq->type & SEQ_EFFECT) == 0) {
 		return OPERATOR_CANCELLED;
 	}
@@ -2824,6 +2865,8 @@ static int sequencer_change_path_exec(bContext *C, wmOperator *op)
 	Editing *ed= seq_give_editing(scene, FALSE);
 	Sequence *seq= seq_active_get(scene);
 
+	seq_prefetch_cancel();
+
 	if(seq->type == SEQ_IMAGE) {
 		char directory[FILE_MAX];
 		const int len= RNA_property_collection_length(op->ptr, RNA_struct_find_property(op->ptr, "files"));
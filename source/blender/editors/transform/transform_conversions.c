@@ -2208,6 +2208,9 @@ void flushTransSeq(TransInfo *t)
 	 * but so will TransDataSeq */
 	Sequence *seq_prev= NULL;
 
+	/* prefetch threads may be rendering the strips that move */
+	seq_prefetch_cancel();
+
 	/* flush to 2d vector from internally used 3d vector */
 	for(a=0, td= t->data, td2d= t->data2d; a<t->total; a++, td++, td2d++) {
 		tdsq= (TransDataSeq *)td->extra;
@@ -3974,6 +3977,8 @@ static void freeSeqData(TransInfo *t)
 		Sequence *seq_prev= NULL;
 		Sequence *seq;
 
+		seq_prefetch_cancel();
+
 
 		if (!(t->state == TRANS_CANCEL)) {
 
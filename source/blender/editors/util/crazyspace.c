@@ -271,6 +271,7 @@ void crazyspace_set_quats_mesh(Mesh *me, float *origcos, float *mappedcos, float
 
 int editmesh_get_first_deform_matrices(Scene *scene, Object *ob, EditMesh *em, float (**deformmats)[3][3], float (**deformcos)[3])
 {
+	VirtualModifierData virtualModifierData;
 	ModifierData *md;
 	DerivedMesh *dm;
 	int i, a, numleft = 0, numVerts = 0;
@@ -280,7 +281,7 @@ int editmesh_get_first_deform_matrices(Scene *scene, Object *ob, EditMesh *em, f
 	modifiers_clearErrors(ob);
 
 	dm = NULL;
-	md = modifiers_getVirtualModifierList(ob);
+	md = modifiers_getVirtualModifierList(ob, &virtualModifierData);
 
 	/* compute the deformation matrices and coordinates for the first
 	   modifiers with on cage editing that are enabled and support computing
@@ -323,6 +324,7 @@ int editmesh_get_first_deform_matrices(Scene *scene, Object *ob, EditMesh *em, f
 
 int sculpt_get_first_deform_matrices(Scene *scene, Object *ob, float (**deformmats)[3][3], float (**deformcos)[3])
 {
+	VirtualModifierData virtualModifierData;
 	ModifierData *md;
 	DerivedMesh *dm;
 	int a, numVerts= 0;
@@ -338,7 +340,7 @@ int sculpt_get_first_deform_matrices(Scene *scene, Object *ob, float (**deformma
 	}
 
 	dm= NULL;
-	md= modifiers_getVirtualModifierList(ob);
+	md= modifiers_getVirtualModifierList(ob, &virtualModifierData);
 
 	for(; md; md= md->next) {
 		ModifierTypeInfo *mti= modifierType_getInfo(md->type);
@@ -384,6 +386,7 @@ void crazyspace_build_sculpt(Scene *scene, Object *ob, float (**deformmats)[3][3
 	int totleft= sculpt_get_first_deform_matrices(scene, ob, deformmats, deformcos);
 
 	if(totleft) {
+		VirtualModifierData virtualModifierData;
 		/* there are deformation modifier which doesn't support deformation matricies
 		   calculation. Need additional crazyspace correction */
 
@@ -391,7 +394,7 @@ void crazyspace_build_sculpt(Scene *scene, Object *ob, float (**deformmats)[3][3
 		float (*origVerts)[3]= MEM_dupallocN(deformedVerts);
 		float *quats= NULL;
 		int i, deformed= 0;
-		ModifierData *md= modifiers_getVirtualModifierList(ob);
+		ModifierData *md= modifiers_getVirtualModifierList(ob, &virtualModifierData);
 		Mesh *me= (Mesh*)ob->data;
 
 		for(; md; md= md->next) {
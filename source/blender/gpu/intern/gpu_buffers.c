@@ -94,6 +94,9 @@ typedef struct GPUBufferPool {
 } GPUBufferPool;
 #define MAX_FREE_GPU_BUFFERS 8
 
+/* objects can be updated in threads, which free buffers too */
+static ThreadMutex buffer_mutex = PTHREAD_MUTEX_INITIALIZER;
+
 /* create a new GPUBufferPool */
 static GPUBufferPool *gpu_buffer_pool_new(void)
 {
@@ -181,13 +184,14 @@ static GPUBufferPool *gpu_get_global_buffer_pool(void)
 
 void GPU_global_buffer_pool_free(void)
 {
+	BLI_mutex_lock(&buffer_mutex);
 	gpu_buffer_pool_free(gpu_buffer_pool);
 	gpu_buffer_pool = NULL;
+	BLI_mutex_unlock(&buffer_mutex);
 }
 
-/* get a GPUBuffer of at least `size' bytes; uses one from the buffer
-   pool if possible, otherwise creates a new one */
-GPUBuffer *GPU_buffer_alloc(int size)
+/* buffer_mutex must be held */
+static GPUBuffer *gpu_buffer_alloc(int size)
 {
 	GPUBufferPool *pool;
 	GPUBuffer *buf;
@@ -261,10 +265,21 @@ GPUBuffer *GPU_buffer_alloc(int size)
 	return buf;
 }
 
-/* release a GPUBuffer; does not free the actual buffer or its data,
-   but rather moves it to the pool of recently-free'd buffers for
-   possible re-use*/
-void GPU_buffer_free(GPUBuffer *buffer)
+/* get a GPUBuffer of at least `size' bytes; uses one from the buffer
+   pool if possible, otherwise creates a new one */
+GPUBuffer *GPU_buffer_alloc(int size)
+{
+	GPUBuffer *buf;
+
+	BLI_mutex_lock(&buffer_mutex);
+	buf = gpu_buffer_alloc(size);
+	BLI_mutex_unlock(&buffer_mutex);
+
+	return buf;
+}
+
+/* buffer_mutex must be held */
+static void gpu_buffer_free(GPUBuffer *buffer)
 {
 	GPUBufferPool *pool;
 	int i;
@@ -303,6 +318,16 @@ void GPU_buffer_free(GPUBuffer *buffer)
 	pool->totbuf++;
 }
 
+/* release a GPUBuffer; does not free the actual buffer or its data,
+   but rather moves it to the pool of recently-free'd buffers for
+   possible re-use*/
+void GPU_buffer_free(GPUBuffer *buffer)
+{
+	BLI_mutex_lock(&buffer_mutex);
+	gpu_buffer_free(buffer);
+	BLI_mutex_unlock(&buffer_mutex);
+}
+
 typedef struct GPUVertPointLink {
 	struct GPUVertPointLink *next;
 	/* -1 means uninitialized */
@@ -518,7 +543,8 @@ static GPUBuffer *gpu_buffer_setup(DerivedMesh *dm, GPUDrawObject *object,
 			/* attempt to map the buffer */
 			if(!(varray = glMapBufferARB(target, GL_WRITE_ONLY_ARB))) {
 				/* failed to map the buffer; delete it */
-				GPU_buffer_free(buffer);
+				BLI_mutex_lock(&buffer_mutex);
+				gpu_buffer_free(buffer);
 				gpu_buffer_pool_delete_last(pool);
 				buffer= NULL;
 
@@ -526,8 +552,9 @@ static GPUBuffer *gpu_buffer_setup(DerivedMesh *dm, GPUDrawObject *object,
 				   and reallocating the buffer */
 				if(pool->totbuf > 0) {
 					gpu_buffer_pool_delete_last(pool);
-					buffer = GPU_buffer_alloc(size);
+					buffer = gpu_buffer_alloc(size);
 				}
+				BLI_mutex_unlock(&buffer_mutex);
 
 				/* allocation still failed; fall back
 				   to legacy mode */
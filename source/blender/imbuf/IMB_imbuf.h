@@ -265,6 +265,7 @@ struct ImBuf *IMB_getmipmap(struct ImBuf *ibuf, int level);
 void IMB_tile_cache_params(int totthread, int maxmem);
 unsigned int *IMB_gettile(struct ImBuf *ibuf, int tx, int ty, int thread);
 void IMB_tiles_to_rect(struct ImBuf *ibuf);
+void IMB_tile_cache_stats(struct ImBuf *ibuf, double *hits, double *loads);
 
 /**
  *
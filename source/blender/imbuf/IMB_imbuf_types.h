@@ -128,6 +128,9 @@ typedef struct ImBuf {
 	unsigned char *encodedbuffer;     /* Compressed image only used with png currently */
 	unsigned int   encodedsize;       /* Size of data written to encodedbuffer */
 	unsigned int   encodedbuffersize; /* Size of encodedbuffer */
+
+	/* tile cache statistics, see IMB_tile_cache_stats */
+	double tilehits, tileloads;
 } ImBuf;
 
 /* Moved from BKE_bmfont_types.h because it is a userflag bit mask. */
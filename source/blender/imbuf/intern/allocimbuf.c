@@ -51,6 +51,11 @@
 #include "MEM_CacheLimiterC-Api.h"
 #include "MEM_guardedalloc.h"
 
+#include "BLI_threads.h"
+
+/* caches share imbufs between threads, reference counting has to be atomic */
+static ThreadMutex refcounter_lock = PTHREAD_MUTEX_INITIALIZER;
+
 void imb_freemipmapImBuf(ImBuf *ibuf)
 {
 	int a;
@@ -155,10 +160,18 @@ void IMB_freezbuffloatImBuf(ImBuf *ibuf)
 void IMB_freeImBuf(ImBuf *ibuf)
 {
 	if(ibuf) {
+		int needfree;
+
+		BLI_mutex_lock(&refcounter_lock);
 		if(ibuf->refcounter > 0) {
 			ibuf->refcounter--;
+			needfree= 0;
 		}
-		else {
+		else
+			needfree= 1;
+		BLI_mutex_unlock(&refcounter_lock);
+
+		if(needfree) {
 			imb_freerectImBuf(ibuf);
 			imb_freerectfloatImBuf(ibuf);
 			imb_freetilesImBuf(ibuf);
@@ -174,7 +187,9 @@ void IMB_freeImBuf(ImBuf *ibuf)
 
 void IMB_refImBuf(ImBuf *ibuf)
 {
+	BLI_mutex_lock(&refcounter_lock);
 	ibuf->refcounter++;
+	BLI_mutex_unlock(&refcounter_lock);
 }
 
 short addzbufImBuf(ImBuf *ibuf)
@@ -451,12 +466,25 @@ static void imbuf_cache_destructor(void *data)
 	ibuf->c_handle = NULL;
 }
 
+static size_t imbuf_cache_data_size(void *data)
+{
+	ImBuf *ibuf = (ImBuf*) data;
+	size_t size = 0;
+
+	if(ibuf->rect)
+		size += sizeof(unsigned int)*ibuf->x*ibuf->y;
+	if(ibuf->rect_float)
+		size += sizeof(float)*ibuf->channels*ibuf->x*ibuf->y;
+
+	return size;
+}
+
 static MEM_CacheLimiterC **get_imbuf_cache_limiter(void)
 {
 	static MEM_CacheLimiterC *c = NULL;
 
 	if(!c)
-		c = new_MEM_CacheLimiter(imbuf_cache_destructor);
+		c = new_MEM_CacheLimiter(imbuf_cache_destructor, imbuf_cache_data_size);
 
 	return &c;
 }
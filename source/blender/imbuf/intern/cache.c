@@ -48,7 +48,15 @@
    
    The per-thread cache should be big enough that one might hope to not fall
    back to the global cache every pixel, but not to big to keep too many tiles
-   locked and using memory. */
+   locked and using memory.
+
+   The global cache is kept in least recently used order, when the memory
+   limit is hit the least recently used tile that no thread holds is unloaded.
+   Hits and loads are counted per ImBuf, hits in the per-thread cache are
+   counted in the thread tile and only added to the global tile when the tile
+   leaves the thread cache, to avoid locking. The global tile adds them to the
+   ImBuf when it is unloaded or freed, so thread caches never touch an ImBuf
+   through a tile they no longer hold. */
 
 #define IB_THREAD_CACHE_SIZE	100
 
@@ -59,6 +67,8 @@ typedef struct ImGlobalTile {
 	int tx, ty;
 	int refcount;
 	volatile int loading;
+
+	double hits;	/* thread cache hits, not added to the ImBuf yet */
 } ImGlobalTile;
 
 typedef struct ImThreadTile {
@@ -68,6 +78,7 @@ typedef struct ImThreadTile {
 	int tx, ty;
 
 	ImGlobalTile *global;
+	double hits;
 } ImThreadTile;
 
 typedef struct ImThreadTileCache {
@@ -151,10 +162,39 @@ static void imb_global_cache_tile_unload(ImGlobalTile *gtile)
 	MEM_freeN(ibuf->tiles[toffs]);
 	ibuf->tiles[toffs]= NULL;
 
+	ibuf->tilehits += gtile->hits;
+	gtile->hits= 0.0;
+
 	GLOBAL_CACHE.totmem -= sizeof(unsigned int)*ibuf->tilex*ibuf->tiley;
 }
 
-/* external free */
+/* drop thread cache tiles that still hold a freed tile, so they are not
+   replaced later through a global tile that may be reused by then */
+static void imb_thread_caches_remove_tile(ImGlobalTile *gtile)
+{
+	ImThreadTileCache *cache;
+	ImThreadTile *ttile, *tnext;
+	int a;
+
+	for(a=0; a<GLOBAL_CACHE.totthread; a++) {
+		cache= &GLOBAL_CACHE.thread_cache[a];
+
+		for(ttile=cache->tiles.first; ttile; ttile=tnext) {
+			tnext= ttile->next;
+
+			if(ttile->global == gtile) {
+				gtile->hits += ttile->hits;
+				gtile->refcount--;
+
+				BLI_ghash_remove(cache->tilehash, ttile, NULL, NULL);
+				BLI_remlink(&cache->tiles, ttile);
+				BLI_addtail(&cache->unused, ttile);
+			}
+		}
+	}
+}
+
+/* external free, presumed to be called when no threads are running */
 void imb_tile_cache_tile_free(ImBuf *ibuf, int tx, int ty)
 {
 	ImGlobalTile *gtile, lookuptile;
@@ -171,9 +211,17 @@ void imb_tile_cache_tile_free(ImBuf *ibuf, int tx, int ty)
 		while(gtile->loading)
 			;
 
+		imb_thread_caches_remove_tile(gtile);
+
+		ibuf->tilehits += gtile->hits;
+		gtile->hits= 0.0;
+
 		BLI_ghash_remove(GLOBAL_CACHE.tilehash, gtile, NULL, NULL);
 		BLI_remlink(&GLOBAL_CACHE.tiles, gtile);
 		BLI_addtail(&GLOBAL_CACHE.unused, gtile);
+
+		/* tile memory itself is freed by the caller */
+		GLOBAL_CACHE.totmem -= sizeof(unsigned int)*ibuf->tilex*ibuf->tiley;
 	}
 
 	BLI_mutex_unlock(&GLOBAL_CACHE.mutex);
@@ -271,14 +319,16 @@ void IMB_tile_cache_params(int totthread, int maxmem)
 
 /***************************** Global Cache **********************************/
 
-static ImGlobalTile *imb_global_cache_get_tile(ImBuf *ibuf, int tx, int ty, ImGlobalTile *replacetile)
+static ImGlobalTile *imb_global_cache_get_tile(ImBuf *ibuf, int tx, int ty, ImGlobalTile *replacetile, double replacehits)
 {
 	ImGlobalTile *gtile, lookuptile;
 
 	BLI_mutex_lock(&GLOBAL_CACHE.mutex);
 
-	if(replacetile)
+	if(replacetile) {
 		replacetile->refcount--;
+		replacetile->hits += replacehits;
+	}
 
 	/* find tile in global cache */
 	lookuptile.ibuf = ibuf;
@@ -291,6 +341,11 @@ static ImGlobalTile *imb_global_cache_get_tile(ImBuf *ibuf, int tx, int ty, ImGl
 		   by another thread, in that case we do stupid busy loop waiting
 		   for the other thread to load the tile */
 		gtile->refcount++;
+		ibuf->tilehits++;
+
+		/* keep least recently used tiles at the end */
+		BLI_remlink(&GLOBAL_CACHE.tiles, gtile);
+		BLI_addhead(&GLOBAL_CACHE.tiles, gtile);
 
 		BLI_mutex_unlock(&GLOBAL_CACHE.mutex);
 
@@ -330,12 +385,14 @@ static ImGlobalTile *imb_global_cache_get_tile(ImBuf *ibuf, int tx, int ty, ImGl
 		gtile->ty= ty;
 		gtile->refcount= 1;
 		gtile->loading= 1;
+		gtile->hits= 0.0;
 
 		BLI_ghash_insert(GLOBAL_CACHE.tilehash, gtile, gtile);
 		BLI_addhead(&GLOBAL_CACHE.tiles, gtile);
 
 		/* mark as being loaded and unlock to allow other threads to load too */
 		GLOBAL_CACHE.totmem += sizeof(unsigned int)*ibuf->tilex*ibuf->tiley;
+		ibuf->tileloads++;
 
 		BLI_mutex_unlock(&GLOBAL_CACHE.mutex);
 
@@ -355,13 +412,16 @@ static unsigned int *imb_thread_cache_get_tile(ImThreadTileCache *cache, ImBuf *
 {
 	ImThreadTile *ttile, lookuptile;
 	ImGlobalTile *gtile, *replacetile;
+	double replacehits;
 	int toffs= ibuf->xtiles*ty + tx;
 
 	/* test if it is already in our thread local cache */
 	if((ttile=cache->tiles.first)) {
 		/* check last used tile before going to hash */
-		if(ttile->ibuf == ibuf && ttile->tx == tx && ttile->ty == ty)
+		if(ttile->ibuf == ibuf && ttile->tx == tx && ttile->ty == ty) {
+			ttile->hits++;
 			return ibuf->tiles[toffs];
+		}
 
 		/* find tile in hash */
 		lookuptile.ibuf = ibuf;
@@ -371,6 +431,7 @@ static unsigned int *imb_thread_cache_get_tile(ImThreadTileCache *cache, ImBuf *
 		if((ttile=BLI_ghash_lookup(cache->tilehash, &lookuptile))) {
 			BLI_remlink(&cache->tiles, ttile);
 			BLI_addhead(&cache->tiles, ttile);
+			ttile->hits++;
 
 			return ibuf->tiles[toffs];
 		}
@@ -380,24 +441,27 @@ static unsigned int *imb_thread_cache_get_tile(ImThreadTileCache *cache, ImBuf *
 	if(cache->unused.first == NULL) {
 		ttile= cache->tiles.last;
 		replacetile= ttile->global;
+		replacehits= ttile->hits;
 		BLI_remlink(&cache->tiles, ttile);
 		BLI_ghash_remove(cache->tilehash, ttile, NULL, NULL);
 	}
 	else {
 		ttile= cache->unused.first;
 		replacetile= NULL;
+		replacehits= 0.0;
 		BLI_remlink(&cache->unused, ttile);
 	}
 
 	BLI_addhead(&cache->tiles, ttile);
 	BLI_ghash_insert(cache->tilehash, ttile, ttile);
 
-	gtile= imb_global_cache_get_tile(ibuf, tx, ty, replacetile);
+	gtile= imb_global_cache_get_tile(ibuf, tx, ty, replacetile, replacehits);
 
 	ttile->ibuf= gtile->ibuf;
 	ttile->tx= gtile->tx;
 	ttile->ty= gtile->ty;
 	ttile->global= gtile;
+	ttile->hits= 0.0;
 
 	return ibuf->tiles[toffs];
 }
@@ -431,7 +495,7 @@ void IMB_tiles_to_rect(ImBuf *ibuf)
 			for(tx=0; tx<mipbuf->xtiles; tx++) {
 				/* acquire tile through cache, this assumes cache is initialized,
 				   which it is always now but it's a weak assumption ... */
-				gtile= imb_global_cache_get_tile(mipbuf, tx, ty, NULL);
+				gtile= imb_global_cache_get_tile(mipbuf, tx, ty, NULL, 0.0);
 
 				/* setup pointers */
 				from= mipbuf->tiles[mipbuf->xtiles*ty + tx];
@@ -456,3 +520,34 @@ void IMB_tiles_to_rect(ImBuf *ibuf)
 	}
 }
 
+/* presumed to be called when no threads are running, sums the statistics of
+   the image and its mipmap levels, including hits not added to the ImBuf yet */
+void IMB_tile_cache_stats(ImBuf *ibuf, double *hits, double *loads)
+{
+	ImGlobalTile *gtile;
+	ImThreadTile *ttile;
+	ImBuf *mipbuf;
+	int a, b;
+
+	*hits= 0.0;
+	*loads= 0.0;
+
+	for(a=0; a<=IB_MIPMAP_LEVELS; a++) {
+		mipbuf= (a == 0)? ibuf: ibuf->mipmap[a-1];
+		if(mipbuf == NULL)
+			continue;
+
+		*hits += mipbuf->tilehits;
+		*loads += mipbuf->tileloads;
+
+		for(gtile=GLOBAL_CACHE.tiles.first; gtile; gtile=gtile->next)
+			if(gtile->ibuf == mipbuf)
+				*hits += gtile->hits;
+
+		for(b=0; b<GLOBAL_CACHE.totthread; b++)
+			for(ttile=GLOBAL_CACHE.thread_cache[b].tiles.first; ttile; ttile=ttile->next)
+				if(ttile->ibuf == mipbuf)
+					*hits += ttile->hits;
+	}
+}
+
@@ -52,6 +52,7 @@ struct Multires;
 struct PartialVisibility;
 struct EditMesh;
 struct AnimData;
+struct VertCornerMap;
 
 typedef struct Mesh {
 	ID id;
@@ -75,6 +76,7 @@ typedef struct Mesh {
 	struct MSelect *mselect;
 	
 	struct EditMesh *edit_mesh;	/* not saved in file! */
+	struct VertCornerMap *cornermap;	/* not saved in file, see mesh_get_vert_corner_map */
 
 	struct CustomData vdata, edata, fdata;
 
@@ -102,7 +102,8 @@ typedef enum {
 	eSubsurfModifierFlag_Incremental = (1<<0),
 	eSubsurfModifierFlag_DebugIncr = (1<<1),
 	eSubsurfModifierFlag_ControlEdges = (1<<2),
-	eSubsurfModifierFlag_SubsurfUv = (1<<3)
+	eSubsurfModifierFlag_SubsurfUv = (1<<3),
+	eSubsurfModifierFlag_Stencils = (1<<4)
 } SubsurfModifierFlag;
 
 /* not a real modifier */
@@ -399,6 +399,8 @@ typedef struct SoftBody {
 #define PTCACHE_IGNORE_LIBPATH		2048
 /* high resolution cache is saved for smoke for backwards compatibility, so set this flag to know it's a "fake" cache */
 #define PTCACHE_FAKE_SMOKE			(1<<12)
+/* disk cache frames are stored in one indexed file, see pointcache.c */
+#define PTCACHE_DISK_PACKED			(1<<13)
 
 /* PTCACHE_OUTDATED + PTCACHE_FRAMES_SKIPPED */
 #define PTCACHE_REDO_NEEDED			258
@@ -260,7 +260,7 @@ typedef struct ParticleSystem{				/* note, make sure all (runtime) are NULL's in
 	char name[32];							/* particle system name */
 	
 	float imat[4][4];	/* used for duplicators */
-	float cfra, tree_frame, bvhtree_frame;
+	float cfra, tree_frame, spatialhash_frame;
 	int seed, child_seed;
 	int flag, totpart, totunexist, totchild, totcached, totchildcache;
 	short recalc, target_psys, totkeyed, bakespace;
@@ -283,11 +283,12 @@ typedef struct ParticleSystem{				/* note, make sure all (runtime) are NULL's in
 	int tot_fluidsprings, alloc_fluidsprings;
 
 	struct KDTree *tree;								/* used for interactions with self and other systems */
-	struct BVHTree *bvhtree;								/* used for interactions with self and other systems */
+	struct SpatialHash *spatialhash;					/* used for fluid interactions with self and other systems */
 
 	struct ParticleDrawData *pdd;
 
 	float *frand;							/* array of 1024 random floats for fast lookups */
+	unsigned int *childcachesum;			/* checksums of the parent paths the child cache was made from (runtime) */
 }ParticleSystem;
 
 /* part->type */
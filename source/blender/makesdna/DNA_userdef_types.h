@@ -388,7 +388,10 @@ typedef struct UserDef {
 	
 	short widget_unit;		/* defaults to 20 for 72 DPI setting */
 	short anisotropic_filter;
-	/*short pad[3];			*/
+	short seqcache_raw;		/* sequencer cache budgets, percentage of memcachelimit */
+	short seqcache_preprocess;
+	short seqcache_composite;
+	short modcachelimit;	/* modifier result cache, megabytes, 0 disables */
 
 	float ndof_sensitivity;	/* overall sensitivity of 3D mouse */
 	int ndof_flag;			/* flags for 3D mouse */
@@ -650,6 +650,85 @@ static void rna_SequenceEditor_overlay_lock_set(PointerRNA *ptr, int value)
 	}
 }
 
+static PointerRNA rna_SequenceEditor_cache_stats_get(PointerRNA *ptr)
+{
+	return rna_pointer_inherit_refine(ptr, &RNA_SequenceCacheStats, ptr->data);
+}
+
+static void rna_SequenceCacheStats_hits_get(PointerRNA *UNUSED(ptr), int *values)
+{
+	SeqCacheStats stats;
+	int i;
+
+	seq_stripelem_cache_stats(&stats);
+	for(i=0; i<SEQ_CACHE_TOT_STAGE; i++)
+		values[i]= stats.hits[i];
+}
+
+static void rna_SequenceCacheStats_misses_get(PointerRNA *UNUSED(ptr), int *values)
+{
+	SeqCacheStats stats;
+	int i;
+
+	seq_stripelem_cache_stats(&stats);
+	for(i=0; i<SEQ_CACHE_TOT_STAGE; i++)
+		values[i]= stats.misses[i];
+}
+
+static void rna_SequenceCacheStats_evictions_get(PointerRNA *UNUSED(ptr), int *values)
+{
+	SeqCacheStats stats;
+	int i;
+
+	seq_stripelem_cache_stats(&stats);
+	for(i=0; i<SEQ_CACHE_TOT_STAGE; i++)
+		values[i]= stats.evictions[i];
+}
+
+static void rna_SequenceCacheStats_entries_get(PointerRNA *UNUSED(ptr), int *values)
+{
+	SeqCacheStats stats;
+	int i;
+
+	seq_stripelem_cache_stats(&stats);
+	for(i=0; i<SEQ_CACHE_TOT_STAGE; i++)
+		values[i]= stats.totentry[i];
+}
+
+static void rna_SequenceCacheStats_memory_used_get(PointerRNA *UNUSED(ptr), float *values)
+{
+	SeqCacheStats stats;
+	int i;
+
+	seq_stripelem_cache_stats(&stats);
+	for(i=0; i<SEQ_CACHE_TOT_STAGE; i++)
+		values[i]= (float)stats.size[i] / (1024.0f*1024.0f);
+}
+
+static void rna_SequenceCacheStats_memory_budget_get(PointerRNA *UNUSED(ptr), float *values)
+{
+	SeqCacheStats stats;
+	int i;
+
+	seq_stripelem_cache_stats(&stats);
+	for(i=0; i<SEQ_CACHE_TOT_STAGE; i++)
+		values[i]= (float)stats.budget[i] / (1024.0f*1024.0f);
+}
+
+static float rna_SequenceCacheStats_hit_rate_get(PointerRNA *UNUSED(ptr))
+{
+	SeqCacheStats stats;
+	int i, hits= 0, total= 0;
+
+	seq_stripelem_cache_stats(&stats);
+	for(i=0; i<SEQ_CACHE_TOT_STAGE; i++) {
+		hits += stats.hits[i];
+		total += stats.hits[i] + stats.misses[i];
+	}
+
+	return (total)? (float)hits / (float)total: 0.0f;
+}
+
 static int rna_SequenceEditor_overlay_frame_get(PointerRNA *ptr)
 {
 	Scene *scene= (Scene *)ptr->id.data;
@@ -1117,6 +1196,62 @@ static void rna_def_editor(BlenderRNA *brna)
 	RNA_def_property_int_funcs(prop, "rna_SequenceEditor_overlay_frame_get", "rna_SequenceEditor_overlay_frame_set", NULL);
 	RNA_def_property_update(prop, NC_SPACE|ND_SPACE_SEQUENCER, NULL);
 	RNA_def_property_ui_text(prop, "Active Strip", "Sequencers active strip");
+
+	prop= RNA_def_property(srna, "cache_stats", PROP_POINTER, PROP_NONE);
+	RNA_def_property_flag(prop, PROP_NEVER_NULL);
+	RNA_def_property_struct_type(prop, "SequenceCacheStats");
+	RNA_def_property_pointer_funcs(prop, "rna_SequenceEditor_cache_stats_get", NULL, NULL, NULL);
+	RNA_def_property_ui_text(prop, "Cache Statistics", "Memory use and hit rate of the sequencer cache");
+}
+
+static void rna_def_cache_stats(BlenderRNA *brna)
+{
+	StructRNA *srna;
+	PropertyRNA *prop;
+
+	srna = RNA_def_struct(brna, "SequenceCacheStats", NULL);
+	RNA_def_struct_ui_text(srna, "Sequence Cache Statistics", "Sequencer cache usage, shared by all scenes. Arrays hold the raw, preprocessed and composite stages");
+
+	prop= RNA_def_property(srna, "hits", PROP_INT, PROP_UNSIGNED);
+	RNA_def_property_array(prop, SEQ_CACHE_TOT_STAGE);
+	RNA_def_property_clear_flag(prop, PROP_EDITABLE);
+	RNA_def_property_int_funcs(prop, "rna_SequenceCacheStats_hits_get", NULL, NULL);
+	RNA_def_property_ui_text(prop, "Hits", "Number of images found in the cache");
+
+	prop= RNA_def_property(srna, "misses", PROP_INT, PROP_UNSIGNED);
+	RNA_def_property_array(prop, SEQ_CACHE_TOT_STAGE);
+	RNA_def_property_clear_flag(prop, PROP_EDITABLE);
+	RNA_def_property_int_funcs(prop, "rna_SequenceCacheStats_misses_get", NULL, NULL);
+	RNA_def_property_ui_text(prop, "Misses", "Number of images that had to be rendered");
+
+	prop= RNA_def_property(srna, "evictions", PROP_INT, PROP_UNSIGNED);
+	RNA_def_property_array(prop, SEQ_CACHE_TOT_STAGE);
+	RNA_def_property_clear_flag(prop, PROP_EDITABLE);
+	RNA_def_property_int_funcs(prop, "rna_SequenceCacheStats_evictions_get", NULL, NULL);
+	RNA_def_property_ui_text(prop, "Evictions", "Number of images dropped to stay within the memory budget");
+
+	prop= RNA_def_property(srna, "entries", PROP_INT, PROP_UNSIGNED);
+	RNA_def_property_array(prop, SEQ_CACHE_TOT_STAGE);
+	RNA_def_property_clear_flag(prop, PROP_EDITABLE);
+	RNA_def_property_int_funcs(prop, "rna_SequenceCacheStats_entries_get", NULL, NULL);
+	RNA_def_property_ui_text(prop, "Entries", "Number of images in the cache");
+
+	prop= RNA_def_property(srna, "memory_used", PROP_FLOAT, PROP_UNSIGNED);
+	RNA_def_property_array(prop, SEQ_CACHE_TOT_STAGE);
+	RNA_def_property_clear_flag(prop, PROP_EDITABLE);
+	RNA_def_property_float_funcs(prop, "rna_SequenceCacheStats_memory_used_get", NULL, NULL);
+	RNA_def_property_ui_text(prop, "Memory Used", "Memory used by cached images (megabytes)");
+
+	prop= RNA_def_property(srna, "memory_budget", PROP_FLOAT, PROP_UNSIGNED);
+	RNA_def_property_array(prop, SEQ_CACHE_TOT_STAGE);
+	RNA_def_property_clear_flag(prop, PROP_EDITABLE);
+	RNA_def_property_float_funcs(prop, "rna_SequenceCacheStats_memory_budget_get", NULL, NULL);
+	RNA_def_property_ui_text(prop, "Memory Budget", "Memory cached images may use, zero is unlimited (megabytes)");
+
+	prop= RNA_def_property(srna, "hit_rate", PROP_FLOAT, PROP_FACTOR);
+	RNA_def_property_clear_flag(prop, PROP_EDITABLE);
+	RNA_def_property_float_funcs(prop, "rna_SequenceCacheStats_hit_rate_get", NULL, NULL);
+	RNA_def_property_ui_text(prop, "Hit Rate", "Part of the cache lookups of all stages that found an image");
 }
 
 static void rna_def_filter_video(StructRNA *srna)
@@ -1676,6 +1811,7 @@ void RNA_def_sequencer(BlenderRNA *brna)
 
 	rna_def_sequence(brna);
 	rna_def_editor(brna);
+	rna_def_cache_stats(brna);
 
 	rna_def_image(brna);
 	rna_def_meta(brna);
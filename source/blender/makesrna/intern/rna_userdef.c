@@ -236,6 +236,13 @@ static void rna_Userdef_memcache_update(Main *UNUSED(bmain), Scene *UNUSED(scene
 	MEM_CacheLimiter_set_maximum(U.memcachelimit * 1024 * 1024);
 }
 
+static void rna_Userdef_modcache_update(Main *UNUSED(bmain), Scene *UNUSED(scene), PointerRNA *UNUSED(ptr))
+{
+	/* a lower limit is enforced on the next insert */
+	if(U.modcachelimit == 0)
+		DM_modifier_cache_free();
+}
+
 static void rna_UserDef_weight_color_update(Main *bmain, Scene *scene, PointerRNA *ptr)
 {
 	Object *ob;
@@ -2672,6 +2679,27 @@ static void rna_def_userdef_system(BlenderRNA *brna)
 	RNA_def_property_ui_text(prop, "Memory Cache Limit", "Memory cache limit in sequencer (megabytes)");
 	RNA_def_property_update(prop, 0, "rna_Userdef_memcache_update");
 
+	prop= RNA_def_property(srna, "sequencer_cache_raw", PROP_INT, PROP_PERCENTAGE);
+	RNA_def_property_int_sdna(prop, NULL, "seqcache_raw");
+	RNA_def_property_range(prop, 1, 100);
+	RNA_def_property_ui_text(prop, "Raw Cache", "Part of the memory cache limit used for source images in the sequencer");
+
+	prop= RNA_def_property(srna, "sequencer_cache_preprocessed", PROP_INT, PROP_PERCENTAGE);
+	RNA_def_property_int_sdna(prop, NULL, "seqcache_preprocess");
+	RNA_def_property_range(prop, 1, 100);
+	RNA_def_property_ui_text(prop, "Preprocessed Cache", "Part of the memory cache limit used for preprocessed strips in the sequencer");
+
+	prop= RNA_def_property(srna, "sequencer_cache_composite", PROP_INT, PROP_PERCENTAGE);
+	RNA_def_property_int_sdna(prop, NULL, "seqcache_composite");
+	RNA_def_property_range(prop, 1, 100);
+	RNA_def_property_ui_text(prop, "Composite Cache", "Part of the memory cache limit used for composited frames in the sequencer");
+
+	prop= RNA_def_property(srna, "modifier_cache_limit", PROP_INT, PROP_NONE);
+	RNA_def_property_int_sdna(prop, NULL, "modcachelimit");
+	RNA_def_property_range(prop, 0, (sizeof(void *) ==8)? 1024*16: 1024);
+	RNA_def_property_ui_text(prop, "Modifier Cache Limit", "Memory limit for keeping modifier results, so editing a modifier doesn't evaluate the modifiers before it again, 0 disables (megabytes)");
+	RNA_def_property_update(prop, 0, "rna_Userdef_modcache_update");
+
 	prop= RNA_def_property(srna, "frame_server_port", PROP_INT, PROP_NONE);
 	RNA_def_property_int_sdna(prop, NULL, "frameserverport");
 	RNA_def_property_range(prop, 0, 32727);
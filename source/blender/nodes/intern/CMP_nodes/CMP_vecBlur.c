@@ -49,8 +49,9 @@ static bNodeSocketType cmp_node_vecblur_out[]= {
 
 
 
-static void node_composit_exec_vecblur(void *UNUSED(data), bNode *node, bNodeStack **in, bNodeStack **out)
+static void node_composit_exec_vecblur(void *data, bNode *node, bNodeStack **in, bNodeStack **out)
 {
+	RenderData *rd= data;
 	NodeBlurData *nbd= node->storage;
 	CompBuf *new, *img= in[0]->data, *vecbuf= in[2]->data, *zbuf= in[1]->data;
 	
@@ -79,7 +80,7 @@ static void node_composit_exec_vecblur(void *UNUSED(data), bNode *node, bNodeSta
 	new= dupalloc_compbuf(img);
 	
 	/* call special zbuffer version */
-	RE_zbuf_accumulate_vecblur(nbd, img->x, img->y, new->rect, img->rect, vecbuf->rect, zbuf->rect);
+	RE_zbuf_accumulate_vecblur(nbd, rd->threads, img->x, img->y, new->rect, img->rect, vecbuf->rect, zbuf->rect);
 	
 	out[0]->data= new;
 	
@@ -210,6 +210,12 @@ void RE_DataBase_ApplyWindow(struct Render *re);
 /* override the scene setting for amount threads, commandline */
 void RE_set_max_threads(int threads);
 
+/* write per part ray counters and timing of each rendered frame to a json or csv file, commandline */
+void RE_set_stats_output(const char *filepath);
+
+/* load tiled images on demand with a memory limit in MB, commandline */
+void RE_set_texture_cache(int maxmem);
+
 /* set the render threads based on the commandline and autothreads setting */
 void RE_init_threadcount(Render *re);
 
@@ -249,7 +255,7 @@ void RE_test_break_cb	(struct Render *re, void *handle, int (*f)(void *handle));
 /* should move to kernel once... still unsure on how/where */
 float RE_filter_value(int type, float x);
 /* vector blur zbuffer method */
-void RE_zbuf_accumulate_vecblur(struct NodeBlurData *nbd, int xsize, int ysize, float *newrect, float *imgrect, float *vecbufrect, float *zbufrect);
+void RE_zbuf_accumulate_vecblur(struct NodeBlurData *nbd, int totthread, int xsize, int ysize, float *newrect, float *imgrect, float *vecbufrect, float *zbufrect);
 
 /* shaded view or baking options */
 #define RE_BAKE_LIGHT				0	/* not listed in rna_scene.c -> can't be enabled! */
@@ -183,10 +183,6 @@ typedef struct ShadeInput
 	struct Group *light_override;
 	struct Material *mat_override;
 	
-#ifdef RE_RAYCOUNTER
-	RayCounter raycounter;
-#endif
-	
 } ShadeInput;
 
 
@@ -47,7 +47,7 @@ struct Render;
 struct TexResult;
 
 void make_envmaps(struct Render *re);
-int envmaptex(struct Tex *tex, float *texvec, float *dxt, float *dyt, int osatex, struct TexResult *texres);
+int envmaptex(struct Tex *tex, float *texvec, float *dxt, float *dyt, int osatex, struct TexResult *texres, int thread);
 
 #endif /* ENVMAP_EXT_H */
 
@@ -35,39 +35,34 @@
 #ifndef RE_RAYCOUNTER_H
 #define RE_RAYCOUNTER_H
 
-//#define RE_RAYCOUNTER			/* enable counters per ray, usefull for measuring raytrace structures performance */
-
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-#ifdef RE_RAYCOUNTER
-
-/* ray counter functions */
+/* ray counters, always compiled in so that production renders can be
+ * measured too. counting happens per render thread, in re_rc_counter,
+ * each Isect points to the counter of the thread that casts it. */
 
 typedef struct RayCounter {
 	struct {
 		unsigned long long test, hit;
 	} faces, bb, simd_bb, raycast, raytrace_hint, rayshadow_last_hit;
+	
+	/* pad to avoid threads sharing cache lines in re_rc_counter */
+	char pad[32];
 } RayCounter;
 
-#define RE_RC_INIT(isec, shi) (isec).raycounter = &((shi).shading.raycounter)
-void RE_RC_INFO (RayCounter *rc);
-void RE_RC_MERGE(RayCounter *rc, RayCounter *tmp);
+#define RE_RC_INIT(isec, shi) (isec).raycounter = &re_rc_counter[(shi).thread]
 #define RE_RC_COUNT(var) (var)++
+#define RE_RC_CLEAR(rc) memset((rc), 0, sizeof(RayCounter))
 
-extern RayCounter re_rc_counter[];
-
-#else
+void RE_RC_INFO (RayCounter *rc);
+void RE_RC_MERGE(RayCounter *rc, RayCounter *tmp);
 
-/* ray counter stubs */
+/* bounding box tests, both single and SIMD */
+#define RE_RC_NODES(rc) ((rc)->bb.test + (rc)->simd_bb.test)
 
-#define RE_RC_INIT(isec,shi)
-#define RE_RC_INFO(rc)
-#define RE_RC_MERGE(dest,src)
-#define	RE_RC_COUNT(var)
-		
-#endif
+extern RayCounter re_rc_counter[];
 
 #ifdef __cplusplus
 }
@@ -95,10 +95,8 @@ typedef struct Isect {
 #endif
 	RayHint *hint;
 	
-	/* ray counter */
-#ifdef RE_RAYCOUNTER
-	RayCounter *raycounter;
-#endif
+	/* ray counter, NULL for rays cast outside of render threads */
+	struct RayCounter *raycounter;
 } Isect;
 
 /* ray types */
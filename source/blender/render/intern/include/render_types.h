@@ -48,6 +48,7 @@
 #include "RE_pipeline.h"
 #include "RE_shader_ext.h"	/* TexResult, ShadeResult, ShadeInput */
 #include "sunsky.h"
+#include "raycounter.h"
 
 #include "BLO_sys_types.h" // for intptr_t support
 
@@ -113,8 +114,37 @@ typedef struct RenderPart
 	short thread;					/* thread id */
 	
 	char *clipflag;					/* clipflags for part zbuffering */
+	
+	int (*binface)[2];				/* faces overlapping part, instance and face index */
+	int totbinface, maxbinface;
+	short binned, pad;				/* when not binned, zbuffering tests all faces */
+	
+	double time;					/* render time of the part */
+	RayCounter raycounter;			/* ray counters of the part */
 } RenderPart;
 
+/* statistics of a finished part, kept after parts are freed */
+typedef struct RenderPartStats
+{
+	struct RenderPartStats *next, *prev;
+	
+	rcti disprect;
+	int nr, thread;
+	double time;
+	RayCounter raycounter;
+} RenderPartStats;
+
+/* statistics of one tile processor run, a frame does multiple
+   runs for fields, motion blur and sss */
+typedef struct RenderProcessStats
+{
+	struct RenderProcessStats *next, *prev;
+	
+	ListBase parts;					/* RenderPartStats */
+	double time;
+	RayCounter raycounter;			/* sum of all parts */
+} RenderProcessStats;
+
 /* controls state of render, everything that's read-only during render stage */
 struct Render
 {
@@ -210,6 +240,7 @@ struct Render
 	ListBase lampren;	/* storage, for free */
 	
 	ListBase objecttable;
+	ListBase objectfinalize;	/* objects to finalize threaded, see convertblender.c */
 
 	struct ObjectInstanceRen *objectinstance;
 	ListBase instancetable;
@@ -254,6 +285,9 @@ struct Render
 	void *tbh;
 	
 	RenderStats i;
+	
+	/* per part ray counters and timing of the current frame, RenderProcessStats */
+	ListBase processstats;
 
 	struct ReportList *reports;
 };
@@ -314,6 +348,7 @@ typedef struct ObjectRen {
 	int  actmtface, actmcol, bakemtface;
 
 	float obmat[4][4];	/* only used in convertblender.c, for instancing */
+	float smoothresh;	/* phong threshold for ray shadow terminator problem */
 
 	/* used on makeraytree */
 	struct RayObject *raytree;
@@ -604,6 +639,7 @@ typedef struct LampRen {
 #define R_NEED_TANGENT	16
 #define R_BAKE_TRACE	32
 #define R_BAKING		64
+#define R_CONVERT_THREADED	128
 
 /* vlakren->flag (vlak = face in dutch) char!!! */
 #define R_SMOOTH		1
@@ -624,6 +660,7 @@ typedef struct LampRen {
 
 /* objectren->flag */
 #define R_INSTANCEABLE		1
+#define R_FINALIZE_THREADED	2
 
 /* objectinstance->flag */
 #define R_DUPLI_TRANSFORMED	1
@@ -49,7 +49,7 @@ void scatter_settings_free(ScatterSettings *ss);
 
 ScatterTree *scatter_tree_new(ScatterSettings *ss[3], float scale, float error,
 	float (*co)[3], float (*color)[3], float *area, int totpoint);
-void scatter_tree_build(ScatterTree *tree);
+void scatter_tree_build(ScatterTree *tree, int totthread);
 void scatter_tree_sample(ScatterTree *tree, float *co, float *color);
 void scatter_tree_free(ScatterTree *tree);
 
@@ -369,7 +369,7 @@ MALWAYS_INLINE int intersect_rayface(RayObject *hit_obj, RayFace *face, Isect *i
 
 /* Intersection */
 
-int RE_rayobject_raycast(RayObject *r, Isect *isec)
+static int rayobject_raycast(RayObject *r, Isect *isec)
 {
 	int i;
 
@@ -419,6 +419,23 @@ int RE_rayobject_raycast(RayObject *r, Isect *isec)
 	return 0;
 }
 
+int RE_rayobject_raycast(RayObject *r, Isect *isec)
+{
+	RayCounter counter;
+	int hit;
+
+	if(isec->raycounter)
+		return rayobject_raycast(r, isec);
+
+	/* rays cast outside of render threads (baking, volume precache) are
+	 * counted in a scratch counter, so traversal never needs a NULL check */
+	isec->raycounter= &counter;
+	hit= rayobject_raycast(r, isec);
+	isec->raycounter= NULL;
+
+	return hit;
+}
+
 int RE_rayobject_intersect(RayObject *r, Isect *i)
 {
 	if(RE_rayobject_isRayFace(r))
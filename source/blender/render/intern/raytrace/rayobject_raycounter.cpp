@@ -32,10 +32,14 @@
  */
 
 
+#include <stdio.h>
+
+#include "BLI_threads.h"
+
 #include "rayobject.h"
 #include "raycounter.h"
 
-#ifdef RE_RAYCOUNTER
+RayCounter re_rc_counter[BLENDER_MAX_THREADS];
 
 void RE_RC_INFO(RayCounter *info)
 {
@@ -90,4 +94,3 @@ void RE_RC_MERGE(RayCounter *dest, RayCounter *tmp)
 	dest->raytrace_hint.hit  += tmp->raytrace_hint.hit;
 }
 
-#endif
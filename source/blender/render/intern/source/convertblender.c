@@ -2325,7 +2325,7 @@ static void displace_render_vert(Render *re, ObjectRen *obr, ShadeInput *shi, Ve
 	return;
 }
 
-static void displace_render_face(Render *re, ObjectRen *obr, VlakRen *vlr, float *scale, float mat[][4], float imat[][3])
+static void displace_render_face(Render *re, ObjectRen *obr, VlakRen *vlr, float *scale, float mat[][4], float imat[][3], int thread)
 {
 	ShadeInput shi;
 
@@ -2342,7 +2342,7 @@ static void displace_render_face(Render *re, ObjectRen *obr, VlakRen *vlr, float
 	shi.obr= obr;
 	shi.vlr= vlr;		/* current render face */
 	shi.mat= vlr->mat;		/* current input material */
-	shi.thread= 0;
+	shi.thread= thread;
 	
 	/* TODO, assign these, displacement with new bumpmap is skipped without - campbell */
 #if 0
@@ -2381,7 +2381,7 @@ static void displace_render_face(Render *re, ObjectRen *obr, VlakRen *vlr, float
 	}
 }
 
-static void do_displacement(Render *re, ObjectRen *obr, float mat[][4], float imat[][3])
+static void do_displacement(Render *re, ObjectRen *obr, float mat[][4], float imat[][3], int thread)
 {
 	VertRen *vr;
 	VlakRen *vlr;
@@ -2406,7 +2406,7 @@ static void do_displacement(Render *re, ObjectRen *obr, float mat[][4], float im
 
 	for(i=0; i<obr->totvlak; i++){
 		vlr=RE_findOrAddVlak(obr, i);
-		displace_render_face(re, obr, vlr, scale, mat, imat);
+		displace_render_face(re, obr, vlr, scale, mat, imat, thread);
 	}
 	
 	/* Recalc vertex normals */
@@ -3234,6 +3234,42 @@ static void add_volume(Render *re, ObjectRen *obr, Material *ma)
 	BLI_addtail(&re->volumes, vo);
 }
 
+/* displacement, autosmooth and normals of a mesh only change its own ObjectRen,
+ * when rendering threaded this is done after all objects are converted */
+typedef struct ObjectRenFinalize {
+	struct ObjectRenFinalize *next, *prev;
+	
+	ObjectRen *obr;
+	Mesh *me;
+	float mat[4][4], imat[3][3];
+	int do_displace, do_autosmooth, recalc_normals;
+	int need_tangent, need_nmap_tangent, need_stress;
+	
+	int thread_ready;
+} ObjectRenFinalize;
+
+static void finalize_render_mesh(Render *re, ObjectRenFinalize *of, int thread)
+{
+	ObjectRen *obr= of->obr;
+	
+	if(of->do_displace) {
+		calc_vertexnormals(re, obr, 0, 0);
+		if(of->do_autosmooth)
+			do_displacement(re, obr, of->mat, of->imat, thread);
+		else
+			do_displacement(re, obr, NULL, NULL, thread);
+	}
+
+	if(of->do_autosmooth)
+		autosmooth(re, obr, of->mat, of->me->smoothresh);
+
+	if(of->recalc_normals || of->need_tangent)
+		calc_vertexnormals(re, obr, of->need_tangent, of->need_nmap_tangent);
+	
+	if(of->need_stress)
+		calc_edge_stress(re, obr, of->me);
+}
+
 static void init_render_mesh(Render *re, ObjectRen *obr, int timeoffset)
 {
 	Object *ob= obr->ob;
@@ -3536,25 +3572,27 @@ static void init_render_mesh(Render *re, ObjectRen *obr, int timeoffset)
 	}
 	
 	if(!timeoffset) {
-		if (test_for_displace(re, ob ) ) {
-			recalc_normals= 1;
-			calc_vertexnormals(re, obr, 0, 0);
-			if(do_autosmooth)
-				do_displacement(re, obr, mat, imat);
-			else
-				do_displacement(re, obr, NULL, NULL);
-		}
-
-		if(do_autosmooth) {
-			recalc_normals= 1;
-			autosmooth(re, obr, mat, me->smoothresh);
-		}
-
-		if(recalc_normals!=0 || need_tangent!=0)
-			calc_vertexnormals(re, obr, need_tangent, need_nmap_tangent);
+		ObjectRenFinalize of= {0};
 		
-		if(need_stress)
-			calc_edge_stress(re, obr, me);
+		of.obr= obr;
+		of.me= me;
+		copy_m4_m4(of.mat, mat);
+		copy_m3_m3(of.imat, imat);
+		of.do_displace= test_for_displace(re, ob);
+		of.do_autosmooth= do_autosmooth;
+		of.recalc_normals= recalc_normals || of.do_displace || do_autosmooth;
+		of.need_tangent= need_tangent;
+		of.need_nmap_tangent= need_nmap_tangent;
+		of.need_stress= need_stress;
+		
+		if(re->flag & R_CONVERT_THREADED) {
+			ObjectRenFinalize *ofp= MEM_mallocN(sizeof(ObjectRenFinalize), "ObjectRenFinalize");
+			*ofp= of;
+			BLI_addtail(&re->objectfinalize, ofp);
+			obr->flag |= R_FINALIZE_THREADED;
+		}
+		else
+			finalize_render_mesh(re, &of, 0);
 	}
 
 	dm->release(dm);
@@ -4080,7 +4118,7 @@ static void set_phong_threshold(ObjectRen *obr)
 	
 	if(tot) {
 		thresh/= (float)tot;
-		obr->ob->smoothresh= cos(0.5*M_PI-saacos(thresh));
+		obr->smoothresh= cos(0.5*M_PI-saacos(thresh));
 	}
 }
 
@@ -4278,7 +4316,7 @@ static void check_non_flat_quads(ObjectRen *obr)
 	}
 }
 
-static void finalize_render_object(Render *re, ObjectRen *obr, int timeoffset)
+static void finalize_render_object(Render *re, ObjectRen *obr, int timeoffset, int thread)
 {
 	Object *ob= obr->ob;
 	VertRen *ver= NULL;
@@ -4292,12 +4330,12 @@ static void finalize_render_object(Render *re, ObjectRen *obr, int timeoffset)
 		I will look at means to have autosmooth enabled for all object types 
 		and have it as general postprocess, like displace */
 		if(ob->type!=OB_MESH && test_for_displace(re, ob)) 
-			do_displacement(re, obr, NULL, NULL);
+			do_displacement(re, obr, NULL, NULL, thread);
 	
 		if(!timeoffset) {
 			/* phong normal interpolation can cause error in tracing
 			 * (terminator problem) */
-			ob->smoothresh= 0.0;
+			obr->smoothresh= 0.0;
 			if((re->r.mode & R_RAYTRACE) && (re->r.mode & R_SHADOW)) 
 				set_phong_threshold(obr);
 			
@@ -4354,6 +4392,110 @@ static void finalize_render_object(Render *re, ObjectRen *obr, int timeoffset)
 	}
 }
 
+typedef struct FinalizeThread {
+	Render *re;
+	ObjectRenFinalize **next;	/* shared between threads */
+	int thread;
+} FinalizeThread;
+
+static void *do_finalize_thread(void *data)
+{
+	FinalizeThread *ft= data;
+	Render *re= ft->re;
+	ObjectRenFinalize *of;
+
+	do {
+		BLI_lock_thread(LOCK_CUSTOM1);
+		of= *ft->next;
+		if(of)
+			*ft->next= of->next;
+		BLI_unlock_thread(LOCK_CUSTOM1);
+
+		if(of) {
+			finalize_render_mesh(re, of, ft->thread);
+			finalize_render_object(re, of->obr, 0, ft->thread);
+
+			BLI_lock_thread(LOCK_CUSTOM1);
+			of->thread_ready= 1;
+			BLI_unlock_thread(LOCK_CUSTOM1);
+		}
+	} while(of && !re->test_break(re->tbh));
+
+	return NULL;
+}
+
+static volatile int g_break= 0;
+static int thread_break(void *UNUSED(arg))
+{
+	return g_break;
+}
+
+/* finalize the meshes deferred by init_render_mesh, each ObjectRen is done by
+ * a single thread so results don't depend on the amount of threads, and they
+ * are counted in the order the objects were converted */
+static void threaded_finalize_objects(Render *re)
+{
+	ListBase threads;
+	FinalizeThread ft[BLENDER_MAX_THREADS];
+	ObjectRenFinalize *of, *next;
+	ObjectRen *obr;
+	int a, totthread;
+	int (*test_break)(void *);
+
+	if(re->objectfinalize.first==NULL)
+		return;
+
+	if(!re->test_break(re->tbh)) {
+		totthread= MIN2(BLI_countlist(&re->objectfinalize), re->r.threads);
+		next= re->objectfinalize.first;
+
+		/* swap test break function */
+		test_break= re->test_break;
+		re->test_break= thread_break;
+
+		BLI_init_threads(&threads, do_finalize_thread, totthread);
+
+		for(a=0; a<totthread; a++) {
+			ft[a].re= re;
+			ft[a].next= &next;
+			ft[a].thread= a;
+			BLI_insert_thread(&threads, &ft[a]);
+		}
+
+		/* wait for all objects to be finalized */
+		do {
+			if((g_break=test_break(re->tbh)))
+				break;
+
+			PIL_sleep_ms(20);
+
+			BLI_lock_thread(LOCK_CUSTOM1);
+			for(of=re->objectfinalize.first; of; of=of->next)
+				if(!of->thread_ready)
+					break;
+			BLI_unlock_thread(LOCK_CUSTOM1);
+		} while(of);
+
+		BLI_end_threads(&threads);
+
+		/* unset threadsafety */
+		re->test_break= test_break;
+		g_break= 0;
+	}
+
+	for(of=re->objectfinalize.first; of; of=of->next) {
+		obr= of->obr;
+		obr->flag &= ~R_FINALIZE_THREADED;
+
+		re->totvert += obr->totvert;
+		re->totvlak += obr->totvlak;
+		re->tothalo += obr->tothalo;
+		re->totstrand += obr->totstrand;
+	}
+
+	BLI_freelistN(&re->objectfinalize);
+}
+
 /* ------------------------------------------------------------------------- */
 /* Database																	 */
 /* ------------------------------------------------------------------------- */
@@ -4515,7 +4657,11 @@ static void init_render_object_data(Render *re, ObjectRen *obr, int timeoffset)
 			init_render_mball(re, obr);
 	}
 
-	finalize_render_object(re, obr, timeoffset);
+	/* counted in threaded_finalize_objects */
+	if(obr->flag & R_FINALIZE_THREADED)
+		return;
+
+	finalize_render_object(re, obr, timeoffset, 0);
 
 	re->totvert += obr->totvert;
 	re->totvlak += obr->totvlak;
@@ -4850,6 +4996,10 @@ static void database_init_objects(Render *re, unsigned int renderlay, int nolamp
 	 * untransformed, set_dupli_tex_mat sets the matrix to allow that
 	 * NULL is just for init */
 	set_dupli_tex_mat(NULL, NULL, NULL);
+	
+	/* finalizing meshes is threaded, but not for previews or speed vectors */
+	if(re->r.threads > 1 && !(re->r.scemode & R_PREVIEWBUTS) && !timeoffset)
+		re->flag |= R_CONVERT_THREADED;
 
 	for(SETLOOPER(re->scene, sce_iter, base)) {
 		ob= base->object;
@@ -5001,6 +5151,9 @@ static void database_init_objects(Render *re, unsigned int renderlay, int nolamp
 	for(group= re->main->group.first; group; group=group->id.next)
 		add_group_render_dupli_obs(re, group, nolamps, onlyselected, actob, timeoffset, renderlay, 0);
 
+	threaded_finalize_objects(re);
+	re->flag &= ~R_CONVERT_THREADED;
+
 	if(!re->test_break(re->tbh))
 		RE_makeRenderInstances(re);
 }
@@ -44,6 +44,10 @@
 #include <io.h>
 #endif
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include "MEM_guardedalloc.h"
 
 #include "IMB_imbuf_types.h"
@@ -76,13 +80,31 @@
 extern struct Render R;
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-static void boxsample(ImBuf *ibuf, float minx, float miny, float maxx, float maxy, TexResult *texres, const short imaprepeat, const short imapextend);
+static void boxsample(ImBuf *ibuf, float minx, float miny, float maxx, float maxy, TexResult *texres, const short imaprepeat, const short imapextend, int thread);
 
 /* *********** IMAGEWRAPPING ****************** */
 
+/* images loaded through the tile cache have no rect, only byte tiles */
+static int ibuf_has_pixels(ImBuf *ibuf)
+{
+	return (ibuf->rect || ibuf->rect_float || ibuf->tiles);
+}
+
+/* byte pixel, x and y have to be checked for image size */
+static char *ibuf_get_rect_pixel(ImBuf *ibuf, int x, int y, int thread)
+{
+	if(ibuf->rect)
+		return (char *)(ibuf->rect + y * ibuf->x + x);
+	else {
+		int tx= x / ibuf->tilex, ty= y / ibuf->tiley;
+		unsigned int *tile= IMB_gettile(ibuf, tx, ty, thread);
+
+		return (char *)(tile + (y - ty * ibuf->tiley) * ibuf->tilex + (x - tx * ibuf->tilex));
+	}
+}
 
 /* x and y have to be checked for image size */
-static void ibuf_get_color(float *col, struct ImBuf *ibuf, int x, int y)
+static void ibuf_get_color(float *col, struct ImBuf *ibuf, int x, int y, int thread)
 {
 	int ofs = y * ibuf->x + x;
 	
@@ -102,7 +124,7 @@ static void ibuf_get_color(float *col, struct ImBuf *ibuf, int x, int y)
 		}
 	}
 	else {
-		char *rect = (char *)( ibuf->rect+ ofs);
+		char *rect = ibuf_get_rect_pixel(ibuf, x, y, thread);
 
 		col[0] = ((float)rect[0])*(1.0f/255.0f);
 		col[1] = ((float)rect[1])*(1.0f/255.0f);
@@ -111,7 +133,7 @@ static void ibuf_get_color(float *col, struct ImBuf *ibuf, int x, int y)
 	}	
 }
 
-int imagewrap(Tex *tex, Image *ima, ImBuf *ibuf, float *texvec, TexResult *texres)
+int imagewrap(Tex *tex, Image *ima, ImBuf *ibuf, float *texvec, TexResult *texres, int thread)
 {
 	float fx, fy, val1, val2, val3;
 	int x, y, retval;
@@ -133,7 +155,7 @@ int imagewrap(Tex *tex, Image *ima, ImBuf *ibuf, float *texvec, TexResult *texre
 		
 		ibuf= BKE_image_get_ibuf(ima, &tex->iuser);
 	}
-	if(ibuf==NULL || (ibuf->rect==NULL && ibuf->rect_float==NULL))
+	if(ibuf==NULL || !ibuf_has_pixels(ibuf))
 		return retval;
 	
 	/* setup mapping */
@@ -216,10 +238,10 @@ int imagewrap(Tex *tex, Image *ima, ImBuf *ibuf, float *texvec, TexResult *texre
 		fx -= (float)(xi - x) / (float)ibuf->x;
 		fy -= (float)(yi - y) / (float)ibuf->y;
 
-		boxsample(ibuf, fx-filterx, fy-filtery, fx+filterx, fy+filtery, texres, (tex->extend==TEX_REPEAT), (tex->extend==TEX_EXTEND));
+		boxsample(ibuf, fx-filterx, fy-filtery, fx+filterx, fy+filtery, texres, (tex->extend==TEX_REPEAT), (tex->extend==TEX_EXTEND), thread);
 	}
 	else { /* no filtering */
-		ibuf_get_color(&texres->tr, ibuf, x, y);
+		ibuf_get_color(&texres->tr, ibuf, x, y, thread);
 	}
 	
 	if( (R.flag & R_SEC_FIELD) && (ibuf->flags & IB_fields) ) {
@@ -250,14 +272,14 @@ int imagewrap(Tex *tex, Image *ima, ImBuf *ibuf, float *texvec, TexResult *texre
 
 			if(x<ibuf->x-1) {
 				float col[4];
-				ibuf_get_color(col, ibuf, x+1, y);
+				ibuf_get_color(col, ibuf, x+1, y, thread);
 				val2= (col[0]+col[1]+col[2]);
 			}
 			else val2= val1;
 
 			if(y<ibuf->y-1) {
 				float col[4];
-				ibuf_get_color(col, ibuf, x, y+1);
+				ibuf_get_color(col, ibuf, x, y+1, thread);
 				val3= (col[0]+col[1]+col[2]);
 			}
 			else val3= val1;
@@ -449,7 +471,7 @@ static float clipy_rctf(rctf *rf, float y1, float y2)
 
 }
 
-static void boxsampleclip(struct ImBuf *ibuf, rctf *rf, TexResult *texres)
+static void boxsampleclip(struct ImBuf *ibuf, rctf *rf, TexResult *texres, int thread)
 {
 	/* sample box, is clipped already, and minx etc. have been set at ibuf size.
 	   Enlarge with antialiased edges of the pixels */
@@ -468,7 +490,7 @@ static void boxsampleclip(struct ImBuf *ibuf, rctf *rf, TexResult *texres)
 	if(endy>=ibuf->y) endy= ibuf->y-1;
 
 	if(starty==endy && startx==endx) {
-		ibuf_get_color(&texres->tr, ibuf, startx, starty);
+		ibuf_get_color(&texres->tr, ibuf, startx, starty, thread);
 	}
 	else {
 		div= texres->tr= texres->tg= texres->tb= texres->ta= 0.0;
@@ -485,7 +507,7 @@ static void boxsampleclip(struct ImBuf *ibuf, rctf *rf, TexResult *texres)
 			if(startx==endx) {
 				mulx= muly;
 				
-				ibuf_get_color(col, ibuf, startx, y);
+				ibuf_get_color(col, ibuf, startx, y, thread);
 
 				texres->ta+= mulx*col[3];
 				texres->tr+= mulx*col[0];
@@ -499,7 +521,7 @@ static void boxsampleclip(struct ImBuf *ibuf, rctf *rf, TexResult *texres)
 					if(x==startx) mulx*= 1.0f-(rf->xmin - x);
 					if(x==endx) mulx*= (rf->xmax - x);
 
-					ibuf_get_color(col, ibuf, x, y);
+					ibuf_get_color(col, ibuf, x, y, thread);
 					
 					if(mulx==1.0f) {
 						texres->ta+= col[3];
@@ -532,7 +554,7 @@ static void boxsampleclip(struct ImBuf *ibuf, rctf *rf, TexResult *texres)
 	}
 }
 
-static void boxsample(ImBuf *ibuf, float minx, float miny, float maxx, float maxy, TexResult *texres, const short imaprepeat, const short imapextend)
+static void boxsample(ImBuf *ibuf, float minx, float miny, float maxx, float maxy, TexResult *texres, const short imaprepeat, const short imapextend, int thread)
 {
 	/* Sample box, performs clip. minx etc are in range 0.0 - 1.0 .
 	 * Enlarge with antialiased edges of pixels.
@@ -589,7 +611,7 @@ static void boxsample(ImBuf *ibuf, float minx, float miny, float maxx, float max
 	if(count>1) {
 		tot= texres->tr= texres->tb= texres->tg= texres->ta= 0.0;
 		while(count--) {
-			boxsampleclip(ibuf, rf, &texr);
+			boxsampleclip(ibuf, rf, &texr, thread);
 			
 			opp= square_rctf(rf);
 			tot+= opp;
@@ -608,7 +630,7 @@ static void boxsample(ImBuf *ibuf, float minx, float miny, float maxx, float max
 		}
 	}
 	else
-		boxsampleclip(ibuf, rf, texres);
+		boxsampleclip(ibuf, rf, texres, thread);
 
 	if(texres->talpha==0) texres->ta= 1.0;
 	
@@ -632,6 +654,7 @@ typedef struct afdata_t {
 	float majrad, minrad, theta;
 	int iProbes;
 	float dusc, dvsc;
+	int thread;
 } afdata_t;
 
 // this only used here to make it easier to pass extend flags as single int
@@ -639,7 +662,7 @@ enum {TXC_XMIR=1, TXC_YMIR, TXC_REPT, TXC_EXTD};
 
 // similar to ibuf_get_color() but clips/wraps coords according to repeat/extend flags
 // returns true if out of range in clipmode
-static int ibuf_get_color_clip(float *col, ImBuf *ibuf, int x, int y, int extflag)
+static int ibuf_get_color_clip(float *col, ImBuf *ibuf, int x, int y, int extflag, int thread)
 {
 	int clip = 0;
 	switch (extflag) {
@@ -687,7 +710,7 @@ static int ibuf_get_color_clip(float *col, ImBuf *ibuf, int x, int y, int extfla
 		}
 	}
 	else {
-		char* rect = (char*)(ibuf->rect + x + y*ibuf->x);
+		char* rect = ibuf_get_rect_pixel(ibuf, x, y, thread);
 		col[0] = rect[0]*(1.f/255.f);
 		col[1] = rect[1]*(1.f/255.f);
 		col[2] = rect[2]*(1.f/255.f);
@@ -697,7 +720,7 @@ static int ibuf_get_color_clip(float *col, ImBuf *ibuf, int x, int y, int extfla
 }
 
 // as above + bilerp
-static int ibuf_get_color_clip_bilerp(float *col, ImBuf *ibuf, float u, float v, int intpol, int extflag)
+static int ibuf_get_color_clip_bilerp(float *col, ImBuf *ibuf, float u, float v, int intpol, int extflag, int thread)
 {
 	if (intpol) {
 		float c00[4], c01[4], c10[4], c11[4];
@@ -705,17 +728,91 @@ static int ibuf_get_color_clip_bilerp(float *col, ImBuf *ibuf, float u, float v,
 		const float uf = u - ufl, vf = v - vfl;
 		const float w00=(1.f-uf)*(1.f-vf), w10=uf*(1.f-vf), w01=(1.f-uf)*vf, w11=uf*vf;
 		const int x1 = (int)ufl, y1 = (int)vfl, x2 = x1 + 1, y2 = y1 + 1;
-		int clip = ibuf_get_color_clip(c00, ibuf, x1, y1, extflag);
-		clip |= ibuf_get_color_clip(c10, ibuf, x2, y1, extflag);
-		clip |= ibuf_get_color_clip(c01, ibuf, x1, y2, extflag);
-		clip |= ibuf_get_color_clip(c11, ibuf, x2, y2, extflag);
+		int clip = ibuf_get_color_clip(c00, ibuf, x1, y1, extflag, thread);
+		clip |= ibuf_get_color_clip(c10, ibuf, x2, y1, extflag, thread);
+		clip |= ibuf_get_color_clip(c01, ibuf, x1, y2, extflag, thread);
+		clip |= ibuf_get_color_clip(c11, ibuf, x2, y2, extflag, thread);
 		col[0] = w00*c00[0] + w10*c10[0] + w01*c01[0] + w11*c11[0];
 		col[1] = w00*c00[1] + w10*c10[1] + w01*c01[1] + w11*c11[1];
 		col[2] = w00*c00[2] + w10*c10[2] + w01*c01[2] + w11*c11[2];
 		col[3] = clip ? 0.f : w00*c00[3] + w10*c10[3] + w01*c01[3] + w11*c11[3];
 		return clip;
 	}
-	return ibuf_get_color_clip(col, ibuf, (int)u, (int)v, extflag);
+	return ibuf_get_color_clip(col, ibuf, (int)u, (int)v, extflag, thread);
+}
+
+// fast paths of the filters below read texels directly, without clipping and tile cache
+static int ibuf_direct_access(ImBuf *ibuf)
+{
+	return ibuf->rect_float ? (ibuf->channels == 4) : (ibuf->rect != NULL);
+}
+
+// true if texels x1..x2, y1..y2 are all inside the image, so no clipping is needed
+static int ibuf_inside(ImBuf *ibuf, int x1, int y1, int x2, int y2)
+{
+	return (x1 >= 0 && y1 >= 0 && x2 < ibuf->x && y2 < ibuf->y);
+}
+
+#ifdef __SSE2__
+static __m128 ibuf_get_texel_sse(ImBuf *ibuf, int x, int y)
+{
+	if (ibuf->rect_float)
+		return _mm_loadu_ps(ibuf->rect_float + (x + y*ibuf->x)*4);
+	else {
+		const __m128i zero = _mm_setzero_si128();
+		__m128i px = _mm_cvtsi32_si128(*(int*)(ibuf->rect + x + y*ibuf->x));
+		px = _mm_unpacklo_epi16(_mm_unpacklo_epi8(px, zero), zero);
+		return _mm_mul_ps(_mm_cvtepi32_ps(px), _mm_set_ps1(1.f/255.f));
+	}
+}
+#else
+static void ibuf_get_texel(float *col, ImBuf *ibuf, int x, int y)
+{
+	if (ibuf->rect_float)
+		QUATCOPY(col, ibuf->rect_float + (x + y*ibuf->x)*4)
+	else {
+		const unsigned char* rect = (unsigned char*)(ibuf->rect + x + y*ibuf->x);
+		col[0] = rect[0]*(1.f/255.f);
+		col[1] = rect[1]*(1.f/255.f);
+		col[2] = rect[2]*(1.f/255.f);
+		col[3] = rect[3]*(1.f/255.f);
+	}
+}
+#endif
+
+// as ibuf_get_color_clip_bilerp(), all four texels must be inside the image
+static void ibuf_get_color_bilerp_inside(float *col, ImBuf *ibuf, float u, float v, int intpol)
+{
+	if (intpol) {
+		const float ufl = floorf(u -= 0.5f), vfl = floorf(v -= 0.5f);
+		const float uf = u - ufl, vf = v - vfl;
+		const float w00=(1.f-uf)*(1.f-vf), w10=uf*(1.f-vf), w01=(1.f-uf)*vf, w11=uf*vf;
+		const int x1 = (int)ufl, y1 = (int)vfl;
+#ifdef __SSE2__
+		__m128 c = _mm_mul_ps(ibuf_get_texel_sse(ibuf, x1, y1), _mm_set_ps1(w00));
+		c = _mm_add_ps(c, _mm_mul_ps(ibuf_get_texel_sse(ibuf, x1 + 1, y1), _mm_set_ps1(w10)));
+		c = _mm_add_ps(c, _mm_mul_ps(ibuf_get_texel_sse(ibuf, x1, y1 + 1), _mm_set_ps1(w01)));
+		c = _mm_add_ps(c, _mm_mul_ps(ibuf_get_texel_sse(ibuf, x1 + 1, y1 + 1), _mm_set_ps1(w11)));
+		_mm_storeu_ps(col, c);
+#else
+		float c00[4], c01[4], c10[4], c11[4];
+		ibuf_get_texel(c00, ibuf, x1, y1);
+		ibuf_get_texel(c10, ibuf, x1 + 1, y1);
+		ibuf_get_texel(c01, ibuf, x1, y1 + 1);
+		ibuf_get_texel(c11, ibuf, x1 + 1, y1 + 1);
+		col[0] = w00*c00[0] + w10*c10[0] + w01*c01[0] + w11*c11[0];
+		col[1] = w00*c00[1] + w10*c10[1] + w01*c01[1] + w11*c11[1];
+		col[2] = w00*c00[2] + w10*c10[2] + w01*c01[2] + w11*c11[2];
+		col[3] = w00*c00[3] + w10*c10[3] + w01*c01[3] + w11*c11[3];
+#endif
+	}
+	else {
+#ifdef __SSE2__
+		_mm_storeu_ps(col, ibuf_get_texel_sse(ibuf, (int)u, (int)v));
+#else
+		ibuf_get_texel(col, ibuf, (int)u, (int)v);
+#endif
+	}
 }
 
 static void area_sample(TexResult* texr, ImBuf* ibuf, float fx, float fy, afdata_t* AFD)
@@ -738,7 +835,7 @@ static void area_sample(TexResult* texr, ImBuf* ibuf, float fx, float fy, afdata
 			const float sv = (ys + ((xs & 1) + 0.5f)*0.5f)*ysd - 0.5f;
 			const float pu = fx + su*AFD->dxt[0] + sv*AFD->dyt[0];
 			const float pv = fy + su*AFD->dxt[1] + sv*AFD->dyt[1];
-			const int out = ibuf_get_color_clip_bilerp(tc, ibuf, pu*ibuf->x, pv*ibuf->y, AFD->intpol, AFD->extflag);
+			const int out = ibuf_get_color_clip_bilerp(tc, ibuf, pu*ibuf->x, pv*ibuf->y, AFD->intpol, AFD->extflag, AFD->thread);
 			clip |= out;
 			cw += out ? 0.f : 1.f;
 			texr->tr += tc[0];
@@ -896,7 +993,46 @@ static void ewa_eval(TexResult* texr, ImBuf* ibuf, float fx, float fy, afdata_t*
 	BU = B*U;
 
 	d = texr->tr = texr->tb = texr->tg = texr->ta = 0.f;
-	for (v=v1; v<=v2; ++v) {
+	if (ibuf_direct_access(ibuf) && ibuf_inside(ibuf, u1, v1, u2, v2)) {
+		// ellipse fully inside the image, walk the rows without clipping
+		float sum[4];
+#ifdef __SSE2__
+		__m128 vsum = _mm_setzero_ps();
+#else
+		sum[0] = sum[1] = sum[2] = sum[3] = 0.f;
+#endif
+		for (v=v1; v<=v2; ++v) {
+			const float V = v - V0;
+			float DQ = ac1 + B*V;
+			float Q = (C*V + BU)*V + ac2;
+			for (u=u1; u<=u2; ++u) {
+				if (Q < (float)(EWA_MAXIDX + 1)) {
+					const float wt = EWA_WTS[(Q < 0.f) ? 0 : (unsigned int)Q];
+#ifdef __SSE2__
+					vsum = _mm_add_ps(vsum, _mm_mul_ps(ibuf_get_texel_sse(ibuf, u, v), _mm_set_ps1(wt)));
+#else
+					float tc[4];
+					ibuf_get_texel(tc, ibuf, u, v);
+					sum[0] += tc[0]*wt;
+					sum[1] += tc[1]*wt;
+					sum[2] += tc[2]*wt;
+					sum[3] += tc[3]*wt;
+#endif
+					d += wt;
+				}
+				Q += DQ;
+				DQ += DDQ;
+			}
+		}
+#ifdef __SSE2__
+		_mm_storeu_ps(sum, vsum);
+#endif
+		texr->tr = sum[0];
+		texr->tg = sum[1];
+		texr->tb = sum[2];
+		texr->ta = texr->talpha ? sum[3] : 0.f;
+	}
+	else for (v=v1; v<=v2; ++v) {
 		const float V = v - V0;
 		float DQ = ac1 + B*V;
 		float Q = (C*V + BU)*V + ac2;
@@ -904,7 +1040,7 @@ static void ewa_eval(TexResult* texr, ImBuf* ibuf, float fx, float fy, afdata_t*
 			if (Q < (float)(EWA_MAXIDX + 1)) {
 				float tc[4];
 				const float wt = EWA_WTS[(Q < 0.f) ? 0 : (unsigned int)Q];
-				/*const int out =*/ ibuf_get_color_clip(tc, ibuf, u, v, AFD->extflag);
+				/*const int out =*/ ibuf_get_color_clip(tc, ibuf, u, v, AFD->extflag, AFD->thread);
 				// TXF alpha: clip |= out;
 				// TXF alpha: cw += out ? 0.f : wt;
 				texr->tr += tc[0]*wt;
@@ -935,11 +1071,17 @@ static void feline_eval(TexResult* texr, ImBuf* ibuf, float fx, float fy, afdata
 	float dv = maxn ? sinf(AFD->theta)*ll : 0.f;
 	//const float D = -0.5f*(du*du + dv*dv) / (AFD->majrad*AFD->majrad);
 	const float D = (EWA_MAXIDX + 1)*0.25f*(du*du + dv*dv) / (AFD->majrad*AFD->majrad);
-	float d; // TXF alpha: cw = 0.f;
-	int n; // TXF alpha: clip = 0;
+	float d, pu, pv; // TXF alpha: cw = 0.f;
+	int n, inside; // TXF alpha: clip = 0;
 	// have to use same scaling for du/dv here as for Ux/Vx/Uy/Vy (*after* D calc.)
 	du *= AFD->dusc;
 	dv *= AFD->dvsc;
+	// probes lie on a line, if both ends are inside with a texel margin for bilerp, all are
+	pu = 0.5f*maxn*fabsf(du);
+	pv = 0.5f*maxn*fabsf(dv);
+	inside = ibuf_direct_access(ibuf) &&
+		ibuf_inside(ibuf, (int)floorf(ibuf->x*(fx - pu)) - 1, (int)floorf(ibuf->y*(fy - pv)) - 1,
+			(int)floorf(ibuf->x*(fx + pu)) + 1, (int)floorf(ibuf->y*(fy + pv)) + 1);
 	d = texr->tr = texr->tb = texr->tg = texr->ta = 0.f;
 	for (n=-maxn; n<=maxn; n+=2) {
 		float tc[4];
@@ -948,7 +1090,10 @@ static void feline_eval(TexResult* texr, ImBuf* ibuf, float fx, float fy, afdata
 		//const float wt = expf(n*n*D);
 		// can use ewa table here too
 		const float wt = EWA_WTS[(int)(n*n*D)];
-		/*const int out =*/ ibuf_get_color_clip_bilerp(tc, ibuf, ibuf->x*u, ibuf->y*v, AFD->intpol, AFD->extflag);
+		if (inside)
+			ibuf_get_color_bilerp_inside(tc, ibuf, ibuf->x*u, ibuf->y*v, AFD->intpol);
+		else
+			/*const int out =*/ ibuf_get_color_clip_bilerp(tc, ibuf, ibuf->x*u, ibuf->y*v, AFD->intpol, AFD->extflag, AFD->thread);
 		// TXF alpha: clip |= out;
 		// TXF alpha: cw += out ? 0.f : wt;
 		texr->tr += tc[0]*wt;
@@ -998,7 +1143,8 @@ static void alpha_clip_aniso(ImBuf *ibuf, float minx, float miny, float maxx, fl
 static void image_mipmap_test(Tex *tex, ImBuf *ibuf)
 {
 	if (tex->imaflag & TEX_MIPMAP) {
-		if ((ibuf->flags & IB_fields) == 0) {
+		/* tiled images come with their mipmaps */
+		if ((ibuf->flags & (IB_fields|IB_tilecache)) == 0) {
 			
 			if (ibuf->mipmap[0] && (ibuf->userflags & IB_MIPMAP_INVALID)) {
 				BLI_lock_thread(LOCK_IMAGE);
@@ -1019,7 +1165,7 @@ static void image_mipmap_test(Tex *tex, ImBuf *ibuf)
 	
 }
 
-static int imagewraposa_aniso(Tex *tex, Image *ima, ImBuf *ibuf, float *texvec, float *dxt, float *dyt, TexResult *texres)
+static int imagewraposa_aniso(Tex *tex, Image *ima, ImBuf *ibuf, float *texvec, float *dxt, float *dyt, TexResult *texres, int thread)
 {
 	TexResult texr;
 	float fx, fy, minx, maxx, miny, maxy;
@@ -1053,7 +1199,7 @@ static int imagewraposa_aniso(Tex *tex, Image *ima, ImBuf *ibuf, float *texvec,
 		ibuf = BKE_image_get_ibuf(ima, &tex->iuser); 
 	}
 
-	if ((ibuf == NULL) || ((ibuf->rect == NULL) && (ibuf->rect_float == NULL))) return retval;
+	if ((ibuf == NULL) || !ibuf_has_pixels(ibuf)) return retval;
 
 	/* mipmap test */
 	image_mipmap_test(tex, ibuf);
@@ -1206,6 +1352,7 @@ static int imagewraposa_aniso(Tex *tex, Image *ima, ImBuf *ibuf, float *texvec,
 	copy_v2_v2(AFD.dyt, dyt);
 	AFD.intpol = intpol;
 	AFD.extflag = extflag;
+	AFD.thread = thread;
 
 	// brecht: added stupid clamping here, large dx/dy can give very large
 	// filter sizes which take ages to render, it may be better to do this
@@ -1409,7 +1556,7 @@ static int imagewraposa_aniso(Tex *tex, Image *ima, ImBuf *ibuf, float *texvec,
 }
 
 
-int imagewraposa(Tex *tex, Image *ima, ImBuf *ibuf, float *texvec, float *DXT, float *DYT, TexResult *texres)
+int imagewraposa(Tex *tex, Image *ima, ImBuf *ibuf, float *texvec, float *DXT, float *DYT, TexResult *texres, int thread)
 {
 	TexResult texr;
 	float fx, fy, minx, maxx, miny, maxy, dx, dy, dxt[3], dyt[3];
@@ -1423,7 +1570,7 @@ int imagewraposa(Tex *tex, Image *ima, ImBuf *ibuf, float *texvec, float *DXT, f
 
 	// anisotropic filtering
 	if (tex->texfilter != TXF_BOX)
-		return imagewraposa_aniso(tex, ima, ibuf, texvec, dxt, dyt, texres);
+		return imagewraposa_aniso(tex, ima, ibuf, texvec, dxt, dyt, texres, thread);
 
 	texres->tin= texres->ta= texres->tr= texres->tg= texres->tb= 0.0f;
 	
@@ -1441,7 +1588,7 @@ int imagewraposa(Tex *tex, Image *ima, ImBuf *ibuf, float *texvec, float *DXT, f
 		
 		ibuf= BKE_image_get_ibuf(ima, &tex->iuser); 
 	}
-	if(ibuf==NULL || (ibuf->rect==NULL && ibuf->rect_float==NULL))
+	if(ibuf==NULL || !ibuf_has_pixels(ibuf))
 		return retval;
 	
 	/* mipmap test */
@@ -1653,11 +1800,11 @@ int imagewraposa(Tex *tex, Image *ima, ImBuf *ibuf, float *texvec, float *DXT, f
 			//minx*= 1.35f;
 			//miny*= 1.35f;
 			
-			boxsample(curibuf, fx-minx, fy-miny, fx+minx, fy+miny, texres, imaprepeat, imapextend);
+			boxsample(curibuf, fx-minx, fy-miny, fx+minx, fy+miny, texres, imaprepeat, imapextend, thread);
 			val1= texres->tr+texres->tg+texres->tb;
-			boxsample(curibuf, fx-minx+dxt[0], fy-miny+dxt[1], fx+minx+dxt[0], fy+miny+dxt[1], &texr, imaprepeat, imapextend);
+			boxsample(curibuf, fx-minx+dxt[0], fy-miny+dxt[1], fx+minx+dxt[0], fy+miny+dxt[1], &texr, imaprepeat, imapextend, thread);
 			val2= texr.tr + texr.tg + texr.tb;
-			boxsample(curibuf, fx-minx+dyt[0], fy-miny+dyt[1], fx+minx+dyt[0], fy+miny+dyt[1], &texr, imaprepeat, imapextend);
+			boxsample(curibuf, fx-minx+dyt[0], fy-miny+dyt[1], fx+minx+dyt[0], fy+miny+dyt[1], &texr, imaprepeat, imapextend, thread);
 			val3= texr.tr + texr.tg + texr.tb;
 
 			/* don't switch x or y! */
@@ -1666,7 +1813,7 @@ int imagewraposa(Tex *tex, Image *ima, ImBuf *ibuf, float *texvec, float *DXT, f
 			
 			if(previbuf!=curibuf) {  /* interpolate */
 				
-				boxsample(previbuf, fx-minx, fy-miny, fx+minx, fy+miny, &texr, imaprepeat, imapextend);
+				boxsample(previbuf, fx-minx, fy-miny, fx+minx, fy+miny, &texr, imaprepeat, imapextend, thread);
 				
 				/* calc rgb */
 				dx= 2.0f*(pixsize-maxd)/pixsize;
@@ -1683,9 +1830,9 @@ int imagewraposa(Tex *tex, Image *ima, ImBuf *ibuf, float *texvec, float *DXT, f
 				}
 				
 				val1= dy*val1+ dx*(texr.tr + texr.tg + texr.tb);
-				boxsample(previbuf, fx-minx+dxt[0], fy-miny+dxt[1], fx+minx+dxt[0], fy+miny+dxt[1], &texr, imaprepeat, imapextend);
+				boxsample(previbuf, fx-minx+dxt[0], fy-miny+dxt[1], fx+minx+dxt[0], fy+miny+dxt[1], &texr, imaprepeat, imapextend, thread);
 				val2= dy*val2+ dx*(texr.tr + texr.tg + texr.tb);
-				boxsample(previbuf, fx-minx+dyt[0], fy-miny+dyt[1], fx+minx+dyt[0], fy+miny+dyt[1], &texr, imaprepeat, imapextend);
+				boxsample(previbuf, fx-minx+dyt[0], fy-miny+dyt[1], fx+minx+dyt[0], fy+miny+dyt[1], &texr, imaprepeat, imapextend, thread);
 				val3= dy*val3+ dx*(texr.tr + texr.tg + texr.tb);
 				
 				texres->nor[0]= (val1-val2);	/* vals have been interpolated above! */
@@ -1708,10 +1855,10 @@ int imagewraposa(Tex *tex, Image *ima, ImBuf *ibuf, float *texvec, float *DXT, f
 			maxy= fy+miny;
 			miny= fy-miny;
 
-			boxsample(curibuf, minx, miny, maxx, maxy, texres, imaprepeat, imapextend);
+			boxsample(curibuf, minx, miny, maxx, maxy, texres, imaprepeat, imapextend, thread);
 
 			if(previbuf!=curibuf) {  /* interpolate */
-				boxsample(previbuf, minx, miny, maxx, maxy, &texr, imaprepeat, imapextend);
+				boxsample(previbuf, minx, miny, maxx, maxy, &texr, imaprepeat, imapextend, thread);
 				
 				fx= 2.0f*(pixsize-maxd)/pixsize;
 				
@@ -1737,11 +1884,11 @@ int imagewraposa(Tex *tex, Image *ima, ImBuf *ibuf, float *texvec, float *DXT, f
 		}
 
 		if(texres->nor && (tex->imaflag & TEX_NORMALMAP)==0) {
-			boxsample(ibuf, fx-minx, fy-miny, fx+minx, fy+miny, texres, imaprepeat, imapextend);
+			boxsample(ibuf, fx-minx, fy-miny, fx+minx, fy+miny, texres, imaprepeat, imapextend, thread);
 			val1= texres->tr+texres->tg+texres->tb;
-			boxsample(ibuf, fx-minx+dxt[0], fy-miny+dxt[1], fx+minx+dxt[0], fy+miny+dxt[1], &texr, imaprepeat, imapextend);
+			boxsample(ibuf, fx-minx+dxt[0], fy-miny+dxt[1], fx+minx+dxt[0], fy+miny+dxt[1], &texr, imaprepeat, imapextend, thread);
 			val2= texr.tr + texr.tg + texr.tb;
-			boxsample(ibuf, fx-minx+dyt[0], fy-miny+dyt[1], fx+minx+dyt[0], fy+miny+dyt[1], &texr, imaprepeat, imapextend);
+			boxsample(ibuf, fx-minx+dyt[0], fy-miny+dyt[1], fx+minx+dyt[0], fy+miny+dyt[1], &texr, imaprepeat, imapextend, thread);
 			val3= texr.tr + texr.tg + texr.tb;
 
 			/* don't switch x or y! */
@@ -1749,7 +1896,7 @@ int imagewraposa(Tex *tex, Image *ima, ImBuf *ibuf, float *texvec, float *DXT, f
 			texres->nor[1]= (val1-val3);
 		}
 		else
-			boxsample(ibuf, fx-minx, fy-miny, fx+minx, fy+miny, texres, imaprepeat, imapextend);
+			boxsample(ibuf, fx-minx, fy-miny, fx+minx, fy+miny, texres, imaprepeat, imapextend, thread);
 	}
 	
 	if(tex->imaflag & TEX_CALCALPHA) {
@@ -1803,7 +1950,7 @@ void image_sample(Image *ima, float fx, float fy, float dx, float dy, float *res
 		ibuf->rect+= (ibuf->x*ibuf->y);
 
 	texres.talpha= 1; /* boxsample expects to be initialized */
-	boxsample(ibuf, fx, fy, fx+dx, fy+dy, &texres, 0, 1);
+	boxsample(ibuf, fx, fy, fx+dx, fy+dy, &texres, 0, 1, -1);
 	result[0]= texres.tr;
 	result[1]= texres.tg;
 	result[2]= texres.tb;
@@ -1829,6 +1976,7 @@ void ibuf_sample(ImBuf *ibuf, float fx, float fy, float dx, float dy, float *res
 	
 	AFD.intpol = 1;
 	AFD.extflag = TXC_EXTD;
+	AFD.thread = -1;
 	
 	memset(&texres, 0, sizeof(texres));
 	ewa_eval(&texres, ibuf, fx, fy, &AFD);
@@ -486,6 +486,7 @@ void freeparts(Render *re)
 	while(part) {
 		if(part->rectp) MEM_freeN(part->rectp);
 		if(part->rectz) MEM_freeN(part->rectz);
+		if(part->binface) MEM_freeN(part->binface);
 		part= part->next;
 	}
 	BLI_freelistN(&re->parts);
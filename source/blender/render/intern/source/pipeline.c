@@ -122,7 +122,13 @@ static struct {
 
 	/* commandline thread override */
 	int threads;
-} RenderGlobal = {{NULL, NULL}, -1}; 
+	
+	/* commandline render statistics output */
+	char statspath[FILE_MAX];
+	
+	/* commandline texture tile cache memory limit in MB, 0 is off */
+	int texcachemem;
+} RenderGlobal = {{NULL, NULL}, -1, "", 0}; 
 
 /* hardcopy of current render, used while rendering for speed */
 Render R;
@@ -1166,6 +1172,157 @@ RenderStats *RE_GetStats(Render *re)
 	return &re->i;
 }
 
+/* ********* ray counter and timing statistics ******** */
+
+static void free_process_stats(Render *re)
+{
+	RenderProcessStats *ps;
+	
+	for(ps= re->processstats.first; ps; ps= ps->next)
+		BLI_freelistN(&ps->parts);
+	BLI_freelistN(&re->processstats);
+}
+
+static void write_json_string(FILE *fp, const char *str)
+{
+	fputc('"', fp);
+	for(; *str; str++) {
+		if(ELEM(*str, '"', '\\'))
+			fputc('\\', fp);
+		fputc(*str, fp);
+	}
+	fputc('"', fp);
+}
+
+static void write_json_counter(FILE *fp, RayCounter *rc)
+{
+	fprintf(fp, "\"rays\": %llu, \"hits\": %llu, \"nodes\": %llu, \"primitives\": %llu, \"primitive_hits\": %llu",
+		rc->raycast.test, rc->raycast.hit, RE_RC_NODES(rc), rc->faces.test, rc->faces.hit);
+}
+
+/* tile cache hits of images loaded tiled, counted since they were loaded */
+static void write_texture_stats_json(Render *re, FILE *fp)
+{
+	Image *ima;
+	ImBuf *ibuf;
+	double hits, loads;
+	int first= 1;
+	
+	fprintf(fp, ",\n\t\"textures\": [");
+	
+	for(ima= re->main->image.first; ima; ima= ima->id.next) {
+		for(ibuf= ima->ibufs.first; ibuf; ibuf= ibuf->next) {
+			if(!(ibuf->flags & IB_tilecache))
+				continue;
+			
+			IMB_tile_cache_stats(ibuf, &hits, &loads);
+			
+			fprintf(fp, "%s\n\t\t{\"image\": ", first? "": ",");
+			write_json_string(fp, ima->id.name+2);
+			fprintf(fp, ", \"file\": ");
+			write_json_string(fp, ibuf->cachename);
+			fprintf(fp, ", \"hits\": %.0f, \"loads\": %.0f, \"hit_rate\": %f}",
+				hits, loads, (hits + loads > 0.0)? hits/(hits + loads): 0.0);
+			first= 0;
+		}
+	}
+	
+	fprintf(fp, "\n\t]");
+}
+
+static void write_process_stats_json(Render *re, FILE *fp)
+{
+	RenderProcessStats *ps;
+	RenderPartStats *pst;
+	RayCounter total;
+	
+	RE_RC_CLEAR(&total);
+	for(ps= re->processstats.first; ps; ps= ps->next)
+		RE_RC_MERGE(&total, &ps->raycounter);
+	
+	fprintf(fp, "{\n\t\"scene\": ");
+	write_json_string(fp, re->scene->id.name+2);
+	fprintf(fp, ",\n\t\"frame\": %d,\n\t\"time\": %f,\n\t", re->r.cfra, re->i.lastframetime);
+	write_json_counter(fp, &total);
+	fprintf(fp, ",\n\t\"passes\": [");
+	
+	for(ps= re->processstats.first; ps; ps= ps->next) {
+		fprintf(fp, "%s\n\t\t{\"time\": %f, ", ps->prev? ",": "", ps->time);
+		write_json_counter(fp, &ps->raycounter);
+		fprintf(fp, ", \"parts\": [");
+		
+		for(pst= ps->parts.first; pst; pst= pst->next) {
+			fprintf(fp, "%s\n\t\t\t{\"part\": %d, \"thread\": %d, \"rect\": [%d, %d, %d, %d], \"time\": %f, ",
+				pst->prev? ",": "", pst->nr, pst->thread,
+				pst->disprect.xmin, pst->disprect.ymin, pst->disprect.xmax, pst->disprect.ymax, pst->time);
+			write_json_counter(fp, &pst->raycounter);
+			fprintf(fp, "}");
+		}
+		
+		fprintf(fp, "\n\t\t]}");
+	}
+	
+	fprintf(fp, "\n\t]");
+	
+	if(RenderGlobal.texcachemem)
+		write_texture_stats_json(re, fp);
+	
+	fprintf(fp, "\n}\n");
+}
+
+static void write_process_stats_csv(Render *re, FILE *fp)
+{
+	RenderProcessStats *ps;
+	RenderPartStats *pst;
+	int pass;
+	
+	fprintf(fp, "frame,pass,part,thread,xmin,ymin,xmax,ymax,time,rays,hits,nodes,primitives,primitive_hits\n");
+	
+	for(ps= re->processstats.first, pass= 0; ps; ps= ps->next, pass++) {
+		for(pst= ps->parts.first; pst; pst= pst->next) {
+			RayCounter *rc= &pst->raycounter;
+			
+			fprintf(fp, "%d,%d,%d,%d,%d,%d,%d,%d,%f,%llu,%llu,%llu,%llu,%llu\n",
+				re->r.cfra, pass, pst->nr, pst->thread,
+				pst->disprect.xmin, pst->disprect.ymin, pst->disprect.xmax, pst->disprect.ymax, pst->time,
+				rc->raycast.test, rc->raycast.hit, RE_RC_NODES(rc), rc->faces.test, rc->faces.hit);
+		}
+	}
+}
+
+/* writes the statistics of the last rendered frame */
+static void write_process_stats(Render *re)
+{
+	char filepath[FILE_MAX];
+	const char *ext;
+	FILE *fp;
+	
+	BLI_strncpy(filepath, RenderGlobal.statspath, sizeof(filepath));
+	BLI_path_abs(filepath, re->main->name);
+	
+	ext= BLI_testextensie(filepath, ".csv")? ".csv": ".json";
+	BLI_replace_extension(filepath, sizeof(filepath), "");
+	BLI_path_frame(filepath, re->r.cfra, 4);
+	BLI_replace_extension(filepath, sizeof(filepath), ext);
+	
+	BLI_make_existing_file(filepath);
+	fp= fopen(filepath, "w");
+	if(fp==NULL) {
+		printf("Error: cannot write render statistics to %s\n", filepath);
+		return;
+	}
+	
+	if(ext[1]=='c')
+		write_process_stats_csv(re, fp);
+	else
+		write_process_stats_json(re, fp);
+	
+	fclose(fp);
+	
+	if(G.f & G_DEBUG)
+		printf("Saved render statistics: %s\n", filepath);
+}
+
 Render *RE_NewRender(const char *name)
 {
 	Render *re;
@@ -1214,6 +1371,7 @@ void RE_FreeRender(Render *re)
 	
 	free_renderdata_tables(re);
 	free_sample_tables(re);
+	free_process_stats(re);
 	
 	RE_FreeRenderResult(re->result);
 	RE_FreeRenderResult(re->pushedresult);
@@ -1242,6 +1400,8 @@ void RE_InitState(Render *re, Render *source, RenderData *rd, SceneRenderLayer *
 	re->i.starttime= PIL_check_seconds_timer();
 	re->r= *rd;		/* hardcopy */
 	
+	free_process_stats(re);
+	
 	re->winx= winx;
 	re->winy= winy;
 	if(disprect) {
@@ -1337,6 +1497,10 @@ void RE_InitState(Render *re, Render *source, RenderData *rd, SceneRenderLayer *
 	re->mblur_offs = re->field_offs = 0.f;
 	
 	RE_init_threadcount(re);
+	
+	/* textures loaded tiled are read through the tile cache per thread */
+	if(RenderGlobal.texcachemem)
+		IMB_tile_cache_params(re->r.threads, RenderGlobal.texcachemem);
 }
 
 /* part of external api, not called for regular render pipeline */
@@ -1472,6 +1636,9 @@ static void *do_part_thread(void *pa_v)
 	
 	/* need to return nicely all parts on esc */
 	if(R.test_break(R.tbh)==0) {
+		double starttime= PIL_check_seconds_timer();
+		
+		RE_RC_CLEAR(&re_rc_counter[pa->thread]);
 		
 		if(!R.sss_points && (R.r.scemode & R_FULL_SAMPLE))
 			pa->result= new_full_sample_buffers(&R, &pa->fullresult, &pa->disprect, pa->crop);
@@ -1485,6 +1652,9 @@ static void *do_part_thread(void *pa_v)
 		else
 			zbufshade_tile(pa);
 		
+		pa->raycounter= re_rc_counter[pa->thread];
+		pa->time= PIL_check_seconds_timer() - starttime;
+		
 		/* merge too on break! */
 		if(R.result->exrhandle) {
 			RenderResult *rr, *rrpart;
@@ -1620,6 +1790,20 @@ static void print_part_stats(Render *re, RenderPart *pa)
 	re->i.infostr= NULL;
 }
 
+static void add_part_stats(RenderProcessStats *ps, RenderPart *pa)
+{
+	RenderPartStats *pst= MEM_callocN(sizeof(RenderPartStats), "RenderPartStats");
+	
+	pst->disprect= pa->disprect;
+	pst->nr= pa->nr;
+	pst->thread= pa->thread;
+	pst->time= pa->time;
+	pst->raycounter= pa->raycounter;
+	BLI_addtail(&ps->parts, pst);
+	
+	RE_RC_MERGE(&ps->raycounter, &pa->raycounter);
+}
+
 /* make osa new results for samples */
 static RenderResult *new_full_sample_buffers_exr(Render *re)
 {
@@ -1638,7 +1822,9 @@ static void threaded_tile_processor(Render *re)
 {
 	ListBase threads;
 	RenderPart *pa, *nextpa;
+	RenderProcessStats *ps;
 	rctf viewplane= re->viewplane;
+	double starttime= PIL_check_seconds_timer();
 	int rendering=1, counter= 1, drawtimer=0, hasdrawn, minx=0;
 	
 	BLI_rw_mutex_lock(&re->resultmutex, THREAD_LOCK_WRITE);
@@ -1663,6 +1849,13 @@ static void threaded_tile_processor(Render *re)
 	/* warning; no return here without closing exr file */
 	
 	initparts(re);
+	
+	/* project faces once and bin them per part, the sss zbuffer doesn't use this */
+	if(re->sss_points==NULL)
+		zbuffer_bin_parts(re);
+	
+	ps= MEM_callocN(sizeof(RenderProcessStats), "RenderProcessStats");
+	BLI_addtail(&re->processstats, ps);
 
 	if(re->result->exrhandle) {
 		RenderResult *rr;
@@ -1727,6 +1920,7 @@ static void threaded_tile_processor(Render *re)
 					if(render_display_draw_enabled(re))
 						re->display_draw(re->ddh, pa->result, NULL);
 					print_part_stats(re, pa);
+					add_part_stats(ps, pa);
 					
 					free_render_result(&pa->fullresult, pa->result);
 					pa->result= NULL;
@@ -1778,6 +1972,8 @@ static void threaded_tile_processor(Render *re)
 	BLI_end_threads(&threads);
 	freeparts(re);
 	re->viewplane= viewplane; /* restore viewplane, modified by pano render */
+	
+	ps->time= PIL_check_seconds_timer() - starttime;
 }
 
 /* currently only called by preview renders and envmap */
@@ -2641,6 +2837,9 @@ static void do_render_all_options(Render *re)
 	
 	re->stats_draw(re->sdh, &re->i);
 	
+	if(RenderGlobal.statspath[0])
+		write_process_stats(re);
+	
 	/* stamp image info here */
 	if((re->r.stamp & R_STAMP_ALL) && (re->r.stamp & R_STAMP_DRAW)) {
 		renderresult_stampinfo(re);
@@ -3239,6 +3438,21 @@ void RE_set_max_threads(int threads)
 	}
 }
 
+/* '#' characters in the path are replaced by the frame number,
+ * a .csv extension writes one row per part instead of json */
+void RE_set_stats_output(const char *filepath)
+{
+	BLI_strncpy(RenderGlobal.statspath, filepath, sizeof(RenderGlobal.statspath));
+}
+
+/* tiled mipmapped images (.tx files) are loaded on demand with this memory
+ * limit in MB instead of fully, for background renders */
+void RE_set_texture_cache(int maxmem)
+{
+	RenderGlobal.texcachemem= MAX2(maxmem, 0);
+	BKE_image_use_tile_cache(RenderGlobal.texcachemem > 0);
+}
+
 void RE_init_threadcount(Render *re) 
 {
 	if(RenderGlobal.threads >= 1) { /* only set as an arg in background mode */
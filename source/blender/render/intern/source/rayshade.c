@@ -140,11 +140,6 @@ static RayObject*  RE_rayobject_create(Render *re, int type, int size)
 	return res;
 }
 
-#ifdef RE_RAYCOUNTER
-RayCounter re_rc_counter[BLENDER_MAX_THREADS];
-#endif
-
-
 void freeraytree(Render *re)
 {
 	ObjectInstanceRen *obi;
@@ -184,17 +179,6 @@ void freeraytree(Render *re)
 			obi->raytree = NULL;
 		}
 	}
-	
-#ifdef RE_RAYCOUNTER
-	{
-		RayCounter sum;
-		memset( &sum, 0, sizeof(sum) );
-		int i;
-		for(i=0; i<BLENDER_MAX_THREADS; i++)
-			RE_RC_MERGE(&sum, re_rc_counter+i);
-		RE_RC_INFO(&sum);
-	}
-#endif
 }
 
 static int is_raytraceable_vlr(Render *re, VlakRen *vlr)
@@ -478,10 +462,6 @@ void makeraytree(Render *re)
 		re->i.infostr= "Raytree finished";
 		re->stats_draw(re->sdh, &re->i);
 	}
-
-#ifdef RE_RAYCOUNTER
-	memset( re_rc_counter, 0, sizeof(re_rc_counter) );
-#endif
 }
 
 /* 	if(shi->osatex)  */
@@ -745,7 +725,7 @@ static void traceray(ShadeInput *origshi, ShadeResult *origshr, short depth, flo
 
 	isec.orig.ob   = obi;
 	isec.orig.face = vlr;
-	RE_RC_INIT(isec, shi);
+	RE_RC_INIT(isec, *origshi);
 
 	if(RE_rayobject_raycast(R.raytree, &isec)) {
 		ShadeResult shr= {{0}};
@@ -889,7 +869,6 @@ static void traceray(ShadeInput *origshi, ShadeResult *origshr, short depth, flo
 	else {
 		ray_fadeout_endcolor(col, origshi, &shi, origshr, &isec, dir);
 	}
-	RE_RC_MERGE(&origshi->raycounter, &shi.raycounter);
 }
 
 /* **************** jitter blocks ********** */
@@ -1672,8 +1651,6 @@ static void ray_trace_shadow_tra(Isect *is, ShadeInput *origshi, int depth, int
 
 			ray_trace_shadow_tra(is, origshi, depth-1, traflag | RAY_TRA, col);
 		}
-		
-		RE_RC_MERGE(&origshi->raycounter, &shi.raycounter);
 	}
 }
 
@@ -1704,7 +1681,7 @@ static int UNUSED_FUNCTION(ray_trace_shadow_rad)(ShadeInput *ship, ShadeResult *
 
 	VECCOPY(isec.start, ship->co);
 	
-	RE_RC_INIT(isec, shi);
+	RE_RC_INIT(isec, *ship);
 	
 	for(a=0; a<8*8; a++) {
 		
@@ -1204,15 +1204,15 @@ static int multitex(Tex *tex, float *texvec, float *dxt, float *dyt, int osatex,
 		retval= texnoise(tex, texres); 
 		break;
 	case TEX_IMAGE:
-		if(osatex) retval= imagewraposa(tex, tex->ima, NULL, texvec, dxt, dyt, texres);
-		else retval= imagewrap(tex, tex->ima, NULL, texvec, texres); 
+		if(osatex) retval= imagewraposa(tex, tex->ima, NULL, texvec, dxt, dyt, texres, thread);
+		else retval= imagewrap(tex, tex->ima, NULL, texvec, texres, thread); 
 		tag_image_time(tex->ima); /* tag image as having being used */
 		break;
 	case TEX_PLUGIN:
 		retval= plugintex(tex, texvec, dxt, dyt, osatex, texres);
 		break;
 	case TEX_ENVMAP:
-		retval= envmaptex(tex, texvec, dxt, dyt, osatex, texres);
+		retval= envmaptex(tex, texvec, dxt, dyt, osatex, texres, thread);
 		break;
 	case TEX_MUSGRAVE:
 		/* newnoise: musgrave types */
@@ -3456,8 +3456,8 @@ void render_realtime_texture(ShadeInput *shi, Image *ima)
 	
 	texr.nor= NULL;
 	
-	if(shi->osatex) imagewraposa(tex, ima, NULL, texvec, dx, dy, &texr);
-	else imagewrap(tex, ima, NULL, texvec, &texr); 
+	if(shi->osatex) imagewraposa(tex, ima, NULL, texvec, dx, dy, &texr, shi->thread);
+	else imagewrap(tex, ima, NULL, texvec, &texr, shi->thread); 
 
 	shi->vcol[0]*= texr.tr;
 	shi->vcol[1]*= texr.tg;
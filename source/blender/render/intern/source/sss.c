@@ -57,6 +57,7 @@
 #include "BLI_utildefines.h"
 #include "BLI_ghash.h"
 #include "BLI_memarena.h"
+#include "BLI_threads.h"
 
 #include "PIL_time.h"
 
@@ -78,6 +79,10 @@
 #include "sss.h"
 #include "zbuf.h"
 
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
 extern Render R; // meh
 
 /* Generic Multiple Scattering API */
@@ -145,16 +150,23 @@ typedef struct ScatterNode {
 
 struct ScatterTree {
 	MemArena *arena;
+	MemArena *subarena[8];	/* one per root child when building threaded */
 
 	ScatterSettings *ss[3];
 	float error, scale;
 
+	/* Rd tables of the three channels interleaved, so that a lookup
+	   for all channels touches a single cache line */
+	float (*tableRd)[4];
+	float (*tableRd2)[4];
+
 	ScatterNode *root;
 	ScatterPoint *points;
 	ScatterPoint **refpoints;
 	ScatterPoint **tmppoints;
 	int totpoint;
 	float min[3], max[3];
+	int totbuildthread;	/* threads the root's subtrees are built with */
 };
 
 typedef struct ScatterResult {
@@ -238,7 +250,24 @@ static float Rd(ScatterSettings *ss, float r)
    a lookup with the squared distance for smaller distances, saving
    another sqrt. */
 
-static void approximate_Rd_rgb(ScatterSettings **ss, float rr, float *rd)
+static void lerp_Rd_rgb(float (*table)[4], int index, float t, float *rd)
+{
+#ifdef __SSE__
+	__m128 a= _mm_loadu_ps(table[index]);
+	__m128 b= _mm_loadu_ps(table[index+1]);
+
+	_mm_storeu_ps(rd, _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), _mm_set_ps1(t))));
+#else
+	float *a= table[index], *b= table[index+1];
+
+	rd[0]= a[0]*(1-t) + b[0]*t;
+	rd[1]= a[1]*(1-t) + b[1]*t;
+	rd[2]= a[2]*(1-t) + b[2]*t;
+#endif
+}
+
+/* rd must have room for 4 floats, the last one is padding */
+static void approximate_Rd_rgb(ScatterTree *tree, float rr, float *rd)
 {
 	float indexf, t, idxf;
 	int index;
@@ -252,9 +281,7 @@ static void approximate_Rd_rgb(ScatterSettings **ss, float rr, float *rd)
 		t= indexf - idxf;
 
 		if(index >= 0 && index < RD_TABLE_SIZE) {
-			rd[0]= (ss[0]->tableRd2[index]*(1-t) + ss[0]->tableRd2[index+1]*t);
-			rd[1]= (ss[1]->tableRd2[index]*(1-t) + ss[1]->tableRd2[index+1]*t);
-			rd[2]= (ss[2]->tableRd2[index]*(1-t) + ss[2]->tableRd2[index+1]*t);
+			lerp_Rd_rgb(tree->tableRd2, index, t, rd);
 			return;
 		}
 	}
@@ -265,17 +292,15 @@ static void approximate_Rd_rgb(ScatterSettings **ss, float rr, float *rd)
 		t= indexf - idxf;
 
 		if(index >= 0 && index < RD_TABLE_SIZE) {
-			rd[0]= (ss[0]->tableRd[index]*(1-t) + ss[0]->tableRd[index+1]*t);
-			rd[1]= (ss[1]->tableRd[index]*(1-t) + ss[1]->tableRd[index+1]*t);
-			rd[2]= (ss[2]->tableRd[index]*(1-t) + ss[2]->tableRd[index+1]*t);
+			lerp_Rd_rgb(tree->tableRd, index, t, rd);
 			return;
 		}
 	}
 
 	/* fallback to slow Rd computation */
-	rd[0]= Rd_rsquare(ss[0], rr);
-	rd[1]= Rd_rsquare(ss[1], rr);
-	rd[2]= Rd_rsquare(ss[2], rr);
+	rd[0]= Rd_rsquare(tree->ss[0], rr);
+	rd[1]= Rd_rsquare(tree->ss[1], rr);
+	rd[2]= Rd_rsquare(tree->ss[2], rr);
 }
 
 static void build_Rd_table(ScatterSettings *ss)
@@ -352,9 +377,9 @@ void scatter_settings_free(ScatterSettings *ss)
 	
 static void add_radiance(ScatterTree *tree, float *frontrad, float *backrad, float area, float backarea, float rr, ScatterResult *result)
 {
-	float rd[3], frontrd[3], backrd[3];
+	float rd[4], frontrd[3], backrd[3];
 
-	approximate_Rd_rgb(tree->ss, rr, rd);
+	approximate_Rd_rgb(tree, rr, rd);
 
 	if(frontrad && area) {
 		frontrd[0] = rd[0]*area;
@@ -628,22 +653,6 @@ static void sum_branch_radiance(ScatterTree *UNUSED(tree), ScatterNode *node)
 	}
 }
 
-static void sum_radiance(ScatterTree *tree, ScatterNode *node)
-{
-	if(node->totpoint > 0) {
-		sum_leaf_radiance(tree, node);
-	}
-	else {
-		int i;
-
-		for(i=0; i<8; i++)
-			if(node->child[i])
-				sum_radiance(tree, node->child[i]);
-
-		sum_branch_radiance(tree, node);
-	}
-}
-
 static void subnode_middle(int i, float *mid, float *subsize, float *submid)
 {
 	int x= i & 1, y= i & 2, z= i & 4;
@@ -653,11 +662,54 @@ static void subnode_middle(int i, float *mid, float *subsize, float *submid)
 	submid[2]= mid[2] + ((z)? subsize[2]: -subsize[2]);
 }
 
-static void create_octree_node(ScatterTree *tree, ScatterNode *node, float *mid, float *size, ScatterPoint **refpoints, int depth)
+typedef struct ScatterBuildThread {
+	ScatterTree *tree;
+	MemArena *arena;
+	ScatterNode *node;
+	float mid[3], size[3];
+	ScatterPoint **refpoints, **tmppoints;
+	int depth;
+} ScatterBuildThread;
+
+/* subtrees are taken from this by up to totbuildthread threads */
+typedef struct ScatterBuildQueue {
+	ScatterBuildThread *jobs;
+	int totjob, nextjob;
+} ScatterBuildQueue;
+
+static void create_octree_node(ScatterTree *tree, MemArena *arena, ScatterNode *node, float *mid, float *size, ScatterPoint **refpoints, ScatterPoint **tmppoints, int depth, int dothreads);
+
+static void *exec_scatter_build(void *data)
 {
+	ScatterBuildQueue *queue= (ScatterBuildQueue*)data;
+	ScatterBuildThread *sthread;
+
+	while(1) {
+		BLI_lock_thread(LOCK_CUSTOM1);
+		sthread= (queue->nextjob < queue->totjob)? &queue->jobs[queue->nextjob++]: NULL;
+		BLI_unlock_thread(LOCK_CUSTOM1);
+
+		if(sthread == NULL)
+			break;
+
+		create_octree_node(sthread->tree, sthread->arena, sthread->node, sthread->mid,
+			sthread->size, sthread->refpoints, sthread->tmppoints, sthread->depth, 0);
+	}
+
+	return 0;
+}
+
+/* tmppoints is scratch space of the same size as refpoints, subnodes use
+   disjoint ranges of both so they can be built in parallel. radiance is
+   summed bottom up once the subnodes are done. */
+static void create_octree_node(ScatterTree *tree, MemArena *arena, ScatterNode *node, float *mid, float *size, ScatterPoint **refpoints, ScatterPoint **tmppoints, int depth, int dothreads)
+{
+	ListBase threads;
+	ScatterBuildThread sthreads[8];
+	ScatterBuildQueue queue;
 	ScatterNode *subnode;
-	ScatterPoint **subrefpoints, **tmppoints= tree->tmppoints;
-	int index, nsize[8], noffset[8], i, subco, usednodes, usedi;
+	ScatterPoint **subrefpoints;
+	int index, nsize[8], noffset[8], i, subco, usednodes, usedi, totjob= 0;
 	float submid[3], subsize[3];
 
 	/* stopping condition */
@@ -665,6 +717,7 @@ static void create_octree_node(ScatterTree *tree, ScatterNode *node, float *mid,
 		for(i=0; i<node->totpoint; i++)
 			node->points[i]= *(refpoints[i]);
 
+		sum_leaf_radiance(tree, node);
 		return;
 	}
 
@@ -700,7 +753,7 @@ static void create_octree_node(ScatterTree *tree, ScatterNode *node, float *mid,
 	
 	if(usednodes<=1) {
 		subnode_middle(usedi, mid, subsize, submid);
-		create_octree_node(tree, node, submid, subsize, refpoints, depth+1);
+		create_octree_node(tree, arena, node, submid, subsize, refpoints, tmppoints, depth+1, dothreads);
 		return;
 	}
 
@@ -714,7 +767,7 @@ static void create_octree_node(ScatterTree *tree, ScatterNode *node, float *mid,
 	/* create subnodes */
 	for(subco=0, i=0; i<8; subco+=nsize[i], i++) {
 		if(nsize[i] > 0) {
-			subnode= BLI_memarena_alloc(tree->arena, sizeof(ScatterNode));
+			subnode= BLI_memarena_alloc(arena, sizeof(ScatterNode));
 			node->child[i]= subnode;
 			subnode->points= node->points + subco;
 			subnode->totpoint= nsize[i];
@@ -722,13 +775,44 @@ static void create_octree_node(ScatterTree *tree, ScatterNode *node, float *mid,
 
 			subnode_middle(i, mid, subsize, submid);
 
-			create_octree_node(tree, subnode, submid, subsize, subrefpoints,
-				depth+1);
+			if(dothreads) {
+				/* each subtree allocates its nodes from its own arena */
+				tree->subarena[i]= BLI_memarena_new(0x1000 * sizeof(ScatterNode), "sss subtree arena");
+				BLI_memarena_use_calloc(tree->subarena[i]);
+
+				sthreads[totjob].tree= tree;
+				sthreads[totjob].arena= tree->subarena[i];
+				sthreads[totjob].node= subnode;
+				VECCOPY(sthreads[totjob].mid, submid);
+				VECCOPY(sthreads[totjob].size, subsize);
+				sthreads[totjob].refpoints= subrefpoints;
+				sthreads[totjob].tmppoints= tmppoints + subco;
+				sthreads[totjob].depth= depth+1;
+				totjob++;
+			}
+			else
+				create_octree_node(tree, arena, subnode, submid, subsize, subrefpoints,
+					tmppoints + subco, depth+1, 0);
 		}
 		else
 			node->child[i]= NULL;
 	}
 
+	if(dothreads) {
+		int totthread= MIN2(totjob, tree->totbuildthread);
+
+		queue.jobs= sthreads;
+		queue.totjob= totjob;
+		queue.nextjob= 0;
+
+		BLI_init_threads(&threads, exec_scatter_build, totthread);
+		for(i=0; i<totthread; i++)
+			BLI_insert_thread(&threads, &queue);
+		BLI_end_threads(&threads);
+	}
+
+	sum_branch_radiance(tree, node);
+
 	node->points= NULL;
 	node->totpoint= 0;
 }
@@ -752,6 +836,21 @@ ScatterTree *scatter_tree_new(ScatterSettings *ss[3], float scale, float error,
 	tree->ss[1]= ss[1];
 	tree->ss[2]= ss[2];
 
+	tree->tableRd= MEM_mallocN(sizeof(*tree->tableRd)*(RD_TABLE_SIZE+1), "scatterTreeTableRd");
+	tree->tableRd2= MEM_mallocN(sizeof(*tree->tableRd2)*(RD_TABLE_SIZE+1), "scatterTreeTableRd2");
+
+	for(i=0; i<=RD_TABLE_SIZE; i++) {
+		tree->tableRd[i][0]= ss[0]->tableRd[i];
+		tree->tableRd[i][1]= ss[1]->tableRd[i];
+		tree->tableRd[i][2]= ss[2]->tableRd[i];
+		tree->tableRd[i][3]= 0.0f;
+
+		tree->tableRd2[i][0]= ss[0]->tableRd2[i];
+		tree->tableRd2[i][1]= ss[1]->tableRd2[i];
+		tree->tableRd2[i][2]= ss[2]->tableRd2[i];
+		tree->tableRd2[i][3]= 0.0f;
+	}
+
 	points= MEM_callocN(sizeof(ScatterPoint)*totpoint, "ScatterPoints");
 	refpoints= MEM_callocN(sizeof(ScatterPoint*)*totpoint, "ScatterRefPoints");
 
@@ -776,7 +875,7 @@ ScatterTree *scatter_tree_new(ScatterSettings *ss[3], float scale, float error,
 	return tree;
 }
 
-void scatter_tree_build(ScatterTree *tree)
+void scatter_tree_build(ScatterTree *tree, int totthread)
 {
 	ScatterPoint *newpoints, **tmppoints;
 	float mid[3], size[3];
@@ -785,6 +884,7 @@ void scatter_tree_build(ScatterTree *tree)
 	newpoints= MEM_callocN(sizeof(ScatterPoint)*totpoint, "ScatterPoints");
 	tmppoints= MEM_callocN(sizeof(ScatterPoint*)*totpoint, "ScatterTmpPoints");
 	tree->tmppoints= tmppoints;
+	tree->totbuildthread= (totpoint > 10000)? totthread: 1;
 
 	tree->arena= BLI_memarena_new(0x8000 * sizeof(ScatterNode), "sss tree arena");
 	BLI_memarena_use_calloc(tree->arena);
@@ -802,7 +902,8 @@ void scatter_tree_build(ScatterTree *tree)
 	size[1]= (tree->max[1]-tree->min[1])*0.5f;
 	size[2]= (tree->max[2]-tree->min[2])*0.5f;
 
-	create_octree_node(tree, tree->root, mid, size, tree->refpoints, 0);
+	create_octree_node(tree, tree->arena, tree->root, mid, size, tree->refpoints,
+		tree->tmppoints, 0, tree->totbuildthread > 1);
 
 	MEM_freeN(tree->points);
 	MEM_freeN(tree->refpoints);
@@ -810,9 +911,6 @@ void scatter_tree_build(ScatterTree *tree)
 	tree->refpoints= NULL;
 	tree->tmppoints= NULL;
 	tree->points= newpoints;
-	
-	/* sum radiance at nodes */
-	sum_radiance(tree, tree->root);
 }
 
 void scatter_tree_sample(ScatterTree *tree, float *co, float *color)
@@ -827,7 +925,13 @@ void scatter_tree_sample(ScatterTree *tree, float *co, float *color)
 
 void scatter_tree_free(ScatterTree *tree)
 {
+	int i;
+
 	if (tree->arena) BLI_memarena_free(tree->arena);
+	for(i=0; i<8; i++)
+		if (tree->subarena[i]) BLI_memarena_free(tree->subarena[i]);
+	if (tree->tableRd) MEM_freeN(tree->tableRd);
+	if (tree->tableRd2) MEM_freeN(tree->tableRd2);
 	if (tree->points) MEM_freeN(tree->points);
 	if (tree->refpoints) MEM_freeN(tree->refpoints);
 		
@@ -839,6 +943,9 @@ void scatter_tree_free(ScatterTree *tree)
 /* sss tree building */
 
 typedef struct SSSData {
+	struct SSSData *next, *prev;
+
+	Material *mat;
 	ScatterTree *tree;
 	ScatterSettings *ss[3];
 } SSSData;
@@ -852,7 +959,9 @@ typedef struct SSSPoints {
 	int totpoint;
 } SSSPoints;
 
-static void sss_create_tree_mat(Render *re, Material *mat)
+/* renders the points for one material, the tree is built later together
+   with the trees of other materials, see make_sss_tree */
+static void sss_create_tree_mat(Render *re, Material *mat, ListBase *trees)
 {
 	SSSPoints *p;
 	RenderResult *rr;
@@ -946,14 +1055,13 @@ static void sss_create_tree_mat(Render *re, Material *mat)
 		sss->ss[2]= scatter_settings_new(mat->sss_col[2], radius[2], ior, cfac, fw, bw);
 		sss->tree= scatter_tree_new(sss->ss, mat->sss_scale, error,
 			co, color, area, totpoint);
+		sss->mat= mat;
 
 		MEM_freeN(co);
 		MEM_freeN(color);
 		MEM_freeN(area);
 
-		scatter_tree_build(sss->tree);
-
-		BLI_ghash_insert(re->sss_hash, mat, sss);
+		BLI_addtail(trees, sss);
 	}
 	else {
 		if (co) MEM_freeN(co);
@@ -989,10 +1097,74 @@ static void sss_free_tree(SSSData *sss)
 	MEM_freeN(sss);
 }
 
+typedef struct SSSBuildThread {
+	SSSData **next;
+} SSSBuildThread;
+
+static void *exec_sss_build(void *data)
+{
+	SSSBuildThread *sthread= (SSSBuildThread*)data;
+	SSSData *sss;
+
+	while(1) {
+		BLI_lock_thread(LOCK_CUSTOM1);
+		sss= *(sthread->next);
+		if(sss)
+			*(sthread->next)= sss->next;
+		BLI_unlock_thread(LOCK_CUSTOM1);
+
+		if(sss == NULL)
+			break;
+
+		scatter_tree_build(sss->tree, 1);
+	}
+
+	return 0;
+}
+
+/* trees of different materials are independent. with a tree per thread
+   whole trees are built in parallel, otherwise they are built one after
+   the other with the subtrees of big ones split over the threads. never
+   both, so build threads don't start threads themselves */
+static void sss_build_trees(Render *re, ListBase *trees)
+{
+	ListBase threads;
+	SSSBuildThread sthread;
+	SSSData *sss, *next;
+	int a, tottree= BLI_countlist(trees), totthread= re->r.threads;
+
+	if(tottree == 0)
+		return;
+
+	if(totthread > 1 && tottree >= totthread) {
+		next= trees->first;
+		sthread.next= &next;
+
+		BLI_init_threads(&threads, exec_sss_build, totthread);
+		for(a=0; a<totthread; a++)
+			BLI_insert_thread(&threads, &sthread);
+		BLI_end_threads(&threads);
+	}
+	else {
+		for(sss=trees->first; sss; sss=sss->next)
+			scatter_tree_build(sss->tree, totthread);
+	}
+
+	/* only now the trees are ready for sampling */
+	for(sss=trees->first; sss; sss=next) {
+		next= sss->next;
+		sss->next= sss->prev= NULL;
+		BLI_ghash_insert(re->sss_hash, sss->mat, sss);
+	}
+
+	trees->first= trees->last= NULL;
+}
+
 /* public functions */
 
 void make_sss_tree(Render *re)
 {
+	ListBase trees= {NULL, NULL};
 	Material *mat;
 	
 	re->sss_hash= BLI_ghash_new(BLI_ghashutil_ptrhash, BLI_ghashutil_ptrcmp, "make_sss_tree gh");
@@ -1002,16 +1174,17 @@ void make_sss_tree(Render *re)
 	
 	for(mat= re->main->mat.first; mat; mat= mat->id.next)
 		if(mat->id.us && (mat->flag & MA_IS_USED) && (mat->sss_flag & MA_DIFF_SSS))
-			sss_create_tree_mat(re, mat);
+			sss_create_tree_mat(re, mat, &trees);
 	
 	/* XXX preview exception */
 	/* localizing preview render data is not fun for node trees :( */
 	if(re->main!=G.main) {
 		for(mat= G.main->mat.first; mat; mat= mat->id.next)
 			if(mat->id.us && (mat->flag & MA_IS_USED) && (mat->sss_flag & MA_DIFF_SSS))
-				sss_create_tree_mat(re, mat);
+				sss_create_tree_mat(re, mat, &trees);
 	}
 	
+	sss_build_trees(re, &trees);
 }
 
 void free_sss(Render *re)
@@ -55,6 +55,7 @@
 
 #include "render_types.h"
 #include "pixelshading.h"
+#include "raycounter.h"
 #include "rayintersection.h"
 #include "rayobject.h"
 #include "shading.h"
@@ -111,6 +112,7 @@ static float vol_get_shadow(ShadeInput *shi, LampRen *lar, float *co)
 		is.orig.ob = NULL;
 		is.orig.face = NULL;
 		is.last_hit = lar->last_hit[shi->thread];
+		RE_RC_INIT(is, *shi);
 		
 		if(RE_rayobject_raycast(R.raytree,&is)) {
 			visibility = 0.f;
@@ -131,6 +133,7 @@ static int vol_get_bounds(ShadeInput *shi, float *co, float *vec, float *hitco,
 	isect->last_hit = NULL;
 	isect->lay= -1;
 	isect->check= RE_CHECK_VLR_NONE;
+	RE_RC_INIT(*isect, *shi);
 	
 	if (intersect_type == VOL_BOUNDS_DEPTH) {
 		isect->skip = RE_SKIP_VLR_NEIGHBOUR;
@@ -201,6 +204,7 @@ static void vol_trace_behind(ShadeInput *shi, VlakRen *vlr, float *co, float *co
 	isect.orig.face = (void*)vlr;
 	isect.last_hit = NULL;
 	isect.lay= -1;
+	RE_RC_INIT(isect, *shi);
 	
 	/* check to see if there's anything behind the volume, otherwise shade the sky */
 	if(RE_rayobject_raycast(R.raytree, &isect)) {
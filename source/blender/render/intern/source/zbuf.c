@@ -42,6 +42,10 @@
 #include <limits.h>
 #include <string.h>
 
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
 #include "BLI_math.h"
 #include "BLI_blenlib.h"
 #include "BLI_jitter.h"
@@ -2037,6 +2041,173 @@ static void zmask_rect(int *rectz, int *rectp, int xs, int ys, int neg)
 
 /* ***************** ZBUFFER MAIN ROUTINES **************** */
 
+/* ------------------------------------------------------------------------- */
+/* Part binning: instead of each part testing every face in the database, all
+   faces get projected once before the parts render, and added to the lists of
+   the parts they overlap. Lists are in database order, so zbuffering gives the
+   same result as looping over all faces. */
+
+#define ZBUF_BIN_MARGIN	2.0f	/* pixels, for jitter and part bounds rounding */
+
+static void zbuf_bin_add(RenderPart *pa, int obi, int v)
+{
+	if(pa->totbinface == pa->maxbinface) {
+		pa->maxbinface= (pa->maxbinface)? 2*pa->maxbinface: 1024;
+		if(pa->binface)
+			pa->binface= MEM_reallocN(pa->binface, sizeof(*pa->binface)*pa->maxbinface);
+		else
+			pa->binface= MEM_mallocN(sizeof(*pa->binface)*pa->maxbinface, "part binface");
+	}
+
+	pa->binface[pa->totbinface][0]= obi;
+	pa->binface[pa->totbinface][1]= v;
+	pa->totbinface++;
+}
+
+void zbuffer_bin_parts(Render *re)
+{
+	RenderPart *pa, **grid;
+	ObjectInstanceRen *obi;
+	ObjectRen *obr;
+	VlakRen *vlr;
+	VertRen *ver;
+	float (*hoco)[4]= NULL, *ho[4];
+	float winmat[4][4], obwinmat[4][4], bounds[4], min[2], max[2], zmulx, zmuly;
+	int i, a, v, x, y, xmin, xmax, ymin, ymax, allparts, maxvert= 0;
+
+	/* panorama rotates the view for each column of parts */
+	if(re->r.mode & R_PANORAMA)
+		return;
+
+	/* grid lookup of parts, they may be cropped but are never moved */
+	grid= MEM_callocN(sizeof(RenderPart*)*re->xparts*re->yparts, "zbuf bin grid");
+
+	for(pa=re->parts.first; pa; pa=pa->next) {
+		x= (pa->disprect.xmin + pa->crop - re->disprect.xmin)/re->partx;
+		y= (pa->disprect.ymin + pa->crop - re->disprect.ymin)/re->party;
+		grid[y*re->xparts + x]= pa;
+		pa->binned= 1;
+	}
+
+	zbuf_make_winmat(re, winmat);
+	zmulx= ((float)re->winx)/2.0f;
+	zmuly= ((float)re->winy)/2.0f;
+
+	/* object clipping bounds, all parts including filter crop */
+	bounds[0]= (2*(re->disprect.xmin - 4) - re->winx-1)/(float)re->winx;
+	bounds[1]= (2*(re->disprect.xmax + 4) - re->winx+1)/(float)re->winx;
+	bounds[2]= (2*(re->disprect.ymin - 4) - re->winy-1)/(float)re->winy;
+	bounds[3]= (2*(re->disprect.ymax + 4) - re->winy+1)/(float)re->winy;
+
+	for(i=0, obi=re->instancetable.first; obi; i++, obi=obi->next) {
+		obr= obi->obr;
+
+		if(obi->flag & R_TRANSFORMED)
+			mul_m4_m4m4(obwinmat, obi->mat, winmat);
+		else
+			copy_m4_m4(obwinmat, winmat);
+
+		if(clip_render_object(obr->boundbox, bounds, obwinmat))
+			continue;
+
+		if(obr->totvert > maxvert) {
+			if(hoco) MEM_freeN(hoco);
+			maxvert= obr->totvert;
+			hoco= MEM_mallocN(sizeof(*hoco)*maxvert, "zbuf bin hoco");
+		}
+
+		for(a=0, ver=NULL; a<obr->totvert; a++, ver++) {
+			if((a & 255)==0) ver= obr->vertnodes[a>>8].vert;
+			projectvert(ver->co, obwinmat, hoco[a]);
+		}
+
+		for(v=0, vlr=NULL; v<obr->totvlak; v++, vlr++) {
+			if((v & 255)==0) vlr= obr->vlaknodes[v>>8].vlak;
+
+			if(vlr->flag & R_HIDDEN)
+				continue;
+
+			ho[0]= hoco[vlr->v1->index];
+			ho[1]= hoco[vlr->v2->index];
+			ho[2]= hoco[vlr->v3->index];
+			ho[3]= (vlr->v4)? hoco[vlr->v4->index]: NULL;
+
+			/* screen space bounds, behind the camera the face may cover any part */
+			allparts= 0;
+			INIT_MINMAX2(min, max);
+
+			for(a=0; a<4 && ho[a]; a++) {
+				if(ho[a][3] <= 0.0f) {
+					allparts= 1;
+					break;
+				}
+				min[0]= MIN2(min[0], zmulx*(1.0f + ho[a][0]/ho[a][3]));
+				max[0]= MAX2(max[0], zmulx*(1.0f + ho[a][0]/ho[a][3]));
+				min[1]= MIN2(min[1], zmuly*(1.0f + ho[a][1]/ho[a][3]));
+				max[1]= MAX2(max[1], zmuly*(1.0f + ho[a][1]/ho[a][3]));
+			}
+
+			if(allparts) {
+				xmin= ymin= 0;
+				xmax= re->xparts-1;
+				ymax= re->yparts-1;
+			}
+			else {
+				min[0] -= ZBUF_BIN_MARGIN; min[1] -= ZBUF_BIN_MARGIN;
+				max[0] += ZBUF_BIN_MARGIN; max[1] += ZBUF_BIN_MARGIN;
+
+				/* parts overlap their neighbours by the filter crop */
+				xmin= (int)floorf((min[0] - 2 - re->disprect.xmin)/re->partx);
+				xmax= (int)floorf((max[0] + 2 - re->disprect.xmin)/re->partx);
+				ymin= (int)floorf((min[1] - 2 - re->disprect.ymin)/re->party);
+				ymax= (int)floorf((max[1] + 2 - re->disprect.ymin)/re->party);
+
+				CLAMP(xmin, 0, re->xparts-1);
+				CLAMP(xmax, 0, re->xparts-1);
+				CLAMP(ymin, 0, re->yparts-1);
+				CLAMP(ymax, 0, re->yparts-1);
+			}
+
+			for(y=ymin; y<=ymax; y++) {
+				for(x=xmin; x<=xmax; x++) {
+					pa= grid[y*re->xparts + x];
+
+					if(pa==NULL)
+						continue;
+					if(!allparts) {
+						if(max[0] < pa->disprect.xmin || min[0] > pa->disprect.xmax)
+							continue;
+						if(max[1] < pa->disprect.ymin || min[1] > pa->disprect.ymax)
+							continue;
+					}
+
+					zbuf_bin_add(pa, i, v);
+				}
+			}
+		}
+	}
+
+	if(hoco)
+		MEM_freeN(hoco);
+	MEM_freeN(grid);
+}
+
+/* range of faces of instance obi to zbuffer in a part, the bin cursor must
+   be advanced for every instance in order, also when skipping it */
+static void zbuf_part_faces(RenderPart *pa, ObjectRen *obr, int obi, int *bin, int *start, int *end)
+{
+	if(pa->binned) {
+		*start= *bin;
+		while(*bin < pa->totbinface && pa->binface[*bin][0] == obi)
+			(*bin)++;
+		*end= *bin;
+	}
+	else {
+		*start= 0;
+		*end= obr->totvlak;
+	}
+}
+
 void zbuffer_solid(RenderPart *pa, RenderLayer *rl, void(*fillfunc)(RenderPart*, ZSpan*, int, void*), void *data)
 {
 	ZbufProjectCache cache[ZBUF_PROJECT_CACHE_SIZE];
@@ -2049,7 +2220,7 @@ void zbuffer_solid(RenderPart *pa, RenderLayer *rl, void(*fillfunc)(RenderPart*,
 	float obwinmat[4][4], winmat[4][4], bounds[4];
 	float ho1[4], ho2[4], ho3[4], ho4[4]={0};
 	unsigned int lay= rl->lay, lay_zmask= rl->lay_zmask;
-	int i, v, zvlnr, zsample, samples, c1, c2, c3, c4=0;
+	int i, v, f, bin, start, end, zvlnr, zsample, samples, c1, c2, c3, c4=0;
 	short nofill=0, env=0, wire=0, zmaskpass=0;
 	short all_z= (rl->layflag & SCE_LAY_ALL_Z) && !(rl->layflag & SCE_LAY_ZMASK);
 	short neg_zmask= (rl->layflag & SCE_LAY_ZMASK) && (rl->layflag & SCE_LAY_NEG_ZMASK);
@@ -2125,9 +2296,13 @@ void zbuffer_solid(RenderPart *pa, RenderLayer *rl, void(*fillfunc)(RenderPart*,
 		}
 
 		/* regular zbuffering loop, does all sample buffers */
-		for(i=0, obi=R.instancetable.first; obi; i++, obi=obi->next) {
+		for(i=0, bin=0, obi=R.instancetable.first; obi; i++, obi=obi->next) {
 			obr= obi->obr;
 
+			zbuf_part_faces(pa, obr, i, &bin, &start, &end);
+			if(start == end)
+				continue;
+
 			/* continue happens in 2 different ways... zmaskpass only does lay_zmask stuff */
 			if(zmaskpass) {
 				if((obi->lay & lay_zmask)==0)
@@ -2146,9 +2321,9 @@ void zbuffer_solid(RenderPart *pa, RenderLayer *rl, void(*fillfunc)(RenderPart*,
 
 			zbuf_project_cache_clear(cache, obr->totvert);
 
-			for(v=0; v<obr->totvlak; v++) {
-				if((v & 255)==0) vlr= obr->vlaknodes[v>>8].vlak;
-				else vlr++;
+			for(f=start; f<end; f++) {
+				v= (pa->binned)? pa->binface[f][1]: f;
+				vlr= obr->vlaknodes[v>>8].vlak + (v & 255);
 
 				/* the cases: visible for render, only z values, zmask, nothing */
 				if(obi->lay & lay) {
@@ -2631,7 +2806,9 @@ typedef struct DrawBufPixel {
 } DrawBufPixel;
 
 
-static void zbuf_fill_in_rgba(ZSpan *zspan, DrawBufPixel *col, float *v1, float *v2, float *v3, float *v4)
+/* only rows miny to maxy get filled in, but the z interpolation still starts
+   at the top row of the quad, so results don't depend on where bands start */
+static void zbuf_fill_in_rgba(ZSpan *zspan, DrawBufPixel *col, float *v1, float *v2, float *v3, float *v4, int miny, int maxy)
 {
 	DrawBufPixel *rectpofs, *rp;
 	double zxd, zyd, zy0, zverg;
@@ -2659,6 +2836,7 @@ static void zbuf_fill_in_rgba(ZSpan *zspan, DrawBufPixel *col, float *v1, float
 	
 	//	printf("my %d %d\n", my0, my2);
 	if(my2<my0) return;
+	if(my2<miny || my0>maxy) return;
 	
 	/* ZBUF DX DY, in floats still */
 	x1= v1[0]- v2[0];
@@ -2704,7 +2882,7 @@ static void zbuf_fill_in_rgba(ZSpan *zspan, DrawBufPixel *col, float *v1, float
 		if(sn2>=rectx) sn2= rectx-1;
 		if(sn1<0) sn1= 0;
 		
-		if(sn2>=sn1) {
+		if(sn2>=sn1 && y>=miny && y<=maxy) {
 			zverg= (double)sn1*zxd + zy0;
 			rz= rectzofs+sn1;
 			rp= rectpofs+sn1;
@@ -2856,33 +3034,182 @@ static void set_quad_bezier_ipo(float fac, float *data)
 	data[2]= fac*fac;
 }
 
-void RE_zbuf_accumulate_vecblur(NodeBlurData *nbd, int xsize, int ysize, float *newrect, float *imgrect, float *vecbufrect, float *zbufrect)
+/* vector blur accumulates in horizontal bands, one thread per band. each band
+   draws all quads that can reach it but only fills in its own rows, in the same
+   order for any amount of bands, so the result is the same as for a single band */
+typedef struct VecBlurBand {
+	NodeBlurData *nbd;
+	int xsize, ysize, miny, maxy, maxdisp;
+	float *newrect, *imgrect, *zbufrect, *rectvz, *rectz, *rectweight, *rectmax;
+	float (*jit)[2];
+	DrawBufPixel *rectdraw;
+	char *rectmove;
+} VecBlurBand;
+
+static void zbuf_accumulate_vecblur_band(VecBlurBand *band)
 {
+	NodeBlurData *nbd= band->nbd;
 	ZSpan zspan;
-	DrawBufPixel *rectdraw, *dr;
-	static float jit[256][2];
+	DrawBufPixel *dr;
 	float v1[3], v2[3], v3[3], v4[3], fx, fy;
-	float *rectvz, *dvz, *dimg, *dvec1, *dvec2, *dz, *dz1, *dz2, *rectz;
-	float *minvecbufrect= NULL, *rectweight, *rw, *rectmax, *rm, *ro;
-	float maxspeedsq= (float)nbd->maxspeed*nbd->maxspeed, totfac;
-	int y, x, step, maxspeed=nbd->maxspeed, samples= nbd->samples;
-	int tsktsk= 0;
-	static int firsttime= 1;
-	char *rectmove, *dm;
-	
+	float *dimg, *dz, *dz1, *dz2, *rw, *rm;
+	float *rectz= band->rectz, *zbufrect= band->zbufrect;
+	char *dm, *rectmove= band->rectmove;
+	int xsize= band->xsize, ysize= band->ysize, miny= band->miny, maxy= band->maxy;
+	int x, y, sy0, sy1, ofs, tot, step, samples= nbd->samples;
+
 	zbuf_alloc_span(&zspan, xsize, ysize, 1.0f);
 	zspan.zmulx=  ((float)xsize)/2.0f;
 	zspan.zmuly=  ((float)ysize)/2.0f;
 	zspan.zofsx= 0.0f;
 	zspan.zofsy= 0.0f;
+	zspan.rectz= (int *)rectz;
+	zspan.rectp= (int *)band->rectdraw;
+
+	/* pixels of the band, and source rows that can draw into it */
+	ofs= miny*xsize;
+	tot= (maxy - miny + 1)*xsize;
+	sy0= MAX2(miny - band->maxdisp, 0);
+	sy1= MIN2(maxy + band->maxdisp, ysize-1);
+
+	samples/= 2;
+	for(step= 1; step<=samples; step++) {
+		float speedfac= 0.5f*nbd->fac*(float)step/(float)(samples+1);
+		int side;
+
+		for(side=0; side<2; side++) {
+			float blendfac, ipodata[4];
+
+			/* clear zbuf, if we draw future we fill in not moving pixels */
+			for(x= ofs+tot-1; x>=ofs; x--) {
+				if(rectmove[x]==0)
+					rectz[x]= zbufrect[x];
+				else
+					rectz[x]= 10e16;
+			}
+
+			/* clear drawing buffer */
+			for(x= ofs+tot-1; x>=ofs; x--) band->rectdraw[x].colpoin= NULL;
+
+			dimg= band->imgrect + 4*sy0*xsize;
+			dm= rectmove + sy0*xsize;
+			dz= zbufrect + sy0*xsize;
+			dz1= band->rectvz + 4*sy0*(xsize + 1);
+			dz2= dz1 + 4*(xsize + 1);
+
+			if(side) {
+				if(nbd->curved==0) {
+					dz1+= 2;
+					dz2+= 2;
+				}
+				speedfac= -speedfac;
+			}
+
+			set_quad_bezier_ipo(0.5f + 0.5f*speedfac, ipodata);
+
+			for(y=sy0; y<=sy1; y++) {
+				/* not accumulated, so it doesn't depend on the first row of the band */
+				fy= -0.5f + band->jit[step & 255][0] + (float)y;
+
+				for(fx= -0.5f+band->jit[step & 255][1], x=0; x<xsize; x++, fx+=1.0f, dimg+=4, dz1+=4, dz2+=4, dm++, dz++) {
+					if(*dm>1) {
+						float jfx = fx + 0.5f;
+						float jfy = fy + 0.5f;
+						DrawBufPixel col;
+
+						/* make vertices */
+						if(nbd->curved) {	/* curved */
+							quad_bezier_2d(v1, dz1, dz1+2, ipodata);
+							v1[0]+= jfx; v1[1]+= jfy; v1[2]= *dz;
+
+							quad_bezier_2d(v2, dz1+4, dz1+4+2, ipodata);
+							v2[0]+= jfx+1.0f; v2[1]+= jfy; v2[2]= *dz;
+
+							quad_bezier_2d(v3, dz2+4, dz2+4+2, ipodata);
+							v3[0]+= jfx+1.0f; v3[1]+= jfy+1.0f; v3[2]= *dz;
+
+							quad_bezier_2d(v4, dz2, dz2+2, ipodata);
+							v4[0]+= jfx; v4[1]+= jfy+1.0f; v4[2]= *dz;
+						}
+						else {
+							v1[0]= speedfac*dz1[0]+jfx;			v1[1]= speedfac*dz1[1]+jfy;			v1[2]= *dz;
+							v2[0]= speedfac*dz1[4]+jfx+1.0f;		v2[1]= speedfac*dz1[5]+jfy;			v2[2]= *dz;
+							v3[0]= speedfac*dz2[4]+jfx+1.0f;		v3[1]= speedfac*dz2[5]+jfy+1.0f;		v3[2]= *dz;
+							v4[0]= speedfac*dz2[0]+jfx;			v4[1]= speedfac*dz2[1]+jfy+1.0f;		v4[2]= *dz;
+						}
+						if(*dm==255) col.alpha= 1.0f;
+						else if(*dm<2) col.alpha= 0.0f;
+						else col.alpha= ((float)*dm)/255.0f;
+						col.colpoin= dimg;
+
+						zbuf_fill_in_rgba(&zspan, &col, v1, v2, v3, v4, miny, maxy);
+					}
+				}
+				dz1+=4;
+				dz2+=4;
+			}
+
+			/* blend with a falloff. this fixes the ugly effect you get with
+			 * a fast moving object. then it looks like a solid object overlayed
+			 * over a very transparent moving version of itself. in reality, the
+			 * whole object should become transparent if it is moving fast, be
+			 * we don't know what is behind it so we don't do that. this hack
+			 * overestimates the contribution of foreground pixels but looks a
+			 * bit better without a sudden cutoff. */
+			blendfac= ((samples - step)/(float)samples);
+			/* smoothstep to make it look a bit nicer as well */
+			blendfac= 3.0f*pow(blendfac, 2.0f) - 2.0f*pow(blendfac, 3.0f);
+
+			/* accum */
+			rw= band->rectweight + ofs;
+			rm= band->rectmax + ofs;
+			for(dr= band->rectdraw + ofs, dz2= band->newrect + 4*ofs, x= tot-1; x>=0; x--, dr++, dz2+=4, rw++, rm++) {
+				if(dr->colpoin) {
+					float bfac= dr->alpha*blendfac;
+
+#ifdef __SSE__
+					_mm_storeu_ps(dz2, _mm_add_ps(_mm_loadu_ps(dz2), _mm_mul_ps(_mm_set_ps1(bfac), _mm_loadu_ps(dr->colpoin))));
+#else
+					dz2[0] += bfac*dr->colpoin[0];
+					dz2[1] += bfac*dr->colpoin[1];
+					dz2[2] += bfac*dr->colpoin[2];
+					dz2[3] += bfac*dr->colpoin[3];
+#endif
+
+					*rw += bfac;
+					*rm= MAX2(*rm, bfac);
+				}
+			}
+		}
+	}
+
+	zbuf_free_span(&zspan);
+}
+
+static void *do_vecblur_band_thread(void *band_v)
+{
+	zbuf_accumulate_vecblur_band(band_v);
+	return NULL;
+}
+
+void RE_zbuf_accumulate_vecblur(NodeBlurData *nbd, int totthread, int xsize, int ysize, float *newrect, float *imgrect, float *vecbufrect, float *zbufrect)
+{
+	ListBase threads;
+	VecBlurBand bands[BLENDER_MAX_THREADS];
+	DrawBufPixel *rectdraw;
+	static float jit[256][2];
+	float *rectvz, *dvz, *dvec1, *dvec2, *dz1, *dz2, *rectz;
+	float *minvecbufrect= NULL, *rectweight, *rw, *rectmax, *rm, *ro;
+	float maxspeedsq= (float)nbd->maxspeed*nbd->maxspeed, maxvec= 0.0f;
+	int y, x, step, maxspeed=nbd->maxspeed, totband, bandy;
+	int tsktsk= 0;
+	static int firsttime= 1;
+	char *rectmove, *dm;
 	
 	/* the buffers */
 	rectz= MEM_mapallocN(sizeof(float)*xsize*ysize, "zbuf accum");
-	zspan.rectz= (int *)rectz;
-	
 	rectmove= MEM_mapallocN(xsize*ysize, "rectmove");
 	rectdraw= MEM_mapallocN(sizeof(DrawBufPixel)*xsize*ysize, "rect draw");
-	zspan.rectp= (int *)rectdraw;
 
 	rectweight= MEM_mapallocN(sizeof(float)*xsize*ysize, "rect weight");
 	rectmax= MEM_mapallocN(sizeof(float)*xsize*ysize, "rect max");
@@ -3038,115 +3365,48 @@ void RE_zbuf_accumulate_vecblur(NodeBlurData *nbd, int xsize, int ysize, float *
 	}
 	
 	memset(newrect, 0, sizeof(float)*xsize*ysize*4);
-	totfac= 0.0f;
 
-	/* accumulate */
-	samples/= 2;
-	for(step= 1; step<=samples; step++) {
-		float speedfac= 0.5f*nbd->fac*(float)step/(float)(samples+1);
-		int side;
-		
-		for(side=0; side<2; side++) {
-			float blendfac, ipodata[4];
-			
-			/* clear zbuf, if we draw future we fill in not moving pixels */
-			if(0)
-				for(x= xsize*ysize-1; x>=0; x--) rectz[x]= 10e16;
-			else 
-				for(x= xsize*ysize-1; x>=0; x--) {
-					if(rectmove[x]==0)
-						rectz[x]= zbufrect[x];
-					else
-						rectz[x]= 10e16;
-				}
-			
-			/* clear drawing buffer */
-			for(x= xsize*ysize-1; x>=0; x--) rectdraw[x].colpoin= NULL;
-			
-			dimg= imgrect;
-			dm= rectmove;
-			dz= zbufrect;
-			dz1= rectvz;
-			dz2= rectvz + 4*(xsize + 1);
-			
-			if(side) {
-				if(nbd->curved==0) {
-					dz1+= 2;
-					dz2+= 2;
-				}
-				speedfac= -speedfac;
-			}
-			
-			set_quad_bezier_ipo(0.5f + 0.5f*speedfac, ipodata);
-			
-			for(fy= -0.5f+jit[step & 255][0], y=0; y<ysize; y++, fy+=1.0f) {
-				for(fx= -0.5f+jit[step & 255][1], x=0; x<xsize; x++, fx+=1.0f, dimg+=4, dz1+=4, dz2+=4, dm++, dz++) {
-					if(*dm>1) {
-						float jfx = fx + 0.5f;
-						float jfy = fy + 0.5f;
-						DrawBufPixel col;
-						
-						/* make vertices */
-						if(nbd->curved) {	/* curved */
-							quad_bezier_2d(v1, dz1, dz1+2, ipodata);
-							v1[0]+= jfx; v1[1]+= jfy; v1[2]= *dz;
-
-							quad_bezier_2d(v2, dz1+4, dz1+4+2, ipodata);
-							v2[0]+= jfx+1.0f; v2[1]+= jfy; v2[2]= *dz;
-
-							quad_bezier_2d(v3, dz2+4, dz2+4+2, ipodata);
-							v3[0]+= jfx+1.0f; v3[1]+= jfy+1.0f; v3[2]= *dz;
-							
-							quad_bezier_2d(v4, dz2, dz2+2, ipodata);
-							v4[0]+= jfx; v4[1]+= jfy+1.0f; v4[2]= *dz;
-						}
-						else {
-							v1[0]= speedfac*dz1[0]+jfx;			v1[1]= speedfac*dz1[1]+jfy;			v1[2]= *dz;
-							v2[0]= speedfac*dz1[4]+jfx+1.0f;		v2[1]= speedfac*dz1[5]+jfy;			v2[2]= *dz;
-							v3[0]= speedfac*dz2[4]+jfx+1.0f;		v3[1]= speedfac*dz2[5]+jfy+1.0f;		v3[2]= *dz;
-							v4[0]= speedfac*dz2[0]+jfx;			v4[1]= speedfac*dz2[1]+jfy+1.0f;		v4[2]= *dz;
-						}
-						if(*dm==255) col.alpha= 1.0f;
-						else if(*dm<2) col.alpha= 0.0f;
-						else col.alpha= ((float)*dm)/255.0f;
-						col.colpoin= dimg;
-
-						zbuf_fill_in_rgba(&zspan, &col, v1, v2, v3, v4);
-					}
-				}
-				dz1+=4;
-				dz2+=4;
-			}
-
-			/* blend with a falloff. this fixes the ugly effect you get with
-			 * a fast moving object. then it looks like a solid object overlayed
-			 * over a very transparent moving version of itself. in reality, the
-			 * whole object should become transparent if it is moving fast, be
-			 * we don't know what is behind it so we don't do that. this hack
-			 * overestimates the contribution of foreground pixels but looks a
-			 * bit better without a sudden cutoff. */
-			blendfac= ((samples - step)/(float)samples);
-			/* smoothstep to make it look a bit nicer as well */
-			blendfac= 3.0f*pow(blendfac, 2.0f) - 2.0f*pow(blendfac, 3.0f);
-
-			/* accum */
-			rw= rectweight;
-			rm= rectmax;
-			for(dr= rectdraw, dz2=newrect, x= xsize*ysize-1; x>=0; x--, dr++, dz2+=4, rw++, rm++) {
-				if(dr->colpoin) {
-					float bfac= dr->alpha*blendfac;
-					
-					dz2[0] += bfac*dr->colpoin[0];
-					dz2[1] += bfac*dr->colpoin[1];
-					dz2[2] += bfac*dr->colpoin[2];
-					dz2[3] += bfac*dr->colpoin[3];
+	/* largest vertical offset of quad vertices, bezier extrapolation included */
+	for(dvz= rectvz, x= 2*(xsize+1)*(ysize+1); x>0; x--, dvz+=2)
+		maxvec= MAX2(maxvec, ABS(dvz[1]));
+	maxvec*= (1.0f + 0.5f*nbd->fac)*(1.0f + 0.5f*nbd->fac);
+
+	/* accumulate, in bands of at least 16 rows. compositor nodes may run
+	   in threads already, only use the threads they leave free */
+	totband= BLI_thread_budget_acquire(MIN3(totthread, BLENDER_MAX_THREADS, MAX2(ysize/16, 1)));
+	bandy= (ysize + totband - 1)/totband;
+
+	for(x=0; x<totband; x++) {
+		VecBlurBand *band= &bands[x];
+
+		band->nbd= nbd;
+		band->xsize= xsize;
+		band->ysize= ysize;
+		band->miny= x*bandy;
+		band->maxy= MIN2((x+1)*bandy, ysize) - 1;
+		band->maxdisp= (int)ceil(maxvec) + 2;
+		band->newrect= newrect;
+		band->imgrect= imgrect;
+		band->zbufrect= zbufrect;
+		band->rectvz= rectvz;
+		band->rectz= rectz;
+		band->rectweight= rectweight;
+		band->rectmax= rectmax;
+		band->jit= jit;
+		band->rectdraw= rectdraw;
+		band->rectmove= rectmove;
+	}
 
-					*rw += bfac;
-					*rm= MAX2(*rm, bfac);
-				}
-			}
-		}
+	if(totband > 1) {
+		BLI_init_threads(&threads, do_vecblur_band_thread, totband);
+		for(x=0; x<totband; x++)
+			if(bands[x].miny <= bands[x].maxy)
+				BLI_insert_thread(&threads, &bands[x]);
+		BLI_end_threads(&threads);
 	}
+	else
+		zbuf_accumulate_vecblur_band(&bands[0]);
+	BLI_thread_budget_release(totband);
 	
 	/* blend between original images and accumulated image */
 	rw= rectweight;
@@ -3171,7 +3431,6 @@ void RE_zbuf_accumulate_vecblur(NodeBlurData *nbd, int xsize, int ysize, float *
 	MEM_freeN(rectweight);
 	MEM_freeN(rectmax);
 	if(minvecbufrect) MEM_freeN(vecbufrect);  /* rects were swapped! */
-	zbuf_free_span(&zspan);
 }
 
 /* ******************** ABUF ************************* */
@@ -3247,7 +3506,7 @@ static int zbuffer_abuf(Render *re, RenderPart *pa, APixstr *APixbuf, ListBase *
 	VertRen *v1, *v2, *v3, *v4;
 	float vec[3], hoco[4], mul, zval, fval;
 	float obwinmat[4][4], bounds[4], ho1[4], ho2[4], ho3[4], ho4[4]={0};
-	int i, v, zvlnr, c1, c2, c3, c4=0, dofill= 0;
+	int i, v, f, bin, start, end, zvlnr, c1, c2, c3, c4=0, dofill= 0;
 	int zsample, polygon_offset;
 
 	zbuffer_part_bounds(winx, winy, pa, bounds);
@@ -3293,9 +3552,13 @@ static int zbuffer_abuf(Render *re, RenderPart *pa, APixstr *APixbuf, ListBase *
 	/* we use this to test if nothing was filled in */
 	zvlnr= 0;
 		
-	for(i=0, obi=re->instancetable.first; obi; i++, obi=obi->next) {
+	for(i=0, bin=0, obi=re->instancetable.first; obi; i++, obi=obi->next) {
 		obr= obi->obr;
 
+		zbuf_part_faces(pa, obr, i, &bin, &start, &end);
+		if(start == end)
+			continue;
+
 		if(!(obi->lay & lay))
 			continue;
 
@@ -3309,10 +3572,9 @@ static int zbuffer_abuf(Render *re, RenderPart *pa, APixstr *APixbuf, ListBase *
 
 		zbuf_project_cache_clear(cache, obr->totvert);
 
-		for(v=0; v<obr->totvlak; v++) {
-			if((v & 255)==0)
-				vlr= obr->vlaknodes[v>>8].vlak;
-			else vlr++;
+		for(f=start; f<end; f++) {
+			v= (pa->binned)? pa->binface[f][1]: f;
+			vlr= obr->vlaknodes[v>>8].vlak + (v & 255);
 			
 			if(vlr->mat!=ma) {
 				ma= vlr->mat;
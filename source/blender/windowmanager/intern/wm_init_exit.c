@@ -60,6 +60,7 @@
 #include "BKE_report.h"
 
 #include "BKE_packedFile.h"
+#include "BKE_pointcache.h"
 #include "BKE_sequencer.h" /* free seq clipboard */
 #include "BKE_material.h" /* clear_matcopybuf */
 
@@ -393,7 +394,9 @@ void WM_exit(bContext *C)
 
 	seq_free_clipboard(); /* sequencer.c */
 		
+	BKE_ptcache_write_flush(NULL); /* pointcache.c, frames still being written */
 	free_blender();				/* blender.c, does entire library and spacetypes */
+	DM_modifier_cache_free();	/* DerivedMesh.c, modifier result cache */
 //	free_matcopybuf();
 	free_anim_copybuf();
 	free_anim_drivers_copybuf();
@@ -448,6 +451,8 @@ void WM_exit(bContext *C)
 	
 	GHOST_DisposeSystemPaths();
 
+	MEM_profile_end();
+
 	if(MEM_get_memory_blocks_in_use()!=0) {
 		printf("Error: Not freed memory blocks: %d\n", MEM_get_memory_blocks_in_use());
 		MEM_printmemlist();
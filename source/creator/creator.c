@@ -218,6 +218,8 @@ static int print_help(int UNUSED(argc), const char **UNUSED(argv), void *data)
 	BLI_argsPrintArgDoc(ba, "--frame-jump");
 	BLI_argsPrintArgDoc(ba, "--render-output");
 	BLI_argsPrintArgDoc(ba, "--engine");
+	BLI_argsPrintArgDoc(ba, "--render-stats");
+	BLI_argsPrintArgDoc(ba, "--texture-cache");
 	
 	printf("\n");
 	printf ("Format Options:\n");
@@ -244,6 +246,7 @@ static int print_help(int UNUSED(argc), const char **UNUSED(argv), void *data)
 	printf ("Misc Options:\n");
 	BLI_argsPrintArgDoc(ba, "--debug");
 	BLI_argsPrintArgDoc(ba, "--debug-fpe");
+	BLI_argsPrintArgDoc(ba, "--debug-memory-profile");
 	printf("\n");
 	BLI_argsPrintArgDoc(ba, "--factory-startup");
 	printf("\n");
@@ -363,6 +366,17 @@ static int debug_mode(int UNUSED(argc), const char **UNUSED(argv), void *data)
 	return 0;
 }
 
+static int set_memory_profile(int argc, const char **argv, void *UNUSED(data))
+{
+	if (argc >= 1) {
+		MEM_profile_begin(argv[1], 16);
+		return 1;
+	} else {
+		printf("\nError: you must specify a path after '--debug-memory-profile'.\n");
+		return 0;
+	}
+}
+
 static int set_fpe(int UNUSED(argc), const char **UNUSED(argv), void *UNUSED(data))
 {
 #if defined(__sgi) || defined(__linux__) || defined(_WIN32) || defined(OSX_SSE_FPE)
@@ -645,6 +659,28 @@ static int set_threads(int argc, const char **argv, void *UNUSED(data))
 	}
 }
 
+static int set_render_stats(int argc, const char **argv, void *UNUSED(data))
+{
+	if (argc >= 1) {
+		RE_set_stats_output(argv[1]);
+		return 1;
+	} else {
+		printf("\nError: you must specify a path after '--render-stats'.\n");
+		return 0;
+	}
+}
+
+static int set_texture_cache(int argc, const char **argv, void *UNUSED(data))
+{
+	if (argc >= 1) {
+		RE_set_texture_cache(atoi(argv[1]));
+		return 1;
+	} else {
+		printf("\nError: you must specify a memory limit in MB after '--texture-cache'.\n");
+		return 0;
+	}
+}
+
 static int set_extension(int argc, const char **argv, void *data)
 {
 	bContext *C = data;
@@ -1077,6 +1113,7 @@ static void setupArguments(bContext *C, bArgs *ba, SYS_SystemHandle *syshandle)
 
 	BLI_argsAdd(ba, 1, "-d", "--debug", debug_doc, debug_mode, ba);
 	BLI_argsAdd(ba, 1, NULL, "--debug-fpe", "\n\tEnable floating point exceptions", set_fpe, NULL);
+	BLI_argsAdd(ba, 1, NULL, "--debug-memory-profile", "<path>\n\tWrite allocation counts, bytes and lifetimes per memory block name to <path>\n\tConvert it to flame graph input with source/tools/memprof.py", set_memory_profile, NULL);
 
 	BLI_argsAdd(ba, 1, NULL, "--factory-startup", "\n\tSkip reading the "STRINGIFY(BLENDER_STARTUP_FILE)" in the users home directory", set_factory_startup, NULL);
 
@@ -1117,6 +1154,8 @@ static void setupArguments(bContext *C, bArgs *ba, SYS_SystemHandle *syshandle)
 
 	BLI_argsAdd(ba, 4, "-F", "--render-format", format_doc, set_image_type, C);
 	BLI_argsAdd(ba, 4, "-t", "--threads", "<threads>\n\tUse amount of <threads> for rendering in background\n\t[1-" STRINGIFY(BLENDER_MAX_THREADS) "], 0 for systems processor count.", set_threads, NULL);
+	BLI_argsAdd(ba, 4, NULL, "--render-stats", "<path>\n\tWrite ray counters and timing per render part of each frame to <path>\n\tUse '#' for the frame number, a .csv extension writes csv instead of json", set_render_stats, NULL);
+	BLI_argsAdd(ba, 4, NULL, "--texture-cache", "<MB>\n\tLoad tiled and mipmapped images (.tx files) on demand while rendering\n\tkeeping at most <MB> of image tiles in memory", set_texture_cache, NULL);
 	BLI_argsAdd(ba, 4, "-x", "--use-extension", "<bool>\n\tSet option to add the file extension to the end of the file", set_extension, C);
 
 }
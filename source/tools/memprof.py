@@ -0,0 +1,135 @@
+# ##### BEGIN GPL LICENSE BLOCK #####
+#
+#  This program is free software; you can redistribute it and/or
+#  modify it under the terms of the GNU General Public License
+#  as published by the Free Software Foundation; either version 2
+#  of the License, or (at your option) any later version.
+#
+#  This program is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#  GNU General Public License for more details.
+#
+#  You should have received a copy of the GNU General Public License
+#  along with this program; if not, write to the Free Software Foundation,
+#  Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+#
+# ##### END GPL LICENSE BLOCK #####
+
+# <pep8-80 compliant>
+
+# Converts memory profile traces, written by blender with
+# --debug-memory-profile, to the folded stack format that flamegraph.pl
+# reads, one line per block name with a count:
+#
+#   memprof.py trace.bin [metric] > out.folded
+#   flamegraph.pl out.folded > out.svg
+#
+# metrics:
+#   count     allocations (default), shows allocation churn
+#   bytes     total bytes allocated
+#   peak      highest amount of bytes in use at once
+#   lifetime  sampled block lifetimes, one frame per lifetime range
+#   timeline  not folded, csv of bytes in use per name over time
+
+import sys
+import struct
+
+METRICS = ("count", "bytes", "peak", "lifetime", "timeline")
+
+
+def read_trace(filepath):
+    f = open(filepath, "rb")
+    data = f.read()
+    f.close()
+
+    if data[:8] != b"MEMPROF1":
+        raise Exception("%s: not a memory profile trace" % filepath)
+
+    # the byte order check is 1 in native order of the writer
+    endian = "<" if struct.unpack("<i", data[8:12])[0] == 1 else ">"
+    sample_rate, totbucket = struct.unpack(endian + "ii", data[12:20])
+
+    names = {}
+    stats = {}
+    lifetimes = {}
+    timeline = []
+
+    ofs = 20
+    while ofs < len(data):
+        rtype = data[ofs:ofs + 1]
+        ofs += 1
+
+        if rtype == b"T":
+            tag_id, length = struct.unpack_from(endian + "ii", data, ofs)
+            ofs += 8
+            names[tag_id] = data[ofs:ofs + length].decode("utf-8", "replace")
+            ofs += length
+        elif rtype == b"S":
+            time, tot = struct.unpack_from(endian + "Qi", data, ofs)
+            ofs += 12
+            for i in range(tot):
+                values = struct.unpack_from(endian + "iQQQQQ", data, ofs)
+                ofs += 44
+                stats[values[0]] = values[1:]
+                timeline.append((time, values[0], values[4]))
+        elif rtype == b"L":
+            tag_id = struct.unpack_from(endian + "i", data, ofs)[0]
+            ofs += 4
+            fmt = endian + "%dQ" % totbucket
+            lifetimes[tag_id] = struct.unpack_from(fmt, data, ofs)
+            ofs += 8 * totbucket
+        else:
+            raise Exception("%s: unknown record at %d" % (filepath, ofs - 1))
+
+    return sample_rate, names, stats, lifetimes, timeline
+
+
+def frame_name(name):
+    # ';' separates frames, the last space the count
+    return name.replace(";", ":").replace(" ", "_")
+
+
+def lifetime_name(bucket):
+    us = 1 << bucket
+    if us < 1000:
+        return "lifetime_below_%dus" % us
+    elif us < 1000000:
+        return "lifetime_below_%dms" % (us // 1000)
+    return "lifetime_below_%ds" % (us // 1000000)
+
+
+def main():
+    args = sys.argv[1:]
+    if not args or len(args) > 2 or (len(args) == 2 and
+                                     args[1] not in METRICS):
+        print("usage: memprof.py trace [%s]" % "|".join(METRICS))
+        sys.exit(1)
+
+    metric = args[1] if len(args) == 2 else "count"
+    sample_rate, names, stats, lifetimes, timeline = read_trace(args[0])
+
+    if metric == "timeline":
+        print("time_ms,name,bytes_in_use")
+        for time, tag_id, live in timeline:
+            print("%.3f,\"%s\",%d" % (time / 1000.0, names[tag_id], live))
+        return
+
+    for tag_id, values in sorted(stats.items()):
+        totalloc, totfree, totbytes, live, peak = values
+        name = frame_name(names[tag_id])
+
+        if metric == "lifetime":
+            # scale samples back to all blocks
+            for bucket, tot in enumerate(lifetimes.get(tag_id, ())):
+                if tot:
+                    print("%s;%s %d" % (name, lifetime_name(bucket),
+                                        tot * sample_rate))
+        else:
+            value = {"count": totalloc, "bytes": totbytes, "peak": peak}
+            if value[metric]:
+                print("%s %d" % (name, value[metric]))
+
+
+if __name__ == "__main__":
+    main()